@@ -28,6 +28,24 @@ suite.add('uncompressed key', function() {
   key.verifySignatureSync(digest, sig);
 });
 
+if (Key.setVerifyEngine('secp256k1')) {
+  Key.setVerifyEngine('openssl');
+
+  suite.add('compressed key (secp256k1)', function() {
+    Key.setVerifyEngine('secp256k1');
+    key.public = compressedKey;
+    key.verifySignatureSync(digest, sig);
+    Key.setVerifyEngine('openssl');
+  });
+
+  suite.add('uncompressed key (secp256k1)', function() {
+    Key.setVerifyEngine('secp256k1');
+    key.public = uncompressedKey;
+    key.verifySignatureSync(digest, sig);
+    Key.setVerifyEngine('openssl');
+  });
+}
+
 
 // run async
 suite.run({ 'async': true });
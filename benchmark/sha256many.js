@@ -0,0 +1,45 @@
+require('buffertools');
+
+var suite = require('./common');
+
+var Util = require('../lib/util');
+
+// 80 byte block headers and 64 byte merkle node pairs
+var headers = [];
+var pairs = [];
+for (var i = 0; i < 1024; i++) {
+  var header = new Buffer(80);
+  header.fill(i & 0xff);
+  headers.push(header);
+
+  var pair = new Buffer(64);
+  pair.fill((i * 3) & 0xff);
+  pairs.push(pair);
+}
+
+console.log('Multi-buffer SHA-256 implementation: ' +
+            Util.ccmodule.sha256_implementation());
+
+suite.add('1024 headers, twoSha256', function () {
+  for (var i = 0; i < headers.length; i++) {
+    Util.twoSha256(headers[i]);
+  }
+});
+
+suite.add('1024 headers, twoSha256Many', function () {
+  Util.twoSha256Many(headers);
+});
+
+suite.add('1024 merkle pairs, twoSha256', function () {
+  for (var i = 0; i < pairs.length; i++) {
+    Util.twoSha256(pairs[i]);
+  }
+});
+
+suite.add('1024 merkle pairs, twoSha256Many', function () {
+  Util.twoSha256Many(pairs);
+});
+
+
+// run async
+suite.run({ 'async': true });
@@ -1,15 +1,35 @@
 {
   'variables': {
-    'node_shared_openssl%': 'true'
+    'node_shared_openssl%': 'true',
+    # Set to "false" to build without the native secp256k1 verifier
+    'native_secp256k1%': 'true'
   },
   'targets': [
     {
       'target_name': 'native',
       'sources': [
         'src/main.cc',
-        'src/eckey.cc'
+        'src/eckey.cc',
+        'src/secp256k1.cc',
+        'src/pubkeycache.cc',
+        'src/sigcache.cc',
+        'src/sha256.cc',
+        'src/miner.cc',
+        'src/txparser.cc',
+        'src/framer.cc',
+        'src/sighash.cc',
+        'src/interpreter.cc',
+        'src/utxoset.cc',
+        'src/blockrecord.cc',
+        'src/blockfile.cc',
+        'src/blockindex.cc',
+        'src/uint256.cc',
+        'src/headerchain.cc'
       ],
       'conditions': [
+        ['native_secp256k1=="false"', {
+          'defines': [ 'NO_NATIVE_SECP256K1' ]
+        }],
         ['node_shared_openssl=="false"', {
           # so when "node_shared_openssl" is "false", then OpenSSL has been
           # bundled into the node executable. So we need to include the same
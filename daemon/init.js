@@ -101,6 +101,10 @@ var getConfig = exports.getConfig = function getConfig(initConfig) {
     noverifyscripts: {
       type: yanop.flag,
       description: 'Disable tx scripts verification'
+    },
+    verifyengine: {
+      type: yanop.string,
+      description: 'Signature verification engine (openssl or secp256k1)'
     }
   });
 
@@ -265,6 +269,9 @@ var getConfig = exports.getConfig = function getConfig(initConfig) {
   if (opts.noverifyscripts) {
     cfg.verifyScripts = false;
   }
+  if (opts.verifyengine) {
+    cfg.verifyEngine = opts.verifyengine;
+  }
 
   return cfg;
 };
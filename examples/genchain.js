@@ -6,7 +6,7 @@ var Storage = require('../lib/storage').Storage;
 var Settings = require('../lib/settings').Settings;
 var BlockChain = require('../lib/blockchain').BlockChain;
 var Util = require('../lib/util');
-var Miner = require('../lib/miner/javascript.js').JavaScriptMiner;
+var Miner = require('../lib/miner/native.js').NativeMiner;
 
 var settings = new Settings();
 var storage = new Storage('mongodb://localhost/bitcointest');
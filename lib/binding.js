@@ -1,5 +1,11 @@
 var logger = require('./logger');
 
+// Script verification runs on the libuv threadpool, give it one thread per
+// core. This has to happen before anything is queued on it.
+if (!process.env.UV_THREADPOOL_SIZE) {
+  process.env.UV_THREADPOOL_SIZE = Math.max(4, require('os').cpus().length);
+}
+
 // Native extensions
 try {
   // Debug build has precedence
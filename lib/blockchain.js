@@ -6,8 +6,12 @@ var Util = require('./util');
 var BlockLocator = require('./blocklocator').BlockLocator;
 var TransactionMap = require('./transactionmap').TransactionMap;
 var VerificationError = require('./error').VerificationError;
+var ScriptInterpreter = require('./scriptinterpreter').ScriptInterpreter;
+var binding = require('./binding');
+var BlockIndex = binding.BlockIndex;
 
 var PlainBlock = require('./schema/block').Block;
+var BlockRules = require('./schema/block').BlockRules;
 var PlainTransaction = require('./schema/transaction').Transaction;
 
 var Binary = require('binary');
@@ -42,6 +46,9 @@ var BlockChain = exports.BlockChain = function BlockChain(storage, settings) {
   var recentBlockIndex = new RecentBlockIndex(recentBlockIndexLimit);
   var recentTxIndex = new RecentTxIndex(2000);
 
+  // Headers of all known blocks, if the storage can load them
+  var blockIndex = null;
+
   // Only process one block at a time
   var isProcessing = false;
   var incomingBlockQueue = [];
@@ -58,6 +65,11 @@ var BlockChain = exports.BlockChain = function BlockChain(storage, settings) {
 
         createGenesisBlock(this);
       },
+      function loadBlockIndexStep(err) {
+        if (err) throw err;
+
+        loadBlockIndex(this);
+      },
       function loadTopBlockStep(err) {
         if (err) throw err;
 
@@ -124,6 +136,28 @@ var BlockChain = exports.BlockChain = function BlockChain(storage, settings) {
     });
   }
 
+  function loadBlockIndex(callback) {
+    if ("function" !== typeof storage.loadBlockIndex) {
+      callback(null);
+      return;
+    }
+
+    var index = new BlockIndex();
+    storage.loadBlockIndex(index, function (err) {
+      if (err) {
+        callback(err);
+        return;
+      }
+
+      var stats = index.getStats();
+      logger.info("Loaded block index ("+stats.size+" blocks" +
+                  (stats.pending ? ", "+stats.pending+" without parent" : "") +
+                  ")");
+      blockIndex = index;
+      callback(null);
+    });
+  }
+
   function loadTopBlock(callback) {
     storage.getTopBlock(function (err, block) {
       if (err) {
@@ -146,6 +180,14 @@ var BlockChain = exports.BlockChain = function BlockChain(storage, settings) {
     return currentTopBlock;
   };
 
+  /**
+   * Returns the BlockIndex, or null if the storage doesn't support one.
+   */
+  var getBlockIndex = this.getBlockIndex =
+  function getBlockIndex() {
+    return blockIndex;
+  };
+
   var getBlockLocator = this.getBlockLocator =
   function getBlockLocator(callback) {
     BlockLocator.createFromBlockChain(this, callback);
@@ -195,6 +237,11 @@ var BlockChain = exports.BlockChain = function BlockChain(storage, settings) {
   var getConflictingTransactions = this.getConflictingTransactions =
   storage.getConflictingTransactions.bind(storage);
 
+  // Only available if the storage keeps an index of unspent outputs
+  var getOutputsByOutpoints = this.getOutputsByOutpoints =
+  storage.getOutputsByOutpoints ?
+    storage.getOutputsByOutpoints.bind(storage) : null;
+
   /**
    * Whether the blockchain has reached the last hardcoded checkpoint.
    *
@@ -650,14 +697,14 @@ var BlockChain = exports.BlockChain = function BlockChain(storage, settings) {
     // Still no match. Maybe this block connects to some other block in our
     // database?
     } else {
-      getBlockByHash(block.prev_hash, function (err, parent) {
+      getBlockHeaderByHash(block.prev_hash, function (err, parent) {
         if (err) {
           callback(err);
           return;
         }
 
         // Actually, can we please double check that we don't know this block
-        getBlockByHash(block.hash, function (err, selfBlock) {
+        getBlockHeaderByHash(block.hash, function (err, selfBlock) {
           if (err) {
             callback(err);
             return;
@@ -694,6 +741,84 @@ var BlockChain = exports.BlockChain = function BlockChain(storage, settings) {
     }
   };
 
+  /**
+   * Looks up a block without its transactions, from the block index if
+   * there is one.
+   */
+  function getBlockHeaderByHash(hash, callback) {
+    if (blockIndex) {
+      var entry = blockIndex.get(hash);
+      callback(null, entry ? new Block(entry) : null);
+      return;
+    }
+
+    getBlockByHash(hash, callback);
+  }
+
+  /**
+   * Validates serialized headers (80 bytes each, back to back) that build
+   * on a block in the block index, in one threadpool job.
+   *
+   * Calls back with {failed, error, chainWork, hashes}: the index of the
+   * first invalid header and why (-1 and null if all are valid), the chain
+   * work up to the last valid one and the hashes of all headers.
+   */
+  var validateHeaders = this.validateHeaders =
+  function validateHeaders(headers, callback) {
+    if (!blockIndex) {
+      callback(new Error("Header validation requires a block index"));
+      return;
+    }
+    if (!headers.length) {
+      callback(new Error("No headers"));
+      return;
+    }
+
+    var parentHash = headers.slice(4, 36);
+    var parent = blockIndex.get(parentHash);
+    if (!parent) {
+      callback(new Error("Headers don't connect to a known block"));
+      return;
+    }
+
+    var interval = targetTimespan / targetSpacing;
+
+    var timestamps = [];
+    for (var height = Math.max(0, parent.height - 10);
+         height <= parent.height; height++) {
+      timestamps.push(blockIndex.getAncestor(parentHash, height).timestamp);
+    }
+
+    var periodStart = blockIndex.getAncestor(
+      parentHash, parent.height - parent.height % interval);
+
+    // Same walk as in Block.getNextWork()
+    var lastNormal = parent;
+    if (isTestnet()) {
+      while (lastNormal.height > 0 &&
+             lastNormal.height % interval !== 0 &&
+             lastNormal.bits == getMinDiff()) {
+        lastNormal = blockIndex.get(lastNormal.prev_hash);
+      }
+    }
+
+    binding.validateHeaders(headers, {
+      hash: parentHash,
+      height: parent.height,
+      bits: parent.bits,
+      chainWork: parent.chainWork,
+      timestamps: timestamps,
+      periodStart: periodStart.timestamp,
+      lastNormalBits: lastNormal.bits,
+      powLimit: getMinDiff(),
+      targetTimespan: targetTimespan,
+      targetSpacing: targetSpacing,
+      testnet: isTestnet(),
+      maxTimestamp: Math.floor(new Date().getTime() / 1000) +
+        BlockRules.maxTimeOffset
+    }, callback);
+  };
+
   var connectToMainChain = this.connectToMainChain =
   function connectToMainChain(bw, callback)
   {
@@ -733,6 +858,11 @@ var BlockChain = exports.BlockChain = function BlockChain(storage, settings) {
     bw.txs.forEach(function (tx) {
       localTx.add(tx);
     });
+
+    // The scripts of all inputs are verified together once every
+    // transaction has been connected
+    var scriptJobs = [];
+
     // Connect transactions
     Step(
       function cacheTxInputs() {
@@ -760,7 +890,7 @@ var BlockChain = exports.BlockChain = function BlockChain(storage, settings) {
               // We won't verify coinbase transactions
               callback(null);
             } else if (self.cfg.verifyScripts && self.isPastCheckpoints()) {
-              tx.verify(txCache, self, function (err) {
+              tx.verify(txCache, self, scriptJobs, function (err) {
                 // Prepend tx id for verification errors for easier debugging
                 if (err instanceof VerificationError) {
                   err.message = "Tx "+Util.formatHashAlt(tx.hash)+": "+
@@ -776,6 +906,28 @@ var BlockChain = exports.BlockChain = function BlockChain(storage, settings) {
           });
         });
       },
+      function verifyScripts(err) {
+        if (err) throw err;
+
+        ScriptInterpreter.verifyInputs(scriptJobs, this);
+      },
+      function verifyScriptsResult(err, failed) {
+        if (failed >= 0) {
+          var job = scriptJobs[failed];
+          var prefix = "Tx "+Util.formatHashAlt(job.tx.hash)+": ";
+          if (err) {
+            err.message = prefix+err.message;
+          } else {
+            logger.scrdbg('Script evaluated to false');
+            logger.scrdbg('|- scriptSig', ""+job.scriptSig);
+            logger.scrdbg('`- scriptPubKey', ""+job.scriptPubKey);
+            err = new VerificationError(prefix+'Script for input '+
+                                        job.index+' evaluated to false');
+          }
+        }
+
+        this(err);
+      },
       callback
     );
   };
@@ -797,6 +949,10 @@ var BlockChain = exports.BlockChain = function BlockChain(storage, settings) {
         return;
       }
 
+      if (blockIndex) {
+        blockIndex.add(bw.block);
+      }
+
       // This event will also trigger us saving all child blocks that
       // are currently waiting.
       self.emit('blockSave', {block: bw.block, txs: bw.txs, chain: self});
@@ -841,19 +997,49 @@ var BlockChain = exports.BlockChain = function BlockChain(storage, settings) {
     });
 
 
-    storage.connectTransactions(txs, function (err) {
-      if (err) {
-        callback(err);
-        return;
-      }
+    Step(
+      function connectInputsStep() {
+        storage.connectTransactions(txs, this);
+      },
+      function connectOutputsStep(err) {
+        if (err) throw err;
 
-      txs.forEach(function (tx, i) {
-        var e = {block: block, index: i, tx: tx, chain: self};
-        self.emit('txSave', e);
-        self.emit('txSave:'+tx.hash.toString('base64'), e);
-      });
+        if (storage.connectOutputs) {
+          storage.connectOutputs(block, txs, this);
+        } else {
+          this(null);
+        }
+      },
+      function emitSaveStep(err) {
+        if (err) throw err;
 
-      callback(null);
+        txs.forEach(function (tx, i) {
+          var e = {block: block, index: i, tx: tx, chain: self};
+          self.emit('txSave', e);
+          self.emit('txSave:'+tx.hash.toString('base64'), e);
+        });
+
+        this(null);
+      },
+      callback
+    );
+  };
+
+  // Puts transactions loaded by hash back into the order of the block. The
+  // unspent output index can only be updated with all of them.
+  function sortBlockTxs(block, txs) {
+    var index = {};
+    txs.forEach(function (tx) {
+      index[tx.getHash().toString('base64')] = tx;
+    });
+    return block.txs.map(function (hash) {
+      var tx = index[hash.toString('base64')];
+      if (!tx) {
+        throw new Error("Transaction "+Util.formatHashAlt(hash)+
+                        " of block "+Util.formatHashAlt(block.getHash())+
+                        " not found");
+      }
+      return tx;
     });
   };
 
@@ -864,6 +1050,11 @@ var BlockChain = exports.BlockChain = function BlockChain(storage, settings) {
         toDisconnect = null;
       }
 
+      if (blockIndex && !toDisconnect && !toConnect) {
+        findForkInIndex(bOld, bNew, callback);
+        return;
+      }
+
       toDisconnect = toDisconnect || [];
       toConnect = toConnect || [];
 
@@ -913,6 +1104,65 @@ var BlockChain = exports.BlockChain = function BlockChain(storage, settings) {
     }
   };
 
+  /**
+   * Same as findFork(), but walks down the chains in the block index and
+   * only loads the blocks to (dis)connect.
+   */
+  function findForkInIndex(bOld, bNew, callback) {
+    // The new head is only added to the index once it is saved
+    var newBranch = [];
+    var newTip = bNew.getHash();
+    if (!blockIndex.get(newTip)) {
+      newBranch.push(bNew);
+      newTip = bNew.prev_hash;
+    }
+
+    var fork = blockIndex.findFork(bOld.getHash(), newTip);
+    if (!fork) {
+      callback(new Error("No common root found"));
+      return;
+    }
+
+    // Hashes from the top down to the fork, excluding it
+    function getBranch(tip) {
+      var hashes = [];
+      var top = blockIndex.get(tip);
+      for (var height = top.height; height > fork.height; height--) {
+        hashes.push(blockIndex.getAncestor(tip, height).hash);
+      }
+      return hashes;
+    };
+
+    var oldHashes = getBranch(bOld.getHash());
+    var newHashes = getBranch(newTip);
+
+    Step(
+      function loadBlocksStep() {
+        storage.getBlocksByHashes(oldHashes.concat(newHashes), this);
+      },
+      function (err, blocks) {
+        if (err) throw err;
+
+        var byHash = {};
+        blocks.forEach(function (block) {
+          byHash[block.getHash().toString('base64')] = block;
+        });
+        function getBlock(hash) {
+          var block = byHash[hash.toString('base64')];
+          if (!block) {
+            throw new Error("Block "+Util.formatHashAlt(hash)+" is missing");
+          }
+          return block;
+        };
+
+        var toDisconnect = oldHashes.map(getBlock);
+        var toConnect = newBranch.concat(newHashes.map(getBlock));
+        this(null, toDisconnect, toConnect, new Block(fork));
+      },
+      callback
+    );
+  }
+
   this.reorganize = function reorganize(oldTopBlock, newTopBlock, callback) {
     logger.info('Reorganize (old head: '+Util.formatHashAlt(oldTopBlock.hash)+
                 ', new head: '+Util.formatHashAlt(newTopBlock.hash)+')');
@@ -928,6 +1178,10 @@ var BlockChain = exports.BlockChain = function BlockChain(storage, settings) {
         return;
       }
 
+      // findFork() collects the new branch from the top down, its outputs
+      // have to be connected from the bottom up
+      toConnect.reverse();
+
       logger.bchdbg('Found common root at '+Util.formatHashAlt(toConnect[0].prev_hash));
 
       var reorgSteps = [];
@@ -982,6 +1236,16 @@ var BlockChain = exports.BlockChain = function BlockChain(storage, settings) {
             // Revoke txs in reverse order
             revokeSteps.reverse();
 
+            revokeSteps.push(function (err) {
+              if (err) throw err;
+
+              if (storage.disconnectOutputs) {
+                storage.disconnectOutputs(block, sortBlockTxs(block, txs), this);
+              } else {
+                this(null);
+              }
+            });
+
             // Once done, save the block and go to the next
             // reorg step.
             revokeSteps.push(function (err) {
@@ -1055,6 +1319,16 @@ var BlockChain = exports.BlockChain = function BlockChain(storage, settings) {
               };
             });
 
+            addSteps.push(function (err) {
+              if (err) throw err;
+
+              if (storage.connectOutputs) {
+                storage.connectOutputs(block, sortBlockTxs(block, txs), this);
+              } else {
+                this(null);
+              }
+            });
+
             addSteps.push(function (err) {
               if (err) {
                 logger.error('Error during reorg '+
@@ -2,6 +2,13 @@ var BlockLocator = exports.BlockLocator = function () {
 };
 
 BlockLocator.createFromBlockChain = function (blockChain, callback) {
+  var index = blockChain.getBlockIndex ? blockChain.getBlockIndex() : null;
+  var locator = index && index.getLocator(blockChain.getTopBlock().getHash());
+  if (locator) {
+    callback(null, locator);
+    return;
+  }
+
   var height = blockChain.getTopBlock().height;
   var step = 1;
   var heights = [];
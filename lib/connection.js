@@ -1,29 +1,14 @@
 var util = require('util');
 var events = require('events');
-var Buffers = require('buffers');
 var logger = require('./logger');
 var Binary = require('./binary');
 var Parser = require('./parser').Parser;
+var TxTable = require('./txtable').TxTable;
 var Util = require('./util');
 var Block = require('./schema/block').Block;
 
 var bitcoin = require('./bitcoin');
 
-Buffers.prototype.skip = function (i) {
-  if (i == 0) {
-    return;
-  } else if (i == this.length) {
-    this.buffers = [];
-    this.length = 0;
-    return;
-  }
-  var pos = this.pos(i);
-  this.buffers = this.buffers.slice(pos.buf);
-  this.buffers[0].length -= pos.offset;
-  this.buffers[0].offset += pos.offset;
-  this.length -= i;
-};
-
 var BIP0031_VERSION = 60000;
 
 var Connection = exports.Connection = function Connection(node, socket, peer) {
@@ -47,7 +32,7 @@ var Connection = exports.Connection = function Connection(node, socket, peer) {
   this.getaddr = false;
 
   // Receive buffer
-  this.buffers = new Buffers();
+  this.framer = new Util.ccmodule.Framer(node.cfg.network.magicBytes);
 
   // Starting 20 Feb 2012, Version 0.2 is obsolete
   // This is the same behavior as the official client
@@ -234,6 +219,10 @@ Connection.prototype.sendGetAddr = function (invs) {
 };
 
 Connection.prototype.sendInv = function (data) {
+  this.sendMessage('inv', Connection.serializeInv(data));
+};
+
+Connection.serializeInv = function (data) {
   if (!Array.isArray(data)) {
     data = [data];
   }
@@ -252,7 +241,7 @@ Connection.prototype.sendInv = function (data) {
     put.put(value.getHash());
   });
 
-  this.sendMessage('inv', put.buffer());
+  return put.buffer();
 };
 
 Connection.prototype.sendHeaders = function (headers) {
@@ -270,7 +259,7 @@ Connection.prototype.sendHeaders = function (headers) {
 };
 
 Connection.prototype.sendTx = function (tx) {
-  this.sendMessage('tx', tx.serialize());
+  this.sendMessage('tx', tx.getBuffer());
 };
 
 Connection.prototype.sendBlock = function (block, txs) {
@@ -288,37 +277,44 @@ Connection.prototype.sendBlock = function (block, txs) {
   this.sendMessage('block', put.buffer());
 };
 
+// Payloads at least this large are written after their header instead of
+// being copied into one message buffer
+var SCATTER_MIN_SIZE = 4096;
+
+/**
+ * Checksum of a payload, cached on the Buffer.
+ *
+ * Payloads that are broadcast (invs, txs) are sent as the same Buffer to
+ * every peer, so they are only hashed once.
+ */
+Connection.getChecksum = function (payload) {
+  if ("undefined" !== typeof payload.checksumCache) {
+    return payload.checksumCache;
+  }
+
+  return payload.checksumCache = Util.twoSha256(payload).slice(0, 4);
+};
+
 Connection.prototype.sendMessage = function (command, payload) {
   try {
     var magic = this.node.cfg.network.magicBytes;
 
-    var commandBuf = new Buffer(command, 'ascii');
-    if (commandBuf.length > 12) {
-      throw 'Command name too long';
-    }
-
-    var checksum;
+    var checksum = false;
     if (this.sendVer >= 209) {
-      checksum = Util.twoSha256(payload).slice(0, 4);
-    } else {
-      checksum = new Buffer([]);
+      checksum = Connection.getChecksum(payload);
     }
 
-    var message = Binary.put();           // -- HEADER --
-    message.put(magic);                   // magic bytes
-    message.put(commandBuf);              // command name
-    message.pad(12 - commandBuf.length);  // zero-padded
-    message.word32le(payload.length);     // payload length
-    message.put(checksum);                // checksum
-    // -- BODY --
-    message.put(payload);                 // payload data
-
-    var buffer = message.buffer();
-
     logger.netdbg('['+this.peer+'] '+
                   "Sending message "+command+" ("+payload.length+" bytes)");
 
-    this.socket.write(buffer);
+    if (payload.length >= SCATTER_MIN_SIZE) {
+      this.socket.write(Util.ccmodule.frameHeader(magic, command, payload,
+                                                  checksum));
+      this.socket.write(payload);
+    } else {
+      this.socket.write(Util.ccmodule.frameMessage(magic, command, payload,
+                                                   checksum));
+    }
   } catch (err) {
     // TODO: We should catch this error one level higher in order to better
     //       determine how to react to it. For now though, ignoring it will do.
@@ -328,11 +324,10 @@ Connection.prototype.sendMessage = function (command, payload) {
 };
 
 Connection.prototype.handleData = function (data) {
-  this.buffers.push(data);
+  this.framer.push(data);
 
-  if (this.buffers.length > (this.node.cfg.maxReceiveBuffer * 1000)) {
-    logger.error("Peer "+this.peer+" exceeded maxreceivebuffer, disconnecting."+
-                 (err.stack ? err.stack : err.toString()));
+  if (this.framer.length > (this.node.cfg.maxReceiveBuffer * 1000)) {
+    logger.error("Peer "+this.peer+" exceeded maxreceivebuffer, disconnecting.");
     this.socket.destroy();
     return;
   }
@@ -341,67 +336,38 @@ Connection.prototype.handleData = function (data) {
 };
 
 Connection.prototype.processData = function () {
-  // If there are less than 20 bytes there can't be a message yet.
-  if (this.buffers.length < 20) return;
-
-  var magic = this.node.cfg.network.magicBytes;
-  var i = 0;
-  for (;;) {
-    if (this.buffers.get(i  ) === magic[0] &&
-        this.buffers.get(i+1) === magic[1] &&
-        this.buffers.get(i+2) === magic[2] &&
-        this.buffers.get(i+3) === magic[3]) {
-      if (i !== 0) {
-        logger.netdbg('['+this.peer+'] '+
-                      'Received '+i+
-                      ' bytes of inter-message garbage: ');
-        logger.netdbg('... '+this.buffers.slice(0,i));
-
-        this.buffers.skip(i);
-      }
-      break;
-    }
-
-    if (i > (this.buffers.length - 4)) {
-      this.buffers.skip(i);
-      return;
-    }
-    i++;
+  var frames;
+  // A 'version' message ends a batch, as it can change recvVer
+  while ((frames = this.framer.read(this.recvVer >= 209)).length) {
+    frames.forEach(this.processFrame, this);
   }
+};
 
-  var payloadLen = (this.buffers.get(16)      ) +
-                   (this.buffers.get(17) <<  8) +
-                   (this.buffers.get(18) << 16) +
-                   (this.buffers.get(19) << 24);
-
-  var startPos = (this.recvVer >= 209) ? 24 : 20;
-  var endPos = startPos + payloadLen;
+Connection.prototype.processFrame = function (frame) {
+  var command = frame.command;
 
-  if (this.buffers.length < endPos) return;
+  if (frame.skipped) {
+    logger.netdbg('['+this.peer+'] '+
+                  'Received '+frame.skipped+
+                  ' bytes of inter-message garbage');
+  }
 
-  var command = this.buffers.slice(4, 16).toString('ascii').replace(/\0+$/,"");
-  var payload = this.buffers.slice(startPos, endPos);
-  var checksum = (this.recvVer >= 209) ? this.buffers.slice(20, 24) : null;
+  if (!frame.payload) {
+    logger.error('['+this.peer+'] '+
+                 'Checksum failed',
+                 { cmd: command,
+                   expected: Util.encodeHex(frame.calcChecksum),
+                   actual: Util.encodeHex(frame.checksum) });
+    return;
+  }
 
   logger.netdbg('['+this.peer+'] ' +
                 "Received message " + command +
-                " (" + payloadLen + " bytes)");
-
-  if (checksum !== null) {
-    var checksumConfirm = Util.twoSha256(payload).slice(0, 4);
-    if (checksumConfirm.compare(checksum) !== 0) {
-      logger.error('['+this.peer+'] '+
-                   'Checksum failed',
-                   { cmd: command,
-                     expected: Util.encodeHex(checksumConfirm),
-                     actual: Util.encodeHex(checksum) });
-      return;
-    }
-  }
+                " (" + frame.payload.length + " bytes)");
 
   var message;
   try {
-    message = this.parseMessage(command, payload);
+    message = this.parseMessage(command, frame.payload);
   } catch (e) {
     logger.error('Error while parsing message '+command+' from ' +
                  this.peer + ':\n' +
@@ -411,9 +377,6 @@ Connection.prototype.processData = function () {
   if (message) {
     this.handleMessage(message);
   }
-
-  this.buffers.skip(endPos);
-  this.processData();
 };
 
 Connection.prototype.parseMessage = function (command, payload) {
@@ -451,18 +414,20 @@ Connection.prototype.parseMessage = function (command, payload) {
     break;
 
   case 'block':
-    data.version = parser.word32le();
-    data.prev_hash = parser.buffer(32);
-    data.merkle_root = parser.buffer(32);
-    data.timestamp = parser.word32le();
-    data.bits = parser.word32le();
-    data.nonce = parser.word32le();
+    // Header, transactions and txids in one go
+    var block = TxTable.parseBlock(payload);
 
-    var txCount = Connection.parseVarInt(parser);
+    data.version = block.version;
+    data.prev_hash = block.prev_hash;
+    data.merkle_root = block.merkle_root;
+    data.timestamp = block.timestamp;
+    data.bits = block.bits;
+    data.nonce = block.nonce;
+    data.calc_merkle_root = block.calcMerkleRoot;
 
     data.txs = [];
-    for (i = 0; i < txCount; i++) {
-      data.txs.push(Connection.parseTx(parser));
+    for (i = 0; i < block.txs.length; i++) {
+      data.txs.push(block.txs.getData(i));
     }
 
     data.size = payload.length;
@@ -478,6 +443,19 @@ Connection.prototype.parseMessage = function (command, payload) {
       outs: txData.outs
     };
 
+  case 'headers':
+    // Packed back to back for BlockChain.validateHeaders(), each header is
+    // followed by a transaction count that is always zero
+    data.count = Math.min(Connection.parseVarInt(parser),
+                          Math.floor(payload.length / 81));
+
+    data.headers = new Buffer(80 * data.count);
+    for (i = 0; i < data.count; i++) {
+      parser.buffer(80).copy(data.headers, 80 * i);
+      Connection.parseVarInt(parser);
+    }
+    break;
+
   case 'getblocks':
   case 'getheaders':
     // parse out the version
@@ -566,41 +544,11 @@ Connection.parseVarStr = function (parser) {
 
 Connection.parseTx = function (parser) {
   if (Buffer.isBuffer(parser)) {
-    parser = new Parser(parser);
-  }
-
-  var data = {}, i, sLen, startPos = parser.pos;
-
-  data.version = parser.word32le();
-  
-  var txinCount = Connection.parseVarInt(parser, 'tx_in_count');
-
-  data.ins = [];
-  for (j = 0; j < txinCount; j++) {
-    var txin = {};
-    txin.o = parser.buffer(36);               // outpoint
-    sLen = Connection.parseVarInt(parser);    // script_len
-    txin.s = parser.buffer(sLen);             // script
-    txin.q = parser.word32le();               // sequence
-    data.ins.push(txin);
+    return new TxTable(parser).getData(0);
   }
 
-  var txoutCount = Connection.parseVarInt(parser);
+  var txTable = new TxTable(parser.subject, parser.pos);
+  parser.pos = txTable.end;
 
-  data.outs = [];
-  for (j = 0; j < txoutCount; j++) {
-    var txout = {};
-    txout.v = parser.buffer(8);               // value
-    sLen = Connection.parseVarInt(parser);    // script_len
-    txout.s = parser.buffer(sLen);            // script
-    data.outs.push(txout);
-  }
-
-  data.lock_time = parser.word32le();
-
-  var endPos = parser.pos;
-
-  data.buffer = parser.subject.slice(startPos, endPos);
-
-  return data;
+  return txTable.getData(0);
 };
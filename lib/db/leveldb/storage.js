@@ -11,32 +11,44 @@ var mkdirp = require('mkdirp');
 var existsSync = fs.existsSync || path.existsSync;
 
 var leveldb = require('leveldb'); // database
+var binding = require('../../binding');
+var UtxoSet = binding.UtxoSet;
+var BlockFile = binding.BlockFile;
 
 var Block = require('../../schema/block').Block;
 var Transaction = require('../../schema/transaction').Transaction;
 
+// Blocks are stored as fixed layout binary records, see src/blockrecord.h
 function serializeBlock(block)
 {
-  var data = {
-    prev_hash: block.prev_hash.toString('binary'),
-    merkle_root: block.merkle_root.toString('binary'),
-    timestamp: block.timestamp,
-    bits: block.bits,
-    nonce: block.nonce,
-    version: block.version,
-    height: block.height,
-    size: block.size,
-    active: block.active,
-    chainWork: block.chainWork.toString('binary'),
-    txs: block.txs.map(function (hash) {
-      return hash.toString('binary');
-    })
-  };
-
-  return JSON.stringify(data);
+  return binding.encodeBlockRecord(block);
 };
 
 function deserializeBlock(data) {
+  var record = binding.decodeBlockRecord(data);
+  if (record) {
+    return new Block(record);
+  }
+
+  return deserializeLegacyBlock(data);
+};
+
+// Transaction locations (see below) start with the file number, so the
+// marker byte alone doesn't tell them apart
+var BLOCK_RECORD_MIN_SIZE = 128;
+
+function isBlockRecord(data) {
+  return Buffer.isBuffer(data) && data.length >= BLOCK_RECORD_MIN_SIZE &&
+    data[0] === 0xfe;
+};
+
+// Blocks were stored as JSON up to database version 1.0
+function isLegacyBlock(data) {
+  return Buffer.isBuffer(data) && !isTransactionLocation(data) &&
+    data[0] === 0x7b; // "{"
+};
+
+function deserializeLegacyBlock(data) {
   data = JSON.parse(data);
   data.prev_hash = new Buffer(data.prev_hash, 'binary');
   data.merkle_root = new Buffer(data.merkle_root, 'binary');
@@ -51,10 +63,31 @@ function serializeTransaction(tx) {
   return tx.getBuffer();
 };
 
+// Transactions are stored in the block files, main.db only has their
+// location (see src/blockfile.h). Up to database version 1.1 it had the
+// whole transaction, which is always larger.
+var TX_LOCATION_SIZE = 12;
+
+function isTransactionLocation(data) {
+  return Buffer.isBuffer(data) && data.length == TX_LOCATION_SIZE;
+};
+
 function deserializeTransaction(data) {
   return new Transaction(Connection.parseTx(data));
 };
 
+// Unspent output record: value (8 bytes), height (UInt32LE), script
+function decodeOutput(record) {
+  if (!Buffer.isBuffer(record)) {
+    return null;
+  }
+  return {
+    v: record.slice(0, 8),
+    height: record.readUInt32LE(8),
+    s: record.slice(12)
+  };
+};
+
 function formatHeightKey(height) {
   var tempHeightBuffer = new Buffer(4);
   height = Math.floor(+height);
@@ -80,12 +113,22 @@ function LeveldbStorage(uri) {
   var bBlockTxsIndex;
   var bTxAffectsIndex;
 
+  // Unspent outputs by outpoint and undo data by block hash, the UtxoSet
+  // keeps the recently used part of it in memory
+  var hUtxo;
+  var utxo = this.utxo = new UtxoSet();
+  var blockFile = null;
+
   // Database version
   var MAJOR_VERSION = 1;
-  var MINOR_VERSION = 0;
+  var MINOR_VERSION = 2;
+
+  // Number of records rewritten per batch when upgrading
+  var UPGRADE_BATCH_SIZE = 1000;
 
   var connInfo = url.parse(uri);
   var prefix = connInfo.path.trim();
+  var blocksDir = prefix+'blocks';
 
   var defaultCreateOpts = {
     create_if_missing: true,
@@ -115,6 +158,10 @@ function LeveldbStorage(uri) {
       if (!existsSync(baseDir)) {
         mkdirp.sync(baseDir, 0755);
       }
+      if (!existsSync(blocksDir)) {
+        mkdirp.sync(blocksDir, 0755);
+      }
+      blockFile = self.blockFile = new BlockFile(blocksDir);
     } catch (err) {
       logger.error("Could not create datadir '"+baseDir+"': " +
                    (err.stack ? err.stack : err));
@@ -156,6 +203,11 @@ function LeveldbStorage(uri) {
           }
         });
       },
+      function upgradeStep(err) {
+        if (err) throw err;
+
+        upgrade(this);
+      },
       function createBlockTxsIndexDb(err) {
         if (err) throw err;
 
@@ -168,11 +220,18 @@ function LeveldbStorage(uri) {
 
         leveldb.open(prefix+'affects.db', defaultCreateOpts, this);
       },
-      function postStep(err, db) {
+      function createUtxoDb(err, db) {
         if (err) throw err;
 
         self.bTxAffectsIndex = bTxAffectsIndex = db;
 
+        leveldb.open(prefix+'utxo.db', defaultCreateOpts, this);
+      },
+      function postStep(err, db) {
+        if (err) throw err;
+
+        self.hUtxo = hUtxo = db;
+
         logger.info("LevelDB: "+
                     (isNew ? "New database created" : "Database loaded") +
                     " (rev. " +
@@ -185,6 +244,173 @@ function LeveldbStorage(uri) {
     );
   };
 
+  /**
+   * Brings a database written by an older version up to date.
+   */
+  function upgrade(callback) {
+    if (metadata.majorVersion != MAJOR_VERSION ||
+        metadata.minorVersion >= MINOR_VERSION) {
+      callback(null);
+      return;
+    }
+
+    logger.info("LevelDB: Upgrading database from rev. " +
+                metadata.majorVersion + "." + metadata.minorVersion +
+                " to " + MAJOR_VERSION + "." + MINOR_VERSION);
+
+    Step(
+      function upgradeRecordsStep() {
+        upgradeRecords(this);
+      },
+      function setVersionStep(err, counts) {
+        if (err) throw err;
+
+        logger.info("LevelDB: Converted "+counts.blocks+" block records, " +
+                    "moved "+counts.txs+" transactions to block files");
+        setMeta('minorVersion', MINOR_VERSION, this);
+      },
+      callback
+    );
+  };
+
+  /**
+   * Rewrites the records of older versions in a single pass: JSON block
+   * records (rev. 1.0) become binary ones and transactions (up to rev. 1.1)
+   * are moved to the block files.
+   */
+  function upgradeRecords(callback) {
+    var counts = {blocks: 0, txs: 0};
+    var pending = 0;
+    var wb = hMain.batch();
+
+    // Transactions of the current batch, appended when it is written
+    var txKeys = [];
+    var txData = [];
+
+    function writeBatch(callback) {
+      var full = wb;
+      var keys = txKeys;
+      var data = txData;
+      wb = hMain.batch();
+      txKeys = [];
+      txData = [];
+      pending = 0;
+
+      blockFile.append(data, function (err, locations) {
+        if (err) {
+          callback(err);
+          return;
+        }
+
+        keys.forEach(function (key, i) {
+          full.put(key, locations[i]);
+        });
+        full.write(callback);
+      });
+    };
+
+    forEachHashRecord(function (key, value, next) {
+      if (isLegacyBlock(value)) {
+        wb.put(key, serializeBlock(deserializeLegacyBlock(value)));
+        counts.blocks++;
+        pending++;
+      } else if (!isBlockRecord(value) && !isTransactionLocation(value)) {
+        txKeys.push(key);
+        txData.push(value);
+        counts.txs++;
+        pending++;
+      }
+
+      if (pending >= UPGRADE_BATCH_SIZE) {
+        writeBatch(next);
+      } else {
+        next(null);
+      }
+    }, function (err) {
+      if (err) {
+        callback(err);
+        return;
+      }
+
+      writeBatch(function (err) {
+        callback(err, counts);
+      });
+    });
+  };
+
+  /**
+   * Calls fn(key, value, next) for each block and transaction record in
+   * main.db, one after the other, then calls back.
+   */
+  function forEachHashRecord(fn, callback) {
+    hMain.iterator({}, function (err, iterator) {
+      if (err) {
+        callback(err);
+        return;
+      }
+
+      function nextRecord(err) {
+        if (err) {
+          callback(err);
+          return;
+        }
+
+        iterator.key(defaultGetOpts, function (err, key) {
+          if (err) {
+            callback(err);
+            return;
+          }
+
+          // End of the database
+          if (!Buffer.isBuffer(key)) {
+            callback(null);
+            return;
+          }
+
+          // Blocks and transactions are keyed by their 32 byte hash
+          if (key.length != 32) {
+            iterator.next(nextRecord);
+            return;
+          }
+
+          iterator.value(defaultGetOpts, function (err, value) {
+            if (err) {
+              callback(err);
+              return;
+            }
+
+            fn(key, value, function (err) {
+              if (err) {
+                callback(err);
+                return;
+              }
+              iterator.next(nextRecord);
+            });
+          });
+        });
+      };
+
+      iterator.seek(new Buffer(0), nextRecord);
+    });
+  };
+
+  // Deletes the files of a BlockFile store in blocksDir
+  function destroyBlockFiles(callback) {
+    try {
+      if (existsSync(blocksDir)) {
+        fs.readdirSync(blocksDir).forEach(function (name) {
+          if (/^blk\d{5}\.dat$/.test(name)) {
+            fs.unlinkSync(path.join(blocksDir, name));
+          }
+        });
+      }
+    } catch (err) {
+      callback(err);
+      return;
+    }
+    callback(null);
+  };
+
   var disconnect = this.disconnect = function disconnect(callback) {
     if (!connected) {
       callback(null);
@@ -193,6 +419,12 @@ function LeveldbStorage(uri) {
     delete hMain;
     delete bBlockTxsIndex;
     delete bTxAffectsIndex;
+    delete hUtxo;
+    utxo = self.utxo = new UtxoSet();
+    if (blockFile) {
+      blockFile.close();
+      blockFile = self.blockFile = null;
+    }
 
     callback();
   };
@@ -215,6 +447,14 @@ function LeveldbStorage(uri) {
         if (err) throw err;
 
         leveldb.destroy(prefix+'affects.db', {}, this);
+      }, function (err) {
+        if (err) throw err;
+
+        leveldb.destroy(prefix+'utxo.db', {}, this);
+      }, function (err) {
+        if (err) throw err;
+
+        destroyBlockFiles(this);
       },
       function (err) {
         if (err) throw err;
@@ -237,6 +477,14 @@ function LeveldbStorage(uri) {
         if (err) throw err;
 
         leveldb.destroy(prefix+'affects.db', {}, this);
+      }, function (err) {
+        if (err) throw err;
+
+        leveldb.destroy(prefix+'utxo.db', {}, this);
+      }, function (err) {
+        if (err) throw err;
+
+        destroyBlockFiles(this);
       }, callback);
   };
 
@@ -377,18 +625,38 @@ function LeveldbStorage(uri) {
   };
 
   this.saveTransaction = function (tx, callback) {
-    var hash = tx.getHash();
-    var data = serializeTransaction(tx);
-    hMain.put(hash, data, callback);
+    saveTransactions([tx], callback);
   };
 
-  this.saveTransactions = function (txs, callback) {
-    var wb = currentBatch ? currentBatch : hMain.batch();
-    txs.forEach(function (tx) {
-      wb.put(tx.getHash(), serializeTransaction(tx));
+  /**
+   * Appends the transactions to the block files, back to back, and indexes
+   * their locations.
+   */
+  var saveTransactions = this.saveTransactions =
+  function saveTransactions(txs, callback) {
+    blockFile.append(txs.map(serializeTransaction), function (err, locations) {
+      if (err) {
+        callback(err);
+        return;
+      }
+
+      var wb = currentBatch ? currentBatch : hMain.batch();
+      txs.forEach(function (tx, i) {
+        wb.put(tx.getHash(), locations[i]);
+      });
+      if (!currentBatch) wb.write(callback);
+      else callback(null);
     });
-    if (!currentBatch) wb.write(callback);
-    else callback(null);
+  };
+
+  // Resolves a transaction record from main.db to the raw transaction.
+  // Buffers from the block files are read-only, so transactions get a copy
+  // that can be modified like any other.
+  function readTransaction(data) {
+    if (isTransactionLocation(data)) {
+      return new Buffer(blockFile.read(data));
+    }
+    return data;
   };
 
   var connectTransaction = this.connectTransaction =
@@ -448,6 +716,150 @@ function LeveldbStorage(uri) {
     else callback(null);
   };
 
+  /**
+   * Update the unspent outputs for a block joining the main chain.
+   *
+   * Outputs spent by the block are loaded first, then the whole block is
+   * applied in memory at once. The changes and the undo data are written
+   * in one batch.
+   */
+  var connectOutputs = this.connectOutputs =
+  function connectOutputs(block, txs, callback) {
+    var buffers = txs.map(function (tx) {
+      return tx.getBuffer();
+    });
+
+    Step(
+      function loadSpentStep() {
+        getOutputsByOutpoints(utxo.missing(buffers), this);
+      },
+      function applyStep(err) {
+        if (err) throw err;
+
+        var undo = utxo.applyBlock(buffers, block.height);
+        writeOutputs(block.getHash(), undo, this);
+      },
+      callback
+    );
+  };
+
+  /**
+   * Revert connectOutputs() for a block leaving the main chain.
+   */
+  var disconnectOutputs = this.disconnectOutputs =
+  function disconnectOutputs(block, txs, callback) {
+    var buffers = txs.map(function (tx) {
+      return tx.getBuffer();
+    });
+
+    Step(
+      function getUndoStep() {
+        hUtxo.get(block.getHash(), defaultGetOpts, this);
+      },
+      function undoStep(err, undo) {
+        if (err) throw err;
+
+        // Blocks connected before the index existed have no undo data
+        utxo.undoBlock(buffers, Buffer.isBuffer(undo) ? undo : new Buffer(0));
+        writeOutputs(block.getHash(), null, this);
+      },
+      callback
+    );
+  };
+
+  function writeOutputs(blockHash, undo, callback) {
+    var wb = hUtxo.batch();
+    var flush = utxo.flush();
+    flush.changes.forEach(function (change) {
+      if (change[1]) {
+        wb.put(change[0], change[1]);
+      } else {
+        wb.del(change[0]);
+      }
+    });
+    if (undo) {
+      wb.put(blockHash, undo);
+    } else {
+      wb.del(blockHash);
+    }
+    wb.write(function (err) {
+      // On failure the changes stay dirty and go out with the next flush
+      if (!err) {
+        utxo.commit(flush.id);
+      }
+      callback(err);
+    });
+  };
+
+  /**
+   * Look up unspent outputs.
+   *
+   * Returns an {v, s, height} object for each outpoint, or null if it is
+   * spent or unknown. Outpoints that aren't in memory are read from the
+   * database and kept in memory afterwards.
+   *
+   * If a flush is committed while the database is read, the rows may be
+   * outdated and the lookup starts over.
+   */
+  var getOutputsByOutpoints = this.getOutputsByOutpoints =
+  function getOutputsByOutpoints(outpoints, callback) {
+    var records = utxo.get(outpoints);
+    var epoch = utxo.getEpoch();
+    var missing = [];
+    records.forEach(function (record, i) {
+      if ("undefined" === typeof record) {
+        missing.push(i);
+      }
+    });
+
+    Step(
+      function queryUtxoDbStep() {
+        var group = this.group();
+        missing.forEach(function (i) {
+          hUtxo.get(outpoints[i], defaultGetOpts, group());
+        });
+      },
+      function loadStep(err, results) {
+        if (err) throw err;
+
+        var loaded = missing.map(function (i) {
+          return outpoints[i];
+        });
+        if (!utxo.load(loaded, results, epoch)) {
+          getOutputsByOutpoints(outpoints, this);
+          return;
+        }
+
+        // Blocks applied in the meantime take precedence
+        var current = utxo.get(loaded);
+        missing.forEach(function (i, j) {
+          records[i] = "undefined" === typeof current[j] ? results[j] : current[j];
+        });
+
+        this(null, records.map(decodeOutput));
+      },
+      callback
+    );
+  };
+
+  /**
+   * Adds all stored blocks to a BlockIndex, in one pass over the database.
+   */
+  var loadBlockIndex = this.loadBlockIndex =
+  function loadBlockIndex(index, callback) {
+    forEachHashRecord(function (key, value, next) {
+      try {
+        if (isBlockRecord(value)) {
+          index.addRecord(key, value);
+        }
+      } catch (err) {
+        next(err);
+        return;
+      }
+      next(null);
+    }, callback);
+  };
+
   var getTransactionByHash = this.getTransactionByHash =
   function getTransactionByHash(hash, callback) {
     hMain.get(hash, defaultGetOpts, function (err, data) {
@@ -456,7 +868,12 @@ function LeveldbStorage(uri) {
         return;
       }
       if (data) {
-        data = deserializeTransaction(data);
+        try {
+          data = deserializeTransaction(readTransaction(data));
+        } catch (e) {
+          callback(e);
+          return;
+        }
       }
       callback(null, data);
     });
@@ -476,7 +893,7 @@ function LeveldbStorage(uri) {
         var txs = [];
         result.forEach(function (tx) {
           if (tx) {
-            txs.push(deserializeTransaction(tx));
+            txs.push(deserializeTransaction(readTransaction(tx)));
           }
         });
         this(null, txs);
@@ -0,0 +1,16 @@
+var Util = require('../util.js');
+
+/**
+ * Miner running the nonce search natively on the libuv threadpool.
+ *
+ * Drop-in replacement for JavaScriptMiner. Note that while it is searching
+ * it occupies `threads` threadpool slots (all of them by default), so other
+ * asynchronous work like signature verification has to wait.
+ */
+var NativeMiner = exports.NativeMiner = function NativeMiner(threads) {
+  this.threads = threads || 0;
+};
+
+NativeMiner.prototype.solve = function (header, target, callback) {
+  Util.ccmodule.mine(header, target, this.threads, callback);
+};
@@ -62,6 +62,19 @@ var Node = function Node(cfg) {
     }
   }
 
+  if (cfg.verifyEngine &&
+      !Util.BitcoinKey.setVerifyEngine(cfg.verifyEngine)) {
+    logger.warn('Verify engine "'+cfg.verifyEngine+'" is not available, '+
+                'using "'+Util.BitcoinKey.getVerifyEngine()+'"');
+  }
+
+  if ("number" === typeof cfg.pubkeyCacheSize) {
+    Util.BitcoinKey.setPubKeyCacheSize(cfg.pubkeyCacheSize);
+  }
+  if ("number" === typeof cfg.sigCacheSize) {
+    Util.SigCache.setSize(cfg.sigCacheSize);
+  }
+
   var existsSync = fs.existsSync || path.existsSync;
 
   // Try and create homedir if it doesn't exist
@@ -303,6 +316,13 @@ Node.prototype.handleInv = function (e) {
 
 Node.prototype.handleBlock = function (e) {
   var txs = e.message.txs;
+
+  if (e.message.calc_merkle_root.compare(e.message.merkle_root) !== 0) {
+    logger.warn("Dropping block from " + e.conn.peer +
+                ", merkle root does not match its transactions");
+    return;
+  }
+
   var block = this.blockChain.makeBlockObject({
     "version": e.message.version,
     "prev_hash": e.message.prev_hash,
@@ -522,9 +542,12 @@ Node.prototype.handleGetheaders = function (e) {
  * This function sends an inv message to all active connections.
  */
 Node.prototype.sendInv = function (inv) {
+  // Serialized once, so the checksum is only calculated once as well
+  var payload = Connection.serializeInv(inv);
+
   var conns = this.peerManager.getActiveConnections();
   conns.forEach(function (conn) {
-    conn.sendInv(inv);
+    conn.sendMessage('inv', payload);
   });
 };
 
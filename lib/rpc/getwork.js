@@ -11,7 +11,7 @@ var lastTime = 0;
 var enonce = 0;
 var enoncePrevBlock = Util.NULL_HASH;
 
-function updateEnonce(block, txs, enonce) {
+function updateEnonce(block, txs, branch, enonce) {
   // Update coinbase tx script
   txs[0].ins[0].script = Binary.put()
     .word32le(block.bits)  // Difficulty bits
@@ -21,8 +21,8 @@ function updateEnonce(block, txs, enonce) {
   // Update coinbase tx hash
   txs[0].hash = txs[0].calcHash();
 
-  // Update merkle root
-  block.merkle_root = block.calcMerkleRoot(txs);
+  // Update merkle root, only the coinbase changed so the branch is enough
+  block.merkle_root = block.calcMerkleRootFromBranch(txs[0].hash, branch);
 };
 
 exports.getwork = function getwork(args, opt, callback) {
@@ -58,6 +58,7 @@ exports.getwork = function getwork(args, opt, callback) {
       steps.push(function (err, data) {
         if (err) throw err;
         blockData = data;
+        blockData.merkleBranch = data.block.getMerkleBranch(data.txs);
         lastTime = time;
         this(null);
       });
@@ -77,7 +78,8 @@ exports.getwork = function getwork(args, opt, callback) {
       }
       ++enonce;
 
-      updateEnonce(blockData.block, blockData.txs, enonce);
+      updateEnonce(blockData.block, blockData.txs,
+                   blockData.merkleBranch, enonce);
 
       var header = blockData.block.getHeader();
 
@@ -94,6 +96,7 @@ exports.getwork = function getwork(args, opt, callback) {
       var cache = {
         block: blockData.block,
         txs: blockData.txs,
+        merkleBranch: blockData.merkleBranch,
         time: timestamp,
         enonce: enonce
       };
@@ -129,7 +132,7 @@ exports.getwork = function getwork(args, opt, callback) {
     // Update stored block
     nb.block.nonce = nonce;
     nb.block.timestamp = nb.time;
-    updateEnonce(nb.block, nb.txs, nb.enonce);
+    updateEnonce(nb.block, nb.txs, nb.merkleBranch, nb.enonce);
 
     // Check solution
     try {
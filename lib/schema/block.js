@@ -1,4 +1,5 @@
 var Util = require('../util');
+var binding = require('../binding');
 var logger = require('../logger');
 var Script = require('../script').Script;
 var bignum = require('bignum');
@@ -14,8 +15,7 @@ var COINBASE_OP = SchemaTransaction.COINBASE_OP;
 var VerificationError = require('../error').VerificationError;
 
 var BlockRules = exports.BlockRules = {
-  maxTimeOffset: 2 * 60 * 60,  // How far block timestamps can be into the future
-  largestHash: bignum(2).pow(256)
+  maxTimeOffset: 2 * 60 * 60  // How far block timestamps can be into the future
 };
 
 var Block = exports.Block =
@@ -91,8 +91,8 @@ Block.prototype.checkProofOfWork = function checkProofOfWork() {
  * of all possible hashes would mean that 20 "work" is required to meet it.
  */
 Block.prototype.getWork = function getWork() {
-  var target = Util.decodeDiffBits(this.bits, true);
-  return BlockRules.largestHash.div(target.add(1));
+  // 32 byte big endian Buffer
+  return binding.getWork(+this.bits);
 };
 
 Block.prototype.checkTimestamp = function checkTimestamp() {
@@ -140,36 +140,65 @@ Block.prototype.getMerkleTree = function getMerkleTree(txs) {
   // again and so on upwards into the tree. The point of this scheme is to allow for
   // disk space savings later on.
   //
-  // This function is a direct translation of CBlock::BuildMerkleTree().
+  // The tree is computed natively (see merkleTree() in src/main.cc) in the
+  // same order as CBlock::BuildMerkleTree().
 
   if (txs.length == 0) {
     return [Util.NULL_HASH.slice(0)];
   }
 
-  // Start by adding all the hashes of the transactions as leaves of the tree.
-  var tree = txs.map(function (tx) {
-    return tx instanceof Transaction ? tx.getHash() : tx;
-  });
+  var treeBuf = Util.ccmodule.merkleTree(getMerkleLeaves(txs), txs.length);
 
-  var j = 0;
-  // Now step through each level ...
-  for (var size = txs.length; size > 1; size = Math.floor((size + 1) / 2)) {
-    // and for each leaf on that level ..
-    for (var i = 0; i < size; i += 2) {
-      var i2 = Math.min(i + 1, size - 1);
-      var a = tree[j + i];
-      var b = tree[j + i2];
-      tree.push(Util.twoSha256(a.concat(b)));
-    }
-    j += size;
+  var tree = [];
+  for (var i = 0, l = treeBuf.length; i < l; i += 32) {
+    tree.push(treeBuf.slice(i, i + 32));
   }
 
   return tree;
 };
 
+/**
+ * Concatenate the hashes of the transactions into one Buffer.
+ */
+function getMerkleLeaves(txs) {
+  var leaves = new Buffer(32 * txs.length);
+  for (var i = 0, l = txs.length; i < l; i++) {
+    var hash = txs[i] instanceof Transaction ? txs[i].getHash() : txs[i];
+    hash.copy(leaves, 32 * i);
+  }
+  return leaves;
+};
+
 Block.prototype.calcMerkleRoot = function calcMerkleRoot(txs) {
-  var tree = this.getMerkleTree(txs);
-  return tree[tree.length - 1];
+  if (txs.length == 0) {
+    return Util.NULL_HASH.slice(0);
+  }
+
+  return Util.ccmodule.merkleRoot(getMerkleLeaves(txs), txs.length);
+};
+
+/**
+ * Merkle branch of the first transaction (the coinbase).
+ *
+ * Returns the sibling hashes on the path from the coinbase to the root as
+ * one Buffer. See calcMerkleRootFromBranch().
+ */
+Block.prototype.getMerkleBranch = function getMerkleBranch(txs) {
+  if (txs.length == 0) {
+    return new Buffer(0);
+  }
+
+  return Util.ccmodule.merkleBranch(getMerkleLeaves(txs), txs.length);
+};
+
+/**
+ * Recalculate the merkle root after the coinbase has changed.
+ *
+ * Takes about log2(n) hash operations instead of rebuilding the tree.
+ */
+Block.prototype.calcMerkleRootFromBranch =
+function calcMerkleRootFromBranch(coinbaseHash, branch) {
+  return Util.ccmodule.merkleRootFromBranch(coinbaseHash, branch);
 };
 
 Block.prototype.checkMerkleRoot = function checkMerkleRoot(txs) {
@@ -219,7 +248,7 @@ Block.prototype.toString = function toString() {
  */
 Block.prototype.attachTo = function attachTo(parent) {
   this.height = parent.height + 1;
-  this.setChainWork(parent.getChainWork().add(this.getWork()));
+  this.setChainWork(binding.addWork(parent.chainWork, this.getWork()));
 };
 
 Block.prototype.setChainWork = function setChainWork(chainWork) {
@@ -231,6 +260,13 @@ Block.prototype.setChainWork = function setChainWork(chainWork) {
     throw new Error("Block.setChainWork(): Invalid datatype");
   }
 
+  // Always stored as 32 bytes, big endian
+  if (chainWork.length < 32) {
+    var padded = new Buffer(32).clear();
+    chainWork.copy(padded, 32 - chainWork.length);
+    chainWork = padded;
+  }
+
   this.chainWork = chainWork;
 };
 
@@ -242,7 +278,33 @@ Block.prototype.getChainWork = function getChainWork() {
  * Compares the chainWork of two blocks.
  */
 Block.prototype.moreWorkThan = function moreWorkThan(otherBlock) {
-  return this.getChainWork().cmp(otherBlock.getChainWork()) > 0;
+  return binding.compareWork(this.chainWork, otherBlock.chainWork) > 0;
+};
+
+/**
+ * Returns the BlockIndex of a chain, if it has one.
+ */
+function getBlockIndex(blockChain) {
+  return "function" === typeof blockChain.getBlockIndex ?
+    blockChain.getBlockIndex() : null;
+};
+
+/**
+ * Looks up the ancestor of a block at the given height.
+ *
+ * Uses the block index if the block is in it, otherwise the block is
+ * assumed to be on the main chain.
+ */
+function getAncestor(blockChain, block, height, callback) {
+  var index = getBlockIndex(blockChain);
+  var hash = "function" === typeof block.getHash ? block.getHash() : block.hash;
+  var ancestor = index && index.get(hash) && index.getAncestor(hash, height);
+  if (ancestor) {
+    callback(null, ancestor);
+    return;
+  }
+
+  blockChain.getBlockByHeight(height, callback);
 };
 
 /**
@@ -284,8 +346,8 @@ function getNextWork(blockChain, nextBlock, callback) {
               if (block.height > 0 &&
                   block.height % interval !== 0 &&
                   block.bits == powLimit) {
-                blockChain.getBlockByHeight(
-                  block.height - 1,
+                getAncestor(
+                  blockChain, block, block.height - 1,
                   function (err, lastBlock) {
                     try {
                       if (err) throw err;
@@ -311,8 +373,8 @@ function getNextWork(blockChain, nextBlock, callback) {
     }
   } else {
     // Get the first block from the old difficulty period
-    blockChain.getBlockByHeight(
-      this.height - interval + 1,
+    getAncestor(
+      blockChain, this, this.height - interval + 1,
       function (err, lastBlock) {
         try {
           if (err) throw err;
@@ -357,6 +419,13 @@ function getMedianTimePast(blockChain, callback)
 {
   var self = this;
 
+  var index = getBlockIndex(blockChain);
+  var medianTimePast = index && index.getMedianTimePast(this.getHash());
+  if (medianTimePast !== null && medianTimePast !== undefined) {
+    callback(null, medianTimePast);
+    return;
+  }
+
   Step(
     function getBlocks() {
       var heights = [];
@@ -377,7 +446,9 @@ function getMedianTimePast(blockChain, callback)
       });
 
       // Sort timestamps
-      timestamps = timestamps.sort();
+      timestamps = timestamps.sort(function (a, b) {
+        return a - b;
+      });
 
       // Return median timestamp
       this(null, timestamps[Math.floor(timestamps.length/2)]);
@@ -192,9 +192,23 @@ function cacheInputs(blockChain, txStore, wait, callback) {
   txCache.buffer(blockChain, txStore, wait, callback);
 };
 
-Transaction.prototype.verify = function verify(txCache, blockChain, callback) {
+/**
+ * Verify the transaction against its cached inputs.
+ *
+ * If an Array is passed as scriptJobs, the scripts are not evaluated here.
+ * Instead a {tx, index, scriptSig, scriptPubKey} job is appended for each
+ * input, so a whole block can be handed to ScriptInterpreter.verifyInputs()
+ * at once.
+ */
+Transaction.prototype.verify =
+function verify(txCache, blockChain, scriptJobs, callback) {
   var self = this;
 
+  if ("function" === typeof scriptJobs) {
+    callback = scriptJobs;
+    scriptJobs = null;
+  }
+
   var txIndex = txCache.txIndex;
 
   var outpoints = [];
@@ -245,7 +259,16 @@ Transaction.prototype.verify = function verify(txCache, blockChain, callback) {
 
         outpoints.push(txin.o);
 
-        self.verifyInput(n, txout.getScript(), group());
+        if (scriptJobs) {
+          scriptJobs.push({
+            tx: self,
+            index: n,
+            scriptSig: txin.getScript(),
+            scriptPubKey: txout.getScript()
+          });
+        } else {
+          self.verifyInput(n, txout.getScript(), group());
+        }
       });
     },
 
@@ -400,13 +423,15 @@ Transaction.prototype.getAffectedKeys = function getAffectedKeys(txCache) {
   return affectedKeys;
 };
 
-var OP_CODESEPARATOR = 171;
-
-var SIGHASH_ALL = 1;
-var SIGHASH_NONE = 2;
-var SIGHASH_SINGLE = 3;
-var SIGHASH_ANYONECANPAY = 80;
-
+/**
+ * Signature hash of input inIndex, signed with script.
+ *
+ * The modified serialization is only streamed through the hash natively,
+ * OP_CODESEPARATORs are removed from the script on the way. The native
+ * object is kept with the transaction, so that the parts shared by all
+ * inputs are only prepared once. Works on getBuffer(), so serialize() has
+ * to be called after modifying the transaction.
+ */
 Transaction.prototype.hashForSignature =
 function hashForSignature(script, inIndex, hashType) {
   if (+inIndex !== inIndex ||
@@ -415,101 +440,13 @@ function hashForSignature(script, inIndex, hashType) {
                     "("+this.ins.length+" inputs)");
   }
 
-  // Clone transaction
-  var txTmp = new Transaction();
-  this.ins.forEach(function (txin, i) {
-    txTmp.ins.push(new TransactionIn(txin));
-  });
-  this.outs.forEach(function (txout) {
-    txTmp.outs.push(new TransactionOut(txout));
-  });
-  txTmp.version = this.version;
-  txTmp.lock_time = this.lock_time;
-
-  // In case concatenating two scripts ends up with two codeseparators,
-  // or an extra one at the end, this prevents all those possible
-  // incompatibilities.
-  script.findAndDelete(OP_CODESEPARATOR);
-
-  // Get mode portion of hashtype
-  var hashTypeMode = hashType & 0x1f;
-
-  // Generate modified transaction data for hash
-  var bytes = Binary.put();
-  bytes.word32le(this.version);
-
-  // Serialize inputs
-  if (hashType & SIGHASH_ANYONECANPAY) {
-    // Blank out all inputs except current one, not recommended for open
-    // transactions.
-    bytes.varint(1);
-    bytes.put(this.ins[inIndex].o);
-    bytes.varint(script.buffer.length);
-    bytes.put(script.buffer);
-    bytes.word32le(this.ins[inIndex].q);
-  } else {
-    bytes.varint(this.ins.length);
-    for (var i = 0, l = this.ins.length; i < l; i++) {
-      var txin = this.ins[i];
-      bytes.put(this.ins[i].o);
-
-      // Current input's script gets set to the script to be signed, all others
-      // get blanked.
-      if (inIndex === i) {
-        bytes.varint(script.buffer.length);
-        bytes.put(script.buffer);
-      } else {
-        bytes.varint(0);
-      }
-
-      if (hashTypeMode === SIGHASH_NONE && inIndex !== i) {
-        bytes.word32le(0);
-      } else {
-        bytes.word32le(this.ins[i].q);
-      }
-    }
-  }
-
-  // Serialize outputs
-  if (hashTypeMode === SIGHASH_NONE) {
-    bytes.varint(0);
-  } else {
-    var outsLen;
-    if (hashTypeMode === SIGHASH_SINGLE) {
-      // TODO: Untested
-      if (inIndex >= txTmp.outs.length) {
-        throw new Error("Transaction.hashForSignature(): SIGHASH_SINGLE " +
-                        "no corresponding txout found - out of bounds");
-      }
-      outsLen = inIndex + 1;
-    } else {
-      outsLen = this.outs.length;
-    }
-
-    // TODO: If hashTypeMode !== SIGHASH_SINGLE, we could memcpy this whole
-    //       section from the original transaction as is.
-    bytes.varint(outsLen);
-    for (var i = 0; i < outsLen; i++) {
-      if (hashTypeMode === SIGHASH_SINGLE && i !== inIndex) {
-        // Zero all outs except the one we want to keep
-        bytes.put(Util.INT64_MAX);
-        bytes.varint(0);
-      } else {
-        bytes.put(this.outs[i].v);
-        bytes.varint(this.outs[i].s.length);
-        bytes.put(this.outs[i].s);
-      }
-    }
+  var buffer = this.getBuffer();
+  if (!this._sigHash || this._sigHash.buffer !== buffer) {
+    this._sigHash = new Util.ccmodule.SigHash(buffer);
+    this._sigHash.buffer = buffer;
   }
 
-  bytes.word32le(this.lock_time);
-
-  var buffer = bytes.buffer();
-
-  // Append hashType
-  buffer = buffer.concat(new Buffer([parseInt(hashType), 0, 0, 0]));
-
-  return Util.twoSha256(buffer);
+  return this._sigHash.hash(inIndex, script.buffer, hashType);
 };
 
 /**
@@ -639,14 +576,69 @@ TransactionInputsCache.prototype.buffer = function buffer(blockChain, txStore, w
       }
     },
     indexTxs,
-    // Second find and index persistent transactions
+    // Second look up the remaining outputs in the unspent output index
+    function findUnspentOutputs(err) {
+      if (err) throw err;
+
+      if (!blockChain.getOutputsByOutpoints) {
+        this(null);
+        return;
+      }
+
+      var callback = this;
+      var outpoints = [];
+      self.tx.ins.forEach(function (txin) {
+        if (!txin.isCoinBase() &&
+            missingTx[txin.o.slice(0, 32).toString('base64')]) {
+          outpoints.push(txin.o);
+        }
+      });
+      blockChain.getOutputsByOutpoints(outpoints, function (err, outputs) {
+        if (err) {
+          callback(err);
+          return;
+        }
+
+        var found = {};
+        outputs.forEach(function (output, i) {
+          var hash64 = outpoints[i].slice(0, 32).toString('base64');
+          if (!output) {
+            // Spent or unknown, the whole transaction is loaded instead
+            found[hash64] = false;
+            return;
+          }
+          if (!self.txIndex[hash64]) {
+            self.txIndex[hash64] = {};
+          }
+          self.txIndex[hash64][outpoints[i].readUInt32LE(32)] =
+            new TransactionOut(output);
+          if (found[hash64] !== false) {
+            found[hash64] = true;
+          }
+        });
+        Object.keys(found).forEach(function (hash64) {
+          if (found[hash64]) {
+            delete missingTx[hash64];
+          }
+        });
+
+        callback(null);
+      });
+    },
+    // Third find and index persistent transactions
     function findBlockChainTx(err) {
       if (err) throw err;
 
-      // TODO: Major speedup should be possible if we load only the outs and not
-      //       whole transactions.
+      var hashes = self.txList.filter(function (hash, i) {
+        return missingTx[self.txList64[i]];
+      });
+      if (!hashes.length) {
+        this(null, []);
+        return;
+      }
+
       var callback = this;
-      blockChain.getOutputsByHashes(self.txList, function (err, result) {
+      blockChain.getOutputsByHashes(hashes, function (err, result) {
         callback(err, result);
       });
     },
@@ -16,6 +16,12 @@ function ScriptInterpreter() {
   this.disableUnsafeOpcodes = true;
 };
 
+var verifyScript = Util.ccmodule.verifyScript;
+var verifyInputs = Util.ccmodule.verifyInputs;
+
+// Whether verify() uses the native interpreter, the JS one is the fallback
+ScriptInterpreter.useNative = "function" === typeof verifyScript;
+
 ScriptInterpreter.prototype.eval = function eval(script, tx, inIndex, hashType, callback)
 {
   if ("function" !== typeof callback) {
@@ -737,6 +743,35 @@ function evalTwo(scriptSig, scriptPubkey, tx, n, hashType, callback)
   });
 };
 
+/**
+ * Evaluate both scripts with the native interpreter.
+ *
+ * Runs on the threadpool without a callback per opcode. Afterwards the stack
+ * is the same as after evalTwo(). The scripts and the transaction buffer
+ * must not be modified until the callback has been called.
+ */
+ScriptInterpreter.prototype.evalNative =
+function evalNative(scriptSig, scriptPubkey, tx, n, hashType, callback)
+{
+  var self = this;
+
+  // Without a serialized transaction every signature check fails, just like
+  // it does in checkSig()
+  var txBuffer = null;
+  if (tx && "function" === typeof tx.getBuffer) {
+    txBuffer = tx.getBuffer();
+  }
+
+  verifyScript(scriptSig.buffer, scriptPubkey.buffer, txBuffer, n, hashType,
+               function (e, stack) {
+    self.stack = stack;
+    if (e) {
+      logger.scrdbg("Script aborted: "+e.message);
+    }
+    callback(e);
+  });
+};
+
 /**
  * Get the top element of the stack.
  *
@@ -886,8 +921,11 @@ function verify(scriptSig, scriptPubKey, txTo, n, hashType, callback)
   // Create execution environment
   var si = new ScriptInterpreter();
 
-  // Evaluate scripts
-  si.evalTwo(scriptSig, scriptPubKey, txTo, n, hashType, function (err) {
+  // Evaluate scripts, the native interpreter only takes integer arguments
+  var useNative = ScriptInterpreter.useNative &&
+    n === n >>> 0 && hashType === hashType >>> 0;
+  var evalTwo = useNative ? si.evalNative : si.evalTwo;
+  evalTwo.call(si, scriptSig, scriptPubKey, txTo, n, hashType, function (err) {
     if (err) {
       callback(err);
       return;
@@ -907,6 +945,80 @@ function verify(scriptSig, scriptPubKey, txTo, n, hashType, callback)
   return si;
 };
 
+/**
+ * Verify many inputs at once.
+ *
+ * Takes an Array of {tx, index, scriptSig, scriptPubKey} jobs, where tx is
+ * the Transaction and the scripts are Script objects, and stops at the first
+ * input that fails. The callback receives that input's error, or null if its
+ * scripts evaluated to false, and its index in the Array, which is -1 if all
+ * inputs are valid.
+ *
+ * The native interpreter spreads the jobs over the whole threadpool.
+ */
+ScriptInterpreter.verifyInputs =
+function verifyInputs(jobs, callback)
+{
+  if ("function" !== typeof callback) {
+    throw new Error("ScriptInterpreter.verifyInputs() requires a callback");
+  }
+
+  if (ScriptInterpreter.useNative) {
+    verifyInputsNative(jobs, callback);
+    return;
+  }
+
+  // Results come back in any order, the inputs before a failed one have to
+  // be known before it can be reported
+  var results = new Array(jobs.length);
+  var next = 0;
+  var done = false;
+
+  if (!jobs.length) {
+    callback(null, -1);
+    return;
+  }
+
+  jobs.forEach(function (job, i) {
+    ScriptInterpreter.verify(job.scriptSig, job.scriptPubKey, job.tx,
+                             job.index, 0, function (err, result) {
+      if (done) {
+        return;
+      }
+      results[i] = {err: err || null, valid: !err && !!result};
+      while (next < jobs.length && results[next]) {
+        if (!results[next].valid) {
+          done = true;
+          callback(results[next].err, next);
+          return;
+        }
+        next++;
+      }
+      if (next === jobs.length) {
+        done = true;
+        callback(null, -1);
+      }
+    });
+  });
+};
+
+function verifyInputsNative(jobs, callback)
+{
+  verifyInputs(jobs.map(function (job) {
+    return {
+      tx: job.tx.getBuffer(),
+      index: job.index,
+      scriptSig: job.scriptSig.buffer,
+      scriptPubKey: job.scriptPubKey.buffer
+    };
+  }), function (err, failed) {
+    if (err) {
+      logger.scrdbg("Script aborted: "+err.message);
+    }
+    callback(err, failed);
+  });
+};
+
 var checkSig = ScriptInterpreter.checkSig =
 function (sig, pubkey, scriptCode, tx, n, hashType, callback) {
   if (!sig.length) {
@@ -926,10 +1038,29 @@ function (sig, pubkey, scriptCode, tx, n, hashType, callback) {
     // Signature verification requires a special hash procedure
     var hash = tx.hashForSignature(scriptCode, n, hashType);
 
+    // Signatures seen in the memory pool don't need to be checked again
+    // when the transaction arrives in a block
+    var cached = Util.SigCache.query(hash, pubkey, sig);
+  } catch (err) {
+    callback(null, false);
+    return;
+  }
+
+  if (cached) {
+    callback(null, true);
+    return;
+  }
+
+  try {
     // Verify signature
     var key = new Util.BitcoinKey();
     key.public = pubkey;
-    key.verifySignature(hash, sig, callback);
+    key.verifySignature(hash, sig, function (err, result) {
+      if (!err && result) {
+        Util.SigCache.insert(hash, pubkey, sig);
+      }
+      callback(err, result);
+    });
   } catch (err) {
     callback(null, false);
   }
@@ -41,6 +41,18 @@ Settings.prototype.setGeneralDefaults = function () {
 
   // Switch for disabling script/signature verification
   this.verifyScripts = true;
+
+  // Signature verification engine, either 'openssl' or 'secp256k1'
+  //
+  // The native secp256k1 engine is several times faster, but is not
+  // available on all platforms. If it isn't, OpenSSL is used instead.
+  this.verifyEngine = 'openssl';
+
+  // Number of decoded public keys to keep in memory (0 = no cache)
+  this.pubkeyCacheSize = 8192;
+
+  // Size in bytes of the cache of already verified signatures (0 = no cache)
+  this.sigCacheSize = 4 * 1024 * 1024;
 };
 
 Settings.prototype.setStorageDefaults = function () {
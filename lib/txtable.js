@@ -0,0 +1,138 @@
+var ccmodule = require('./binding');
+
+var HEADER_WORDS = 2;
+var RECORD_WORDS = 4;
+var IO_WORDS = 3;
+
+/**
+ * Offsets table for consecutive serialized transactions.
+ *
+ * The transactions are scanned natively in a single pass, which only records
+ * where each field is. Fields are sliced from the original buffer (without
+ * copying) when they are requested.
+ *
+ * @param {Buffer} buffer Serialized data.
+ * @param {Number|Buffer} offset Position of the first transaction, default
+ * 0. Or a table that was already returned by the native parser.
+ * @param {Number} count Number of transactions, default 1.
+ */
+var TxTable = exports.TxTable = function TxTable(buffer, offset, count) {
+  this.buffer = buffer;
+  if (Buffer.isBuffer(offset)) {
+    this.table = offset;
+  } else {
+    this.table = ccmodule.parseTxs(buffer, offset || 0,
+                                   "number" === typeof count ? count : 1);
+  }
+  this.length = this.word(0);
+  this.end = this.word(1);
+
+  // Txids back to back, if they are known in advance
+  this.hashes = null;
+};
+
+/**
+ * Parses a serialized block in a single native call.
+ *
+ * Returns the header fields, `txs`, a TxTable with the txids filled in, and
+ * `calcMerkleRoot`, the merkle root computed from those txids.
+ */
+TxTable.parseBlock = function parseBlock(buffer) {
+  var block = ccmodule.parseBlock(buffer);
+
+  block.txs = new TxTable(buffer, block.txTable);
+  block.txs.hashes = block.txHashes;
+
+  return block;
+};
+
+TxTable.prototype.word = function word(i) {
+  return this.table.readUInt32LE(4 * i, true);
+};
+
+// Index of the first word of transaction i's record
+TxTable.prototype.record = function record(i) {
+  return this.word(HEADER_WORDS + i);
+};
+
+TxTable.prototype.getBuffer = function getBuffer(i) {
+  var rec = this.record(i);
+  return this.buffer.slice(this.word(rec), this.word(rec + 1));
+};
+
+TxTable.prototype.getHash = function getHash(i) {
+  if (this.hashes) {
+    return this.hashes.slice(32 * i, 32 * (i + 1));
+  }
+  return ccmodule.sha256d(this.getBuffer(i));
+};
+
+TxTable.prototype.getVersion = function getVersion(i) {
+  return this.buffer.readUInt32LE(this.word(this.record(i)), true);
+};
+
+TxTable.prototype.getLockTime = function getLockTime(i) {
+  return this.buffer.readUInt32LE(this.word(this.record(i) + 1) - 4, true);
+};
+
+TxTable.prototype.getInCount = function getInCount(i) {
+  return this.word(this.record(i) + 2);
+};
+
+TxTable.prototype.getOutCount = function getOutCount(i) {
+  return this.word(this.record(i) + 3);
+};
+
+// Returns input j of transaction i as {o, s, q}
+TxTable.prototype.getIn = function getIn(i, j) {
+  var w = this.record(i) + RECORD_WORDS + IO_WORDS * j;
+  var pos = this.word(w);
+  var scriptPos = this.word(w + 1);
+  var scriptEnd = scriptPos + this.word(w + 2);
+
+  return {
+    o: this.buffer.slice(pos, pos + 36),
+    s: this.buffer.slice(scriptPos, scriptEnd),
+    q: this.buffer.readUInt32LE(scriptEnd, true)
+  };
+};
+
+// Returns output j of transaction i as {v, s}
+TxTable.prototype.getOut = function getOut(i, j) {
+  var rec = this.record(i);
+  var w = rec + RECORD_WORDS + IO_WORDS * (this.word(rec + 2) + j);
+  var pos = this.word(w);
+  var scriptPos = this.word(w + 1);
+
+  return {
+    v: this.buffer.slice(pos, pos + 8),
+    s: this.buffer.slice(scriptPos, scriptPos + this.word(w + 2))
+  };
+};
+
+/**
+ * Materializes transaction i in the format of Connection.parseTx().
+ */
+TxTable.prototype.getData = function getData(i) {
+  var data = {}, j, l;
+
+  data.version = this.getVersion(i);
+
+  data.ins = [];
+  for (j = 0, l = this.getInCount(i); j < l; j++) {
+    data.ins.push(this.getIn(i, j));
+  }
+
+  data.outs = [];
+  for (j = 0, l = this.getOutCount(i); j < l; j++) {
+    data.outs.push(this.getOut(i, j));
+  }
+
+  data.lock_time = this.getLockTime(i);
+  data.buffer = this.getBuffer(i);
+  if (this.hashes) {
+    data.hash = this.getHash(i);
+  }
+
+  return data;
+};
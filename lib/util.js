@@ -8,6 +8,7 @@ var ccmodule = require('./binding');
 exports.ccmodule = ccmodule;
 
 exports.BitcoinKey = ccmodule.BitcoinKey;
+exports.SigCache = ccmodule.SigCache;
 
 var sha256 = exports.sha256 = function (data) {
   return new Buffer(crypto.createHash('sha256').update(data).digest('binary'), 'binary');
@@ -21,16 +22,17 @@ var sha1 = exports.sha1 = function (data) {
   return new Buffer(crypto.createHash('sha1').update(data).digest('binary'), 'binary');
 };
 
-var twoSha256 = exports.twoSha256 = function (data) {
-  return sha256(sha256(data));
-};
+// twoSha256(data, [out], [offset])
+var twoSha256 = exports.twoSha256 = ccmodule.sha256d;
 
-var sha256ripe160 = exports.sha256ripe160 = function (data) {
-  return ripe160(sha256(data));
-};
+// sha256ripe160(data, [out], [offset])
+var sha256ripe160 = exports.sha256ripe160 = ccmodule.hash160;
 
 var sha256midstate = exports.sha256midstate = ccmodule.sha256_midstate;
 
+// Returns the twoSha256 of each Buffer in an Array as one Buffer
+var twoSha256Many = exports.twoSha256Many = ccmodule.sha256dMany;
+
 var encodeHex = exports.encodeHex = function (buffer) {
   return buffer.slice(0).toHex().toString('ascii');
 };
@@ -44,6 +46,11 @@ var encodeBase58 = exports.encodeBase58 = ccmodule.base58_encode;
 
 var decodeBase58 = exports.decodeBase58 = ccmodule.base58_decode;
 
+// Batch variants, invalid strings decode to null
+var encodeBase58Many = exports.encodeBase58Many = ccmodule.base58EncodeMany;
+
+var decodeBase58Many = exports.decodeBase58Many = ccmodule.base58DecodeMany;
+
 // DEPRECATED, use BitcoinKey
 var verifySig = exports.verifySig = function (sig, pubkey, hash) {
   var key = new ccmodule.BitcoinKey();
@@ -134,48 +141,35 @@ var formatValue = exports.formatValue = function (valueBuffer) {
   return integerPart+"."+decimalPart;
 };
 
-var pubKeyHashToAddress = exports.pubKeyHashToAddress = function (pubKeyHash) {
+// Base58Check encoding of a version byte and 20 byte hash
+var encodeAddress = exports.encodeAddress = ccmodule.encodeAddress;
+// Returns {version, hash} or null for invalid addresses
+var decodeAddress = exports.decodeAddress = ccmodule.decodeAddress;
+// Batch versions, invalid addresses decode to null
+var encodeAddressMany = exports.encodeAddressMany = ccmodule.encodeAddressMany;
+var decodeAddressMany = exports.decodeAddressMany = ccmodule.decodeAddressMany;
+
+var pubKeyHashToAddress = exports.pubKeyHashToAddress = function (pubKeyHash, version) {
   if (!pubKeyHash) {
     return "";
   }
 
-  var put = Binary.put();
-  // Version
-  put.word8le(0);
-  // Hash
-  put.put(pubKeyHash);
-  // Checksum (four bytes)
-  put.put(twoSha256(put.buffer()).slice(0,4));
-  return encodeBase58(put.buffer());
+  return encodeAddress(version || 0, pubKeyHash);
 };
 
-var addressToPubKeyHash = exports.addressToPubKeyHash = function (address) {
-  // Trim
-  address = String(address).replace(/\s/g, '');
+// Removes all whitespace, including within the address
+var normalizeAddress = exports.normalizeAddress = function (address) {
+  return String(address).replace(/\s/g, '');
+};
 
-  // Check sanity
-  if (!address.match(/^[1-9A-HJ-NP-Za-km-z]{27,35}$/)) {
+var addressToPubKeyHash = exports.addressToPubKeyHash = function (address) {
+  var decoded = decodeAddress(normalizeAddress(address));
+  if (!decoded) {
     logger.warn("Not a valid Bitcoin address");
     return null;
   }
 
-  // Decode
-  var buffer = decodeBase58(address);
-
-  // Parse
-  var parser = Binary.parse(buffer);
-  parser.word8('version');
-  parser.buffer('hash', 20);
-  parser.buffer('checksum', 4);
-
-  // Check checksum
-  var checksum = twoSha256(buffer.slice(0, 21)).slice(0, 4);
-  if (checksum.compare(parser.vars.checksum) !== 0) {
-    logger.warn("Checksum comparison failed");
-    return null;
-  }
-
-  return parser.vars.hash;
+  return decoded.hash;
 };
 
 // Utility that synchronizes function calls based on a key
@@ -242,18 +236,14 @@ var generateNonce = exports.generateNonce = function () {
  */
 var decodeDiffBits = exports.decodeDiffBits = function (diffBits, asBigInt) {
   diffBits = +diffBits;
-  var target = bignum(diffBits & 0xffffff);
-  target = target.shiftLeft(8*((diffBits >>> 24) - 3));
 
   if (asBigInt) {
-    return target;
+    var target = bignum(diffBits & 0xffffff);
+    return target.shiftLeft(8*((diffBits >>> 24) - 3));
   }
 
-  // Convert to buffer
-  var diffBuf = target.toBuffer();
-  var targetBuf = new Buffer(32).clear();
-  diffBuf.copy(targetBuf, 32-diffBuf.length);
-  return targetBuf;
+  // 32 byte big endian Buffer
+  return ccmodule.decodeBits(diffBits);
 };
 
 /**
@@ -263,7 +253,7 @@ var decodeDiffBits = exports.decodeDiffBits = function (diffBits, asBigInt) {
  */
 var encodeDiffBits = exports.encodeDiffBits = function encodeDiffBits(target) {
   if (Buffer.isBuffer(target)) {
-    target = bignum.fromBuffer(target);
+    return ccmodule.encodeBits(target);
   } else if ("function" === typeof target.toBuffer) { // duck-typing bignum
     // Nothing to do
   } else {
@@ -240,25 +240,26 @@ Pubkeys.method('register', {
     var blockChain = this.node.getBlockChain();
 
     // Validate keys
-    var keys = params.keys.split(',');
-    var pubKeyHashes = [];
-    for (var i = 0; i < keys.length; i++) {
-      // Trim whitespace
-      var key = keys[i].replace(/^\s+|\s+$/g, '');
-
+    var keys = params.keys.split(',').map(function (key) {
+      // Remove whitespace
+      return Util.normalizeAddress(key);
+    }).filter(function (key) {
       // Ignore empty keys
-      if (!key.length) continue;
+      return key.length;
+    });
 
-      // Convert Bitcoin address to pubkey hash
-      var pubKeyHash = Util.addressToPubKeyHash(keys[i]);
-      if (!pubKeyHash) {
+    // Convert Bitcoin addresses to pubkey hashes
+    var decoded = Util.decodeAddressMany(keys);
+    var pubKeyHashes = [];
+    for (var i = 0; i < keys.length; i++) {
+      if (!decoded[i]) {
         callback({
           type: "InvalidKeys",
           message: "This is not a valid Bitcoin address: '"+keys[i]+"'"
         });
         return;
       }
-      pubKeyHashes.push(pubKeyHash);
+      pubKeyHashes.push(decoded[i].hash);
     }
 
     // Make sure we have at least one key
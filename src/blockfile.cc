@@ -0,0 +1,473 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <v8.h>
+
+#include <node.h>
+#include <node_buffer.h>
+
+#include "blockfile.h"
+#include "common.h"
+
+using namespace std;
+using namespace v8;
+using namespace node;
+
+// Same as bitcoind's MAX_BLOCKFILE_SIZE
+#define BLOCK_FILE_DEFAULT_MAX_SIZE (128 * 1024 * 1024)
+
+static inline uint32_t read_le32(const unsigned char *p)
+{
+  return (uint32_t) p[0] | ((uint32_t) p[1] << 8) |
+    ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static inline void write_le32(unsigned char *p, uint32_t x)
+{
+  p[0] = x & 0xff;
+  p[1] = (x >> 8) & 0xff;
+  p[2] = (x >> 16) & 0xff;
+  p[3] = (x >> 24) & 0xff;
+}
+
+// Returns true if name is a block file name and sets its number
+static bool
+parse_file_name (const char *name, uint32_t *file)
+{
+  unsigned int num;
+  char tail;
+  if (strlen(name) != 12 ||
+      sscanf(name, "blk%5u.da%c", &num, &tail) != 2 || tail != 't') {
+    return false;
+  }
+  *file = num;
+  return true;
+}
+
+Persistent<FunctionTemplate> BlockFile::s_ct;
+
+void BlockFile::Init(Handle<Object> target)
+{
+  HandleScope scope;
+  Local<FunctionTemplate> t = FunctionTemplate::New(New);
+
+  s_ct = Persistent<FunctionTemplate>::New(t);
+  s_ct->InstanceTemplate()->SetInternalFieldCount(1);
+  s_ct->SetClassName(String::NewSymbol("BlockFile"));
+
+  // Methods
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "append", Append);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "read", Read);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "close", CloseFiles);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "getStats", GetStats);
+
+  target->Set(String::NewSymbol("BlockFile"),
+              s_ct->GetFunction());
+}
+
+BlockFile::BlockFile(const string &dir, size_t maxFileSize) :
+  dir(dir),
+  maxFileSize(maxFileSize),
+  current(0),
+  fd(-1)
+{
+}
+
+BlockFile::~BlockFile()
+{
+  Close();
+}
+
+string BlockFile::FileName(uint32_t file) const
+{
+  char name[16];
+  snprintf(name, sizeof(name), "blk%05u.dat", file);
+  return dir + "/" + name;
+}
+
+int BlockFile::Scan()
+{
+  DIR *d = opendir(dir.c_str());
+  if (d == NULL) {
+    return errno;
+  }
+
+  struct dirent *entry;
+  while ((entry = readdir(d)) != NULL) {
+    uint32_t file;
+    struct stat st;
+    if (!parse_file_name(entry->d_name, &file) ||
+        stat(FileName(file).c_str(), &st) != 0) {
+      continue;
+    }
+    if (file >= sizes.size()) {
+      sizes.resize(file + 1, 0);
+    }
+    sizes[file] = st.st_size;
+  }
+  closedir(d);
+
+  // Continue with the last file
+  if (sizes.empty()) {
+    sizes.push_back(0);
+  }
+  current = sizes.size() - 1;
+  mappings.resize(sizes.size(), NULL);
+
+  return 0;
+}
+
+BlockFile::mapping_t *BlockFile::Map(uint32_t file, int *error)
+{
+  if (mappings[file]) {
+    return mappings[file];
+  }
+
+  int map_fd = open(FileName(file).c_str(), O_RDONLY);
+  if (map_fd < 0) {
+    *error = errno;
+    return NULL;
+  }
+
+  // The current file is mapped up to the size it may grow to, so the mapping
+  // stays valid for the data appended later
+  size_t len = sizes[file];
+  if (file == current && len < maxFileSize) {
+    len = maxFileSize;
+  }
+
+  void *data = mmap(NULL, len, PROT_READ, MAP_SHARED, map_fd, 0);
+  if (data == MAP_FAILED) {
+    *error = errno;
+    close(map_fd);
+    return NULL;
+  }
+  close(map_fd);
+
+  mapping_t *m = new mapping_t();
+  m->data = (unsigned char *) data;
+  m->len = len;
+  m->refs = 1;
+  mappings[file] = m;
+  return m;
+}
+
+void BlockFile::ReleaseMapping(char *data, void *hint)
+{
+  mapping_t *m = static_cast<mapping_t *>(hint);
+  if (--m->refs == 0) {
+    munmap(m->data, m->len);
+    delete m;
+  }
+}
+
+void BlockFile::Close()
+{
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+
+  // Mappings still used by Buffers are released together with the last one
+  for (size_t i = 0; i < mappings.size(); i++) {
+    if (mappings[i]) {
+      ReleaseMapping(NULL, mappings[i]);
+      mappings[i] = NULL;
+    }
+  }
+  mappings.clear();
+  sizes.clear();
+}
+
+/**
+ * Arguments: directory, [maximum file size]
+ */
+Handle<Value>
+BlockFile::New(const Arguments& args)
+{
+  if (!args.IsConstructCall()) {
+    return FromConstructorTemplate(s_ct, args);
+  }
+
+  HandleScope scope;
+
+  if (args.Length() < 1 || !args[0]->IsString()) {
+    return VException("Argument 'dir' must be a string");
+  }
+  String::Utf8Value dir(args[0]);
+
+  size_t max_size = BLOCK_FILE_DEFAULT_MAX_SIZE;
+  if (args.Length() > 1 && !args[1]->IsUndefined()) {
+    // Offsets must fit into a location
+    if (!args[1]->IsUint32() || args[1]->Uint32Value() == 0 ||
+        args[1]->Uint32Value() > 0x7fffffff) {
+      return VException("Argument 'maxFileSize' must be a positive 31 bit integer");
+    }
+    max_size = args[1]->Uint32Value();
+  }
+
+  BlockFile *store = new BlockFile(*dir, max_size);
+  int error = store->Scan();
+  if (error) {
+    delete store;
+    return VException(strerror(error));
+  }
+  store->Wrap(args.Holder());
+
+  return scope.Close(args.This());
+}
+
+/**
+ * Arguments: Array of Buffers, callback
+ *
+ * Appends the Buffers to the current file. The callback receives an Array
+ * with the location of each Buffer once they are written.
+ */
+Handle<Value>
+BlockFile::Append(const Arguments& args)
+{
+  HandleScope scope;
+  BlockFile *store = ObjectWrap::Unwrap<BlockFile>(args.This());
+
+  if (args.Length() != 2 || !args[0]->IsArray()) {
+    return VException("Two arguments expected: buffers, callback");
+  }
+  REQ_FUN_ARG(1, cb);
+
+  if (store->sizes.empty()) {
+    return VException("Block files are closed");
+  }
+
+  Local<Array> buffers = Local<Array>::Cast(args[0]);
+  uint32_t count = buffers->Length();
+
+  append_baton_t *baton = new append_baton_t();
+  baton->data.resize(count);
+  baton->lens.resize(count);
+
+  size_t total = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    Local<Value> buf = buffers->Get(i);
+    if (!Buffer::HasInstance(buf)) {
+      delete baton;
+      return VException("Argument 'buffers' must contain only Buffers");
+    }
+    baton->data[i] = (const unsigned char *) Buffer::Data(buf->ToObject());
+    baton->lens[i] = Buffer::Length(buf->ToObject());
+    total += baton->lens[i];
+  }
+
+  if (total > 0x7fffffff) {
+    delete baton;
+    return VException("Data is too large for a block file");
+  }
+
+  // Start a new file rather than grow beyond the limit
+  size_t pos = store->sizes[store->current];
+  if (pos > 0 && pos + total > store->maxFileSize) {
+    if (store->fd >= 0) {
+      close(store->fd);
+      store->fd = -1;
+    }
+    store->current++;
+    store->sizes.push_back(0);
+    store->mappings.push_back(NULL);
+    pos = 0;
+  }
+
+  if (store->fd < 0) {
+    store->fd = open(store->FileName(store->current).c_str(),
+                     O_WRONLY | O_CREAT, 0644);
+    if (store->fd < 0) {
+      int error = errno;
+      delete baton;
+      return VException(strerror(error));
+    }
+  }
+
+  // The descriptor may be closed by a later append, before this one ran
+  baton->fd = dup(store->fd);
+  if (baton->fd < 0) {
+    int error = errno;
+    delete baton;
+    return VException(strerror(error));
+  }
+
+  baton->offset = pos;
+  baton->locations.resize(LOCATION_SIZE * (size_t) count);
+  for (uint32_t i = 0; i < count; i++) {
+    unsigned char *location = &baton->locations[LOCATION_SIZE * i];
+    write_le32(location, store->current);
+    write_le32(location + 4, pos);
+    write_le32(location + 8, baton->lens[i]);
+    pos += baton->lens[i];
+  }
+  store->sizes[store->current] = pos;
+
+  baton->buffers = Persistent<Object>::New(buffers);
+  baton->error = 0;
+  baton->cb = Persistent<Function>::New(cb);
+
+  uv_work_t *req = new uv_work_t();
+  req->data = baton;
+
+  uv_queue_work(uv_default_loop(), req, EIO_Append, AppendCallback);
+
+  return scope.Close(Undefined());
+}
+
+void
+BlockFile::EIO_Append(uv_work_t *req)
+{
+  append_baton_t *baton = static_cast<append_baton_t *>(req->data);
+
+  size_t offset = baton->offset;
+  for (size_t i = 0; i < baton->data.size(); i++) {
+    const unsigned char *data = baton->data[i];
+    size_t len = baton->lens[i];
+    while (len > 0) {
+      ssize_t written = pwrite(baton->fd, data, len, offset);
+      if (written < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        baton->error = errno;
+        return;
+      }
+      data += written;
+      len -= written;
+      offset += written;
+    }
+  }
+}
+
+void
+BlockFile::AppendCallback(uv_work_t *req, int status)
+{
+  HandleScope scope;
+  append_baton_t *baton = static_cast<append_baton_t *>(req->data);
+
+  close(baton->fd);
+  baton->buffers.Dispose();
+
+  Local<Value> argv[2];
+  argv[0] = Local<Value>::New(Null());
+  argv[1] = Local<Value>::New(Null());
+  if (baton->error) {
+    argv[0] = Exception::Error(String::New(strerror(baton->error)));
+  } else {
+    size_t count = baton->locations.size() / LOCATION_SIZE;
+    Local<Array> locations = Array::New(count);
+    for (size_t i = 0; i < count; i++) {
+      Buffer *location = Buffer::New(LOCATION_SIZE);
+      memcpy(Buffer::Data(location), &baton->locations[LOCATION_SIZE * i],
+             LOCATION_SIZE);
+      locations->Set(i, Local<Object>::New(location->handle_));
+    }
+    argv[1] = locations;
+  }
+
+  TryCatch try_catch;
+
+  baton->cb->Call(Context::GetCurrent()->Global(), 2, argv);
+
+  baton->cb.Dispose();
+
+  delete baton;
+  delete req;
+
+  if (try_catch.HasCaught()) {
+    FatalException(try_catch);
+  }
+}
+
+/**
+ * Arguments: location Buffer. Returns the data at that location, without
+ * copying it. The Buffer is read-only, see blockfile.h.
+ */
+Handle<Value>
+BlockFile::Read(const Arguments& args)
+{
+  HandleScope scope;
+  BlockFile *store = ObjectWrap::Unwrap<BlockFile>(args.This());
+
+  if (args.Length() != 1 || !Buffer::HasInstance(args[0]) ||
+      Buffer::Length(args[0]->ToObject()) != LOCATION_SIZE) {
+    return VException("Argument 'location' must be a Buffer of length 12 bytes");
+  }
+
+  const unsigned char *location =
+    (const unsigned char *) Buffer::Data(args[0]->ToObject());
+  uint32_t file = read_le32(location);
+  size_t offset = read_le32(location + 4);
+  size_t len = read_le32(location + 8);
+
+  // Never touch the mapping beyond the end of the file
+  if (file >= store->sizes.size() || offset + len > store->sizes[file]) {
+    return VException("Location is outside of the block files");
+  }
+
+  if (len == 0) {
+    return scope.Close(Buffer::New(0)->handle_);
+  }
+
+  int error = 0;
+  mapping_t *m = store->Map(file, &error);
+  if (m == NULL) {
+    return VException(strerror(error));
+  }
+
+  m->refs++;
+  Buffer *result = Buffer::New((char *) m->data + offset, len,
+                               ReleaseMapping, m);
+
+  return scope.Close(result->handle_);
+}
+
+/**
+ * Closes the current file and releases the mappings. Buffers returned by
+ * read() stay valid.
+ */
+Handle<Value>
+BlockFile::CloseFiles(const Arguments& args)
+{
+  HandleScope scope;
+  BlockFile *store = ObjectWrap::Unwrap<BlockFile>(args.This());
+
+  store->Close();
+
+  return scope.Close(Undefined());
+}
+
+Handle<Value>
+BlockFile::GetStats(const Arguments& args)
+{
+  HandleScope scope;
+  BlockFile *store = ObjectWrap::Unwrap<BlockFile>(args.This());
+
+  double size = 0;
+  uint32_t mapped = 0;
+  for (size_t i = 0; i < store->sizes.size(); i++) {
+    size += store->sizes[i];
+    if (store->mappings[i]) {
+      mapped++;
+    }
+  }
+
+  Local<Object> result = Object::New();
+  result->Set(String::NewSymbol("files"),
+              Integer::NewFromUnsigned(store->sizes.size()));
+  result->Set(String::NewSymbol("current"),
+              Integer::NewFromUnsigned(store->current));
+  result->Set(String::NewSymbol("size"), Number::New(size));
+  result->Set(String::NewSymbol("mapped"), Integer::NewFromUnsigned(mapped));
+
+  return scope.Close(result);
+}
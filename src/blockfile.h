@@ -0,0 +1,112 @@
+#ifndef BITCOINJS_SERVER_INCLUDE_BLOCKFILE_H_
+#define BITCOINJS_SERVER_INCLUDE_BLOCKFILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <v8.h>
+#include <node.h>
+
+using namespace v8;
+using namespace node;
+
+/**
+ * Append-only store for raw block data.
+ *
+ * Data is appended to numbered files (blk00000.dat, blk00001.dat, ...) in a
+ * directory, a new file is started once the current one would grow beyond
+ * the maximum file size. The data passed to one append() call is always
+ * written to the same file, back to back.
+ *
+ * Every appended Buffer is identified by its location:
+ *
+ *   file number, offset, length (32 bit little endian each)
+ *
+ * Reads return Buffers pointing into a read-only mapping of the file, which
+ * stays mapped as long as such a Buffer is alive. They must never be
+ * written to, that crashes the process. Copy the data to modify it.
+ *
+ * Writes are done on the threadpool. A location must not be read before the
+ * append() that returned it has called back.
+ */
+class BlockFile : ObjectWrap
+{
+private:
+
+  struct mapping_t {
+    unsigned char *data;
+    size_t len;
+
+    // Buffers pointing into the mapping, plus one for the BlockFile
+    int refs;
+  };
+
+  struct append_baton_t {
+    int fd;
+    size_t offset;
+    std::vector<const unsigned char *> data;
+    std::vector<size_t> lens;
+
+    // Keeps the Buffers alive
+    Persistent<Object> buffers;
+
+    // Result
+    std::vector<unsigned char> locations;
+    int error;
+    Persistent<Function> cb;
+  };
+
+  std::string dir;
+  size_t maxFileSize;
+
+  // File being appended to, its descriptor is opened on the first append
+  uint32_t current;
+  int fd;
+
+  // Size of each file, by file number
+  std::vector<size_t> sizes;
+
+  // Mapping of each file, NULL until it is first read
+  std::vector<mapping_t *> mappings;
+
+  std::string FileName(uint32_t file) const;
+
+  // Loads the sizes of the existing files. Returns an errno value or 0.
+  int Scan();
+
+  mapping_t *Map(uint32_t file, int *error);
+
+  void Close();
+
+  static void ReleaseMapping(char *data, void *hint);
+
+  static void EIO_Append(uv_work_t *req);
+
+public:
+
+  static const int LOCATION_SIZE = 12;
+
+  static Persistent<FunctionTemplate> s_ct;
+
+  static void Init(Handle<Object> target);
+
+  BlockFile(const std::string &dir, size_t maxFileSize);
+  ~BlockFile();
+
+  static Handle<Value> New(const Arguments& args);
+
+  static Handle<Value> Append(const Arguments& args);
+
+  static void AppendCallback(uv_work_t *req, int status);
+
+  static Handle<Value> Read(const Arguments& args);
+
+  static Handle<Value> CloseFiles(const Arguments& args);
+
+  static Handle<Value> GetStats(const Arguments& args);
+};
+
+#endif
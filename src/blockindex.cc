@@ -0,0 +1,444 @@
+#include <string.h>
+
+#include <algorithm>
+
+#include <v8.h>
+
+#include <node.h>
+#include <node_buffer.h>
+
+#include "blockindex.h"
+#include "blockrecord.h"
+#include "common.h"
+
+using namespace std;
+using namespace v8;
+using namespace node;
+
+// Number of blocks the median time past is taken over
+#define MEDIAN_TIME_SPAN 11
+
+static const unsigned char null_hash[32] = { 0 };
+
+static inline uint32_t read_le32(const unsigned char *p)
+{
+  return (uint32_t) p[0] | ((uint32_t) p[1] << 8) |
+    ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static Local<Object>
+copy_buffer (const unsigned char *data, size_t len)
+{
+  Buffer *result = Buffer::New(len);
+  memcpy(Buffer::Data(result), data, len);
+  return Local<Object>::New(result->handle_);
+}
+
+// Turns the lowest set bit off
+static inline uint32_t invert_lowest_one(uint32_t n)
+{
+  return n & (n - 1);
+}
+
+// Height the skip pointer of a block at the given height points to
+static inline uint32_t get_skip_height(uint32_t height)
+{
+  if (height < 2) {
+    return 0;
+  }
+
+  // Any number strictly lower than height is acceptable, but this one makes
+  // sure the walk in GetAncestor() takes O(log n) steps
+  return (height & 1) ?
+    invert_lowest_one(invert_lowest_one(height - 1)) + 1 :
+    invert_lowest_one(height);
+}
+
+Persistent<FunctionTemplate> BlockIndex::s_ct;
+
+void BlockIndex::Init(Handle<Object> target)
+{
+  HandleScope scope;
+  Local<FunctionTemplate> t = FunctionTemplate::New(New);
+
+  s_ct = Persistent<FunctionTemplate>::New(t);
+  s_ct->InstanceTemplate()->SetInternalFieldCount(1);
+  s_ct->SetClassName(String::NewSymbol("BlockIndex"));
+
+  // Methods
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "add", Add);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "addRecord", AddRecord);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "get", Get);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "getAncestor", GetAncestor);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "getMedianTimePast", GetMedianTimePast);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "findFork", FindFork);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "getLocator", GetLocator);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "getStats", GetStats);
+
+  target->Set(String::NewSymbol("BlockIndex"),
+              s_ct->GetFunction());
+}
+
+int32_t BlockIndex::Find(Handle<Value> hash) const
+{
+  if (!Buffer::HasInstance(hash) || Buffer::Length(hash->ToObject()) != 32) {
+    return -2;
+  }
+
+  map<string, int32_t>::const_iterator it =
+    positions.find(string(Buffer::Data(hash->ToObject()), 32));
+  return it == positions.end() ? -1 : it->second;
+}
+
+int32_t BlockIndex::GetAncestor(int32_t pos, uint32_t height) const
+{
+  if (pos < 0 || height > entries[pos].height) {
+    return -1;
+  }
+
+  uint32_t walk_height = entries[pos].height;
+  while (walk_height > height) {
+    uint32_t skip_height = get_skip_height(walk_height);
+    uint32_t skip_height_prev = get_skip_height(walk_height - 1);
+
+    // Only follow the skip pointer if the parent's isn't better
+    if (entries[pos].skip >= 0 &&
+        (skip_height == height ||
+         (skip_height > height &&
+          !(skip_height_prev + 2 < skip_height &&
+            skip_height_prev >= height)))) {
+      pos = entries[pos].skip;
+      walk_height = skip_height;
+    } else {
+      pos = entries[pos].parent;
+      walk_height--;
+    }
+  }
+
+  return pos;
+}
+
+void BlockIndex::Insert(const entry_t &first, const string &firstPrevHash)
+{
+  vector<pending_t> queue;
+  queue.push_back(pending_t());
+  queue.back().entry = first;
+  queue.back().prevHash = firstPrevHash;
+
+  while (!queue.empty()) {
+    pending_t p = queue.back();
+    queue.pop_back();
+
+    string hash((const char *) p.entry.hash, 32);
+    if (positions.find(hash) != positions.end()) {
+      continue;
+    }
+
+    entry_t &e = p.entry;
+    if (memcmp(p.prevHash.data(), null_hash, 32) == 0) {
+      e.parent = -1;
+      e.skip = -1;
+      e.height = 0;
+    } else {
+      map<string, int32_t>::iterator parent = positions.find(p.prevHash);
+      if (parent == positions.end()) {
+        pending.insert(make_pair(p.prevHash, p));
+        continue;
+      }
+      e.parent = parent->second;
+      e.height = entries[e.parent].height + 1;
+      e.skip = GetAncestor(e.parent, get_skip_height(e.height));
+    }
+
+    positions[hash] = entries.size();
+    entries.push_back(e);
+
+    // Children that arrived first
+    pair<multimap<string, pending_t>::iterator,
+         multimap<string, pending_t>::iterator> range =
+      pending.equal_range(hash);
+    for (multimap<string, pending_t>::iterator it = range.first;
+         it != range.second; ++it) {
+      queue.push_back(it->second);
+    }
+    pending.erase(range.first, range.second);
+  }
+}
+
+Local<Object> BlockIndex::ToObject(int32_t pos) const
+{
+  const entry_t &e = entries[pos];
+
+  Local<Object> result = Object::New();
+  result->Set(String::NewSymbol("hash"), copy_buffer(e.hash, 32));
+  result->Set(String::NewSymbol("prev_hash"),
+              copy_buffer(e.parent >= 0 ? entries[e.parent].hash : null_hash,
+                          32));
+  result->Set(String::NewSymbol("height"), Integer::NewFromUnsigned(e.height));
+  result->Set(String::NewSymbol("bits"), Integer::NewFromUnsigned(e.bits));
+  result->Set(String::NewSymbol("timestamp"),
+              Integer::NewFromUnsigned(e.timestamp));
+  result->Set(String::NewSymbol("chainWork"), copy_buffer(e.chainWork, 32));
+  return result;
+}
+
+Handle<Value>
+BlockIndex::New(const Arguments& args)
+{
+  if (!args.IsConstructCall()) {
+    return FromConstructorTemplate(s_ct, args);
+  }
+
+  HandleScope scope;
+
+  BlockIndex *index = new BlockIndex();
+  index->Wrap(args.Holder());
+
+  return scope.Close(args.This());
+}
+
+/**
+ * Arguments: Block (with its hash set)
+ */
+Handle<Value>
+BlockIndex::Add(const Arguments& args)
+{
+  HandleScope scope;
+  BlockIndex *index = ObjectWrap::Unwrap<BlockIndex>(args.This());
+
+  if (args.Length() != 1 || !args[0]->IsObject()) {
+    return VException("One argument expected: block");
+  }
+  Local<Object> block = args[0]->ToObject();
+
+  Local<Value> hash = block->Get(String::NewSymbol("hash"));
+  Local<Value> prev_hash = block->Get(String::NewSymbol("prev_hash"));
+  if (!Buffer::HasInstance(hash) || Buffer::Length(hash->ToObject()) != 32 ||
+      !Buffer::HasInstance(prev_hash) ||
+      Buffer::Length(prev_hash->ToObject()) != 32) {
+    return VException("Block fields 'hash' and 'prev_hash' must be Buffers of length 32 bytes");
+  }
+
+  Local<Value> chain_work = block->Get(String::NewSymbol("chainWork"));
+  if (!Buffer::HasInstance(chain_work) ||
+      Buffer::Length(chain_work->ToObject()) > 32) {
+    return VException("Block field 'chainWork' must be a Buffer of at most 32 bytes");
+  }
+  size_t chain_work_len = Buffer::Length(chain_work->ToObject());
+
+  entry_t e;
+  memcpy(e.hash, Buffer::Data(hash->ToObject()), 32);
+  memset(e.chainWork, 0, 32 - chain_work_len);
+  memcpy(e.chainWork + 32 - chain_work_len,
+         Buffer::Data(chain_work->ToObject()), chain_work_len);
+  e.bits = block->Get(String::NewSymbol("bits"))->Uint32Value();
+  e.timestamp = block->Get(String::NewSymbol("timestamp"))->Uint32Value();
+
+  index->Insert(e, string(Buffer::Data(prev_hash->ToObject()), 32));
+
+  return scope.Close(Undefined());
+}
+
+/**
+ * Arguments: hash, block record Buffer (see BlockRecord)
+ *
+ * Used to load the index from the database, without creating Block objects.
+ */
+Handle<Value>
+BlockIndex::AddRecord(const Arguments& args)
+{
+  HandleScope scope;
+  BlockIndex *index = ObjectWrap::Unwrap<BlockIndex>(args.This());
+
+  if (args.Length() != 2 || !Buffer::HasInstance(args[0]) ||
+      Buffer::Length(args[0]->ToObject()) != 32 ||
+      !Buffer::HasInstance(args[1])) {
+    return VException("Two arguments expected: hash, record");
+  }
+
+  const unsigned char *record =
+    (const unsigned char *) Buffer::Data(args[1]->ToObject());
+  size_t len = Buffer::Length(args[1]->ToObject());
+  if (len < (size_t) BlockRecord::TXIDS_OFFSET ||
+      record[0] != BlockRecord::MARKER) {
+    return VException("Argument 'record' is not a block record");
+  }
+
+  const unsigned char *header = record + BlockRecord::HEADER_OFFSET;
+
+  entry_t e;
+  memcpy(e.hash, Buffer::Data(args[0]->ToObject()), 32);
+  memcpy(e.chainWork, record + BlockRecord::CHAINWORK_OFFSET, 32);
+  e.timestamp = read_le32(header + 68);
+  e.bits = read_le32(header + 72);
+
+  index->Insert(e, string((const char *) header + 4, 32));
+
+  return scope.Close(Undefined());
+}
+
+/**
+ * Arguments: hash. Returns the entry or null.
+ */
+Handle<Value>
+BlockIndex::Get(const Arguments& args)
+{
+  HandleScope scope;
+  BlockIndex *index = ObjectWrap::Unwrap<BlockIndex>(args.This());
+
+  int32_t pos = index->Find(args[0]);
+  if (pos == -2) {
+    return VException("Argument 'hash' must be a Buffer of length 32 bytes");
+  }
+  if (pos < 0) {
+    return scope.Close(Null());
+  }
+
+  return scope.Close(index->ToObject(pos));
+}
+
+/**
+ * Arguments: hash, height. Returns the entry of the block's ancestor at the
+ * given height, or null.
+ */
+Handle<Value>
+BlockIndex::GetAncestor(const Arguments& args)
+{
+  HandleScope scope;
+  BlockIndex *index = ObjectWrap::Unwrap<BlockIndex>(args.This());
+
+  if (args.Length() != 2 || !args[1]->IsNumber()) {
+    return VException("Two arguments expected: hash, height");
+  }
+  int32_t pos = index->Find(args[0]);
+  if (pos == -2) {
+    return VException("Argument 'hash' must be a Buffer of length 32 bytes");
+  }
+  if (args[1]->NumberValue() < 0) {
+    return scope.Close(Null());
+  }
+
+  pos = index->GetAncestor(pos, args[1]->Uint32Value());
+  if (pos < 0) {
+    return scope.Close(Null());
+  }
+
+  return scope.Close(index->ToObject(pos));
+}
+
+/**
+ * Arguments: hash. Returns the median timestamp of the block and the ones
+ * before it, or null if the block is unknown.
+ */
+Handle<Value>
+BlockIndex::GetMedianTimePast(const Arguments& args)
+{
+  HandleScope scope;
+  BlockIndex *index = ObjectWrap::Unwrap<BlockIndex>(args.This());
+
+  int32_t pos = index->Find(args[0]);
+  if (pos == -2) {
+    return VException("Argument 'hash' must be a Buffer of length 32 bytes");
+  }
+  if (pos < 0) {
+    return scope.Close(Null());
+  }
+
+  uint32_t times[MEDIAN_TIME_SPAN];
+  int count = 0;
+  for (; count < MEDIAN_TIME_SPAN && pos >= 0; count++) {
+    times[count] = index->entries[pos].timestamp;
+    pos = index->entries[pos].parent;
+  }
+  sort(times, times + count);
+
+  return scope.Close(Integer::NewFromUnsigned(times[count / 2]));
+}
+
+/**
+ * Arguments: hash, hash. Returns the entry of the last block both chains
+ * have in common, or null.
+ */
+Handle<Value>
+BlockIndex::FindFork(const Arguments& args)
+{
+  HandleScope scope;
+  BlockIndex *index = ObjectWrap::Unwrap<BlockIndex>(args.This());
+
+  if (args.Length() != 2) {
+    return VException("Two arguments expected: hash, hash");
+  }
+  int32_t a = index->Find(args[0]);
+  int32_t b = index->Find(args[1]);
+  if (a == -2 || b == -2) {
+    return VException("Arguments must be Buffers of length 32 bytes");
+  }
+  if (a < 0 || b < 0) {
+    return scope.Close(Null());
+  }
+
+  if (index->entries[a].height > index->entries[b].height) {
+    a = index->GetAncestor(a, index->entries[b].height);
+  } else {
+    b = index->GetAncestor(b, index->entries[a].height);
+  }
+
+  while (a != b && a >= 0 && b >= 0) {
+    a = index->entries[a].parent;
+    b = index->entries[b].parent;
+  }
+  if (a < 0 || b < 0) {
+    return scope.Close(Null());
+  }
+
+  return scope.Close(index->ToObject(a));
+}
+
+/**
+ * Arguments: hash. Returns the hashes of a block locator for the chain
+ * ending in that block, the same as BlockLocator.createFromBlockChain().
+ */
+Handle<Value>
+BlockIndex::GetLocator(const Arguments& args)
+{
+  HandleScope scope;
+  BlockIndex *index = ObjectWrap::Unwrap<BlockIndex>(args.This());
+
+  int32_t pos = index->Find(args[0]);
+  if (pos == -2) {
+    return VException("Argument 'hash' must be a Buffer of length 32 bytes");
+  }
+  if (pos < 0) {
+    return scope.Close(Null());
+  }
+
+  Local<Array> result = Array::New();
+  int64_t height = index->entries[pos].height;
+  int64_t step = 1;
+  uint32_t count = 0;
+  while (height > 0) {
+    pos = index->GetAncestor(pos, height);
+    result->Set(count++, copy_buffer(index->entries[pos].hash, 32));
+    if (count > 10) {
+      step *= 2;
+    }
+    height -= step;
+  }
+
+  return scope.Close(result);
+}
+
+Handle<Value>
+BlockIndex::GetStats(const Arguments& args)
+{
+  HandleScope scope;
+  BlockIndex *index = ObjectWrap::Unwrap<BlockIndex>(args.This());
+
+  Local<Object> result = Object::New();
+  result->Set(String::NewSymbol("size"),
+              Integer::NewFromUnsigned(index->entries.size()));
+  result->Set(String::NewSymbol("pending"),
+              Integer::NewFromUnsigned(index->pending.size()));
+
+  return scope.Close(result);
+}
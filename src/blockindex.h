@@ -0,0 +1,94 @@
+#ifndef BITCOINJS_SERVER_INCLUDE_BLOCKINDEX_H_
+#define BITCOINJS_SERVER_INCLUDE_BLOCKINDEX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <v8.h>
+#include <node.h>
+
+using namespace v8;
+using namespace node;
+
+/**
+ * In-memory index of all block headers the chain knows of.
+ *
+ * Every block is an entry in one array with its height, bits, timestamp,
+ * chainWork and the position of its parent, plus a skip pointer to an
+ * ancestor further down (the same scheme as bitcoind's CBlockIndex::pskip),
+ * so any ancestor is found in O(log n) steps.
+ *
+ * Blocks may be added in any order. A block whose parent is not known yet
+ * is held back until the parent is added, a block with the null hash as
+ * parent is a genesis block.
+ *
+ * Entries are returned as plain objects with the Block fields hash,
+ * prev_hash, height, bits, timestamp and chainWork.
+ */
+class BlockIndex : ObjectWrap
+{
+private:
+
+  struct entry_t {
+    unsigned char hash[32];
+
+    // Big endian and right aligned, like bignum.toBuffer()
+    unsigned char chainWork[32];
+
+    int32_t parent;
+    int32_t skip;
+    uint32_t height;
+    uint32_t bits;
+    uint32_t timestamp;
+  };
+
+  // A block waiting for its parent
+  struct pending_t {
+    entry_t entry;
+    std::string prevHash;
+  };
+
+  std::vector<entry_t> entries;
+  std::map<std::string, int32_t> positions;
+  std::multimap<std::string, pending_t> pending;
+
+  // Position of a hash Buffer, -1 if unknown or -2 if not a hash
+  int32_t Find(Handle<Value> hash) const;
+
+  int32_t GetAncestor(int32_t pos, uint32_t height) const;
+
+  // Adds a block and the blocks that were waiting for it
+  void Insert(const entry_t &entry, const std::string &prevHash);
+
+  Local<Object> ToObject(int32_t pos) const;
+
+public:
+
+  static Persistent<FunctionTemplate> s_ct;
+
+  static void Init(Handle<Object> target);
+
+  static Handle<Value> New(const Arguments& args);
+
+  static Handle<Value> Add(const Arguments& args);
+
+  static Handle<Value> AddRecord(const Arguments& args);
+
+  static Handle<Value> Get(const Arguments& args);
+
+  static Handle<Value> GetAncestor(const Arguments& args);
+
+  static Handle<Value> GetMedianTimePast(const Arguments& args);
+
+  static Handle<Value> FindFork(const Arguments& args);
+
+  static Handle<Value> GetLocator(const Arguments& args);
+
+  static Handle<Value> GetStats(const Arguments& args);
+};
+
+#endif
@@ -0,0 +1,211 @@
+#include <string.h>
+
+#include <v8.h>
+
+#include <node.h>
+#include <node_buffer.h>
+
+#include "blockrecord.h"
+#include "common.h"
+
+using namespace std;
+using namespace v8;
+using namespace node;
+
+#define CHAINWORK_SIZE 32
+
+static inline uint32_t read_le32(const unsigned char *p)
+{
+  return (uint32_t) p[0] | ((uint32_t) p[1] << 8) |
+    ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static inline void write_le32(unsigned char *p, uint32_t x)
+{
+  p[0] = x & 0xff;
+  p[1] = (x >> 8) & 0xff;
+  p[2] = (x >> 16) & 0xff;
+  p[3] = (x >> 24) & 0xff;
+}
+
+// Returns the Buffer in obj[name] if it has the given length (or at most
+// max_len bytes, if that is not 0)
+static bool
+get_buffer (Handle<Object> obj, const char *name, size_t len, size_t max_len,
+            const unsigned char **data, size_t *data_len)
+{
+  Local<Value> value = obj->Get(String::NewSymbol(name));
+  if (!Buffer::HasInstance(value)) {
+    return false;
+  }
+  Local<Object> buf = value->ToObject();
+  *data = (const unsigned char *) Buffer::Data(buf);
+  *data_len = Buffer::Length(buf);
+  return max_len ? *data_len <= max_len : *data_len == len;
+}
+
+static uint32_t
+get_uint32 (Handle<Object> obj, const char *name)
+{
+  return obj->Get(String::NewSymbol(name))->Uint32Value();
+}
+
+void
+BlockRecord::Init(Handle<Object> target)
+{
+  HandleScope scope;
+
+  target->Set(String::NewSymbol("encodeBlockRecord"),
+              FunctionTemplate::New(Encode)->GetFunction());
+  target->Set(String::NewSymbol("decodeBlockRecord"),
+              FunctionTemplate::New(Decode)->GetFunction());
+}
+
+/**
+ * Arguments: Block. Returns its record as a Buffer.
+ */
+Handle<Value>
+BlockRecord::Encode(const Arguments& args)
+{
+  HandleScope scope;
+
+  if (args.Length() != 1 || !args[0]->IsObject()) {
+    return VException("One argument expected: block");
+  }
+
+  Handle<Object> block = args[0]->ToObject();
+  const unsigned char *prev_hash, *merkle_root, *chain_work;
+  size_t len, chain_work_len;
+
+  if (!get_buffer(block, "prev_hash", 32, 0, &prev_hash, &len) ||
+      !get_buffer(block, "merkle_root", 32, 0, &merkle_root, &len)) {
+    return VException("Block fields 'prev_hash' and 'merkle_root' must be Buffers of length 32 bytes");
+  }
+  if (!get_buffer(block, "chainWork", 0, CHAINWORK_SIZE,
+                  &chain_work, &chain_work_len)) {
+    return VException("Block field 'chainWork' must be a Buffer of at most 32 bytes");
+  }
+
+  Local<Value> txs_value = block->Get(String::NewSymbol("txs"));
+  if (!txs_value->IsArray()) {
+    return VException("Block field 'txs' must be an Array");
+  }
+  Local<Array> txs = Local<Array>::Cast(txs_value);
+  uint32_t count = txs->Length();
+
+  Buffer *result = Buffer::New(TXIDS_OFFSET + 32 * (size_t) count);
+  unsigned char *out = (unsigned char *) Buffer::Data(result);
+
+  out[0] = MARKER;
+  out[1] = VERSION;
+  out[2] = block->Get(String::NewSymbol("active"))->BooleanValue() ? 1 : 0;
+  out[3] = 0;
+
+  unsigned char *header = out + HEADER_OFFSET;
+  write_le32(header, get_uint32(block, "version"));
+  memcpy(header + 4, prev_hash, 32);
+  memcpy(header + 36, merkle_root, 32);
+  write_le32(header + 68, get_uint32(block, "timestamp"));
+  write_le32(header + 72, get_uint32(block, "bits"));
+  write_le32(header + 76, get_uint32(block, "nonce"));
+
+  write_le32(out + HEIGHT_OFFSET, get_uint32(block, "height"));
+  write_le32(out + SIZE_OFFSET, get_uint32(block, "size"));
+
+  // Right aligned, so it reads back as the same number
+  memset(out + CHAINWORK_OFFSET, 0, CHAINWORK_SIZE - chain_work_len);
+  if (chain_work_len) {
+    memcpy(out + CHAINWORK_OFFSET + CHAINWORK_SIZE - chain_work_len,
+           chain_work, chain_work_len);
+  }
+
+  write_le32(out + COUNT_OFFSET, count);
+  for (uint32_t i = 0; i < count; i++) {
+    Local<Value> txid = txs->Get(i);
+    if (!Buffer::HasInstance(txid) || Buffer::Length(txid->ToObject()) != 32) {
+      return VException("Block field 'txs' must contain Buffers of length 32 bytes");
+    }
+    memcpy(out + TXIDS_OFFSET + 32 * (size_t) i,
+           Buffer::Data(txid->ToObject()), 32);
+  }
+
+  return scope.Close(result->handle_);
+}
+
+/**
+ * Arguments: record Buffer. Returns the data for a Block, with all hashes as
+ * slices of the record. Returns null if the Buffer is not a binary record
+ * (but, for example, an old JSON one) and throws if it is malformed.
+ */
+Handle<Value>
+BlockRecord::Decode(const Arguments& args)
+{
+  HandleScope scope;
+
+  if (args.Length() != 1 || !Buffer::HasInstance(args[0])) {
+    return VException("One argument expected: record Buffer");
+  }
+
+  Local<Object> buf = args[0]->ToObject();
+  const unsigned char *data = (const unsigned char *) Buffer::Data(buf);
+  size_t len = Buffer::Length(buf);
+
+  if (len == 0 || data[0] != MARKER) {
+    return scope.Close(Null());
+  }
+  if (len < TXIDS_OFFSET) {
+    return VException("Block record is truncated");
+  }
+  if (data[1] != VERSION) {
+    return VException("Unsupported block record version");
+  }
+
+  uint32_t count = read_le32(data + COUNT_OFFSET);
+  if ((len - TXIDS_OFFSET) / 32 != count || (len - TXIDS_OFFSET) % 32) {
+    return VException("Block record is truncated");
+  }
+
+  // Buffer.prototype.slice, for slices that share the record's memory
+  Local<Value> slice_value = buf->Get(String::NewSymbol("slice"));
+  if (!slice_value->IsFunction()) {
+    return VException("Argument 'record' has no slice() method");
+  }
+  Local<Function> slice = Local<Function>::Cast(slice_value);
+  Local<Value> argv[2];
+
+#define SLICE(start, size)                                              \
+  (argv[0] = Integer::NewFromUnsigned(start),                           \
+   argv[1] = Integer::NewFromUnsigned((start) + (size)),                \
+   slice->Call(buf, 2, argv))
+
+  const unsigned char *header = data + HEADER_OFFSET;
+  Local<Object> result = Object::New();
+  result->Set(String::NewSymbol("version"),
+              Integer::NewFromUnsigned(read_le32(header)));
+  result->Set(String::NewSymbol("prev_hash"), SLICE(HEADER_OFFSET + 4, 32));
+  result->Set(String::NewSymbol("merkle_root"),
+              SLICE(HEADER_OFFSET + 36, 32));
+  result->Set(String::NewSymbol("timestamp"),
+              Integer::NewFromUnsigned(read_le32(header + 68)));
+  result->Set(String::NewSymbol("bits"),
+              Integer::NewFromUnsigned(read_le32(header + 72)));
+  result->Set(String::NewSymbol("nonce"),
+              Integer::NewFromUnsigned(read_le32(header + 76)));
+  result->Set(String::NewSymbol("height"),
+              Integer::NewFromUnsigned(read_le32(data + HEIGHT_OFFSET)));
+  result->Set(String::NewSymbol("size"),
+              Integer::NewFromUnsigned(read_le32(data + SIZE_OFFSET)));
+  result->Set(String::NewSymbol("active"), Boolean::New(data[2] & 1));
+  result->Set(String::NewSymbol("chainWork"),
+              SLICE(CHAINWORK_OFFSET, CHAINWORK_SIZE));
+
+  Local<Array> txs = Array::New(count);
+  for (uint32_t i = 0; i < count; i++) {
+    txs->Set(i, SLICE(TXIDS_OFFSET + 32 * i, 32));
+  }
+  result->Set(String::NewSymbol("txs"), txs);
+
+#undef SLICE
+
+  return scope.Close(result);
+}
@@ -0,0 +1,47 @@
+#ifndef BITCOINJS_SERVER_INCLUDE_BLOCKRECORD_H_
+#define BITCOINJS_SERVER_INCLUDE_BLOCKRECORD_H_
+
+#include <v8.h>
+#include <node.h>
+
+using namespace v8;
+using namespace node;
+
+/**
+ * Binary block records, as stored by the LevelDB backend.
+ *
+ * A record has a fixed layout, all integers are little endian:
+ *
+ *   0    marker (0xfe), format version, flags (bit 0: active), 0
+ *   4    block header (80 bytes)
+ *   84   height
+ *   88   size
+ *   92   chainWork (32 bytes, big endian like bignum.toBuffer())
+ *   124  number of transactions
+ *   128  txids, 32 bytes each
+ *
+ * The marker can't start a JSON record, which is how records written by
+ * older versions are recognized.
+ */
+class BlockRecord
+{
+public:
+
+  static const unsigned char MARKER = 0xfe;
+  static const unsigned char VERSION = 1;
+
+  static const int HEADER_OFFSET = 4;
+  static const int HEIGHT_OFFSET = 84;
+  static const int SIZE_OFFSET = 88;
+  static const int CHAINWORK_OFFSET = 92;
+  static const int COUNT_OFFSET = 124;
+  static const int TXIDS_OFFSET = 128;
+
+  static void Init(Handle<Object> target);
+
+  static Handle<Value> Encode(const Arguments& args);
+
+  static Handle<Value> Decode(const Arguments& args);
+};
+
+#endif
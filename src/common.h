@@ -1,6 +1,8 @@
 #ifndef BITCOINJS_SERVER_INCLUDE_COMMON_H_
 #define BITCOINJS_SERVER_INCLUDE_COMMON_H_
 
+#include <stdlib.h>
+
 #include <v8.h>
 
 #define REQ_FUN_ARG(I, VAR)                                                            \
@@ -14,4 +16,11 @@ static v8::Handle<v8::Value> VException(const char *msg) {
     return v8::ThrowException(v8::Exception::Error(v8::String::New(msg)));
 }
 
+// Size of the libuv threadpool, same default as libuv itself
+static inline int GetThreadpoolSize() {
+    const char *val = getenv("UV_THREADPOOL_SIZE");
+    int size = val ? atoi(val) : 0;
+    return size > 0 ? size : 4;
+}
+
 #endif
@@ -1,4 +1,5 @@
 #include <string.h>
+#include <stdlib.h>
 
 #include <v8.h>
 
@@ -11,11 +12,16 @@
 
 #include "common.h"
 #include "eckey.h"
+#include "pubkeycache.h"
+#include "sigcache.h"
 
 using namespace std;
 using namespace v8;
 using namespace node;
 
+// Batches smaller than this are not worth splitting any further
+#define VERIFY_BATCH_MIN_CHUNK 16
+
 int static inline EC_KEY_regenerate_key(EC_KEY *eckey, const BIGNUM *priv_key)
 {
   int ok = 0;
@@ -61,11 +67,42 @@ void BitcoinKey::Generate()
 
   hasPublic = true;
   hasPrivate = true;
+  hasNativePublic = false;
+}
+
+/**
+ * Decodes the public key for the native engine.
+ *
+ * Must be called from the main thread before queueing a verification, so
+ * that the worker only ever reads nativePub.
+ */
+bool BitcoinKey::PrepareNativePublic()
+{
+  if (hasNativePublic) {
+    return true;
+  }
+
+  unsigned char pub[65];
+  unsigned char *pub_end = pub;
+  int pub_size = i2o_ECPublicKey(ec, NULL);
+  if (pub_size <= 0 || pub_size > (int)sizeof(pub) ||
+      i2o_ECPublicKey(ec, &pub_end) != pub_size) {
+    return false;
+  }
+
+  if (!PubKeyCache::Fetch(pub, pub_size, NULL, &nativePub, &hasNativePublic)) {
+    hasNativePublic = false;
+  }
+  return hasNativePublic;
 }
 
 int BitcoinKey::VerifySignature(const unsigned char *digest, int digest_len,
                     const unsigned char *sig, int sig_len)
 {
+  if (verifyEngine == VERIFY_ENGINE_SECP256K1 && hasNativePublic) {
+    return Secp256k1::Verify(&nativePub, digest, digest_len, sig, sig_len);
+  }
+
   return ECDSA_verify(0, digest, digest_len, sig, sig_len, ec);
 }
 
@@ -79,6 +116,61 @@ void BitcoinKey::EIO_VerifySignature(uv_work_t *req)
   );
 }
 
+bool BitcoinKey::VerifyCached(EC_KEY **ec,
+                              const unsigned char *pub, int pub_len,
+                              const unsigned char *digest, int digest_len,
+                              const unsigned char *sig, int sig_len)
+{
+  if (SigCache::Query(digest, digest_len, pub, pub_len, sig, sig_len)) {
+    return true;
+  }
+
+  int result;
+  if (verifyEngine == VERIFY_ENGINE_SECP256K1) {
+    Secp256k1::Point point;
+    bool has_point = false;
+    if (!PubKeyCache::Fetch(pub, pub_len, NULL, &point, &has_point) ||
+        !has_point) {
+      return false;
+    }
+    result = Secp256k1::Verify(&point, digest, digest_len, sig, sig_len);
+  } else {
+    if (*ec == NULL) {
+      *ec = EC_KEY_new_by_curve_name(NID_secp256k1);
+    }
+    if (*ec == NULL || !PubKeyCache::Fetch(pub, pub_len, *ec, NULL, NULL)) {
+      return false;
+    }
+    result = ECDSA_verify(0, digest, digest_len, sig, sig_len, *ec);
+  }
+
+  if (result != 1) {
+    return false;
+  }
+  SigCache::Insert(digest, digest_len, pub, pub_len, sig, sig_len);
+  return true;
+}
+
+void BitcoinKey::EIO_VerifyBatch(uv_work_t *req)
+{
+  verify_batch_chunk_t *c = static_cast<verify_batch_chunk_t *>(req->data);
+  verify_batch_baton_t *b = c->batch;
+
+  // One key per chunk, only its public point is replaced for each item
+  EC_KEY *ec = NULL;
+
+  for (int i = c->start; i < c->end; i++) {
+    verify_batch_item_t *item = &b->items[i];
+    b->results[i] = VerifyCached(&ec, item->pub, item->pubLen,
+                                 item->digest, item->digestLen,
+                                 item->sig, item->sigLen) ? 1 : 0;
+  }
+
+  if (ec != NULL) {
+    EC_KEY_free(ec);
+  }
+}
+
 ECDSA_SIG *BitcoinKey::Sign(const unsigned char *digest, int digest_len)
 {
   ECDSA_SIG *sig;
@@ -96,6 +188,8 @@ void BitcoinKey::Init(Handle<Object> target)
   HandleScope scope;
   Local<FunctionTemplate> t = FunctionTemplate::New(New);
 
+  PubKeyCache::Init();
+
   s_ct = Persistent<FunctionTemplate>::New(t);
   s_ct->InstanceTemplate()->SetInternalFieldCount(1);
   s_ct->SetClassName(String::NewSymbol("BitcoinKey"));
@@ -116,6 +210,11 @@ void BitcoinKey::Init(Handle<Object> target)
   // Static methods
   NODE_SET_METHOD(s_ct->GetFunction(), "generateSync", GenerateSync);
   NODE_SET_METHOD(s_ct->GetFunction(), "fromDER", FromDER);
+  NODE_SET_METHOD(s_ct->GetFunction(), "verifyBatch", VerifyBatch);
+  NODE_SET_METHOD(s_ct->GetFunction(), "setVerifyEngine", SetVerifyEngine);
+  NODE_SET_METHOD(s_ct->GetFunction(), "getVerifyEngine", GetVerifyEngine);
+  NODE_SET_METHOD(s_ct->GetFunction(), "getPubKeyCacheStats", GetPubKeyCacheStats);
+  NODE_SET_METHOD(s_ct->GetFunction(), "setPubKeyCacheSize", SetPubKeyCacheSize);
 
   target->Set(String::NewSymbol("BitcoinKey"),
               s_ct->GetFunction());
@@ -124,7 +223,8 @@ void BitcoinKey::Init(Handle<Object> target)
 BitcoinKey::BitcoinKey() :
   lastError(NULL),
   hasPrivate(false),
-  hasPublic(false)
+  hasPublic(false),
+  hasNativePublic(false)
 {
   ec = EC_KEY_new_by_curve_name(NID_secp256k1);
   if (ec == NULL) {
@@ -275,7 +375,15 @@ BitcoinKey::SetPublic(Local<String> property, Local<Value> value, const Accessor
   Handle<Object> buffer = value->ToObject();
   const unsigned char *data = (const unsigned char*) Buffer::Data(buffer);
 
-  if (!o2i_ECPublicKey(&(key->ec), &data, Buffer::Length(buffer))) {
+  key->hasNativePublic = false;
+
+  Secp256k1::Point *native = NULL;
+  if (verifyEngine == VERIFY_ENGINE_SECP256K1) {
+    native = &key->nativePub;
+  }
+
+  if (!PubKeyCache::Fetch(data, Buffer::Length(buffer), key->ec,
+                          native, &key->hasNativePublic)) {
     // TODO: Error
     return;
   }
@@ -295,6 +403,7 @@ BitcoinKey::RegenerateSync(const Arguments& args)
 
   EC_KEY *old = key->ec;
 
+  key->hasNativePublic = false;
   key->ec = EC_KEY_new_by_curve_name(NID_secp256k1);
   if (EC_KEY_regenerate_key(key->ec, EC_KEY_get0_private_key(old)) == 1) {
     key->hasPublic = true;
@@ -397,6 +506,10 @@ BitcoinKey::VerifySignature(const Arguments& args)
     return VException("Argument 'hash' must be Buffer of length 32 bytes");
   }
 
+  if (verifyEngine == VERIFY_ENGINE_SECP256K1) {
+    key->PrepareNativePublic();
+  }
+
   verify_sig_baton_t *baton = new verify_sig_baton_t();
   baton->key = key;
   baton->digest = (unsigned char *)Buffer::Data(hash_buf);
@@ -492,6 +605,10 @@ BitcoinKey::VerifySignatureSync(const Arguments& args)
     return VException("Argument 'hash' must be Buffer of length 32 bytes");
   }
 
+  if (verifyEngine == VERIFY_ENGINE_SECP256K1) {
+    key->PrepareNativePublic();
+  }
+
   // Verify signature
   int result = key->VerifySignature(hash_data, hash_len, sig_data, sig_len);
 
@@ -508,6 +625,159 @@ BitcoinKey::VerifySignatureSync(const Arguments& args)
   }
 }
 
+/**
+ * Verify many signatures with a single callback.
+ *
+ * Takes an array of {pubkey, hash, sig} objects and splits it into chunks
+ * that are verified on the libuv threadpool. The callback receives a Buffer
+ * bitmap where bit (i & 7) of byte (i >> 3) is set if signature i is valid.
+ */
+Handle<Value>
+BitcoinKey::VerifyBatch(const Arguments& args)
+{
+  HandleScope scope;
+
+  if (args.Length() != 2) {
+    return VException("Two arguments expected: items, callback");
+  }
+  if (!args[0]->IsArray()) {
+    return VException("Argument 'items' must be an Array");
+  }
+  REQ_FUN_ARG(1, cb);
+
+  Local<Array> items = Local<Array>::Cast(args[0]);
+  int count = items->Length();
+
+  Local<String> pubkey_sym = String::NewSymbol("pubkey");
+  Local<String> hash_sym = String::NewSymbol("hash");
+  Local<String> sig_sym = String::NewSymbol("sig");
+
+  // First pass: validate and measure
+  size_t total = 0;
+  for (int i = 0; i < count; i++) {
+    Local<Value> item = items->Get(i);
+    if (!item->IsObject()) {
+      return VException("Batch items must be objects: {pubkey, hash, sig}");
+    }
+    Local<Object> obj = item->ToObject();
+    Local<Value> pub = obj->Get(pubkey_sym);
+    Local<Value> hash = obj->Get(hash_sym);
+    Local<Value> sig = obj->Get(sig_sym);
+    if (!Buffer::HasInstance(pub) ||
+        !Buffer::HasInstance(hash) ||
+        !Buffer::HasInstance(sig)) {
+      return VException("Batch item fields 'pubkey', 'hash' and 'sig' must be of type Buffer");
+    }
+    if (Buffer::Length(hash->ToObject()) != 32) {
+      return VException("Batch item field 'hash' must be Buffer of length 32 bytes");
+    }
+    total += Buffer::Length(pub->ToObject()) + 32 +
+      Buffer::Length(sig->ToObject());
+  }
+
+  verify_batch_baton_t *baton = new verify_batch_baton_t();
+  baton->count = count;
+  baton->data = (unsigned char *)malloc(total > 0 ? total : 1);
+  baton->items = new verify_batch_item_t[count > 0 ? count : 1];
+  baton->results = (unsigned char *)calloc(count > 0 ? count : 1, 1);
+  baton->cb = Persistent<Function>::New(cb);
+
+  // Second pass: copy everything into one arena
+  unsigned char *p = baton->data;
+  for (int i = 0; i < count; i++) {
+    Local<Object> obj = items->Get(i)->ToObject();
+    Local<Object> pub = obj->Get(pubkey_sym)->ToObject();
+    Local<Object> hash = obj->Get(hash_sym)->ToObject();
+    Local<Object> sig = obj->Get(sig_sym)->ToObject();
+    verify_batch_item_t *item = &baton->items[i];
+
+    item->pubLen = Buffer::Length(pub);
+    memcpy(p, Buffer::Data(pub), item->pubLen);
+    item->pub = p;
+    p += item->pubLen;
+
+    item->digestLen = 32;
+    memcpy(p, Buffer::Data(hash), 32);
+    item->digest = p;
+    p += 32;
+
+    item->sigLen = Buffer::Length(sig);
+    memcpy(p, Buffer::Data(sig), item->sigLen);
+    item->sig = p;
+    p += item->sigLen;
+  }
+
+  // Split into at most one chunk per worker thread
+  int chunks = GetThreadpoolSize();
+  int maxChunks = (count + VERIFY_BATCH_MIN_CHUNK - 1) / VERIFY_BATCH_MIN_CHUNK;
+  if (chunks > maxChunks) chunks = maxChunks;
+  if (chunks < 1) chunks = 1;
+
+  baton->pending = chunks;
+
+  int chunkSize = count / chunks;
+  int remainder = count % chunks;
+  int start = 0;
+  for (int i = 0; i < chunks; i++) {
+    verify_batch_chunk_t *chunk = new verify_batch_chunk_t();
+    chunk->batch = baton;
+    chunk->start = start;
+    chunk->end = start + chunkSize + (i < remainder ? 1 : 0);
+    start = chunk->end;
+
+    uv_work_t *req = new uv_work_t;
+    req->data = chunk;
+
+    uv_queue_work(uv_default_loop(), req, EIO_VerifyBatch, VerifyBatchCallback);
+  }
+
+  return scope.Close(Undefined());
+}
+
+void
+BitcoinKey::VerifyBatchCallback(uv_work_t *req, int status)
+{
+  HandleScope scope;
+  verify_batch_chunk_t *chunk = static_cast<verify_batch_chunk_t *>(req->data);
+  verify_batch_baton_t *baton = chunk->batch;
+
+  delete chunk;
+  delete req;
+
+  // Wait for the remaining chunks
+  if (--baton->pending > 0) {
+    return;
+  }
+
+  Buffer *bitmap_buf = Buffer::New((baton->count + 7) / 8);
+  unsigned char *bitmap = (unsigned char *) Buffer::Data(bitmap_buf);
+  memset(bitmap, 0, Buffer::Length(bitmap_buf));
+  for (int i = 0; i < baton->count; i++) {
+    if (baton->results[i]) {
+      bitmap[i >> 3] |= 1 << (i & 7);
+    }
+  }
+
+  Local<Value> argv[2];
+  argv[0] = Local<Value>::New(Null());
+  argv[1] = Local<Value>::New(bitmap_buf->handle_);
+
+  TryCatch try_catch;
+
+  baton->cb->Call(Context::GetCurrent()->Global(), 2, argv);
+
+  baton->cb.Dispose();
+
+  free(baton->data);
+  free(baton->results);
+  delete [] baton->items;
+  delete baton;
+
+  if (try_catch.HasCaught()) {
+    FatalException(try_catch);
+  }
+}
+
 Handle<Value>
 BitcoinKey::SignSync(const Arguments& args)
 {
@@ -559,4 +829,88 @@ BitcoinKey::SignSync(const Arguments& args)
   return scope.Close(der_buf->handle_);
 }
 
+/**
+ * Select the implementation used by all signature verification methods.
+ *
+ * Accepts "openssl" or "secp256k1" and returns true if the requested engine
+ * is now active. If the native engine was not compiled in, OpenSSL stays
+ * selected and false is returned.
+ */
+Handle<Value>
+BitcoinKey::SetVerifyEngine(const Arguments& args)
+{
+  HandleScope scope;
+
+  if (args.Length() != 1 || !args[0]->IsString()) {
+    return VException("One argument expected: engine name");
+  }
+
+  String::AsciiValue name(args[0]->ToString());
+
+  if (strcmp(*name, "openssl") == 0) {
+    verifyEngine = VERIFY_ENGINE_OPENSSL;
+    return scope.Close(Boolean::New(true));
+  } else if (strcmp(*name, "secp256k1") == 0) {
+    if (!Secp256k1::Init()) {
+      return scope.Close(Boolean::New(false));
+    }
+    verifyEngine = VERIFY_ENGINE_SECP256K1;
+    return scope.Close(Boolean::New(true));
+  }
+
+  return VException("Unknown verify engine, expected 'openssl' or 'secp256k1'");
+}
+
+Handle<Value>
+BitcoinKey::GetVerifyEngine(const Arguments& args)
+{
+  HandleScope scope;
+
+  if (verifyEngine == VERIFY_ENGINE_SECP256K1) {
+    return scope.Close(String::New("secp256k1"));
+  }
+  return scope.Close(String::New("openssl"));
+}
+
+/**
+ * Returns the counters of the decoded public key cache.
+ */
+Handle<Value>
+BitcoinKey::GetPubKeyCacheStats(const Arguments& args)
+{
+  HandleScope scope;
+
+  uint64_t hits, misses;
+  size_t size, capacity;
+  PubKeyCache::GetStats(&hits, &misses, &size, &capacity);
+
+  Local<Object> stats = Object::New();
+  stats->Set(String::NewSymbol("hits"), Number::New((double) hits));
+  stats->Set(String::NewSymbol("misses"), Number::New((double) misses));
+  stats->Set(String::NewSymbol("size"), Number::New((double) size));
+  stats->Set(String::NewSymbol("capacity"), Number::New((double) capacity));
+
+  return scope.Close(stats);
+}
+
+/**
+ * Sets the maximum number of cached public keys, 0 disables the cache.
+ */
+Handle<Value>
+BitcoinKey::SetPubKeyCacheSize(const Arguments& args)
+{
+  HandleScope scope;
+
+  if (args.Length() != 1 || !args[0]->IsNumber() ||
+      args[0]->NumberValue() < 0) {
+    return VException("One argument expected: size (non-negative number)");
+  }
+
+  PubKeyCache::SetCapacity((size_t) args[0]->NumberValue());
+
+  return scope.Close(Undefined());
+}
+
 Persistent<FunctionTemplate> BitcoinKey::s_ct;
+BitcoinKey::verify_engine_t BitcoinKey::verifyEngine =
+  BitcoinKey::VERIFY_ENGINE_OPENSSL;
@@ -4,6 +4,8 @@
 #include <v8.h>
 #include <node.h>
 
+#include "secp256k1.h"
+
 using namespace v8;
 using namespace node;
 
@@ -17,8 +19,21 @@ private:
   bool hasPrivate;
   bool hasPublic;
 
+  // Public key decoded for the native engine, derived lazily from ec
+  Secp256k1::Point nativePub;
+  bool hasNativePublic;
+
+  enum verify_engine_t {
+    VERIFY_ENGINE_OPENSSL,
+    VERIFY_ENGINE_SECP256K1
+  };
+
+  static verify_engine_t verifyEngine;
+
   void Generate();
 
+  bool PrepareNativePublic();
+
   struct verify_sig_baton_t {
     // Parameters
     BitcoinKey *key;
@@ -40,6 +55,38 @@ private:
 
   static void EIO_VerifySignature(uv_work_t *req);
 
+  struct verify_batch_item_t {
+    const unsigned char *pub;
+    const unsigned char *digest;
+    const unsigned char *sig;
+    int pubLen;
+    int digestLen;
+    int sigLen;
+  };
+
+  struct verify_batch_baton_t {
+    // Parameters (copied, so the JS objects may change while we work)
+    unsigned char *data;
+    verify_batch_item_t *items;
+    int count;
+
+    // Result
+    // 1 = good, 0 = bad sig or unparseable key/sig
+    unsigned char *results;
+
+    // Number of chunks still in the threadpool
+    int pending;
+    Persistent<Function> cb;
+  };
+
+  struct verify_batch_chunk_t {
+    verify_batch_baton_t *batch;
+    int start;
+    int end;
+  };
+
+  static void EIO_VerifyBatch(uv_work_t *req);
+
   ECDSA_SIG *Sign(const unsigned char *digest, int digest_len);
 
 public:
@@ -53,6 +100,17 @@ public:
 
   static BitcoinKey* New();
 
+  /**
+   * Verifies a signature against a serialized public key with the selected
+   * engine. The signature cache is consulted first and updated on success.
+   * Safe to call from the threadpool; *ec is a scratch key for the OpenSSL
+   * engine, created on first use and freed by the caller.
+   */
+  static bool VerifyCached(EC_KEY **ec,
+                           const unsigned char *pub, int pub_len,
+                           const unsigned char *digest, int digest_len,
+                           const unsigned char *sig, int sig_len);
+
   static Handle<Value> New(const Arguments& args);
   static Handle<Value> GenerateSync(const Arguments& args);
 
@@ -86,8 +144,26 @@ public:
   static Handle<Value>
     VerifySignatureSync(const Arguments& args);
 
+  static Handle<Value>
+    VerifyBatch(const Arguments& args);
+
+  static void
+    VerifyBatchCallback(uv_work_t *req, int status);
+
   static Handle<Value>
     SignSync(const Arguments& args);
+
+  static Handle<Value>
+    SetVerifyEngine(const Arguments& args);
+
+  static Handle<Value>
+    GetVerifyEngine(const Arguments& args);
+
+  static Handle<Value>
+    GetPubKeyCacheStats(const Arguments& args);
+
+  static Handle<Value>
+    SetPubKeyCacheSize(const Arguments& args);
 };
 
 #endif
@@ -0,0 +1,376 @@
+#include <string.h>
+
+#include <v8.h>
+
+#include <node.h>
+#include <node_buffer.h>
+
+#include "common.h"
+#include "framer.h"
+#include "sha256.h"
+
+using namespace std;
+using namespace v8;
+using namespace node;
+
+// magic, command, length, [checksum]
+#define HEADER_SIZE_V1 20
+#define HEADER_SIZE 24
+#define COMMAND_SIZE 12
+
+static inline uint32_t read_le32(const unsigned char *p)
+{
+  return (uint32_t) p[0] | ((uint32_t) p[1] << 8) |
+    ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static Local<Object>
+copy_buffer (const unsigned char *data, size_t len)
+{
+  Buffer *result = Buffer::New(len);
+  memcpy(Buffer::Data(result), data, len);
+  return Local<Object>::New(result->handle_);
+}
+
+Persistent<FunctionTemplate> Framer::s_ct;
+
+void Framer::Init(Handle<Object> target)
+{
+  HandleScope scope;
+  Local<FunctionTemplate> t = FunctionTemplate::New(New);
+
+  s_ct = Persistent<FunctionTemplate>::New(t);
+  s_ct->InstanceTemplate()->SetInternalFieldCount(1);
+  s_ct->SetClassName(String::NewSymbol("Framer"));
+
+  // Accessors
+  s_ct->InstanceTemplate()->SetAccessor(String::New("length"), GetLength);
+
+  // Methods
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "push", Push);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "read", Read);
+
+  target->Set(String::NewSymbol("Framer"),
+              s_ct->GetFunction());
+  target->Set(String::NewSymbol("frameMessage"),
+              FunctionTemplate::New(FrameMessage)->GetFunction());
+  target->Set(String::NewSymbol("frameHeader"),
+              FunctionTemplate::New(FrameHeader)->GetFunction());
+}
+
+Framer::Framer(const unsigned char *magic) :
+  head(0),
+  tail(0),
+  skipped(0)
+{
+  memcpy(this->magic, magic, 4);
+}
+
+void Framer::Append(const unsigned char *buf, size_t len)
+{
+  if (len == 0) {
+    return;
+  }
+  if (head == tail) {
+    head = tail = 0;
+  }
+
+  if (len > data.size() - tail) {
+    // Reclaim the consumed bytes before growing
+    if (head > 0) {
+      memmove(&data[0], &data[head], tail - head);
+      tail -= head;
+      head = 0;
+    }
+    if (len > data.size() - tail) {
+      size_t size = data.size() * 2;
+      if (size < tail + len) {
+        size = tail + len;
+      }
+      data.resize(size);
+    }
+  }
+
+  memcpy(&data[tail], buf, len);
+  tail += len;
+}
+
+bool Framer::FindMagic()
+{
+  size_t pos = head;
+
+  while (pos < tail) {
+    const unsigned char *p = (const unsigned char *)
+      memchr(&data[pos], magic[0], tail - pos);
+    if (!p) {
+      break;
+    }
+    pos = p - &data[0];
+
+    // Could still be the start of a magic
+    if (tail - pos < 4) {
+      skipped += pos - head;
+      head = pos;
+      return false;
+    }
+
+    if (memcmp(p, magic, 4) == 0) {
+      skipped += pos - head;
+      head = pos;
+      return true;
+    }
+    pos++;
+  }
+
+  skipped += tail - head;
+  head = tail;
+  return false;
+}
+
+Handle<Value>
+Framer::New(const Arguments& args)
+{
+  if (!args.IsConstructCall()) {
+    return FromConstructorTemplate(s_ct, args);
+  }
+
+  HandleScope scope;
+
+  if (args.Length() != 1 || !Buffer::HasInstance(args[0]) ||
+      Buffer::Length(args[0]->ToObject()) != 4) {
+    return VException("Argument 'magic' must be a Buffer of length 4 bytes");
+  }
+
+  Framer *framer = new Framer(
+    (const unsigned char *) Buffer::Data(args[0]->ToObject()));
+  framer->Wrap(args.Holder());
+
+  return scope.Close(args.This());
+}
+
+Handle<Value>
+Framer::GetLength(Local<String> property, const AccessorInfo& info)
+{
+  HandleScope scope;
+  Framer *framer = ObjectWrap::Unwrap<Framer>(info.Holder());
+
+  return scope.Close(Number::New(framer->tail - framer->head));
+}
+
+/**
+ * Appends received data to the stream.
+ */
+Handle<Value>
+Framer::Push(const Arguments& args)
+{
+  HandleScope scope;
+  Framer *framer = ObjectWrap::Unwrap<Framer>(args.This());
+
+  if (args.Length() != 1 || !Buffer::HasInstance(args[0])) {
+    return VException("One argument expected: data Buffer");
+  }
+
+  Handle<Object> buf = args[0]->ToObject();
+  framer->Append((const unsigned char *) Buffer::Data(buf),
+                 Buffer::Length(buf));
+
+  return scope.Close(Undefined());
+}
+
+/**
+ * Removes all complete messages from the stream.
+ *
+ * Argument: whether the headers have a checksum (protocol version 209 and
+ * up). Returns an Array of {command, payload, skipped}, where skipped is
+ * the number of garbage bytes before the message. Messages with a bad
+ * checksum have a null payload, and carry `checksum` and `calcChecksum`.
+ *
+ * A 'version' message ends the batch, since it may change the header
+ * format of the messages after it.
+ */
+Handle<Value>
+Framer::Read(const Arguments& args)
+{
+  HandleScope scope;
+  Framer *framer = ObjectWrap::Unwrap<Framer>(args.This());
+
+  if (args.Length() != 1) {
+    return VException("One argument expected: checksummed");
+  }
+
+  bool checksummed = args[0]->BooleanValue();
+  size_t header_size = checksummed ? HEADER_SIZE : HEADER_SIZE_V1;
+
+  vector<frame_t> frames;
+  while (framer->FindMagic() && framer->tail - framer->head >= header_size) {
+    const unsigned char *header = &framer->data[framer->head];
+    size_t len = read_le32(header + 4 + COMMAND_SIZE);
+    if (framer->tail - framer->head - header_size < len) {
+      break;
+    }
+
+    frame_t frame;
+    frame.pos = framer->head;
+    frame.payloadPos = framer->head + header_size;
+    frame.payloadLen = len;
+    frame.skipped = framer->skipped;
+    frames.push_back(frame);
+
+    framer->skipped = 0;
+    framer->head += header_size + len;
+
+    if (memcmp(header + 4, "version\0\0\0\0\0", COMMAND_SIZE) == 0) {
+      break;
+    }
+  }
+
+  size_t count = frames.size();
+  vector<unsigned char> hashes(32 * count);
+  if (checksummed && count) {
+    vector<const unsigned char *> msgs(count);
+    vector<size_t> lens(count);
+    for (size_t i = 0; i < count; i++) {
+      msgs[i] = &framer->data[0] + frames[i].payloadPos;
+      lens[i] = frames[i].payloadLen;
+    }
+    Sha256::DoubleMany(&msgs[0], &lens[0], count, &hashes[0]);
+  }
+
+  Local<Array> result = Array::New(count);
+  for (size_t i = 0; i < count; i++) {
+    const frame_t &frame = frames[i];
+    const unsigned char *header = &framer->data[0] + frame.pos;
+    const unsigned char *payload = &framer->data[0] + frame.payloadPos;
+
+    size_t command_len = 0;
+    while (command_len < COMMAND_SIZE && header[4 + command_len]) {
+      command_len++;
+    }
+
+    Local<Object> obj = Object::New();
+    obj->Set(String::NewSymbol("command"),
+             String::New((const char *) header + 4, command_len));
+    obj->Set(String::NewSymbol("skipped"), Number::New(frame.skipped));
+
+    if (checksummed && memcmp(&hashes[32 * i], header + 20, 4) != 0) {
+      obj->Set(String::NewSymbol("payload"), Null());
+      obj->Set(String::NewSymbol("checksum"), copy_buffer(header + 20, 4));
+      obj->Set(String::NewSymbol("calcChecksum"),
+               copy_buffer(&hashes[32 * i], 4));
+    } else {
+      obj->Set(String::NewSymbol("payload"),
+               copy_buffer(payload, frame.payloadLen));
+    }
+
+    result->Set(i, obj);
+  }
+
+  return scope.Close(result);
+}
+
+Handle<Value>
+Framer::WriteHeader(const Arguments& args, unsigned char *out,
+                    size_t *header_size)
+{
+  if (args.Length() < 3 || args.Length() > 4) {
+    return VException("Arguments expected: magic, command, payload, [checksum]");
+  }
+  if (!Buffer::HasInstance(args[0]) ||
+      Buffer::Length(args[0]->ToObject()) != 4) {
+    return VException("Argument 'magic' must be a Buffer of length 4 bytes");
+  }
+  if (!args[1]->IsString()) {
+    return VException("Argument 'command' must be of type String");
+  }
+  if (!Buffer::HasInstance(args[2])) {
+    return VException("Argument 'payload' must be of type Buffer");
+  }
+
+  String::Utf8Value command(args[1]->ToString());
+  if (command.length() > COMMAND_SIZE) {
+    return VException("Command name too long");
+  }
+
+  Handle<Object> payload_buf = args[2]->ToObject();
+  const unsigned char *payload = (const unsigned char *) Buffer::Data(payload_buf);
+  size_t len = Buffer::Length(payload_buf);
+  if (len > 0xffffffff) {
+    return VException("Payload too large");
+  }
+
+  memcpy(out, Buffer::Data(args[0]->ToObject()), 4);
+  memset(out + 4, 0, COMMAND_SIZE);
+  memcpy(out + 4, *command, command.length());
+  out[16] = len & 0xff;
+  out[17] = (len >> 8) & 0xff;
+  out[18] = (len >> 16) & 0xff;
+  out[19] = (len >> 24) & 0xff;
+
+  // Checksum: computed if missing, given as a Buffer or omitted if false
+  Handle<Value> checksum = args.Length() > 3 ? args[3] : Handle<Value>();
+  if (checksum.IsEmpty() || checksum->IsUndefined() || checksum->IsNull()) {
+    unsigned char hash[32];
+    Sha256::DoubleMany(&payload, &len, 1, hash);
+    memcpy(out + 20, hash, 4);
+    *header_size = HEADER_SIZE;
+  } else if (checksum->IsBoolean() && !checksum->BooleanValue()) {
+    *header_size = HEADER_SIZE_V1;
+  } else if (Buffer::HasInstance(checksum) &&
+             Buffer::Length(checksum->ToObject()) == 4) {
+    memcpy(out + 20, Buffer::Data(checksum->ToObject()), 4);
+    *header_size = HEADER_SIZE;
+  } else {
+    return VException("Argument 'checksum' must be false or a Buffer of length 4 bytes");
+  }
+
+  return Handle<Value>();
+}
+
+/**
+ * Serializes a complete message into a single allocation.
+ *
+ * Arguments: magic, command, payload, [checksum]. The checksum is computed
+ * if it is missing, may be passed in if it is already known, or is left out
+ * of the header (protocol versions before 209) if it is false.
+ */
+Handle<Value>
+Framer::FrameMessage(const Arguments& args)
+{
+  HandleScope scope;
+
+  unsigned char header[HEADER_SIZE];
+  size_t header_size;
+  Handle<Value> err = WriteHeader(args, header, &header_size);
+  if (!err.IsEmpty()) {
+    return err;
+  }
+
+  Handle<Object> payload_buf = args[2]->ToObject();
+  size_t len = Buffer::Length(payload_buf);
+
+  Buffer *result = Buffer::New(header_size + len);
+  unsigned char *out = (unsigned char *) Buffer::Data(result);
+  memcpy(out, header, header_size);
+  memcpy(out + header_size, Buffer::Data(payload_buf), len);
+
+  return scope.Close(result->handle_);
+}
+
+/**
+ * Like frameMessage(), but returns only the header, so that a payload that
+ * goes to many peers can be written as is after it.
+ */
+Handle<Value>
+Framer::FrameHeader(const Arguments& args)
+{
+  HandleScope scope;
+
+  unsigned char header[HEADER_SIZE];
+  size_t header_size;
+  Handle<Value> err = WriteHeader(args, header, &header_size);
+  if (!err.IsEmpty()) {
+    return err;
+  }
+
+  return scope.Close(copy_buffer(header, header_size));
+}
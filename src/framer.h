@@ -0,0 +1,74 @@
+#ifndef BITCOINJS_SERVER_INCLUDE_FRAMER_H_
+#define BITCOINJS_SERVER_INCLUDE_FRAMER_H_
+
+#include <stddef.h>
+
+#include <vector>
+
+#include <v8.h>
+#include <node.h>
+
+using namespace v8;
+using namespace node;
+
+/**
+ * Splits the byte stream of a peer connection into protocol messages.
+ *
+ * Received data is appended to one growable buffer per connection, consumed
+ * bytes are reclaimed by moving the unread tail to the front once it is
+ * cheap to do so. read() scans for all complete messages at once and
+ * verifies their checksums with a single multi-buffer SHA256d call.
+ */
+class Framer : ObjectWrap
+{
+private:
+
+  unsigned char magic[4];
+
+  std::vector<unsigned char> data;
+  size_t head;
+  size_t tail;
+
+  // Garbage bytes skipped since the last returned frame
+  size_t skipped;
+
+  struct frame_t {
+    size_t pos;
+    size_t payloadPos;
+    size_t payloadLen;
+    size_t skipped;
+  };
+
+  void Append(const unsigned char *buf, size_t len);
+
+  // Moves head to the next magic, returns false if there is none yet
+  bool FindMagic();
+
+  // Checks the arguments of frameMessage() and frameHeader() and writes the
+  // header, returns an empty handle on success
+  static Handle<Value> WriteHeader(const Arguments& args, unsigned char *out,
+                                   size_t *header_size);
+
+public:
+
+  static Persistent<FunctionTemplate> s_ct;
+
+  static void Init(Handle<Object> target);
+
+  Framer(const unsigned char *magic);
+
+  static Handle<Value> New(const Arguments& args);
+
+  static Handle<Value>
+    GetLength(Local<String> property, const AccessorInfo& info);
+
+  static Handle<Value> Push(const Arguments& args);
+
+  static Handle<Value> Read(const Arguments& args);
+
+  static Handle<Value> FrameMessage(const Arguments& args);
+
+  static Handle<Value> FrameHeader(const Arguments& args);
+};
+
+#endif
@@ -0,0 +1,323 @@
+#include <string.h>
+
+#include <algorithm>
+
+#include <v8.h>
+
+#include <node.h>
+#include <node_buffer.h>
+
+#include "common.h"
+#include "headerchain.h"
+#include "sha256.h"
+
+using namespace std;
+using namespace v8;
+using namespace node;
+
+// Number of blocks the median time past is taken over
+#define MEDIAN_TIME_SPAN 11
+
+static inline uint32_t read_le32(const unsigned char *p)
+{
+  return (uint32_t) p[0] | ((uint32_t) p[1] << 8) |
+    ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint32_t
+get_uint32 (Handle<Object> obj, const char *name, uint32_t default_value)
+{
+  Local<Value> value = obj->Get(String::NewSymbol(name));
+  return value->IsUndefined() ? default_value : value->Uint32Value();
+}
+
+void
+HeaderChain::Init(Handle<Object> target)
+{
+  HandleScope scope;
+
+  target->Set(String::NewSymbol("validateHeaders"),
+              FunctionTemplate::New(ValidateHeaders)->GetFunction());
+}
+
+uint32_t
+HeaderChain::GetNextBits(const state_t &state, const params_t &params,
+                         uint32_t childTimestamp)
+{
+  uint32_t interval = params.targetTimespan / params.targetSpacing;
+
+  if (state.height == 0) {
+    return state.bits;
+  }
+
+  if ((state.height + 1) % interval != 0) {
+    if (params.testnet) {
+      // Special testnet difficulty rules, see Block.getNextWork()
+      if (childTimestamp >
+          (uint64_t) state.timestamp + params.targetSpacing * 2) {
+        return params.powLimit;
+      }
+      return state.lastNormalBits;
+    }
+    return state.bits;
+  }
+
+  // Determine how long the difficulty period really took, within limits
+  int64_t actual = (int64_t) state.timestamp - state.periodStart;
+  int64_t min_timespan = params.targetTimespan / 4;
+  int64_t max_timespan = (int64_t) params.targetTimespan * 4;
+  if (actual < min_timespan) {
+    actual = min_timespan;
+  }
+  if (actual > max_timespan) {
+    actual = max_timespan;
+  }
+
+  Uint256 pow_limit;
+  pow_limit.SetCompact(params.powLimit);
+
+  Uint256 target;
+  if (!target.SetCompact(state.bits) ||
+      !target.MulDiv((uint32_t) actual, params.targetTimespan) ||
+      target.Compare(pow_limit) > 0) {
+    target = pow_limit;
+  }
+
+  return target.GetCompact();
+}
+
+uint32_t
+HeaderChain::GetMedianTimePast(const state_t &state)
+{
+  vector<uint32_t> times(state.timestamps);
+  sort(times.begin(), times.end());
+  return times[times.size() / 2];
+}
+
+const char *
+HeaderChain::Connect(state_t &state, const params_t &params,
+                     const unsigned char *header, const unsigned char *hash)
+{
+  uint32_t timestamp = read_le32(header + 68);
+  uint32_t bits = read_le32(header + 72);
+
+  if (memcmp(header + 4, state.prevHash, 32) != 0) {
+    return "Header does not connect to the previous one";
+  }
+
+  // The hash is little endian, like the target
+  Uint256 target;
+  if (!target.SetCompact(bits) ||
+      Uint256::FromLE(hash).Compare(target) > 0) {
+    return "Difficulty target not met";
+  }
+
+  if (timestamp > params.maxTimestamp) {
+    return "Timestamp too far into the future";
+  }
+
+  if (bits != GetNextBits(state, params, timestamp)) {
+    return "Incorrect proof of work";
+  }
+
+  if (timestamp <= GetMedianTimePast(state)) {
+    return "Block's timestamp is too early";
+  }
+
+  uint32_t interval = params.targetTimespan / params.targetSpacing;
+
+  memcpy(state.prevHash, hash, 32);
+  state.height++;
+  state.bits = bits;
+  state.timestamp = timestamp;
+  if (state.height % interval == 0) {
+    state.periodStart = timestamp;
+  }
+  if (state.height % interval == 0 || bits != params.powLimit) {
+    state.lastNormalBits = bits;
+  }
+  state.timestamps.push_back(timestamp);
+  if (state.timestamps.size() > MEDIAN_TIME_SPAN) {
+    state.timestamps.erase(state.timestamps.begin());
+  }
+  state.chainWork += Uint256::WorkFromCompact(bits);
+
+  return NULL;
+}
+
+/**
+ * Arguments: headers Buffer (N * 80 bytes), parent context, callback
+ *
+ * The context describes the block the first header builds on:
+ *
+ *   hash, height, bits, chainWork (Buffer, big endian)
+ *   timestamps      timestamps of the block and up to ten before it,
+ *                   oldest first
+ *   periodStart     timestamp of the first block of its retarget period
+ *   lastNormalBits  (testnet only) bits of the last block that didn't use
+ *                   the minimum difficulty exception
+ *
+ * and the rules:
+ *
+ *   powLimit, targetTimespan, targetSpacing, testnet
+ *   maxTimestamp    (optional) latest acceptable header timestamp
+ *
+ * The callback receives an object with the index of the first invalid
+ * header and its error (-1 and null if all are valid), the chainWork after
+ * the last valid header as a 32 byte Buffer and the hashes of all headers.
+ */
+Handle<Value>
+HeaderChain::ValidateHeaders(const Arguments& args)
+{
+  HandleScope scope;
+
+  if (args.Length() != 3 || !Buffer::HasInstance(args[0]) ||
+      !args[1]->IsObject()) {
+    return VException("Three arguments expected: headers, context, callback");
+  }
+  REQ_FUN_ARG(2, cb);
+
+  Local<Object> headers = args[0]->ToObject();
+  size_t len = Buffer::Length(headers);
+  if (len % HEADER_SIZE) {
+    return VException("Argument 'headers' must be a multiple of 80 bytes long");
+  }
+
+  Local<Object> context = args[1]->ToObject();
+  Local<Value> hash = context->Get(String::NewSymbol("hash"));
+  if (!Buffer::HasInstance(hash) || Buffer::Length(hash->ToObject()) != 32) {
+    return VException("Context field 'hash' must be a Buffer of length 32 bytes");
+  }
+  Local<Value> chain_work = context->Get(String::NewSymbol("chainWork"));
+  if (!Buffer::HasInstance(chain_work) ||
+      Buffer::Length(chain_work->ToObject()) > 32) {
+    return VException("Context field 'chainWork' must be a Buffer of at most 32 bytes");
+  }
+  Local<Value> timestamps_value = context->Get(String::NewSymbol("timestamps"));
+  if (!timestamps_value->IsArray() ||
+      Local<Array>::Cast(timestamps_value)->Length() == 0) {
+    return VException("Context field 'timestamps' must be a non-empty Array");
+  }
+  Local<Array> timestamps = Local<Array>::Cast(timestamps_value);
+
+  validate_baton_t *baton = new validate_baton_t();
+  baton->headers = (const unsigned char *) Buffer::Data(headers);
+  baton->count = len / HEADER_SIZE;
+
+  params_t &params = baton->params;
+  params.powLimit = get_uint32(context, "powLimit", 0);
+  params.targetTimespan = get_uint32(context, "targetTimespan", 0);
+  params.targetSpacing = get_uint32(context, "targetSpacing", 0);
+  params.maxTimestamp = get_uint32(context, "maxTimestamp", 0xffffffff);
+  params.testnet = context->Get(String::NewSymbol("testnet"))->BooleanValue();
+  if (params.targetSpacing == 0 ||
+      params.targetTimespan < params.targetSpacing) {
+    delete baton;
+    return VException("Context fields 'targetTimespan' and 'targetSpacing' are invalid");
+  }
+
+  state_t &state = baton->state;
+  memcpy(state.prevHash, Buffer::Data(hash->ToObject()), 32);
+  state.height = get_uint32(context, "height", 0);
+  state.bits = get_uint32(context, "bits", 0);
+  state.periodStart = get_uint32(context, "periodStart", 0);
+  state.lastNormalBits = get_uint32(context, "lastNormalBits", state.bits);
+
+  uint32_t count = timestamps->Length();
+  uint32_t first = count > MEDIAN_TIME_SPAN ? count - MEDIAN_TIME_SPAN : 0;
+  for (uint32_t i = first; i < count; i++) {
+    state.timestamps.push_back(timestamps->Get(i)->Uint32Value());
+  }
+  state.timestamp = state.timestamps.back();
+
+  unsigned char work[32];
+  size_t work_len = Buffer::Length(chain_work->ToObject());
+  memset(work, 0, 32 - work_len);
+  memcpy(work + 32 - work_len, Buffer::Data(chain_work->ToObject()), work_len);
+  state.chainWork = Uint256::FromBE(work);
+
+  baton->headersBuf = Persistent<Object>::New(headers);
+  baton->failed = -1;
+  baton->error = NULL;
+  baton->cb = Persistent<Function>::New(cb);
+
+  uv_work_t *req = new uv_work_t();
+  req->data = baton;
+
+  uv_queue_work(uv_default_loop(), req, EIO_Validate, ValidateHeadersCallback);
+
+  return scope.Close(Undefined());
+}
+
+void
+HeaderChain::EIO_Validate(uv_work_t *req)
+{
+  validate_baton_t *baton = static_cast<validate_baton_t *>(req->data);
+
+  if (baton->count == 0) {
+    return;
+  }
+
+  vector<const unsigned char *> msgs(baton->count);
+  vector<size_t> lens(baton->count, HEADER_SIZE);
+  for (size_t i = 0; i < baton->count; i++) {
+    msgs[i] = baton->headers + HEADER_SIZE * i;
+  }
+  baton->hashes.resize(32 * baton->count);
+  Sha256::DoubleMany(&msgs[0], &lens[0], baton->count, &baton->hashes[0]);
+
+  for (size_t i = 0; i < baton->count; i++) {
+    const char *error = Connect(baton->state, baton->params, msgs[i],
+                                &baton->hashes[32 * i]);
+    if (error) {
+      baton->failed = i;
+      baton->error = error;
+      return;
+    }
+  }
+}
+
+void
+HeaderChain::ValidateHeadersCallback(uv_work_t *req, int status)
+{
+  HandleScope scope;
+  validate_baton_t *baton = static_cast<validate_baton_t *>(req->data);
+
+  baton->headersBuf.Dispose();
+
+  Buffer *chain_work = Buffer::New(32);
+  baton->state.chainWork.ToBE((unsigned char *) Buffer::Data(chain_work));
+
+  Buffer *hashes = Buffer::New(baton->hashes.size());
+  if (baton->hashes.size()) {
+    memcpy(Buffer::Data(hashes), &baton->hashes[0], baton->hashes.size());
+  }
+
+  Local<Object> result = Object::New();
+  result->Set(String::NewSymbol("failed"), Integer::New(baton->failed));
+  result->Set(String::NewSymbol("error"),
+              baton->error ?
+              Local<Value>::New(String::New(baton->error)) :
+              Local<Value>::New(Null()));
+  result->Set(String::NewSymbol("chainWork"),
+              Local<Object>::New(chain_work->handle_));
+  result->Set(String::NewSymbol("hashes"),
+              Local<Object>::New(hashes->handle_));
+
+  Local<Value> argv[2];
+  argv[0] = Local<Value>::New(Null());
+  argv[1] = result;
+
+  TryCatch try_catch;
+
+  baton->cb->Call(Context::GetCurrent()->Global(), 2, argv);
+
+  baton->cb.Dispose();
+
+  delete baton;
+  delete req;
+
+  if (try_catch.HasCaught()) {
+    FatalException(try_catch);
+  }
+}
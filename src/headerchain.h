@@ -0,0 +1,96 @@
+#ifndef BITCOINJS_SERVER_INCLUDE_HEADERCHAIN_H_
+#define BITCOINJS_SERVER_INCLUDE_HEADERCHAIN_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include <v8.h>
+#include <node.h>
+
+#include "uint256.h"
+
+using namespace v8;
+using namespace node;
+
+/**
+ * Validation of a run of block headers without their transactions.
+ *
+ * Applies the same checks as Block.checkBlock() (proof of work, timestamp
+ * not too far ahead) and Block.verifyChild() (difficulty, median time past)
+ * to each header, plus the link to the previous one. Everything runs in one
+ * threadpool job, the hashes of all headers are computed up front with the
+ * multi-buffer SHA-256.
+ */
+class HeaderChain
+{
+private:
+
+  // Chain state after the last valid header
+  struct state_t {
+    unsigned char prevHash[32];
+    uint32_t height;
+    uint32_t bits;
+    uint32_t timestamp;
+
+    // Timestamp of the first block of the current retarget period
+    uint32_t periodStart;
+
+    // Bits of the last block that didn't use testnet's minimum difficulty
+    uint32_t lastNormalBits;
+
+    // Timestamps of the last blocks for the median, oldest first
+    std::vector<uint32_t> timestamps;
+
+    Uint256 chainWork;
+  };
+
+  struct params_t {
+    uint32_t powLimit;
+    uint32_t targetTimespan;
+    uint32_t targetSpacing;
+    uint32_t maxTimestamp;
+    bool testnet;
+  };
+
+  struct validate_baton_t {
+    const unsigned char *headers;
+    size_t count;
+    Persistent<Object> headersBuf;
+
+    params_t params;
+    state_t state;
+
+    // Result
+    std::vector<unsigned char> hashes;
+    int failed;
+    const char *error;
+    Persistent<Function> cb;
+  };
+
+  // Bits the block after the current one must have
+  static uint32_t GetNextBits(const state_t &state, const params_t &params,
+                              uint32_t childTimestamp);
+
+  static uint32_t GetMedianTimePast(const state_t &state);
+
+  // Checks one header and updates the state. Returns an error or NULL.
+  static const char *Connect(state_t &state, const params_t &params,
+                             const unsigned char *header,
+                             const unsigned char *hash);
+
+  static void EIO_Validate(uv_work_t *req);
+
+public:
+
+  static const int HEADER_SIZE = 80;
+
+  static void Init(Handle<Object> target);
+
+  static Handle<Value> ValidateHeaders(const Arguments& args);
+
+  static void ValidateHeadersCallback(uv_work_t *req, int status);
+};
+
+#endif
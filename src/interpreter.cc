@@ -0,0 +1,1433 @@
+#include <string.h>
+
+#include <algorithm>
+
+#include <v8.h>
+
+#include <node.h>
+#include <node_buffer.h>
+
+#include <openssl/ecdsa.h>
+#include <openssl/ripemd.h>
+#include <openssl/sha.h>
+
+#include "common.h"
+#include "eckey.h"
+#include "interpreter.h"
+#include "sha256.h"
+
+using namespace std;
+using namespace v8;
+using namespace node;
+
+// Number of jobs a verifyInputs() worker takes at a time
+#define VERIFY_INPUTS_BATCH 16
+
+// Limits, same as the JS interpreter
+#define MAX_SCRIPT_SIZE 10000
+#define MAX_PUSH_SIZE 520
+#define MAX_OPS 201
+#define MAX_STACK_SIZE 1000
+#define MAX_MULTISIG_KEYS 20
+
+#define STACK_UNDERRUN "ScriptInterpreter.stackTop(): Stack underrun"
+
+// Entry i from the top of the stack, 1 is the top
+#define TOP(i) stack[stack.size() - (i)]
+
+#define NEED(n)                                                 \
+  if (stack.size() < (size_t) (n)) {                            \
+    return STACK_UNDERRUN;                                      \
+  }
+
+enum opcode_t {
+  OP_0 = 0x00,
+  OP_PUSHDATA1 = 0x4c,
+  OP_PUSHDATA2 = 0x4d,
+  OP_PUSHDATA4 = 0x4e,
+  OP_1NEGATE = 0x4f,
+  OP_1 = 0x51,
+  OP_16 = 0x60,
+
+  // control
+  OP_NOP = 0x61,
+  OP_IF = 0x63,
+  OP_NOTIF = 0x64,
+  OP_ELSE = 0x67,
+  OP_ENDIF = 0x68,
+  OP_VERIFY = 0x69,
+  OP_RETURN = 0x6a,
+
+  // stack ops
+  OP_TOALTSTACK = 0x6b,
+  OP_FROMALTSTACK = 0x6c,
+  OP_2DROP = 0x6d,
+  OP_2DUP = 0x6e,
+  OP_3DUP = 0x6f,
+  OP_2OVER = 0x70,
+  OP_2ROT = 0x71,
+  OP_2SWAP = 0x72,
+  OP_IFDUP = 0x73,
+  OP_DEPTH = 0x74,
+  OP_DROP = 0x75,
+  OP_DUP = 0x76,
+  OP_NIP = 0x77,
+  OP_OVER = 0x78,
+  OP_PICK = 0x79,
+  OP_ROLL = 0x7a,
+  OP_ROT = 0x7b,
+  OP_SWAP = 0x7c,
+  OP_TUCK = 0x7d,
+
+  // splice ops
+  OP_CAT = 0x7e,
+  OP_SUBSTR = 0x7f,
+  OP_LEFT = 0x80,
+  OP_RIGHT = 0x81,
+  OP_SIZE = 0x82,
+
+  // bit logic
+  OP_INVERT = 0x83,
+  OP_AND = 0x84,
+  OP_OR = 0x85,
+  OP_XOR = 0x86,
+  OP_EQUAL = 0x87,
+  OP_EQUALVERIFY = 0x88,
+
+  // numeric
+  OP_1ADD = 0x8b,
+  OP_1SUB = 0x8c,
+  OP_2MUL = 0x8d,
+  OP_2DIV = 0x8e,
+  OP_NEGATE = 0x8f,
+  OP_ABS = 0x90,
+  OP_NOT = 0x91,
+  OP_0NOTEQUAL = 0x92,
+  OP_ADD = 0x93,
+  OP_SUB = 0x94,
+  OP_MUL = 0x95,
+  OP_DIV = 0x96,
+  OP_MOD = 0x97,
+  OP_LSHIFT = 0x98,
+  OP_RSHIFT = 0x99,
+  OP_BOOLAND = 0x9a,
+  OP_BOOLOR = 0x9b,
+  OP_NUMEQUAL = 0x9c,
+  OP_NUMEQUALVERIFY = 0x9d,
+  OP_NUMNOTEQUAL = 0x9e,
+  OP_LESSTHAN = 0x9f,
+  OP_GREATERTHAN = 0xa0,
+  OP_LESSTHANOREQUAL = 0xa1,
+  OP_GREATERTHANOREQUAL = 0xa2,
+  OP_MIN = 0xa3,
+  OP_MAX = 0xa4,
+  OP_WITHIN = 0xa5,
+
+  // crypto
+  OP_RIPEMD160 = 0xa6,
+  OP_SHA1 = 0xa7,
+  OP_SHA256 = 0xa8,
+  OP_HASH160 = 0xa9,
+  OP_HASH256 = 0xaa,
+  OP_CODESEPARATOR = 0xab,
+  OP_CHECKSIG = 0xac,
+  OP_CHECKSIGVERIFY = 0xad,
+  OP_CHECKMULTISIG = 0xae,
+  OP_CHECKMULTISIGVERIFY = 0xaf,
+
+  // expansion
+  OP_NOP1 = 0xb0,
+  OP_NOP10 = 0xb9
+};
+
+// Data of empty stack entries and scripts
+static const unsigned char empty_value[1] = { 0 };
+
+static inline bool
+is_disabled (unsigned char opcode)
+{
+  return (opcode >= OP_CAT && opcode <= OP_RIGHT) ||
+    (opcode >= OP_INVERT && opcode <= OP_XOR) ||
+    opcode == OP_2MUL || opcode == OP_2DIV ||
+    (opcode >= OP_MUL && opcode <= OP_RSHIFT);
+}
+
+// Like ScriptInterpreter.castBool(), negative zero is false
+template <class T>
+static bool
+cast_bool (const T &item)
+{
+  const unsigned char *data = item.Data();
+  for (size_t i = 0; i < item.len; i++) {
+    if (data[i] != 0) {
+      return !(i == item.len - 1 && data[i] == 0x80);
+    }
+  }
+  return false;
+}
+
+// Like ScriptInterpreter.castBigint(), operands are limited to 4 bytes
+template <class T>
+static const char *
+cast_num (const T &item, int64_t *out)
+{
+  const unsigned char *data = item.Data();
+
+  if (item.len > 4) {
+    return "Bigint cast overflow (> 4 bytes)";
+  }
+
+  int64_t value = 0;
+  for (size_t i = 0; i < item.len; i++) {
+    value |= (int64_t) data[i] << (8 * i);
+  }
+  if (item.len && (data[item.len - 1] & 0x80)) {
+    value &= ~((int64_t) 0x80 << (8 * (item.len - 1)));
+    value = -value;
+  }
+
+  *out = value;
+  return NULL;
+}
+
+// Serializes a push the same way as Script.chunksToBuffer()
+static void
+write_push (vector<unsigned char> &out, const unsigned char *data, size_t len)
+{
+  if (len < OP_PUSHDATA1) {
+    out.push_back((unsigned char) len);
+  } else if (len <= 0xff) {
+    out.push_back(OP_PUSHDATA1);
+    out.push_back((unsigned char) len);
+  } else if (len <= 0xffff) {
+    out.push_back(OP_PUSHDATA2);
+    out.push_back(len & 0xff);
+    out.push_back((len >> 8) & 0xff);
+  } else {
+    out.push_back(OP_PUSHDATA4);
+    for (size_t i = 0; i < 4; i++) {
+      out.push_back((len >> (8 * i)) & 0xff);
+    }
+  }
+  out.insert(out.end(), data, data + len);
+}
+
+void Interpreter::Init(Handle<Object> target)
+{
+  HandleScope scope;
+
+  target->Set(String::NewSymbol("verifyScript"),
+              FunctionTemplate::New(Verify)->GetFunction());
+  target->Set(String::NewSymbol("verifyInputs"),
+              FunctionTemplate::New(VerifyInputs)->GetFunction());
+}
+
+Interpreter::Interpreter(const unsigned char *tx, size_t txLen,
+                         size_t inIndex, uint32_t hashType,
+                         SigHash *sigHash) :
+  tx(tx),
+  txLen(txLen),
+  inIndex(inIndex),
+  hashType(hashType),
+  sigHash(sigHash),
+  ownsSigHash(sigHash == NULL),
+  ec(NULL)
+{
+}
+
+Interpreter::~Interpreter()
+{
+  if (sigHash && ownsSigHash) {
+    delete sigHash;
+  }
+  if (ec) {
+    EC_KEY_free(ec);
+  }
+}
+
+void Interpreter::PushSpan(const unsigned char *data, size_t len)
+{
+  item_t item;
+  item.ptr = data;
+  item.len = len;
+  item.owned = false;
+  stack.push_back(item);
+}
+
+void Interpreter::PushCopy(const unsigned char *data, size_t len)
+{
+  item_t item;
+  item.ptr = NULL;
+  item.len = len;
+  item.owned = true;
+  memcpy(item.value, data, len);
+  stack.push_back(item);
+}
+
+// Minimal encoding, like ScriptInterpreter.bigintToBuffer()
+void Interpreter::PushNum(int64_t num)
+{
+  unsigned char buf[9];
+  size_t len = 0;
+  bool negative = num < 0;
+  uint64_t abs = negative ? -(uint64_t) num : (uint64_t) num;
+
+  while (abs) {
+    buf[len++] = abs & 0xff;
+    abs >>= 8;
+  }
+  if (len && (buf[len - 1] & 0x80)) {
+    buf[len++] = negative ? 0x80 : 0x00;
+  } else if (len && negative) {
+    buf[len - 1] |= 0x80;
+  }
+
+  PushCopy(buf, len);
+}
+
+// Results of comparisons and signature checks are a single byte
+void Interpreter::PushBool(bool value)
+{
+  unsigned char byte = value ? 1 : 0;
+  PushCopy(&byte, 1);
+}
+
+/**
+ * Serializes ops[start..] after removing the signatures, mirroring
+ * Script.findAndDelete() for each of them, including that a match directly
+ * following a removed one is kept.
+ */
+void
+Interpreter::BuildScriptCode(const vector<op_t> &ops, size_t start,
+                             const item_t *sigs, size_t count,
+                             vector<unsigned char> &out)
+{
+  vector<op_t> code(ops.begin() + start, ops.end());
+
+  for (size_t s = 0; s < count; s++) {
+    const unsigned char *sig = sigs[s].Data();
+    size_t len = code.size();
+    for (size_t i = 0; i < len; i++) {
+      if (i < code.size() && code[i].push && code[i].len == sigs[s].len &&
+          memcmp(code[i].data, sig, sigs[s].len) == 0) {
+        code.erase(code.begin() + i);
+      }
+    }
+  }
+
+  out.clear();
+  for (size_t i = 0; i < code.size(); i++) {
+    if (code[i].push) {
+      write_push(out, code[i].data, code[i].len);
+    } else {
+      out.push_back(code[i].opcode);
+    }
+  }
+}
+
+/**
+ * Same as ScriptInterpreter.checkSig(): the last byte of the signature is
+ * the hash type, which has to match the given one unless that is 0. Any
+ * failure counts as an invalid signature.
+ */
+bool
+Interpreter::CheckSig(const item_t &sig, const item_t &pub,
+                      const vector<unsigned char> &scriptCode)
+{
+  const unsigned char *sig_data = sig.Data();
+
+  if (!sig.len || !tx) {
+    return false;
+  }
+
+  uint32_t type = hashType;
+  if (type == 0) {
+    type = sig_data[sig.len - 1];
+  } else if (type != sig_data[sig.len - 1]) {
+    return false;
+  }
+
+  if (!sigHash) {
+    sigHash = new SigHash(tx, txLen);
+  }
+
+  unsigned char digest[32];
+  if (sigHash->Compute(inIndex,
+                       scriptCode.size() ? &scriptCode[0] : empty_value,
+                       scriptCode.size(), type, digest)) {
+    return false;
+  }
+
+  return BitcoinKey::VerifyCached(&ec, pub.Data(), pub.len, digest, 32,
+                                  sig_data, sig.len - 1);
+}
+
+const char *
+Interpreter::Eval(const unsigned char *script, size_t len)
+{
+  if (len > MAX_SCRIPT_SIZE) {
+    return "Oversized script (> 10k bytes)";
+  }
+
+  // Split into operations like Script.parse(), truncated pushes are cut short
+  vector<op_t> ops;
+  for (size_t pos = 0; pos < len; ) {
+    op_t op;
+    op.opcode = script[pos++];
+    op.push = op.opcode > OP_0 && op.opcode <= OP_PUSHDATA4;
+    op.data = NULL;
+    op.len = 0;
+
+    if (op.push) {
+      size_t size_len = op.opcode == OP_PUSHDATA1 ? 1 :
+        op.opcode == OP_PUSHDATA2 ? 2 : op.opcode == OP_PUSHDATA4 ? 4 : 0;
+      uint64_t push = op.opcode;
+
+      if (size_len) {
+        push = 0;
+        for (size_t i = 0; i < size_len && pos + i < len; i++) {
+          push |= (uint64_t) script[pos + i] << (8 * i);
+        }
+        pos = len - pos < size_len ? len : pos + size_len;
+      }
+      if (push > len - pos) {
+        push = len - pos;
+      }
+
+      op.data = script + pos;
+      op.len = (size_t) push;
+      pos += op.len;
+    }
+    ops.push_back(op);
+  }
+
+  vector<item_t> alt;
+  vector<bool> execStack;
+  size_t notExecuted = 0;
+  size_t hashStart = 0;
+  int opCount = 0;
+  vector<unsigned char> scriptCode;
+
+  for (size_t pc = 0; pc < ops.size(); ) {
+    const op_t &op = ops[pc++];
+    unsigned char opcode = op.opcode;
+
+    // Inside the inactive branch of an if statement, only the control
+    // flow is followed
+    bool exec = notExecuted == 0;
+
+    if (op.push) {
+      if (op.len > MAX_PUSH_SIZE) {
+        return "Max push value size exceeded (>520)";
+      }
+      if (exec) {
+        PushSpan(op.data, op.len);
+      }
+    } else {
+      if (opcode > OP_16 && ++opCount > MAX_OPS) {
+        return "Opcode limit exceeded (>200)";
+      }
+      if (is_disabled(opcode)) {
+        return "Encountered a disabled opcode";
+      }
+    }
+
+    if (!op.push && (exec || (OP_IF <= opcode && opcode <= OP_ENDIF))) {
+      switch (opcode) {
+      case OP_0:
+        PushSpan(empty_value, 0);
+        break;
+
+      case OP_1NEGATE:
+      case OP_1: case 0x52: case 0x53: case 0x54: case 0x55: case 0x56:
+      case 0x57: case 0x58: case 0x59: case 0x5a: case 0x5b: case 0x5c:
+      case 0x5d: case 0x5e: case 0x5f: case OP_16:
+        PushNum((int) opcode - (OP_1 - 1));
+        break;
+
+      case OP_NOP:
+      case OP_NOP1: case 0xb1: case 0xb2: case 0xb3: case 0xb4:
+      case 0xb5: case 0xb6: case 0xb7: case 0xb8: case OP_NOP10:
+        break;
+
+      case OP_IF:
+      case OP_NOTIF:
+        {
+          // <expression> if [statements] [else [statements]] endif
+          bool value = false;
+          if (exec) {
+            NEED(1);
+            value = cast_bool(TOP(1));
+            stack.pop_back();
+            if (opcode == OP_NOTIF) {
+              value = !value;
+            }
+          }
+          execStack.push_back(value);
+          if (!value) {
+            notExecuted++;
+          }
+        }
+        break;
+
+      case OP_ELSE:
+        if (execStack.empty()) {
+          return "Unmatched OP_ELSE";
+        }
+        if (execStack.back()) {
+          notExecuted++;
+        } else {
+          notExecuted--;
+        }
+        execStack.back() = !execStack.back();
+        break;
+
+      case OP_ENDIF:
+        if (execStack.empty()) {
+          return "Unmatched OP_ENDIF";
+        }
+        if (!execStack.back()) {
+          notExecuted--;
+        }
+        execStack.pop_back();
+        break;
+
+      case OP_VERIFY:
+        NEED(1);
+        if (!cast_bool(TOP(1))) {
+          return "OP_VERIFY negative";
+        }
+        stack.pop_back();
+        break;
+
+      case OP_RETURN:
+        return "OP_RETURN";
+
+      case OP_TOALTSTACK:
+        NEED(1);
+        alt.push_back(TOP(1));
+        stack.pop_back();
+        break;
+
+      case OP_FROMALTSTACK:
+        if (alt.empty()) {
+          return "OP_FROMALTSTACK with alt stack empty";
+        }
+        stack.push_back(alt.back());
+        alt.pop_back();
+        break;
+
+      case OP_2DROP:
+        // (x1 x2 -- )
+        NEED(2);
+        stack.resize(stack.size() - 2);
+        break;
+
+      case OP_2DUP:
+      case OP_3DUP:
+      case OP_2OVER:
+        {
+          // (x1 x2 -- x1 x2 x1 x2)
+          // (x1 x2 x3 -- x1 x2 x3 x1 x2 x3)
+          // (x1 x2 x3 x4 -- x1 x2 x3 x4 x1 x2)
+          size_t depth = opcode == OP_2DUP ? 2 : opcode == OP_3DUP ? 3 : 4;
+          size_t count = opcode == OP_3DUP ? 3 : 2;
+          NEED(depth);
+          size_t first = stack.size() - depth;
+          for (size_t i = 0; i < count; i++) {
+            item_t item = stack[first + i];
+            stack.push_back(item);
+          }
+        }
+        break;
+
+      case OP_2ROT:
+        {
+          // (x1 x2 x3 x4 x5 x6 -- x3 x4 x5 x6 x1 x2)
+          NEED(6);
+          item_t v1 = TOP(6);
+          item_t v2 = TOP(5);
+          stack.erase(stack.end() - 6, stack.end() - 4);
+          stack.push_back(v1);
+          stack.push_back(v2);
+        }
+        break;
+
+      case OP_2SWAP:
+        // (x1 x2 x3 x4 -- x3 x4 x1 x2)
+        NEED(4);
+        swap(TOP(4), TOP(2));
+        swap(TOP(3), TOP(1));
+        break;
+
+      case OP_IFDUP:
+        // (x - 0 | x x)
+        NEED(1);
+        if (cast_bool(TOP(1))) {
+          item_t item = TOP(1);
+          stack.push_back(item);
+        }
+        break;
+
+      case OP_DEPTH:
+        // -- stacksize
+        PushNum(stack.size());
+        break;
+
+      case OP_DROP:
+        // (x -- )
+        NEED(1);
+        stack.pop_back();
+        break;
+
+      case OP_DUP:
+        {
+          // (x -- x x)
+          NEED(1);
+          item_t item = TOP(1);
+          stack.push_back(item);
+        }
+        break;
+
+      case OP_NIP:
+        // (x1 x2 -- x2)
+        if (stack.size() < 2) {
+          return "OP_NIP insufficient stack size";
+        }
+        stack.erase(stack.end() - 2);
+        break;
+
+      case OP_OVER:
+        {
+          // (x1 x2 -- x1 x2 x1)
+          NEED(2);
+          item_t item = TOP(2);
+          stack.push_back(item);
+        }
+        break;
+
+      case OP_PICK:
+      case OP_ROLL:
+        {
+          // (xn ... x2 x1 x0 n - xn ... x2 x1 x0 xn)
+          // (xn ... x2 x1 x0 n - ... x2 x1 x0 xn)
+          NEED(1);
+          int64_t n;
+          const char *err = cast_num(TOP(1), &n);
+          if (err) {
+            return err;
+          }
+          stack.pop_back();
+          if (n < 0 || n >= (int64_t) stack.size()) {
+            return "OP_PICK/OP_ROLL insufficient stack size";
+          }
+          item_t item = TOP(n + 1);
+          if (opcode == OP_ROLL) {
+            stack.erase(stack.end() - n - 1);
+          }
+          stack.push_back(item);
+        }
+        break;
+
+      case OP_ROT:
+        // (x1 x2 x3 -- x2 x3 x1)
+        NEED(3);
+        swap(TOP(3), TOP(2));
+        swap(TOP(2), TOP(1));
+        break;
+
+      case OP_SWAP:
+        // (x1 x2 -- x2 x1)
+        NEED(2);
+        swap(TOP(2), TOP(1));
+        break;
+
+      case OP_TUCK:
+        {
+          // (x1 x2 -- x2 x1 x2)
+          if (stack.size() < 2) {
+            return "OP_TUCK insufficient stack size";
+          }
+          item_t item = TOP(1);
+          stack.insert(stack.end() - 2, item);
+        }
+        break;
+
+      case OP_SIZE:
+        // (in -- in size)
+        NEED(1);
+        PushNum(TOP(1).len);
+        break;
+
+      case OP_EQUAL:
+      case OP_EQUALVERIFY:
+        {
+          // (x1 x2 - bool)
+          NEED(2);
+          const item_t &v1 = TOP(2);
+          const item_t &v2 = TOP(1);
+          bool equal = v1.len == v2.len &&
+            memcmp(v1.Data(), v2.Data(), v1.len) == 0;
+          stack.resize(stack.size() - 2);
+          PushBool(equal);
+          if (opcode == OP_EQUALVERIFY) {
+            if (!equal) {
+              return "OP_EQUALVERIFY negative";
+            }
+            stack.pop_back();
+          }
+        }
+        break;
+
+      case OP_1ADD:
+      case OP_1SUB:
+      case OP_NEGATE:
+      case OP_ABS:
+      case OP_NOT:
+      case OP_0NOTEQUAL:
+        {
+          // (in -- out)
+          NEED(1);
+          int64_t num;
+          const char *err = cast_num(TOP(1), &num);
+          if (err) {
+            return err;
+          }
+          switch (opcode) {
+          case OP_1ADD:      num = num + 1; break;
+          case OP_1SUB:      num = num - 1; break;
+          case OP_NEGATE:    num = -num; break;
+          case OP_ABS:       num = num < 0 ? -num : num; break;
+          case OP_NOT:       num = num == 0; break;
+          case OP_0NOTEQUAL: num = num != 0; break;
+          }
+          stack.pop_back();
+          PushNum(num);
+        }
+        break;
+
+      case OP_ADD:
+      case OP_SUB:
+      case OP_BOOLAND:
+      case OP_BOOLOR:
+      case OP_NUMEQUAL:
+      case OP_NUMEQUALVERIFY:
+      case OP_NUMNOTEQUAL:
+      case OP_LESSTHAN:
+      case OP_GREATERTHAN:
+      case OP_LESSTHANOREQUAL:
+      case OP_GREATERTHANOREQUAL:
+      case OP_MIN:
+      case OP_MAX:
+        {
+          // (x1 x2 -- out)
+          NEED(2);
+          int64_t v1, v2, num = 0;
+          const char *err = cast_num(TOP(2), &v1);
+          if (!err) {
+            err = cast_num(TOP(1), &v2);
+          }
+          if (err) {
+            return err;
+          }
+          switch (opcode) {
+          case OP_ADD:                num = v1 + v2; break;
+          case OP_SUB:                num = v1 - v2; break;
+          case OP_BOOLAND:            num = v1 != 0 && v2 != 0; break;
+          case OP_BOOLOR:             num = v1 != 0 || v2 != 0; break;
+          case OP_NUMEQUAL:
+          case OP_NUMEQUALVERIFY:     num = v1 == v2; break;
+          case OP_NUMNOTEQUAL:        num = v1 != v2; break;
+          case OP_LESSTHAN:           num = v1 < v2; break;
+          case OP_GREATERTHAN:        num = v1 > v2; break;
+          case OP_LESSTHANOREQUAL:    num = v1 <= v2; break;
+          case OP_GREATERTHANOREQUAL: num = v1 >= v2; break;
+          case OP_MIN:                num = v1 < v2 ? v1 : v2; break;
+          case OP_MAX:                num = v1 > v2 ? v1 : v2; break;
+          }
+          stack.resize(stack.size() - 2);
+          PushNum(num);
+
+          if (opcode == OP_NUMEQUALVERIFY) {
+            if (!cast_bool(TOP(1))) {
+              return "OP_NUMEQUALVERIFY negative";
+            }
+            stack.pop_back();
+          }
+        }
+        break;
+
+      case OP_WITHIN:
+        {
+          // (x min max -- out)
+          NEED(3);
+          int64_t v1, v2, v3;
+          const char *err = cast_num(TOP(3), &v1);
+          if (!err) {
+            err = cast_num(TOP(2), &v2);
+          }
+          if (!err) {
+            err = cast_num(TOP(1), &v3);
+          }
+          if (err) {
+            return err;
+          }
+          stack.resize(stack.size() - 3);
+          PushNum(v1 >= v2 && v1 < v3);
+        }
+        break;
+
+      case OP_RIPEMD160:
+      case OP_SHA1:
+      case OP_SHA256:
+      case OP_HASH160:
+      case OP_HASH256:
+        {
+          // (in -- hash)
+          NEED(1);
+          item_t value = TOP(1);
+          stack.pop_back();
+
+          unsigned char hash[32];
+          size_t hash_len = 32;
+          if (opcode == OP_RIPEMD160) {
+            RIPEMD160(value.Data(), value.len, hash);
+            hash_len = RIPEMD160_DIGEST_LENGTH;
+          } else if (opcode == OP_SHA1) {
+            SHA1(value.Data(), value.len, hash);
+            hash_len = SHA_DIGEST_LENGTH;
+          } else {
+            Sha256::Stream stream;
+            stream.Write(value.Data(), value.len);
+            if (opcode == OP_HASH256) {
+              stream.FinalizeDouble(hash);
+            } else {
+              stream.Finalize(hash);
+            }
+            if (opcode == OP_HASH160) {
+              unsigned char sha[32];
+              memcpy(sha, hash, 32);
+              RIPEMD160(sha, 32, hash);
+              hash_len = RIPEMD160_DIGEST_LENGTH;
+            }
+          }
+          PushCopy(hash, hash_len);
+        }
+        break;
+
+      case OP_CODESEPARATOR:
+        // Hash starts after the code separator
+        hashStart = pc;
+        break;
+
+      case OP_CHECKSIG:
+      case OP_CHECKSIGVERIFY:
+        {
+          // (sig pubkey -- bool)
+          NEED(2);
+          item_t sig = TOP(2);
+          item_t pub = TOP(1);
+
+          // A signature can't sign itself
+          BuildScriptCode(ops, hashStart, &sig, 1, scriptCode);
+          bool success = CheckSig(sig, pub, scriptCode);
+
+          stack.resize(stack.size() - 2);
+          PushBool(success);
+          if (opcode == OP_CHECKSIGVERIFY) {
+            if (!success) {
+              return "OP_CHECKSIGVERIFY negative";
+            }
+            stack.pop_back();
+          }
+        }
+        break;
+
+      case OP_CHECKMULTISIG:
+      case OP_CHECKMULTISIGVERIFY:
+        {
+          // ([sig ...] num_of_signatures [pubkey ...] num_of_pubkeys -- bool)
+          NEED(1);
+          int64_t keysCount, sigsCount;
+          const char *err = cast_num(TOP(1), &keysCount);
+          if (err) {
+            return err;
+          }
+          stack.pop_back();
+          if (keysCount < 0 || keysCount > MAX_MULTISIG_KEYS) {
+            return "OP_CHECKMULTISIG keysCount out of bounds";
+          }
+          opCount += (int) keysCount;
+          if (opCount > MAX_OPS) {
+            return "Opcode limit exceeded (>200)";
+          }
+
+          // Keys and signatures in the order they are popped
+          vector<item_t> keys;
+          for (int64_t i = 0; i < keysCount; i++) {
+            NEED(1);
+            keys.push_back(TOP(1));
+            stack.pop_back();
+          }
+
+          NEED(1);
+          err = cast_num(TOP(1), &sigsCount);
+          if (err) {
+            return err;
+          }
+          stack.pop_back();
+          if (sigsCount < 0 || sigsCount > keysCount) {
+            return "OP_CHECKMULTISIG sigsCount out of bounds";
+          }
+
+          vector<item_t> sigs;
+          for (int64_t i = 0; i < sigsCount; i++) {
+            NEED(1);
+            sigs.push_back(TOP(1));
+            stack.pop_back();
+          }
+
+          // The original client pops an extra element off the stack, which
+          // can't be fixed without causing a chain split
+          NEED(1);
+          stack.pop_back();
+
+          BuildScriptCode(ops, hashStart, sigs.size() ? &sigs[0] : NULL,
+                          sigs.size(), scriptCode);
+
+          bool success = true;
+          size_t isig = 0, ikey = 0;
+          while (success && sigsCount > 0) {
+            if (CheckSig(sigs[isig], keys[ikey], scriptCode)) {
+              isig++;
+              sigsCount--;
+            } else {
+              ikey++;
+              keysCount--;
+
+              // If there are more signatures than keys left, then too many
+              // signatures have failed
+              if (sigsCount > keysCount) {
+                success = false;
+              }
+            }
+          }
+
+          PushBool(success);
+          if (opcode == OP_CHECKMULTISIGVERIFY) {
+            if (!success) {
+              return "OP_CHECKMULTISIGVERIFY negative";
+            }
+            stack.pop_back();
+          }
+        }
+        break;
+
+      default:
+        return "Unknown opcode encountered";
+      }
+    }
+
+    // Size limits
+    if (stack.size() + alt.size() > MAX_STACK_SIZE) {
+      return "Maximum stack size exceeded";
+    }
+  }
+
+  // Execution stack must be empty at the end of the script
+  if (!execStack.empty()) {
+    return "Execution stack ended non-empty";
+  }
+
+  return NULL;
+}
+
+/**
+ * Reads a script that consists of direct pushes (1 to 75 bytes) only,
+ * starting at pos. Returns false if there are other operations or more than
+ * max pushes.
+ */
+static bool
+read_pushes (const unsigned char *script, size_t len, size_t pos,
+             const unsigned char **data, size_t *lens, size_t max,
+             size_t *count)
+{
+  size_t n = 0;
+  while (pos < len) {
+    size_t push = script[pos++];
+    if (push < 1 || push >= OP_PUSHDATA1 || push > len - pos || n >= max) {
+      return false;
+    }
+    data[n] = script + pos;
+    lens[n] = push;
+    n++;
+    pos += push;
+  }
+  *count = n;
+  return true;
+}
+
+static inline bool
+is_small_int (unsigned char opcode)
+{
+  return opcode >= OP_1 && opcode <= OP_16;
+}
+
+/**
+ * Standard scripts, evaluated without the interpreter loop. Pay to pubkey
+ * hash, pay to pubkey and bare m-of-n multisig are matched byte for byte,
+ * together with a scriptSig of just the signatures (and the public key).
+ *
+ * The result, the final stack and errors are the same as from Eval(). Cases
+ * where Eval() would remove a signature from the script code are left to
+ * it. Returns false if the scripts don't match, without side effects.
+ */
+bool
+Interpreter::EvalTemplate(const unsigned char *scriptSig, size_t sigLen,
+                          const unsigned char *scriptPubKey, size_t pubKeyLen,
+                          const char **error)
+{
+  const unsigned char *data[MAX_MULTISIG_KEYS];
+  size_t lens[MAX_MULTISIG_KEYS];
+  size_t count;
+  vector<unsigned char> scriptCode(scriptPubKey, scriptPubKey + pubKeyLen);
+
+  *error = NULL;
+
+  if (pubKeyLen == 25 &&
+      scriptPubKey[0] == OP_DUP && scriptPubKey[1] == OP_HASH160 &&
+      scriptPubKey[2] == 20 && scriptPubKey[23] == OP_EQUALVERIFY &&
+      scriptPubKey[24] == OP_CHECKSIG) {
+    // <sig> <pubkey> | OP_DUP OP_HASH160 <hash> OP_EQUALVERIFY OP_CHECKSIG
+    if (!read_pushes(scriptSig, sigLen, 0, data, lens, 2, &count) ||
+        count != 2 ||
+        (lens[0] == 20 && memcmp(data[0], scriptPubKey + 3, 20) == 0)) {
+      return false;
+    }
+
+    PushSpan(data[0], lens[0]);
+    PushSpan(data[1], lens[1]);
+
+    unsigned char sha[32], hash[RIPEMD160_DIGEST_LENGTH];
+    Sha256::Stream stream;
+    stream.Write(data[1], lens[1]);
+    stream.Finalize(sha);
+    RIPEMD160(sha, 32, hash);
+    if (memcmp(hash, scriptPubKey + 3, 20) != 0) {
+      PushBool(false);
+      *error = "OP_EQUALVERIFY negative";
+      return true;
+    }
+  } else if (pubKeyLen >= 2 && scriptPubKey[0] >= 1 &&
+             scriptPubKey[0] < OP_PUSHDATA1 &&
+             pubKeyLen == (size_t) scriptPubKey[0] + 2 &&
+             scriptPubKey[pubKeyLen - 1] == OP_CHECKSIG) {
+    // <sig> | <pubkey> OP_CHECKSIG
+    if (!read_pushes(scriptSig, sigLen, 0, data, lens, 1, &count) ||
+        count != 1 ||
+        (lens[0] == scriptPubKey[0] &&
+         memcmp(data[0], scriptPubKey + 1, lens[0]) == 0)) {
+      return false;
+    }
+
+    PushSpan(data[0], lens[0]);
+    PushSpan(scriptPubKey + 1, scriptPubKey[0]);
+  } else if (pubKeyLen >= 3 && is_small_int(scriptPubKey[0]) &&
+             is_small_int(scriptPubKey[pubKeyLen - 2]) &&
+             scriptPubKey[pubKeyLen - 1] == OP_CHECKMULTISIG) {
+    // OP_0 <sig> ... | m <pubkey> ... n OP_CHECKMULTISIG
+    size_t m = scriptPubKey[0] - (OP_1 - 1);
+    size_t n = scriptPubKey[pubKeyLen - 2] - (OP_1 - 1);
+    const unsigned char *keys[MAX_MULTISIG_KEYS];
+    size_t keyLens[MAX_MULTISIG_KEYS];
+    size_t keyCount;
+
+    if (m > n ||
+        !read_pushes(scriptPubKey, pubKeyLen - 2, 1, keys, keyLens, n,
+                     &keyCount) ||
+        keyCount != n ||
+        sigLen < 1 || scriptSig[0] != OP_0 ||
+        !read_pushes(scriptSig, sigLen, 1, data, lens, m, &count) ||
+        count != m) {
+      return false;
+    }
+    for (size_t i = 0; i < m; i++) {
+      for (size_t j = 0; j < n; j++) {
+        if (lens[i] == keyLens[j] && memcmp(data[i], keys[j], lens[i]) == 0) {
+          return false;
+        }
+      }
+    }
+
+    // Same order as the loop in Eval(), starting with the topmost entries
+    bool success = true;
+    size_t isig = m, ikey = n;
+    while (success && isig > 0) {
+      item_t sig, pub;
+      sig.ptr = data[isig - 1];
+      sig.len = lens[isig - 1];
+      sig.owned = false;
+      pub.ptr = keys[ikey - 1];
+      pub.len = keyLens[ikey - 1];
+      pub.owned = false;
+
+      if (CheckSig(sig, pub, scriptCode)) {
+        isig--;
+      } else {
+        ikey--;
+
+        // If there are more signatures than keys left, then too many
+        // signatures have failed
+        if (isig > ikey) {
+          success = false;
+        }
+      }
+    }
+
+    PushBool(success);
+    return true;
+  } else {
+    return false;
+  }
+
+  // Both single signature templates end with OP_CHECKSIG on <sig> <pubkey>
+  item_t sig = TOP(2);
+  item_t pub = TOP(1);
+  bool success = CheckSig(sig, pub, scriptCode);
+  stack.resize(stack.size() - 2);
+  PushBool(success);
+  return true;
+}
+
+const char *
+Interpreter::EvalTwo(const unsigned char *scriptSig, size_t sigLen,
+                     const unsigned char *scriptPubKey, size_t pubKeyLen)
+{
+  const char *error;
+  if (stack.empty() &&
+      EvalTemplate(scriptSig, sigLen, scriptPubKey, pubKeyLen, &error)) {
+    return error;
+  }
+
+  error = Eval(scriptSig, sigLen);
+  if (!error) {
+    error = Eval(scriptPubKey, pubKeyLen);
+  }
+  return error;
+}
+
+bool Interpreter::GetResult() const
+{
+  return !stack.empty() && cast_bool(stack.back());
+}
+
+void Interpreter::EIO_Verify(uv_work_t *req)
+{
+  verify_baton_t *b = static_cast<verify_baton_t *>(req->data);
+
+  b->error = b->interp->EvalTwo(b->scriptSig, b->scriptSigLen,
+                                b->scriptPubKey, b->scriptPubKeyLen);
+}
+
+/**
+ * Evaluates a scriptSig and scriptPubKey on the threadpool.
+ *
+ * Arguments: scriptSig, scriptPubKey, serialized transaction (or null),
+ * input index, hash type (0 to take it from the signatures), callback. The
+ * callback receives an error if the scripts failed and the final stack as
+ * an Array of Buffers. Like with ScriptInterpreter.verify(), the result is
+ * the truth value of the top entry.
+ *
+ * The Buffers must not be modified until the callback has been called.
+ */
+Handle<Value>
+Interpreter::Verify(const Arguments& args)
+{
+  HandleScope scope;
+
+  if (args.Length() != 6) {
+    return VException("Six arguments expected: scriptSig, scriptPubKey, tx, inIndex, hashType, callback");
+  }
+  if (!Buffer::HasInstance(args[0]) || !Buffer::HasInstance(args[1])) {
+    return VException("Arguments 'scriptSig' and 'scriptPubKey' must be of type Buffer");
+  }
+  if (!args[2]->IsNull() && !args[2]->IsUndefined() &&
+      !Buffer::HasInstance(args[2])) {
+    return VException("Argument 'tx' must be null or of type Buffer");
+  }
+  if (!args[3]->IsUint32()) {
+    return VException("Argument 'inIndex' must be a non-negative integer");
+  }
+  if (!args[4]->IsUint32()) {
+    return VException("Argument 'hashType' must be a non-negative integer");
+  }
+  REQ_FUN_ARG(5, cb);
+
+  verify_baton_t *baton = new verify_baton_t();
+
+  Handle<Object> script_sig = args[0]->ToObject();
+  Handle<Object> script_pubkey = args[1]->ToObject();
+  baton->scriptSig = (const unsigned char *) Buffer::Data(script_sig);
+  baton->scriptSigLen = Buffer::Length(script_sig);
+  baton->scriptSigBuf = Persistent<Object>::New(script_sig);
+  baton->scriptPubKey = (const unsigned char *) Buffer::Data(script_pubkey);
+  baton->scriptPubKeyLen = Buffer::Length(script_pubkey);
+  baton->scriptPubKeyBuf = Persistent<Object>::New(script_pubkey);
+
+  const unsigned char *tx = NULL;
+  size_t tx_len = 0;
+  if (Buffer::HasInstance(args[2])) {
+    Handle<Object> tx_buf = args[2]->ToObject();
+    tx = (const unsigned char *) Buffer::Data(tx_buf);
+    tx_len = Buffer::Length(tx_buf);
+    baton->txBuf = Persistent<Object>::New(tx_buf);
+  }
+
+  baton->interp = new Interpreter(tx, tx_len, args[3]->Uint32Value(),
+                                  args[4]->Uint32Value());
+  baton->error = NULL;
+  baton->cb = Persistent<Function>::New(cb);
+
+  uv_work_t *req = new uv_work_t;
+  req->data = baton;
+
+  uv_queue_work(uv_default_loop(), req, EIO_Verify, VerifyCallback);
+
+  return scope.Close(Undefined());
+}
+
+void
+Interpreter::VerifyCallback(uv_work_t *req, int status)
+{
+  HandleScope scope;
+  verify_baton_t *baton = static_cast<verify_baton_t *>(req->data);
+  Interpreter *interp = baton->interp;
+
+  // The entries may still point into the scripts
+  Local<Array> stack = Array::New(interp->stack.size());
+  for (size_t i = 0; i < interp->stack.size(); i++) {
+    const item_t &item = interp->stack[i];
+    Buffer *item_buf = Buffer::New(item.len);
+    if (item.len) {
+      memcpy(Buffer::Data(item_buf), item.Data(), item.len);
+    }
+    stack->Set(i, Local<Object>::New(item_buf->handle_));
+  }
+
+  baton->scriptSigBuf.Dispose();
+  baton->scriptPubKeyBuf.Dispose();
+  if (!baton->txBuf.IsEmpty()) {
+    baton->txBuf.Dispose();
+  }
+
+  Local<Value> argv[2];
+  argv[0] = Local<Value>::New(Null());
+  argv[1] = stack;
+  if (baton->error) {
+    argv[0] = Exception::Error(String::New(baton->error));
+  }
+
+  TryCatch try_catch;
+
+  baton->cb->Call(Context::GetCurrent()->Global(), 2, argv);
+
+  baton->cb.Dispose();
+
+  delete interp;
+  delete baton;
+  delete req;
+
+  if (try_catch.HasCaught()) {
+    FatalException(try_catch);
+  }
+}
+
+// Whether a job before index i has failed
+static inline bool
+failed_before (volatile int *failed, int i)
+{
+  int f = *failed;
+  return f >= 0 && f < i;
+}
+
+void Interpreter::EIO_VerifyInputs(uv_work_t *req)
+{
+  verify_inputs_baton_t *b = static_cast<verify_inputs_baton_t *>(req->data);
+  int count = b->jobs.size();
+
+  // Inputs of one transaction are next to each other, so they mostly end up
+  // with the same worker and share its signature hashes
+  SigHash *sigHash = NULL;
+  const unsigned char *sigHashTx = NULL;
+
+  for (;;) {
+    int start = __sync_fetch_and_add(&b->next, VERIFY_INPUTS_BATCH);
+    if (start >= count || failed_before(&b->failed, start)) {
+      break;
+    }
+    int end = min(start + VERIFY_INPUTS_BATCH, count);
+
+    for (int i = start; i < end && !failed_before(&b->failed, i); i++) {
+      verify_inputs_job_t &job = b->jobs[i];
+
+      if (job.tx != sigHashTx) {
+        delete sigHash;
+        sigHash = new SigHash(job.tx, job.txLen);
+        sigHashTx = job.tx;
+      }
+
+      Interpreter interp(job.tx, job.txLen, job.inIndex, 0, sigHash);
+      const char *error = interp.EvalTwo(job.scriptSig, job.scriptSigLen,
+                                         job.scriptPubKey, job.scriptPubKeyLen);
+      if (!error && interp.stack.empty()) {
+        error = "Empty stack after script evaluation";
+      }
+
+      if (error || !interp.GetResult()) {
+        // Keep the lowest failing index. Jobs after it are skipped, the
+        // ones before it still run as they may fail too.
+        job.error = error;
+        int seen = b->failed;
+        while ((seen < 0 || i < seen) &&
+               !__sync_bool_compare_and_swap(&b->failed, seen, i)) {
+          seen = b->failed;
+        }
+      }
+    }
+  }
+
+  delete sigHash;
+}
+
+/**
+ * Verifies the inputs of a block on all threads of the threadpool.
+ *
+ * Arguments: Array of {tx, index, scriptSig, scriptPubKey} jobs, where tx is
+ * the serialized transaction, and a callback. The workers take jobs in
+ * batches and stop after the first input that fails, once the inputs before
+ * it are verified. The callback receives the error of that input, if its
+ * scripts failed, and its index in the Array, which is -1 if every input is
+ * valid. The hash type is taken from the signatures, like with
+ * Transaction.verifyInput().
+ *
+ * Jobs of the same transaction should be next to each other and use the
+ * same Buffer for it. The Buffers must not be modified until the callback
+ * has been called.
+ */
+Handle<Value>
+Interpreter::VerifyInputs(const Arguments& args)
+{
+  HandleScope scope;
+
+  if (args.Length() != 2) {
+    return VException("Two arguments expected: jobs, callback");
+  }
+  if (!args[0]->IsArray()) {
+    return VException("Argument 'jobs' must be an Array");
+  }
+  REQ_FUN_ARG(1, cb);
+
+  Local<Array> jobs = Local<Array>::Cast(args[0]);
+  int count = jobs->Length();
+
+  Local<String> tx_sym = String::NewSymbol("tx");
+  Local<String> index_sym = String::NewSymbol("index");
+  Local<String> script_sig_sym = String::NewSymbol("scriptSig");
+  Local<String> script_pubkey_sym = String::NewSymbol("scriptPubKey");
+
+  verify_inputs_baton_t *baton = new verify_inputs_baton_t();
+  baton->jobs.resize(count);
+
+  for (int i = 0; i < count; i++) {
+    Local<Value> item = jobs->Get(i);
+    if (!item->IsObject()) {
+      delete baton;
+      return VException("Jobs must be objects: {tx, index, scriptSig, scriptPubKey}");
+    }
+    Local<Object> obj = item->ToObject();
+    Local<Value> tx = obj->Get(tx_sym);
+    Local<Value> index = obj->Get(index_sym);
+    Local<Value> script_sig = obj->Get(script_sig_sym);
+    Local<Value> script_pubkey = obj->Get(script_pubkey_sym);
+    if (!Buffer::HasInstance(tx) ||
+        !Buffer::HasInstance(script_sig) ||
+        !Buffer::HasInstance(script_pubkey)) {
+      delete baton;
+      return VException("Job fields 'tx', 'scriptSig' and 'scriptPubKey' must be of type Buffer");
+    }
+    if (!index->IsUint32()) {
+      delete baton;
+      return VException("Job field 'index' must be a non-negative integer");
+    }
+
+    verify_inputs_job_t &job = baton->jobs[i];
+    job.tx = (const unsigned char *) Buffer::Data(tx->ToObject());
+    job.txLen = Buffer::Length(tx->ToObject());
+    job.scriptSig = (const unsigned char *) Buffer::Data(script_sig->ToObject());
+    job.scriptSigLen = Buffer::Length(script_sig->ToObject());
+    job.scriptPubKey =
+      (const unsigned char *) Buffer::Data(script_pubkey->ToObject());
+    job.scriptPubKeyLen = Buffer::Length(script_pubkey->ToObject());
+    job.inIndex = index->Uint32Value();
+    job.error = NULL;
+  }
+
+  baton->jobsArray = Persistent<Object>::New(jobs);
+  baton->next = 0;
+  baton->failed = -1;
+  baton->cb = Persistent<Function>::New(cb);
+
+  // One worker per thread, but no more than there are batches
+  int workers = GetThreadpoolSize();
+  int batches = (count + VERIFY_INPUTS_BATCH - 1) / VERIFY_INPUTS_BATCH;
+  if (workers > batches) workers = batches;
+  if (workers < 1) workers = 1;
+
+  baton->pending = workers;
+
+  for (int i = 0; i < workers; i++) {
+    uv_work_t *req = new uv_work_t;
+    req->data = baton;
+
+    uv_queue_work(uv_default_loop(), req, EIO_VerifyInputs,
+                  VerifyInputsCallback);
+  }
+
+  return scope.Close(Undefined());
+}
+
+void
+Interpreter::VerifyInputsCallback(uv_work_t *req, int status)
+{
+  HandleScope scope;
+  verify_inputs_baton_t *baton =
+    static_cast<verify_inputs_baton_t *>(req->data);
+
+  delete req;
+
+  // Wait for the remaining workers
+  if (--baton->pending > 0) {
+    return;
+  }
+
+  baton->jobsArray.Dispose();
+
+  Local<Value> argv[2];
+  argv[0] = Local<Value>::New(Null());
+  argv[1] = Integer::New(baton->failed);
+  if (baton->failed >= 0 && baton->jobs[baton->failed].error) {
+    argv[0] = Exception::Error(String::New(baton->jobs[baton->failed].error));
+  }
+
+  TryCatch try_catch;
+
+  baton->cb->Call(Context::GetCurrent()->Global(), 2, argv);
+
+  baton->cb.Dispose();
+
+  delete baton;
+
+  if (try_catch.HasCaught()) {
+    FatalException(try_catch);
+  }
+}
@@ -0,0 +1,173 @@
+#ifndef BITCOINJS_SERVER_INCLUDE_INTERPRETER_H_
+#define BITCOINJS_SERVER_INCLUDE_INTERPRETER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include <v8.h>
+#include <node.h>
+
+#include <openssl/ec.h>
+
+#include "sighash.h"
+
+using namespace v8;
+using namespace node;
+
+/**
+ * Script interpreter.
+ *
+ * Evaluates a scriptSig and the scriptPubKey it spends with the same
+ * semantics as ScriptInterpreter.evalTwo() in JS, but without a callback or
+ * an allocation per opcode. Stack entries are spans pointing into the
+ * scripts, only computed values (numbers, hashes, booleans) are stored in
+ * the entry itself. Signatures are checked with the signature cache and
+ * BitcoinKey's verification engine directly.
+ *
+ * The disabled opcodes (OP_CAT, OP_MUL, ...) are always rejected, like with
+ * ScriptInterpreter.disableUnsafeOpcodes.
+ *
+ * An instance evaluates the scripts of one input and may be used on the
+ * threadpool. The scripts and transaction must stay alive and unchanged
+ * until it is destroyed.
+ */
+class Interpreter
+{
+private:
+
+  struct op_t {
+    unsigned char opcode;
+    bool push;
+    const unsigned char *data;
+    size_t len;
+  };
+
+  struct item_t {
+    const unsigned char *ptr;
+    size_t len;
+    bool owned;
+    unsigned char value[32];
+
+    const unsigned char *Data() const { return owned ? value : ptr; }
+  };
+
+  const unsigned char *tx;
+  size_t txLen;
+  size_t inIndex;
+  uint32_t hashType;
+
+  std::vector<item_t> stack;
+
+  // Created on the first signature check, unless shared with other inputs
+  SigHash *sigHash;
+  bool ownsSigHash;
+  EC_KEY *ec;
+
+  struct verify_baton_t {
+    Interpreter *interp;
+    const unsigned char *scriptSig;
+    const unsigned char *scriptPubKey;
+    size_t scriptSigLen;
+    size_t scriptPubKeyLen;
+    Persistent<Object> scriptSigBuf;
+    Persistent<Object> scriptPubKeyBuf;
+    Persistent<Object> txBuf;
+
+    // Result
+    const char *error;
+    Persistent<Function> cb;
+  };
+
+  struct verify_inputs_job_t {
+    const unsigned char *tx;
+    const unsigned char *scriptSig;
+    const unsigned char *scriptPubKey;
+    size_t txLen;
+    size_t scriptSigLen;
+    size_t scriptPubKeyLen;
+    uint32_t inIndex;
+
+    // Set by the worker that evaluated the job
+    const char *error;
+  };
+
+  struct verify_inputs_baton_t {
+    std::vector<verify_inputs_job_t> jobs;
+
+    // Keeps the Buffers alive
+    Persistent<Object> jobsArray;
+
+    // Next job to be taken by a worker
+    volatile int next;
+
+    // Result
+    // Index of the first failed job, -1 if all are valid. Workers finish the
+    // jobs before it, so a lower failing index always replaces it.
+    volatile int failed;
+
+    // Number of workers still in the threadpool
+    int pending;
+    Persistent<Function> cb;
+  };
+
+  // Entries that point into a script, and small computed values
+  void PushSpan(const unsigned char *data, size_t len);
+  void PushCopy(const unsigned char *data, size_t len);
+  void PushNum(int64_t num);
+  void PushBool(bool value);
+
+  // Script code for signature checks, see Script.findAndDelete()
+  static void BuildScriptCode(const std::vector<op_t> &ops, size_t start,
+                              const item_t *sigs, size_t count,
+                              std::vector<unsigned char> &out);
+
+  bool CheckSig(const item_t &sig, const item_t &pub,
+                const std::vector<unsigned char> &scriptCode);
+
+  bool EvalTemplate(const unsigned char *scriptSig, size_t sigLen,
+                    const unsigned char *scriptPubKey, size_t pubKeyLen,
+                    const char **error);
+
+  static void EIO_Verify(uv_work_t *req);
+  static void EIO_VerifyInputs(uv_work_t *req);
+
+public:
+
+  /**
+   * A given sigHash must belong to tx and is used instead of creating one,
+   * so the inputs of a transaction can share it.
+   */
+  Interpreter(const unsigned char *tx, size_t txLen,
+              size_t inIndex, uint32_t hashType, SigHash *sigHash = NULL);
+  ~Interpreter();
+
+  /**
+   * Runs a scriptSig and then the scriptPubKey it spends, on an empty stack.
+   * Standard scripts take a shortcut. Returns an error message or NULL.
+   */
+  const char *EvalTwo(const unsigned char *scriptSig, size_t sigLen,
+                      const unsigned char *scriptPubKey, size_t pubKeyLen);
+
+  /**
+   * Runs a script on the current stack. Returns an error message (the same
+   * as the JS interpreter's) or NULL on success.
+   */
+  const char *Eval(const unsigned char *script, size_t len);
+
+  // Like ScriptInterpreter.getResult() without the error for an empty stack
+  bool GetResult() const;
+
+  static void Init(Handle<Object> target);
+
+  static Handle<Value> Verify(const Arguments& args);
+
+  static void VerifyCallback(uv_work_t *req, int status);
+
+  static Handle<Value> VerifyInputs(const Arguments& args);
+
+  static void VerifyInputsCallback(uv_work_t *req, int status);
+};
+
+#endif
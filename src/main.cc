@@ -2,6 +2,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <stdio.h>
+#include <vector>
 
 #include <v8.h>
 
@@ -19,6 +20,19 @@
 
 #include "common.h"
 #include "eckey.h"
+#include "sigcache.h"
+#include "sha256.h"
+#include "miner.h"
+#include "txparser.h"
+#include "framer.h"
+#include "sighash.h"
+#include "interpreter.h"
+#include "utxoset.h"
+#include "blockrecord.h"
+#include "blockfile.h"
+#include "blockindex.h"
+#include "headerchain.h"
+#include "uint256.h"
 
 using namespace std;
 using namespace v8;
@@ -29,13 +43,21 @@ pubkey_to_address256 (const Arguments& args)
 {
   HandleScope scope;
   
-  if (args.Length() != 1) {
-    return VException("One argument expected: pubkey Buffer");
+  if (args.Length() < 1 || args.Length() > 2) {
+    return VException("Arguments expected: pubkey Buffer, [version]");
   }
   if (!Buffer::HasInstance(args[0])) {
     return VException("One argument expected: pubkey Buffer");
   }
+  if (args.Length() > 1 && !args[1]->IsUndefined() &&
+      (!args[1]->IsUint32() || args[1]->Uint32Value() > 255)) {
+    return VException("Argument 'version' must be a number from 0 to 255");
+  }
   v8::Handle<v8::Object> pub_buf = args[0]->ToObject();
+  unsigned char version = 0;
+  if (args.Length() > 1 && !args[1]->IsUndefined()) {
+    version = (unsigned char) args[1]->Uint32Value();
+  }
   
   unsigned char *pub_data = (unsigned char *) Buffer::Data(pub_buf);
   
@@ -53,10 +75,9 @@ pubkey_to_address256 (const Arguments& args)
   RIPEMD160_Update(&c2, hash1, SHA256_DIGEST_LENGTH);
   RIPEMD160_Final(hash2, &c2);
   
-  // x = '\x00' + ripemd160(sha256(pubkey))
-  // LATER: make the version an optional argument
+  // x = version + ripemd160(sha256(pubkey))
   unsigned char address256[1 + RIPEMD160_DIGEST_LENGTH + 4];
-  address256[0] = 0;
+  address256[0] = version;
   memcpy(address256 + 1, hash2, RIPEMD160_DIGEST_LENGTH);
   
   // sha256(x)
@@ -78,8 +99,896 @@ pubkey_to_address256 (const Arguments& args)
 }
 
 
+/**
+ * Resolves the optional (out, offset) arguments of the hash functions.
+ *
+ * If no output Buffer was given, a new one of `len` bytes is allocated.
+ * Returns NULL and throws if the arguments are invalid.
+ */
+static unsigned char *
+hash_output (const Arguments& args, int first, size_t len,
+             Handle<Object> *out_buf)
+{
+  if (args.Length() <= first || args[first]->IsUndefined() ||
+      args[first]->IsNull()) {
+    Buffer *buf = Buffer::New(len);
+    *out_buf = buf->handle_;
+    return (unsigned char *) Buffer::Data(buf);
+  }
+
+  if (!Buffer::HasInstance(args[first])) {
+    VException("Argument 'out' must be of type Buffer");
+    return NULL;
+  }
+  *out_buf = args[first]->ToObject();
+
+  size_t offset = 0;
+  if (args.Length() > first + 1 && !args[first + 1]->IsUndefined()) {
+    if (!args[first + 1]->IsNumber() || args[first + 1]->NumberValue() < 0) {
+      VException("Argument 'offset' must be a non-negative number");
+      return NULL;
+    }
+    offset = (size_t) args[first + 1]->NumberValue();
+  }
+
+  if (offset > Buffer::Length(*out_buf) ||
+      Buffer::Length(*out_buf) - offset < len) {
+    VException("Output Buffer too small");
+    return NULL;
+  }
+
+  return (unsigned char *) Buffer::Data(*out_buf) + offset;
+}
+
+/**
+ * sha256(sha256(data)), optionally written to out at offset.
+ */
+static Handle<Value>
+sha256d (const Arguments& args)
+{
+  HandleScope scope;
+
+  if (args.Length() < 1 || !Buffer::HasInstance(args[0])) {
+    return VException("Argument 'data' must be of type Buffer");
+  }
+  Handle<Object> data_buf = args[0]->ToObject();
+
+  Handle<Object> out_buf;
+  unsigned char *out = hash_output(args, 1, SHA256_DIGEST_LENGTH, &out_buf);
+  if (out == NULL) {
+    return Undefined();
+  }
+
+  unsigned char hash1[SHA256_DIGEST_LENGTH];
+  SHA256((unsigned char *) Buffer::Data(data_buf), Buffer::Length(data_buf),
+         hash1);
+  SHA256(hash1, SHA256_DIGEST_LENGTH, out);
+
+  return scope.Close(out_buf);
+}
+
+/**
+ * ripemd160(sha256(data)), optionally written to out at offset.
+ */
+static Handle<Value>
+hash160 (const Arguments& args)
+{
+  HandleScope scope;
+
+  if (args.Length() < 1 || !Buffer::HasInstance(args[0])) {
+    return VException("Argument 'data' must be of type Buffer");
+  }
+  Handle<Object> data_buf = args[0]->ToObject();
+
+  Handle<Object> out_buf;
+  unsigned char *out = hash_output(args, 1, RIPEMD160_DIGEST_LENGTH, &out_buf);
+  if (out == NULL) {
+    return Undefined();
+  }
+
+  unsigned char hash1[SHA256_DIGEST_LENGTH];
+  SHA256((unsigned char *) Buffer::Data(data_buf), Buffer::Length(data_buf),
+         hash1);
+  RIPEMD160(hash1, SHA256_DIGEST_LENGTH, out);
+
+  return scope.Close(out_buf);
+}
+
+/**
+ * sha256(sha256(x)) of each Buffer in an Array.
+ *
+ * Returns a single Buffer with the 32 byte hashes back to back. Messages are
+ * hashed in parallel SIMD lanes where the CPU supports it.
+ */
+static Handle<Value>
+sha256d_many (const Arguments& args)
+{
+  HandleScope scope;
+
+  if (args.Length() != 1 || !args[0]->IsArray()) {
+    return VException("One argument expected: Array of Buffers");
+  }
+
+  Local<Array> bufs = Local<Array>::Cast(args[0]);
+  size_t count = bufs->Length();
+
+  const unsigned char **msgs = new const unsigned char *[count + 1];
+  size_t *lens = new size_t[count + 1];
+
+  for (size_t i = 0; i < count; i++) {
+    Local<Value> buf = bufs->Get(i);
+    if (!Buffer::HasInstance(buf)) {
+      delete [] msgs;
+      delete [] lens;
+      return VException("Array elements must be of type Buffer");
+    }
+    msgs[i] = (const unsigned char *) Buffer::Data(buf->ToObject());
+    lens[i] = Buffer::Length(buf->ToObject());
+  }
+
+  Buffer *out_buf = Buffer::New(32 * count);
+  Sha256::DoubleMany(msgs, lens, count,
+                     (unsigned char *) Buffer::Data(out_buf));
+
+  delete [] msgs;
+  delete [] lens;
+
+  return scope.Close(out_buf->handle_);
+}
+
+/**
+ * Returns the multi-buffer SHA-256 implementation in use, optionally
+ * selecting another one first ("avx512", "avx2", "sse4.1" or "scalar").
+ */
+static Handle<Value>
+sha256_implementation (const Arguments& args)
+{
+  HandleScope scope;
+
+  if (args.Length() > 0) {
+    if (!args[0]->IsString()) {
+      return VException("Argument 'name' must be a String");
+    }
+    String::AsciiValue name(args[0]->ToString());
+    if (!Sha256::SetImplementation(*name)) {
+      return VException("SHA-256 implementation not supported on this CPU");
+    }
+  }
+
+  return scope.Close(String::New(Sha256::GetImplementation()));
+}
+
+// Checks the (hashes, count) arguments of the merkle functions
+static Handle<Value>
+merkle_args (const Arguments& args, size_t *count)
+{
+  if (args.Length() < 1 || !Buffer::HasInstance(args[0])) {
+    return VException("Argument 'hashes' must be of type Buffer");
+  }
+  size_t len = Buffer::Length(args[0]->ToObject());
+
+  *count = len / 32;
+  if (args.Length() > 1 && !args[1]->IsUndefined()) {
+    if (!args[1]->IsNumber() || args[1]->NumberValue() < 0) {
+      return VException("Argument 'count' must be a non-negative number");
+    }
+    *count = (size_t) args[1]->NumberValue();
+  }
+  if (*count > len / 32) {
+    return VException("Argument 'hashes' is shorter than count * 32 bytes");
+  }
+  return Handle<Value>();
+}
+
+/**
+ * Merkle root of `count` 32 byte leaf hashes stored back to back.
+ */
+static Handle<Value>
+merkle_root (const Arguments& args)
+{
+  HandleScope scope;
+
+  size_t count;
+  Handle<Value> err = merkle_args(args, &count);
+  if (!err.IsEmpty()) {
+    return err;
+  }
+
+  Buffer *root_buf = Buffer::New(32);
+  Sha256::MerkleRoot((const unsigned char *) Buffer::Data(args[0]->ToObject()),
+                     count, (unsigned char *) Buffer::Data(root_buf));
+
+  return scope.Close(root_buf->handle_);
+}
+
+/**
+ * Full merkle tree of `count` 32 byte leaf hashes stored back to back.
+ *
+ * Returns all nodes, level by level starting with the leaves, in the same
+ * order as Block.getMerkleTree(). The root is the last 32 bytes.
+ */
+static Handle<Value>
+merkle_tree (const Arguments& args)
+{
+  HandleScope scope;
+
+  size_t count;
+  Handle<Value> err = merkle_args(args, &count);
+  if (!err.IsEmpty()) {
+    return err;
+  }
+
+  if (count == 0) {
+    Buffer *null_buf = Buffer::New(32);
+    memset(Buffer::Data(null_buf), 0, 32);
+    return scope.Close(null_buf->handle_);
+  }
+
+  size_t total = count;
+  for (size_t size = count; size > 1; size = (size + 1) / 2) {
+    total += (size + 1) / 2;
+  }
+
+  Buffer *tree_buf = Buffer::New(32 * total);
+  unsigned char *tree = (unsigned char *) Buffer::Data(tree_buf);
+  memcpy(tree, Buffer::Data(args[0]->ToObject()), 32 * count);
+
+  unsigned char *level = tree;
+  for (size_t size = count; size > 1; size = (size + 1) / 2) {
+    Sha256::MerkleLevel(level, size, level + 32 * size);
+    level += 32 * size;
+  }
+
+  return scope.Close(tree_buf->handle_);
+}
+
+/**
+ * Merkle branch of the first leaf.
+ *
+ * Returns the sibling of the leftmost node on every level, bottom up. None
+ * of them depend on the first leaf, so the branch stays valid when only the
+ * coinbase changes.
+ */
+static Handle<Value>
+merkle_branch (const Arguments& args)
+{
+  HandleScope scope;
+
+  size_t count;
+  Handle<Value> err = merkle_args(args, &count);
+  if (!err.IsEmpty()) {
+    return err;
+  }
+
+  size_t depth = 0;
+  for (size_t size = count; size > 1; size = (size + 1) / 2) {
+    depth++;
+  }
+
+  Buffer *branch_buf = Buffer::New(32 * depth);
+  unsigned char *branch = (unsigned char *) Buffer::Data(branch_buf);
+
+  if (depth == 0) {
+    return scope.Close(branch_buf->handle_);
+  }
+
+  unsigned char *work = (unsigned char *) malloc(32 * count);
+  memcpy(work, Buffer::Data(args[0]->ToObject()), 32 * count);
+
+  for (size_t size = count, i = 0; size > 1; size = (size + 1) / 2, i++) {
+    memcpy(branch + 32 * i, work + 32, 32);
+    Sha256::MerkleLevel(work, size, work);
+  }
+
+  free(work);
+
+  return scope.Close(branch_buf->handle_);
+}
+
+/**
+ * Merkle root from the first leaf and its branch (see merkleBranch), this
+ * takes one double SHA-256 per level.
+ */
+static Handle<Value>
+merkle_root_from_branch (const Arguments& args)
+{
+  HandleScope scope;
+
+  if (args.Length() != 2) {
+    return VException("Two arguments expected: leaf, branch");
+  }
+  if (!Buffer::HasInstance(args[0]) ||
+      Buffer::Length(args[0]->ToObject()) != 32) {
+    return VException("Argument 'leaf' must be a Buffer of length 32 bytes");
+  }
+  if (!Buffer::HasInstance(args[1]) ||
+      Buffer::Length(args[1]->ToObject()) % 32 != 0) {
+    return VException("Argument 'branch' must be a Buffer of 32 byte hashes");
+  }
+
+  const unsigned char *branch =
+    (const unsigned char *) Buffer::Data(args[1]->ToObject());
+  size_t depth = Buffer::Length(args[1]->ToObject()) / 32;
+
+  unsigned char pair[64];
+  unsigned char hash1[SHA256_DIGEST_LENGTH];
+  memcpy(pair, Buffer::Data(args[0]->ToObject()), 32);
+
+  for (size_t i = 0; i < depth; i++) {
+    memcpy(pair + 32, branch + 32 * i, 32);
+    SHA256(pair, 64, hash1);
+    SHA256(hash1, SHA256_DIGEST_LENGTH, pair);
+  }
+
+  Buffer *root_buf = Buffer::New(32);
+  memcpy(Buffer::Data(root_buf), pair, 32);
+
+  return scope.Close(root_buf->handle_);
+}
+
+// Reads a big endian number of at most 32 bytes, like a chainWork Buffer
+static bool
+uint256_arg (Handle<Value> arg, Uint256 *out)
+{
+  if (!Buffer::HasInstance(arg) || Buffer::Length(arg->ToObject()) > 32) {
+    return false;
+  }
+  size_t len = Buffer::Length(arg->ToObject());
+  unsigned char data[32];
+  memset(data, 0, 32 - len);
+  memcpy(data + 32 - len, Buffer::Data(arg->ToObject()), len);
+  *out = Uint256::FromBE(data);
+  return true;
+}
+
+// Reads an Array of difficulty bits
+static bool
+bits_array_arg (Handle<Value> arg, vector<uint32_t> *out)
+{
+  if (!arg->IsArray()) {
+    return false;
+  }
+  Local<Array> array = Local<Array>::Cast(arg);
+  out->resize(array->Length());
+  for (uint32_t i = 0; i < array->Length(); i++) {
+    Local<Value> bits = array->Get(i);
+    if (!bits->IsNumber()) {
+      return false;
+    }
+    (*out)[i] = bits->Uint32Value();
+  }
+  return true;
+}
+
+/**
+ * Difficulty target of compact bits as a 32 byte big endian Buffer,
+ * optionally written to out at offset.
+ */
+static Handle<Value>
+decode_bits (const Arguments& args)
+{
+  HandleScope scope;
+
+  if (args.Length() < 1 || !args[0]->IsNumber()) {
+    return VException("Argument 'bits' must be a number");
+  }
+
+  Uint256 target;
+  if (!target.SetCompact(args[0]->Uint32Value())) {
+    return VException("Difficulty bits out of range");
+  }
+
+  Handle<Object> out_buf;
+  unsigned char *out = hash_output(args, 1, 32, &out_buf);
+  if (out == NULL) {
+    return Undefined();
+  }
+  target.ToBE(out);
+
+  return scope.Close(out_buf);
+}
+
+/**
+ * Compact bits of a big endian target Buffer of at most 32 bytes.
+ */
+static Handle<Value>
+encode_bits (const Arguments& args)
+{
+  HandleScope scope;
+
+  Uint256 target;
+  if (args.Length() != 1 || !uint256_arg(args[0], &target)) {
+    return VException("Argument 'target' must be a Buffer of at most 32 bytes");
+  }
+
+  return scope.Close(Integer::NewFromUnsigned(target.GetCompact()));
+}
+
+/**
+ * Work of a block with the given bits, 2^256 / (target + 1), as a 32 byte
+ * big endian Buffer, optionally written to out at offset. Bits that
+ * overflow are no work and a zero target is 2^256 - 1, see
+ * Uint256::WorkFromCompact().
+ */
+static Handle<Value>
+get_work (const Arguments& args)
+{
+  HandleScope scope;
+
+  if (args.Length() < 1 || !args[0]->IsNumber()) {
+    return VException("Argument 'bits' must be a number");
+  }
+
+  Handle<Object> out_buf;
+  unsigned char *out = hash_output(args, 1, 32, &out_buf);
+  if (out == NULL) {
+    return Undefined();
+  }
+  Uint256::WorkFromCompact(args[0]->Uint32Value()).ToBE(out);
+
+  return scope.Close(out_buf);
+}
+
+/**
+ * Sum of two big endian chain works of at most 32 bytes each, as a 32 byte
+ * Buffer, optionally written to out at offset.
+ */
+static Handle<Value>
+add_work (const Arguments& args)
+{
+  HandleScope scope;
+
+  Uint256 a, b;
+  if (args.Length() < 2 || !uint256_arg(args[0], &a) ||
+      !uint256_arg(args[1], &b)) {
+    return VException("Two arguments expected: Buffers of at most 32 bytes");
+  }
+
+  Handle<Object> out_buf;
+  unsigned char *out = hash_output(args, 2, 32, &out_buf);
+  if (out == NULL) {
+    return Undefined();
+  }
+  a += b;
+  a.ToBE(out);
+
+  return scope.Close(out_buf);
+}
+
+/**
+ * Compares two big endian chain works, returns -1, 0 or 1.
+ */
+static Handle<Value>
+compare_work (const Arguments& args)
+{
+  HandleScope scope;
+
+  Uint256 a, b;
+  if (args.Length() != 2 || !uint256_arg(args[0], &a) ||
+      !uint256_arg(args[1], &b)) {
+    return VException("Two arguments expected: Buffers of at most 32 bytes");
+  }
+
+  return scope.Close(Integer::New(a.Compare(b)));
+}
+
+/**
+ * decodeBits for an Array of bits, the targets are returned back to back
+ * in a single Buffer.
+ */
+static Handle<Value>
+decode_bits_many (const Arguments& args)
+{
+  HandleScope scope;
+
+  vector<uint32_t> bits;
+  if (args.Length() != 1 || !bits_array_arg(args[0], &bits)) {
+    return VException("One argument expected: Array of bits");
+  }
+
+  Buffer *out_buf = Buffer::New(32 * bits.size());
+  unsigned char *out = (unsigned char *) Buffer::Data(out_buf);
+  for (size_t i = 0; i < bits.size(); i++) {
+    Uint256 target;
+    if (!target.SetCompact(bits[i])) {
+      return VException("Difficulty bits out of range");
+    }
+    target.ToBE(out + 32 * i);
+  }
+
+  return scope.Close(out_buf->handle_);
+}
+
+/**
+ * getWork for an Array of bits, the works are returned back to back in a
+ * single Buffer.
+ */
+static Handle<Value>
+get_work_many (const Arguments& args)
+{
+  HandleScope scope;
+
+  vector<uint32_t> bits;
+  if (args.Length() != 1 || !bits_array_arg(args[0], &bits)) {
+    return VException("One argument expected: Array of bits");
+  }
+
+  Buffer *out_buf = Buffer::New(32 * bits.size());
+  unsigned char *out = (unsigned char *) Buffer::Data(out_buf);
+  for (size_t i = 0; i < bits.size(); i++) {
+    Uint256::WorkFromCompact(bits[i]).ToBE(out + 32 * i);
+  }
+
+  return scope.Close(out_buf->handle_);
+}
+
+/**
+ * Chain works of a run of blocks with the given bits on top of a parent
+ * with the given chain work. Returns the chain work after each block back
+ * to back in a single Buffer.
+ */
+static Handle<Value>
+accumulate_work (const Arguments& args)
+{
+  HandleScope scope;
+
+  Uint256 work;
+  vector<uint32_t> bits;
+  if (args.Length() != 2 || !uint256_arg(args[0], &work) ||
+      !bits_array_arg(args[1], &bits)) {
+    return VException("Two arguments expected: chainWork Buffer, Array of bits");
+  }
+
+  Buffer *out_buf = Buffer::New(32 * bits.size());
+  unsigned char *out = (unsigned char *) Buffer::Data(out_buf);
+  for (size_t i = 0; i < bits.size(); i++) {
+    work += Uint256::WorkFromCompact(bits[i]);
+    work.ToBE(out + 32 * i);
+  }
+
+  return scope.Close(out_buf->handle_);
+}
+
+
 static const char* BASE58_ALPHABET = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
 
+// Reverse lookup for BASE58_ALPHABET, -1 for characters not in it
+static const signed char BASE58_MAP[256] = {
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1, 0, 1, 2, 3, 4, 5, 6, 7, 8,-1,-1,-1,-1,-1,-1,
+  -1, 9,10,11,12,13,14,15,16,-1,17,18,19,20,21,-1,
+  22,23,24,25,26,27,28,29,30,31,32,-1,-1,-1,-1,-1,
+  -1,33,34,35,36,37,38,39,40,41,42,43,-1,44,45,46,
+  47,48,49,50,51,52,53,54,55,56,57,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+};
+
+/**
+ * Encodes data as base58 into str (which must be large enough, see
+ * base58_encoded_size) and returns the length of the result.
+ *
+ * Works on a big endian base 58 digit array instead of a bignum: every
+ * input byte is multiplied in and carried through the digits so far.
+ */
+static size_t
+base58_encode_raw (const unsigned char *data, size_t len, char *str,
+                   unsigned char *digits)
+{
+  size_t zeros = 0;
+  while (zeros < len && data[zeros] == 0) {
+    zeros++;
+  }
+
+  size_t size = (len - zeros) * 138 / 100 + 1;  // log(256) / log(58)
+  size_t used = 0;
+  memset(digits, 0, size);
+
+  for (size_t i = zeros; i < len; i++) {
+    unsigned int carry = data[i];
+    size_t j = 0;
+    for (size_t k = size; k-- > 0 && (carry != 0 || j < used); j++) {
+      carry += 256 * digits[k];
+      digits[k] = carry % 58;
+      carry /= 58;
+    }
+    used = j;
+  }
+
+  // Skip leading zero digits
+  size_t skip = size - used;
+  while (skip < size && digits[skip] == 0) {
+    skip++;
+  }
+
+  size_t n = 0;
+  for (size_t i = 0; i < zeros; i++) {
+    str[n++] = BASE58_ALPHABET[0];
+  }
+  for (size_t i = skip; i < size; i++) {
+    str[n++] = BASE58_ALPHABET[digits[i]];
+  }
+  return n;
+}
+
+static inline size_t
+base58_encoded_size (size_t len)
+{
+  return len * 138 / 100 + 1;
+}
+
+/**
+ * Decodes a base58 string into out (at least base58_decoded_size bytes).
+ *
+ * Leading and trailing whitespace is ignored. Returns the length of the
+ * result, or -1 if the string contains invalid characters.
+ */
+static long
+base58_decode_raw (const char *psz, size_t len, unsigned char *out,
+                   unsigned char *bytes)
+{
+  const char *end = psz + len;
+
+  while (psz < end && isspace((unsigned char) *psz)) {
+    psz++;
+  }
+  while (end > psz && isspace((unsigned char) end[-1])) {
+    end--;
+  }
+
+  size_t zeros = 0;
+  while (psz + zeros < end && psz[zeros] == BASE58_ALPHABET[0]) {
+    zeros++;
+  }
+
+  size_t size = (end - psz - zeros) * 733 / 1000 + 1;  // log(58) / log(256)
+  size_t used = 0;
+  memset(bytes, 0, size);
+
+  for (const char *p = psz + zeros; p < end; p++) {
+    int carry = BASE58_MAP[(unsigned char) *p];
+    if (carry < 0) {
+      return -1;
+    }
+    size_t j = 0;
+    for (size_t k = size; k-- > 0 && (carry != 0 || j < used); j++) {
+      carry += 58 * bytes[k];
+      bytes[k] = carry % 256;
+      carry /= 256;
+    }
+    used = j;
+  }
+
+  size_t skip = size - used;
+  while (skip < size && bytes[skip] == 0) {
+    skip++;
+  }
+
+  memset(out, 0, zeros);
+  memcpy(out + zeros, bytes + skip, size - skip);
+  return (long) (zeros + size - skip);
+}
+
+static inline size_t
+base58_decoded_size (size_t len)
+{
+  return len + 1;
+}
+
+#define ADDRESS_SIZE (1 + RIPEMD160_DIGEST_LENGTH + 4)
+
+// Base58Check encodes version + hash160, returns the length of str
+static size_t
+address_encode_raw (unsigned char version, const unsigned char *hash,
+                    char *str)
+{
+  unsigned char raw[ADDRESS_SIZE];
+  unsigned char hash1[SHA256_DIGEST_LENGTH];
+  unsigned char hash2[SHA256_DIGEST_LENGTH];
+  unsigned char digits[ADDRESS_SIZE * 138 / 100 + 1];
+
+  raw[0] = version;
+  memcpy(raw + 1, hash, RIPEMD160_DIGEST_LENGTH);
+  SHA256(raw, 1 + RIPEMD160_DIGEST_LENGTH, hash1);
+  SHA256(hash1, SHA256_DIGEST_LENGTH, hash2);
+  memcpy(raw + 1 + RIPEMD160_DIGEST_LENGTH, hash2, 4);
+
+  return base58_encode_raw(raw, ADDRESS_SIZE, str, digits);
+}
+
+// Longest string that can still decode to ADDRESS_SIZE bytes (all zeros)
+#define ADDRESS_MAX_CHARS 64
+
+/**
+ * Decodes and verifies a Base58Check address. Returns false if it isn't
+ * valid base58, has the wrong length or a bad checksum.
+ */
+static bool
+address_decode_raw (const char *str, size_t len, unsigned char *version,
+                    unsigned char *hash)
+{
+  unsigned char out[ADDRESS_MAX_CHARS + 1];
+  unsigned char bytes[ADDRESS_MAX_CHARS + 1];
+  unsigned char hash1[SHA256_DIGEST_LENGTH];
+  unsigned char hash2[SHA256_DIGEST_LENGTH];
+
+  // Whitespace is trimmed by base58_decode_raw, but limits the size
+  while (len > 0 && isspace((unsigned char) *str)) {
+    str++;
+    len--;
+  }
+  while (len > 0 && isspace((unsigned char) str[len - 1])) {
+    len--;
+  }
+  if (len > ADDRESS_MAX_CHARS) {
+    return false;
+  }
+
+  if (base58_decode_raw(str, len, out, bytes) != ADDRESS_SIZE) {
+    return false;
+  }
+
+  SHA256(out, 1 + RIPEMD160_DIGEST_LENGTH, hash1);
+  SHA256(hash1, SHA256_DIGEST_LENGTH, hash2);
+  if (memcmp(hash2, out + 1 + RIPEMD160_DIGEST_LENGTH, 4) != 0) {
+    return false;
+  }
+
+  *version = out[0];
+  memcpy(hash, out + 1, RIPEMD160_DIGEST_LENGTH);
+  return true;
+}
+
+static Local<Object>
+address_object (unsigned char version, const unsigned char *hash)
+{
+  Buffer *hash_buf = Buffer::New(RIPEMD160_DIGEST_LENGTH);
+  memcpy(Buffer::Data(hash_buf), hash, RIPEMD160_DIGEST_LENGTH);
+
+  Local<Object> result = Object::New();
+  result->Set(String::NewSymbol("version"), Integer::New(version));
+  result->Set(String::NewSymbol("hash"), hash_buf->handle_);
+  return result;
+}
+
+static bool
+address_version_arg (Handle<Value> arg)
+{
+  return arg->IsUint32() && arg->Uint32Value() <= 255;
+}
+
+/**
+ * Base58Check encoding of a 20 byte hash with a version byte.
+ */
+static Handle<Value>
+encode_address (const Arguments& args)
+{
+  HandleScope scope;
+
+  if (args.Length() != 2) {
+    return VException("Two arguments expected: version, hash");
+  }
+  if (!address_version_arg(args[0])) {
+    return VException("Argument 'version' must be a number from 0 to 255");
+  }
+  if (!Buffer::HasInstance(args[1]) ||
+      Buffer::Length(args[1]->ToObject()) != RIPEMD160_DIGEST_LENGTH) {
+    return VException("Argument 'hash' must be a Buffer of length 20 bytes");
+  }
+
+  char str[ADDRESS_MAX_CHARS];
+  size_t len = address_encode_raw(
+    (unsigned char) args[0]->Uint32Value(),
+    (const unsigned char *) Buffer::Data(args[1]->ToObject()), str);
+
+  return scope.Close(String::New(str, len));
+}
+
+/**
+ * Decodes a Base58Check address to {version, hash}, or null if invalid.
+ */
+static Handle<Value>
+decode_address (const Arguments& args)
+{
+  HandleScope scope;
+
+  if (args.Length() != 1 || !args[0]->IsString()) {
+    return VException("One argument expected: address String");
+  }
+
+  String::Utf8Value str(args[0]->ToString());
+  unsigned char version;
+  unsigned char hash[RIPEMD160_DIGEST_LENGTH];
+
+  if (!address_decode_raw(*str, str.length(), &version, hash)) {
+    return scope.Close(Null());
+  }
+
+  return scope.Close(address_object(version, hash));
+}
+
+/**
+ * encodeAddress for an Array of hashes sharing one version byte.
+ */
+static Handle<Value>
+encode_address_many (const Arguments& args)
+{
+  HandleScope scope;
+
+  if (args.Length() != 2 || !args[1]->IsArray()) {
+    return VException("Two arguments expected: version, Array of hashes");
+  }
+  if (!address_version_arg(args[0])) {
+    return VException("Argument 'version' must be a number from 0 to 255");
+  }
+
+  unsigned char version = (unsigned char) args[0]->Uint32Value();
+  Local<Array> hashes = Local<Array>::Cast(args[1]);
+  uint32_t count = hashes->Length();
+  Local<Array> result = Array::New(count);
+
+  for (uint32_t i = 0; i < count; i++) {
+    Local<Value> val = hashes->Get(i);
+    if (!Buffer::HasInstance(val) ||
+        Buffer::Length(val->ToObject()) != RIPEMD160_DIGEST_LENGTH) {
+      return VException("Array elements must be Buffers of length 20 bytes");
+    }
+
+    char str[ADDRESS_MAX_CHARS];
+    size_t len = address_encode_raw(
+      version, (const unsigned char *) Buffer::Data(val->ToObject()), str);
+    result->Set(i, String::New(str, len));
+  }
+
+  return scope.Close(result);
+}
+
+/**
+ * decodeAddress for an Array of Strings, invalid entries become null.
+ */
+static Handle<Value>
+decode_address_many (const Arguments& args)
+{
+  HandleScope scope;
+
+  if (args.Length() != 1 || !args[0]->IsArray()) {
+    return VException("One argument expected: Array of Strings");
+  }
+
+  Local<Array> strs = Local<Array>::Cast(args[0]);
+  uint32_t count = strs->Length();
+  Local<Array> result = Array::New(count);
+
+  for (uint32_t i = 0; i < count; i++) {
+    Local<Value> val = strs->Get(i);
+    unsigned char version;
+    unsigned char hash[RIPEMD160_DIGEST_LENGTH];
+
+    if (!val->IsString()) {
+      result->Set(i, Null());
+      continue;
+    }
+
+    String::Utf8Value str(val->ToString());
+    if (!address_decode_raw(*str, str.length(), &version, hash)) {
+      result->Set(i, Null());
+      continue;
+    }
+
+    result->Set(i, address_object(version, hash));
+  }
+
+  return scope.Close(result);
+}
+
 
 static Handle<Value>
 base58_encode (const Arguments& args)
@@ -95,70 +1004,17 @@ base58_encode (const Arguments& args)
   v8::Handle<v8::Object> buf = args[0]->ToObject();
   
   unsigned char *buf_data = (unsigned char *) Buffer::Data(buf);
-  int buf_length = Buffer::Length(buf);
-  
-  BN_CTX *ctx = BN_CTX_new();
-  
-  BIGNUM *bn = BN_bin2bn(buf_data, buf_length, NULL);
-  
-  BIGNUM *bn58 = BN_new();
-  BN_set_word(bn58, 58);
-  
-  BIGNUM *bn0 = BN_new();
-  BN_set_word(bn0, 0);
-  
-  BIGNUM *dv = BN_new();
-  BIGNUM *rem = BN_new();
-  
-  // TODO: compute safe length
-  char *str = new char[100];
-  unsigned int c;
-  int i, j, j2;
-  
-  i = 0;
-  while (BN_cmp(bn, bn0) > 0) {
-    if (!BN_div(dv, rem, bn, bn58, ctx)) {
-      return VException("BN_div failed");
-    }
-    if (bn != dv) {
-      BN_free(bn);
-      bn = dv;
-    }
-    c = BN_get_word(rem);
-    str[i] = BASE58_ALPHABET[c];
-    i++;
-  }
-  
-  // Leading zeros
-  for (j = 0; j < buf_length; j++) {
-    if (buf_data[j] != 0) {
-      break;
-    }
-    str[i] = BASE58_ALPHABET[0];
-    i++;
-  }
-  
-  // Terminator
-  str[i] = 0;
-  
-  // Reverse string
-  int numSwaps = (i / 2);
-  char tmp;
-  for (j = 0; j < numSwaps; j++) {
-    j2 = i - 1 - j;
-    tmp = str[j];
-    str[j] = str[j2];
-    str[j2] = tmp;
-  }
-  
-  BN_free(bn);
-  BN_free(bn58);
-  BN_free(bn0);
-  BN_free(rem);
-  BN_CTX_free(ctx);
-  
-  Local<String> ret = String::New(str);
+  size_t buf_length = Buffer::Length(buf);
+
+  size_t max_len = base58_encoded_size(buf_length);
+  char *str = new char[max_len];
+  unsigned char *digits = new unsigned char[max_len];
+
+  size_t len = base58_encode_raw(buf_data, buf_length, str, digits);
+
+  Local<String> ret = String::New(str, len);
   delete [] str;
+  delete [] digits;
   return scope.Close(ret);
 }
 
@@ -174,69 +1030,119 @@ base58_decode (const Arguments& args)
   if (!args[0]->IsString()) {
     return VException("One argument expected: a String");
   }
-  
-  BN_CTX *ctx = BN_CTX_new();
-  
-  BIGNUM *bn58 = BN_new();
-  BN_set_word(bn58, 58);
-  
-  BIGNUM *bn = BN_new();
-  BN_set_word(bn, 0);
-
-  BIGNUM *bnChar = BN_new();
 
   String::Utf8Value str(args[0]->ToString());
-  char *psz = *str;
-  
-  while (isspace(*psz))
-    psz++;
-  
-  // Convert big endian string to bignum
-  for (const char* p = psz; *p; p++) {
-    const char* p1 = strchr(BASE58_ALPHABET, *p);
-    if (p1 == NULL) {
-      while (isspace(*p))
-        p++;
-      if (*p != '\0')
-        return VException("Error");
-      break;
-    }
-    BN_set_word(bnChar, p1 - BASE58_ALPHABET);
-    if (!BN_mul(bn, bn, bn58, ctx))
-      return VException("BN_mul failed");
-    if (!BN_add(bn, bn, bnChar))
-      return VException("BN_add failed");
+
+  size_t max_len = base58_decoded_size(str.length());
+  unsigned char *out = new unsigned char[max_len];
+  unsigned char *bytes = new unsigned char[max_len];
+
+  long len = base58_decode_raw(*str, str.length(), out, bytes);
+  if (len < 0) {
+    delete [] out;
+    delete [] bytes;
+    return VException("Invalid base58 string");
   }
 
-  // Get bignum as little endian data
-  unsigned int tmpLen = BN_num_bytes(bn);
-  unsigned char *tmp = (unsigned char *)malloc(tmpLen);
-  BN_bn2bin(bn, tmp);
+  Buffer *buf = Buffer::New(len);
+  memcpy(Buffer::Data(buf), out, len);
 
-  // Trim off sign byte if present
-  if (tmpLen >= 2 && tmp[tmpLen-1] == 0 && tmp[tmpLen-2] >= 0x80)
-    tmpLen--;
-  
-  // Restore leading zeros
-  int nLeadingZeros = 0;
-  for (const char* p = psz; *p == BASE58_ALPHABET[0]; p++)
-    nLeadingZeros++;
-
-  // Allocate buffer and zero it
-  Buffer *buf = Buffer::New(nLeadingZeros + tmpLen);
-  char* data = Buffer::Data(buf);
-  memset(data, 0, nLeadingZeros + tmpLen);
-  memcpy(data+nLeadingZeros, tmp, tmpLen);
-
-  BN_free(bn58);
-  BN_free(bn);
-  BN_free(bnChar);
-  BN_CTX_free(ctx);
-  free(tmp);
+  delete [] out;
+  delete [] bytes;
 
   return scope.Close(buf->handle_);
 }
 
+/**
+ * Encodes every Buffer in an Array, returns an Array of Strings.
+ */
+static Handle<Value>
+base58_encode_many (const Arguments& args)
+{
+  HandleScope scope;
+
+  if (args.Length() != 1 || !args[0]->IsArray()) {
+    return VException("One argument expected: Array of Buffers");
+  }
+
+  Local<Array> bufs = Local<Array>::Cast(args[0]);
+  uint32_t count = bufs->Length();
+  Local<Array> result = Array::New(count);
+
+  vector<char> str;
+  vector<unsigned char> digits;
+
+  for (uint32_t i = 0; i < count; i++) {
+    Local<Value> val = bufs->Get(i);
+    if (!Buffer::HasInstance(val)) {
+      return VException("Array elements must be of type Buffer");
+    }
+    Local<Object> buf = val->ToObject();
+    size_t buf_length = Buffer::Length(buf);
+
+    size_t max_len = base58_encoded_size(buf_length);
+    if (str.size() < max_len) {
+      str.resize(max_len);
+      digits.resize(max_len);
+    }
+
+    size_t len = base58_encode_raw((unsigned char *) Buffer::Data(buf),
+                                   buf_length, &str[0], &digits[0]);
+    result->Set(i, String::New(&str[0], len));
+  }
+
+  return scope.Close(result);
+}
+
+/**
+ * Decodes every String in an Array, returns an Array of Buffers. Invalid
+ * strings result in null entries instead of an exception.
+ */
+static Handle<Value>
+base58_decode_many (const Arguments& args)
+{
+  HandleScope scope;
+
+  if (args.Length() != 1 || !args[0]->IsArray()) {
+    return VException("One argument expected: Array of Strings");
+  }
+
+  Local<Array> strs = Local<Array>::Cast(args[0]);
+  uint32_t count = strs->Length();
+  Local<Array> result = Array::New(count);
+
+  vector<unsigned char> out;
+  vector<unsigned char> bytes;
+
+  for (uint32_t i = 0; i < count; i++) {
+    Local<Value> val = strs->Get(i);
+    if (!val->IsString()) {
+      result->Set(i, Null());
+      continue;
+    }
+
+    String::Utf8Value str(val->ToString());
+
+    size_t max_len = base58_decoded_size(str.length());
+    if (out.size() < max_len) {
+      out.resize(max_len);
+      bytes.resize(max_len);
+    }
+
+    long len = base58_decode_raw(*str, str.length(), &out[0], &bytes[0]);
+    if (len < 0) {
+      result->Set(i, Null());
+      continue;
+    }
+
+    Buffer *buf = Buffer::New(len);
+    memcpy(Buffer::Data(buf), &out[0], len);
+    result->Set(i, buf->handle_);
+  }
+
+  return scope.Close(result);
+}
+
 
 int static FormatHashBlocks(void* pbuffer, unsigned int len)
 {
@@ -296,11 +1202,45 @@ extern "C" void
 init (Handle<Object> target)
 {
   HandleScope scope;
+  Sha256::Init();
   BitcoinKey::Init(target);
+  SigCache::Init(target);
+  Miner::Init(target);
+  TxParser::Init(target);
+  Framer::Init(target);
+  SigHash::Init(target);
+  Interpreter::Init(target);
+  UtxoSet::Init(target);
+  BlockRecord::Init(target);
+  BlockFile::Init(target);
+  BlockIndex::Init(target);
+  HeaderChain::Init(target);
   target->Set(String::New("pubkey_to_address256"), FunctionTemplate::New(pubkey_to_address256)->GetFunction());
   target->Set(String::New("base58_encode"), FunctionTemplate::New(base58_encode)->GetFunction());
   target->Set(String::New("base58_decode"), FunctionTemplate::New(base58_decode)->GetFunction());
+  target->Set(String::New("base58EncodeMany"), FunctionTemplate::New(base58_encode_many)->GetFunction());
+  target->Set(String::New("base58DecodeMany"), FunctionTemplate::New(base58_decode_many)->GetFunction());
+  target->Set(String::New("encodeAddress"), FunctionTemplate::New(encode_address)->GetFunction());
+  target->Set(String::New("decodeAddress"), FunctionTemplate::New(decode_address)->GetFunction());
+  target->Set(String::New("encodeAddressMany"), FunctionTemplate::New(encode_address_many)->GetFunction());
+  target->Set(String::New("decodeAddressMany"), FunctionTemplate::New(decode_address_many)->GetFunction());
   target->Set(String::New("sha256_midstate"), FunctionTemplate::New(sha256_midstate)->GetFunction());
+  target->Set(String::New("sha256d"), FunctionTemplate::New(sha256d)->GetFunction());
+  target->Set(String::New("hash160"), FunctionTemplate::New(hash160)->GetFunction());
+  target->Set(String::New("sha256dMany"), FunctionTemplate::New(sha256d_many)->GetFunction());
+  target->Set(String::New("sha256_implementation"), FunctionTemplate::New(sha256_implementation)->GetFunction());
+  target->Set(String::New("merkleRoot"), FunctionTemplate::New(merkle_root)->GetFunction());
+  target->Set(String::New("merkleTree"), FunctionTemplate::New(merkle_tree)->GetFunction());
+  target->Set(String::New("merkleBranch"), FunctionTemplate::New(merkle_branch)->GetFunction());
+  target->Set(String::New("merkleRootFromBranch"), FunctionTemplate::New(merkle_root_from_branch)->GetFunction());
+  target->Set(String::New("decodeBits"), FunctionTemplate::New(decode_bits)->GetFunction());
+  target->Set(String::New("encodeBits"), FunctionTemplate::New(encode_bits)->GetFunction());
+  target->Set(String::New("getWork"), FunctionTemplate::New(get_work)->GetFunction());
+  target->Set(String::New("addWork"), FunctionTemplate::New(add_work)->GetFunction());
+  target->Set(String::New("compareWork"), FunctionTemplate::New(compare_work)->GetFunction());
+  target->Set(String::New("decodeBitsMany"), FunctionTemplate::New(decode_bits_many)->GetFunction());
+  target->Set(String::New("getWorkMany"), FunctionTemplate::New(get_work_many)->GetFunction());
+  target->Set(String::New("accumulateWork"), FunctionTemplate::New(accumulate_work)->GetFunction());
 }
 
 NODE_MODULE(native, init)
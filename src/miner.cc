@@ -0,0 +1,279 @@
+#include <string.h>
+
+#include <v8.h>
+
+#include <node.h>
+#include <node_buffer.h>
+
+#include "common.h"
+#include "miner.h"
+#include "sha256.h"
+
+using namespace std;
+using namespace v8;
+using namespace node;
+
+#define NONCE_POS 76
+
+// How often (in nonces) workers check whether another one has finished
+#define MINER_CHECK_INTERVAL 4096
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define S0(x) (ROTR((x), 2) ^ ROTR((x), 13) ^ ROTR((x), 22))
+#define S1(x) (ROTR((x), 6) ^ ROTR((x), 11) ^ ROTR((x), 25))
+#define s0(x) (ROTR((x), 7) ^ ROTR((x), 18) ^ ((x) >> 3))
+#define s1(x) (ROTR((x), 17) ^ ROTR((x), 19) ^ ((x) >> 10))
+#define CH(x, y, z) (((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x, y, z) (((x) & (y)) | (((x) | (y)) & (z)))
+
+static inline uint32_t read_be32(const unsigned char *p)
+{
+  return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) |
+    ((uint32_t) p[2] << 8) | (uint32_t) p[3];
+}
+
+static inline uint32_t bswap32(uint32_t x)
+{
+  return (x >> 24) | ((x >> 8) & 0xff00) | ((x << 8) & 0xff0000) | (x << 24);
+}
+
+// Runs rounds [from, 64) on s with the expanded schedule w
+static inline void sha256_rounds(uint32_t *s, const uint32_t *w, int from)
+{
+  uint32_t a = s[0], b = s[1], c = s[2], d = s[3];
+  uint32_t e = s[4], f = s[5], g = s[6], h = s[7];
+
+  for (int i = from; i < 64; i++) {
+    uint32_t t1 = h + S1(e) + CH(e, f, g) + Sha256::K[i] + w[i];
+    uint32_t t2 = S0(a) + MAJ(a, b, c);
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+
+  s[0] = a; s[1] = b; s[2] = c; s[3] = d;
+  s[4] = e; s[5] = f; s[6] = g; s[7] = h;
+}
+
+static inline void sha256_expand(uint32_t *w, int from)
+{
+  for (int i = from; i < 64; i++) {
+    w[i] = s1(w[i - 2]) + w[i - 7] + s0(w[i - 15]) + w[i - 16];
+  }
+}
+
+/**
+ * Returns true if the header hash with this nonce is below the target.
+ */
+bool Miner::CheckNonce(const mine_baton_t *b, uint32_t nonce)
+{
+  uint32_t w[64];
+  uint32_t s[8];
+
+  // Second chunk of the header, starting after the precomputed rounds
+  memcpy(w, b->schedule, sizeof(b->schedule));
+  w[3] = bswap32(nonce);
+  sha256_expand(w, 18);
+
+  memcpy(s, b->prestate, sizeof(s));
+  sha256_rounds(s, w, 3);
+  for (int i = 0; i < 8; i++) {
+    w[i] = b->midstate[i] + s[i];
+  }
+
+  // Second hash, a single padded 32 byte block
+  w[8] = 0x80000000;
+  for (int i = 9; i < 15; i++) {
+    w[i] = 0;
+  }
+  w[15] = 256;
+  sha256_expand(w, 16);
+
+  memcpy(s, Sha256::IV, sizeof(s));
+  sha256_rounds(s, w, 0);
+  for (int i = 0; i < 8; i++) {
+    s[i] += Sha256::IV[i];
+  }
+
+  // The hash is compared as a little endian number, so its most significant
+  // word is the byte swapped last state word
+  for (int i = 7; i >= 0; i--) {
+    uint32_t hw = bswap32(s[i]);
+    uint32_t tw = read_be32(b->target + 4 * (7 - i));
+    if (hw != tw) {
+      return hw < tw;
+    }
+  }
+  return false;
+}
+
+void Miner::EIO_Solve(uv_work_t *req)
+{
+  mine_range_t *r = static_cast<mine_range_t *>(req->data);
+  mine_baton_t *b = r->baton;
+
+  for (uint64_t n = r->start; n < r->end && !b->found; ) {
+    uint64_t stop = n + MINER_CHECK_INTERVAL;
+    if (stop > r->end) {
+      stop = r->end;
+    }
+
+    for (; n < stop; n++) {
+      if (CheckNonce(b, (uint32_t) n)) {
+        if (__sync_bool_compare_and_swap(&b->found, 0, 1)) {
+          b->nonce = (uint32_t) n;
+        }
+        return;
+      }
+    }
+  }
+}
+
+void Miner::Init(Handle<Object> target)
+{
+  HandleScope scope;
+
+  target->Set(String::NewSymbol("mine"),
+              FunctionTemplate::New(Solve)->GetFunction());
+}
+
+/**
+ * Search for a nonce that brings the header hash below the target.
+ *
+ * Arguments: header (80 byte Buffer), target (32 byte big endian Buffer),
+ * threads (0 = size of the threadpool), callback(err, nonce). On success
+ * the nonce is also written into the header.
+ */
+Handle<Value>
+Miner::Solve(const Arguments& args)
+{
+  HandleScope scope;
+
+  if (args.Length() != 4) {
+    return VException("Four arguments expected: header, target, threads, callback");
+  }
+  if (!Buffer::HasInstance(args[0]) ||
+      Buffer::Length(args[0]->ToObject()) != 80) {
+    return VException("Argument 'header' must be a Buffer of length 80 bytes");
+  }
+  if (!Buffer::HasInstance(args[1]) ||
+      Buffer::Length(args[1]->ToObject()) != 32) {
+    return VException("Argument 'target' must be a Buffer of length 32 bytes");
+  }
+  if (!args[2]->IsNumber() || args[2]->NumberValue() < 0) {
+    return VException("Argument 'threads' must be a non-negative number");
+  }
+  REQ_FUN_ARG(3, cb);
+
+  Handle<Object> header_buf = args[0]->ToObject();
+  const unsigned char *header = (const unsigned char *) Buffer::Data(header_buf);
+
+  int threads = (int) args[2]->NumberValue();
+  if (threads <= 0) {
+    threads = GetThreadpoolSize();
+  }
+
+  mine_baton_t *baton = new mine_baton_t();
+  memcpy(baton->target, Buffer::Data(args[1]->ToObject()), 32);
+  baton->headerBuf = Persistent<Object>::New(header_buf);
+  baton->found = 0;
+  baton->nonce = 0;
+  baton->pending = threads;
+  baton->cb = Persistent<Function>::New(cb);
+
+  // First chunk
+  memcpy(baton->midstate, Sha256::IV, sizeof(baton->midstate));
+  Sha256::Transform(baton->midstate, header);
+
+  // Second chunk: merkle root tail, time, bits, nonce and padding
+  uint32_t *w = baton->schedule;
+  w[0] = read_be32(header + 64);
+  w[1] = read_be32(header + 68);
+  w[2] = read_be32(header + 72);
+  w[3] = 0;
+  w[4] = 0x80000000;
+  for (int i = 5; i < 15; i++) {
+    w[i] = 0;
+  }
+  w[15] = 640;
+  w[16] = s1(w[14]) + w[9] + s0(w[1]) + w[0];
+  w[17] = s1(w[15]) + w[10] + s0(w[2]) + w[1];
+
+  memcpy(baton->prestate, baton->midstate, sizeof(baton->prestate));
+  {
+    uint32_t *s = baton->prestate;
+    for (int i = 0; i < 3; i++) {
+      uint32_t t1 = s[7] + S1(s[4]) + CH(s[4], s[5], s[6]) + Sha256::K[i] + w[i];
+      uint32_t t2 = S0(s[0]) + MAJ(s[0], s[1], s[2]);
+      memmove(s + 1, s, 7 * sizeof(uint32_t));
+      s[4] += t1;
+      s[0] = t1 + t2;
+    }
+  }
+
+  uint64_t total = (uint64_t) 1 << 32;
+  for (int i = 0; i < threads; i++) {
+    mine_range_t *range = new mine_range_t();
+    range->baton = baton;
+    range->start = total * i / threads;
+    range->end = total * (i + 1) / threads;
+
+    uv_work_t *req = new uv_work_t;
+    req->data = range;
+
+    uv_queue_work(uv_default_loop(), req, EIO_Solve, SolveCallback);
+  }
+
+  return scope.Close(Undefined());
+}
+
+void
+Miner::SolveCallback(uv_work_t *req, int status)
+{
+  HandleScope scope;
+  mine_range_t *range = static_cast<mine_range_t *>(req->data);
+  mine_baton_t *baton = range->baton;
+
+  delete range;
+  delete req;
+
+  // Wait for the remaining ranges
+  if (--baton->pending > 0) {
+    return;
+  }
+
+  Local<Value> argv[2];
+  argv[0] = Local<Value>::New(Null());
+  argv[1] = Local<Value>::New(Null());
+
+  if (baton->found) {
+    unsigned char *header = (unsigned char *) Buffer::Data(baton->headerBuf);
+    header[NONCE_POS    ] = baton->nonce & 0xff;
+    header[NONCE_POS + 1] = (baton->nonce >> 8) & 0xff;
+    header[NONCE_POS + 2] = (baton->nonce >> 16) & 0xff;
+    header[NONCE_POS + 3] = (baton->nonce >> 24) & 0xff;
+
+    argv[1] = Local<Value>::New(Number::New(baton->nonce));
+  } else {
+    argv[0] = Exception::Error(
+      String::New("No nonce found, the nonce space is exhausted"));
+  }
+
+  TryCatch try_catch;
+
+  baton->cb->Call(Context::GetCurrent()->Global(), 2, argv);
+
+  baton->cb.Dispose();
+  baton->headerBuf.Dispose();
+
+  delete baton;
+
+  if (try_catch.HasCaught()) {
+    FatalException(try_catch);
+  }
+}
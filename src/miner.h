@@ -0,0 +1,60 @@
+#ifndef BITCOINJS_SERVER_INCLUDE_MINER_H_
+#define BITCOINJS_SERVER_INCLUDE_MINER_H_
+
+#include <stdint.h>
+
+#include <v8.h>
+#include <node.h>
+
+using namespace v8;
+using namespace node;
+
+/**
+ * Nonce search on the libuv threadpool.
+ *
+ * The first 64 bytes of the header don't change while searching, so their
+ * SHA-256 midstate is computed once. For the second chunk only the nonce
+ * word varies, the rounds and message schedule words before it are
+ * precomputed as well.
+ */
+class Miner
+{
+private:
+
+  struct mine_baton_t {
+    // Parameters
+    unsigned char target[32];
+    uint32_t midstate[8];
+    uint32_t prestate[8];     // midstate after the rounds before the nonce
+    uint32_t schedule[18];    // second chunk words 0..17, word 3 is the nonce
+    Persistent<Object> headerBuf;
+
+    // Result
+    volatile int found;
+    uint32_t nonce;
+
+    // Number of ranges still in the threadpool
+    int pending;
+    Persistent<Function> cb;
+  };
+
+  struct mine_range_t {
+    mine_baton_t *baton;
+    uint64_t start;
+    uint64_t end;
+  };
+
+  static bool CheckNonce(const mine_baton_t *b, uint32_t nonce);
+
+  static void EIO_Solve(uv_work_t *req);
+
+public:
+
+  static void Init(Handle<Object> target);
+
+  static Handle<Value> Solve(const Arguments& args);
+
+  static void SolveCallback(uv_work_t *req, int status);
+};
+
+#endif
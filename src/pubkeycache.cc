@@ -0,0 +1,186 @@
+#include <string.h>
+
+#include <openssl/ec.h>
+#include <openssl/ecdsa.h>
+#include <openssl/obj_mac.h>
+
+#include "pubkeycache.h"
+
+using namespace std;
+
+// Enough for the usual working set of a node, about 250 bytes per entry
+#define PUBKEY_CACHE_DEFAULT_CAPACITY 8192
+
+uv_mutex_t PubKeyCache::mutex;
+PubKeyCache::map_t PubKeyCache::entries;
+PubKeyCache::entry_t *PubKeyCache::head = NULL;
+PubKeyCache::entry_t *PubKeyCache::tail = NULL;
+size_t PubKeyCache::capacity = PUBKEY_CACHE_DEFAULT_CAPACITY;
+uint64_t PubKeyCache::hits = 0;
+uint64_t PubKeyCache::misses = 0;
+
+void PubKeyCache::Init()
+{
+  static bool initialized = false;
+
+  if (!initialized) {
+    uv_mutex_init(&mutex);
+    initialized = true;
+  }
+}
+
+void PubKeyCache::Unlink(entry_t *e)
+{
+  if (e->prev) e->prev->next = e->next; else head = e->next;
+  if (e->next) e->next->prev = e->prev; else tail = e->prev;
+  e->prev = e->next = NULL;
+}
+
+void PubKeyCache::PushFront(entry_t *e)
+{
+  e->prev = NULL;
+  e->next = head;
+  if (head) head->prev = e; else tail = e;
+  head = e;
+}
+
+// Drops least recently used entries until at most `size` remain
+void PubKeyCache::Evict(size_t size)
+{
+  while (entries.size() > size && tail != NULL) {
+    entry_t *e = tail;
+    Unlink(e);
+    entries.erase(e->pub);
+    EC_POINT_free(e->point);
+    delete e;
+  }
+}
+
+bool PubKeyCache::Fetch(const unsigned char *pub, int pub_len, EC_KEY *ec,
+                        Secp256k1::Point *native, bool *has_native)
+{
+  if (pub_len <= 0) {
+    return false;
+  }
+
+  string key((const char *) pub, pub_len);
+  bool ok = true;
+  bool need_native = false;
+
+  uv_mutex_lock(&mutex);
+  map_t::iterator it = entries.find(key);
+  if (it != entries.end()) {
+    entry_t *e = it->second;
+    hits++;
+
+    Unlink(e);
+    PushFront(e);
+
+    if (ec != NULL) {
+      // Same conversion form o2i_ECPublicKey would have set
+      EC_KEY_set_conv_form(ec, (point_conversion_form_t)(pub[0] & ~0x01));
+      ok = EC_KEY_set_public_key(ec, e->point) == 1;
+    }
+    if (native != NULL) {
+      if (e->hasNative) {
+        *native = e->native;
+        *has_native = true;
+      } else {
+        need_native = true;
+      }
+    }
+    uv_mutex_unlock(&mutex);
+
+    // Cached from the OpenSSL side only, add the native point as well
+    if (need_native) {
+      *has_native = Secp256k1::ParsePubKey(native, pub, pub_len) == 1;
+      if (*has_native) {
+        uv_mutex_lock(&mutex);
+        it = entries.find(key);
+        if (it != entries.end()) {
+          it->second->native = *native;
+          it->second->hasNative = true;
+        }
+        uv_mutex_unlock(&mutex);
+      }
+    }
+    return ok;
+  }
+  misses++;
+  uv_mutex_unlock(&mutex);
+
+  // Decode outside of the lock
+  EC_KEY *k = ec;
+  if (k == NULL) {
+    k = EC_KEY_new_by_curve_name(NID_secp256k1);
+    if (k == NULL) {
+      return false;
+    }
+  }
+
+  const unsigned char *data = pub;
+  ok = o2i_ECPublicKey(&k, &data, pub_len) != NULL;
+
+  entry_t *e = NULL;
+  if (ok) {
+    e = new entry_t();
+    e->pub = key;
+    e->point = EC_POINT_dup(EC_KEY_get0_public_key(k), EC_KEY_get0_group(k));
+    e->hasNative = false;
+    e->prev = e->next = NULL;
+
+    if (native != NULL) {
+      e->hasNative = Secp256k1::ParsePubKey(&e->native, pub, pub_len) == 1;
+      *native = e->native;
+      *has_native = e->hasNative;
+    }
+  }
+
+  if (k != ec) {
+    EC_KEY_free(k);
+  }
+
+  if (e == NULL) {
+    return false;
+  }
+  if (e->point == NULL) {
+    delete e;
+    return ok;
+  }
+
+  uv_mutex_lock(&mutex);
+  if (capacity > 0 && entries.find(key) == entries.end()) {
+    entries[key] = e;
+    PushFront(e);
+    Evict(capacity);
+    e = NULL;
+  }
+  uv_mutex_unlock(&mutex);
+
+  // Another thread was faster (or the cache is disabled)
+  if (e != NULL) {
+    EC_POINT_free(e->point);
+    delete e;
+  }
+
+  return ok;
+}
+
+void PubKeyCache::SetCapacity(size_t size)
+{
+  uv_mutex_lock(&mutex);
+  capacity = size;
+  Evict(capacity);
+  uv_mutex_unlock(&mutex);
+}
+
+void PubKeyCache::GetStats(uint64_t *hits_out, uint64_t *misses_out,
+                           size_t *size_out, size_t *capacity_out)
+{
+  uv_mutex_lock(&mutex);
+  *hits_out = hits;
+  *misses_out = misses;
+  *size_out = entries.size();
+  *capacity_out = capacity;
+  uv_mutex_unlock(&mutex);
+}
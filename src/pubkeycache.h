@@ -0,0 +1,77 @@
+#ifndef BITCOINJS_SERVER_INCLUDE_PUBKEYCACHE_H_
+#define BITCOINJS_SERVER_INCLUDE_PUBKEYCACHE_H_
+
+#include <map>
+#include <string>
+
+#include <uv.h>
+
+#include <openssl/ec.h>
+
+#include "secp256k1.h"
+
+/**
+ * Bounded LRU cache of decoded public keys.
+ *
+ * Keyed by the serialized public key, so that keys which are used over and
+ * over again (pools, exchanges, ...) only need to be decoded once. Decoding a
+ * compressed key involves a modular square root, which is a considerable
+ * part of the cost of verifying a signature.
+ *
+ * All methods are safe to call from the libuv threadpool.
+ */
+class PubKeyCache
+{
+private:
+
+  struct entry_t {
+    std::string pub;
+    EC_POINT *point;
+    Secp256k1::Point native;
+    bool hasNative;
+
+    // LRU list, head is the most recently used entry
+    entry_t *prev;
+    entry_t *next;
+  };
+
+  typedef std::map<std::string, entry_t *> map_t;
+
+  static uv_mutex_t mutex;
+  static map_t entries;
+  static entry_t *head;
+  static entry_t *tail;
+  static size_t capacity;
+  static uint64_t hits;
+  static uint64_t misses;
+
+  static void Unlink(entry_t *e);
+  static void PushFront(entry_t *e);
+  static void Evict(size_t size);
+
+public:
+
+  // Must be called once from the main thread
+  static void Init();
+
+  /**
+   * Sets the public key of `ec` (which must use secp256k1) from its
+   * serialized form, using the cached point if there is one. `ec` may be
+   * NULL if only the native point is wanted.
+   *
+   * If `native` is not NULL, it also receives the point decoded for the
+   * native engine, in which case `*has_native` tells whether that worked.
+   *
+   * Returns false if the key could not be decoded.
+   */
+  static bool Fetch(const unsigned char *pub, int pub_len, EC_KEY *ec,
+                    Secp256k1::Point *native, bool *has_native);
+
+  // Maximum number of entries, 0 disables the cache
+  static void SetCapacity(size_t size);
+
+  static void GetStats(uint64_t *hits_out, uint64_t *misses_out,
+                       size_t *size_out, size_t *capacity_out);
+};
+
+#endif
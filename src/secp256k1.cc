@@ -0,0 +1,1174 @@
+#include <string.h>
+
+#include "secp256k1.h"
+
+#ifdef HAVE_NATIVE_SECP256K1
+
+typedef unsigned __int128 uint128_t;
+typedef Secp256k1::FieldElem fe_t;
+typedef Secp256k1::Point ge_t;
+
+// Jacobian point (x = X/Z^2, y = Y/Z^3)
+struct gej_t {
+  fe_t x;
+  fe_t y;
+  fe_t z;
+  int infinity;
+};
+
+// Scalar modulo the group order n, little endian limbs
+struct sc_t {
+  uint64_t n[4];
+};
+
+// p = 2^256 - 2^32 - 977
+static const uint64_t P[4] = {
+  0xFFFFFFFEFFFFFC2FULL, 0xFFFFFFFFFFFFFFFFULL,
+  0xFFFFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL
+};
+// 2^256 - p
+static const uint64_t P_C = 0x1000003D1ULL;
+
+// n = group order
+static const uint64_t N[4] = {
+  0xBFD25E8CD0364141ULL, 0xBAAEDCE6AF48A03BULL,
+  0xFFFFFFFFFFFFFFFEULL, 0xFFFFFFFFFFFFFFFFULL
+};
+// 2^256 - n
+static const uint64_t N_C[3] = {
+  0x402DA1732FC9BEBFULL, 0x4551231950B75FC4ULL, 0x1ULL
+};
+// (n - 1) / 2
+static const uint64_t N_H[4] = {
+  0xDFE92F46681B20A0ULL, 0x5D576E7357A4501DULL,
+  0xFFFFFFFFFFFFFFFFULL, 0x7FFFFFFFFFFFFFFFULL
+};
+
+// Endomorphism: lambda * (x, y) = (beta * x, y)
+static const sc_t LAMBDA = {{
+  0xDF02967C1B23BD72ULL, 0x122E22EA20816678ULL,
+  0xA5261C028812645AULL, 0x5363AD4CC05C30E0ULL
+}};
+static const fe_t BETA = {{
+  0xC1396C28719501EEULL, 0x9CF0497512F58995ULL,
+  0x6E64479EAC3434E9ULL, 0x7AE96A2B657C0710ULL
+}};
+
+// Lattice basis used to split a scalar into two ~128 bit halves
+static const sc_t MINUS_B1 = {{
+  0x6F547FA90ABFE4C3ULL, 0xE4437ED6010E8828ULL, 0, 0
+}};
+static const sc_t MINUS_B2 = {{
+  0xD765CDA83DB1562CULL, 0x8A280AC50774346DULL,
+  0xFFFFFFFFFFFFFFFEULL, 0xFFFFFFFFFFFFFFFFULL
+}};
+static const sc_t G1 = {{
+  0xE893209A45DBB031ULL, 0x3DAA8A1471E8CA7FULL,
+  0xE86C90E49284EB15ULL, 0x3086D221A7D46BCDULL
+}};
+static const sc_t G2 = {{
+  0x1571B4AE8AC47F71ULL, 0x221208AC9DF506C6ULL,
+  0x6F547FA90ABFE4C4ULL, 0xE4437ED6010E8828ULL
+}};
+
+static const fe_t GX = {{
+  0x59F2815B16F81798ULL, 0x029BFCDB2DCE28D9ULL,
+  0x55A06295CE870B07ULL, 0x79BE667EF9DCBBACULL
+}};
+static const fe_t GY = {{
+  0x9C47D08FFB10D4B8ULL, 0xFD17B448A6855419ULL,
+  0x5DA4FBFC0E1108A8ULL, 0x483ADA7726A3C465ULL
+}};
+
+// Window size for the wNAF representation of the u2 halves
+#define WNAF_BITS 5
+#define WNAF_TABLE_SIZE (1 << (WNAF_BITS - 2))
+
+// Generator table: G_TABLE[i][j] = (j + 1) * 16^i * G
+#define G_WINDOWS 64
+#define G_ENTRIES 15
+
+static ge_t G_TABLE[G_WINDOWS][G_ENTRIES];
+static bool initialized = false;
+
+/*
+ * Field arithmetic
+ */
+
+static inline int fe_cmp_p(const fe_t *a)
+{
+  for (int i = 3; i >= 0; i--) {
+    if (a->n[i] > P[i]) return 1;
+    if (a->n[i] < P[i]) return -1;
+  }
+  return 0;
+}
+
+static inline int fe_set_b32(fe_t *r, const unsigned char *b)
+{
+  for (int i = 0; i < 4; i++) {
+    const unsigned char *p = b + 24 - 8 * i;
+    r->n[i] = ((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) |
+              ((uint64_t)p[2] << 40) | ((uint64_t)p[3] << 32) |
+              ((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) |
+              ((uint64_t)p[6] <<  8) |  (uint64_t)p[7];
+  }
+  return fe_cmp_p(r) < 0;
+}
+
+static inline void fe_set_int(fe_t *r, uint64_t v)
+{
+  r->n[0] = v;
+  r->n[1] = r->n[2] = r->n[3] = 0;
+}
+
+static inline int fe_is_zero(const fe_t *a)
+{
+  return (a->n[0] | a->n[1] | a->n[2] | a->n[3]) == 0;
+}
+
+static inline int fe_is_odd(const fe_t *a)
+{
+  return a->n[0] & 1;
+}
+
+static inline int fe_equal(const fe_t *a, const fe_t *b)
+{
+  return ((a->n[0] ^ b->n[0]) | (a->n[1] ^ b->n[1]) |
+          (a->n[2] ^ b->n[2]) | (a->n[3] ^ b->n[3])) == 0;
+}
+
+// Three word accumulator used by the multiplication routines
+#define MULADD(x, y) {                                        \
+    uint128_t t_ = (uint128_t)(x) * (y);                      \
+    uint64_t tl_ = (uint64_t)t_, th_ = (uint64_t)(t_ >> 64);  \
+    c0 += tl_; th_ += (c0 < tl_);                             \
+    c1 += th_; c2 += (c1 < th_);                              \
+  }
+#define SUMADD(x) {                                           \
+    uint64_t x_ = (x);                                        \
+    c0 += x_; x_ = (c0 < x_);                                 \
+    c1 += x_; c2 += (c1 < x_);                                \
+  }
+#define MULADD2(x, y) {                                       \
+    uint128_t t_ = (uint128_t)(x) * (y);                      \
+    uint64_t tl_ = (uint64_t)t_, th_ = (uint64_t)(t_ >> 64);  \
+    uint64_t th2_ = th_ + th_;                                \
+    c2 += (th2_ < th_);                                       \
+    uint64_t tl2_ = tl_ + tl_;                                \
+    th2_ += (tl2_ < tl_);                                     \
+    c0 += tl2_; th2_ += (c0 < tl2_);                          \
+    c2 += (c0 < tl2_) & (th2_ == 0);                          \
+    c1 += th2_; c2 += (c1 < th2_);                            \
+  }
+#define EXTRACT(out) { (out) = c0; c0 = c1; c1 = c2; c2 = 0; }
+
+// r = a + (2^256 - p), returns the carry out of bit 256
+static inline uint64_t fe_add_c(fe_t *r, const fe_t *a)
+{
+  uint128_t c = (uint128_t)a->n[0] + P_C;
+  r->n[0] = (uint64_t)c; c >>= 64;
+  c += a->n[1]; r->n[1] = (uint64_t)c; c >>= 64;
+  c += a->n[2]; r->n[2] = (uint64_t)c; c >>= 64;
+  c += a->n[3]; r->n[3] = (uint64_t)c; c >>= 64;
+  return (uint64_t)c;
+}
+
+// Reduces a value below 2^256 + p (given as carry + r) into [0, p)
+static inline void fe_normalize(fe_t *r, uint64_t carry)
+{
+  // r >= p exactly when r + 2^256 - p overflows
+  fe_t t;
+  if (fe_add_c(&t, r) | carry) {
+    *r = t;
+  }
+}
+
+static inline void fe_add(fe_t *r, const fe_t *a, const fe_t *b)
+{
+  uint128_t c = 0;
+  for (int i = 0; i < 4; i++) {
+    c += (uint128_t)a->n[i] + b->n[i];
+    r->n[i] = (uint64_t)c;
+    c >>= 64;
+  }
+  fe_normalize(r, (uint64_t)c);
+}
+
+static inline void fe_negate(fe_t *r, const fe_t *a)
+{
+  if (fe_is_zero(a)) {
+    fe_set_int(r, 0);
+    return;
+  }
+  uint128_t b = 0;
+  for (int i = 0; i < 4; i++) {
+    uint128_t d = (uint128_t)P[i] - a->n[i] - b;
+    r->n[i] = (uint64_t)d;
+    b = (d >> 64) & 1;
+  }
+}
+
+static inline void fe_sub(fe_t *r, const fe_t *a, const fe_t *b)
+{
+  uint128_t d;
+  uint64_t borrow = 0;
+  for (int i = 0; i < 4; i++) {
+    d = (uint128_t)a->n[i] - b->n[i] - borrow;
+    r->n[i] = (uint64_t)d;
+    borrow = (uint64_t)(d >> 64) & 1;
+  }
+  if (borrow) {
+    // Wrapped around 2^256, adding p is the same as subtracting 2^256 - p
+    d = (uint128_t)r->n[0] - P_C;
+    r->n[0] = (uint64_t)d;
+    borrow = (uint64_t)(d >> 64) & 1;
+    for (int i = 1; i < 4; i++) {
+      d = (uint128_t)r->n[i] - borrow;
+      r->n[i] = (uint64_t)d;
+      borrow = (uint64_t)(d >> 64) & 1;
+    }
+  }
+}
+
+// Reduces the 512 bit product l[0..7] modulo p
+static inline void fe_reduce_512(fe_t *r, const uint64_t *l)
+{
+  // Fold the upper half back in: 2^256 = 2^32 + 977 (mod p)
+  uint128_t c;
+  c = (uint128_t)l[4] * P_C + l[0]; r->n[0] = (uint64_t)c; c >>= 64;
+  c += (uint128_t)l[5] * P_C + l[1]; r->n[1] = (uint64_t)c; c >>= 64;
+  c += (uint128_t)l[6] * P_C + l[2]; r->n[2] = (uint64_t)c; c >>= 64;
+  c += (uint128_t)l[7] * P_C + l[3]; r->n[3] = (uint64_t)c; c >>= 64;
+
+  // At most 34 bits are left over, fold them in once more
+  c = (uint128_t)(uint64_t)c * P_C + r->n[0];
+  r->n[0] = (uint64_t)c; c >>= 64;
+  c += r->n[1]; r->n[1] = (uint64_t)c; c >>= 64;
+  c += r->n[2]; r->n[2] = (uint64_t)c; c >>= 64;
+  c += r->n[3]; r->n[3] = (uint64_t)c; c >>= 64;
+
+  fe_normalize(r, (uint64_t)c);
+}
+
+static void fe_mul(fe_t *r, const fe_t *a, const fe_t *b)
+{
+  const uint64_t *x = a->n, *y = b->n;
+  uint64_t c0 = 0, c1 = 0, c2 = 0;
+  uint64_t l[8];
+
+  MULADD(x[0], y[0]); EXTRACT(l[0]);
+  MULADD(x[0], y[1]); MULADD(x[1], y[0]); EXTRACT(l[1]);
+  MULADD(x[0], y[2]); MULADD(x[1], y[1]); MULADD(x[2], y[0]); EXTRACT(l[2]);
+  MULADD(x[0], y[3]); MULADD(x[1], y[2]); MULADD(x[2], y[1]); MULADD(x[3], y[0]);
+  EXTRACT(l[3]);
+  MULADD(x[1], y[3]); MULADD(x[2], y[2]); MULADD(x[3], y[1]); EXTRACT(l[4]);
+  MULADD(x[2], y[3]); MULADD(x[3], y[2]); EXTRACT(l[5]);
+  MULADD(x[3], y[3]); EXTRACT(l[6]);
+  l[7] = c0;
+
+  fe_reduce_512(r, l);
+}
+
+static void fe_sqr(fe_t *r, const fe_t *a)
+{
+  const uint64_t *x = a->n;
+  uint64_t c0 = 0, c1 = 0, c2 = 0;
+  uint64_t l[8];
+
+  MULADD(x[0], x[0]); EXTRACT(l[0]);
+  MULADD2(x[0], x[1]); EXTRACT(l[1]);
+  MULADD2(x[0], x[2]); MULADD(x[1], x[1]); EXTRACT(l[2]);
+  MULADD2(x[0], x[3]); MULADD2(x[1], x[2]); EXTRACT(l[3]);
+  MULADD2(x[1], x[3]); MULADD(x[2], x[2]); EXTRACT(l[4]);
+  MULADD2(x[2], x[3]); EXTRACT(l[5]);
+  MULADD(x[3], x[3]); EXTRACT(l[6]);
+  l[7] = c0;
+
+  fe_reduce_512(r, l);
+}
+
+static inline void fe_sqr_n(fe_t *r, const fe_t *a, int n)
+{
+  *r = *a;
+  for (int i = 0; i < n; i++) {
+    fe_sqr(r, r);
+  }
+}
+
+// Computes a^(2^223 - 1) and the intermediate blocks used by inv/sqrt
+static void fe_pow_blocks(const fe_t *a, fe_t *x2, fe_t *x22, fe_t *x223)
+{
+  fe_t x3, x6, x9, x11, x44, x88, x176, x220, t;
+
+  fe_sqr(x2, a);       fe_mul(x2, x2, a);
+  fe_sqr(&x3, x2);     fe_mul(&x3, &x3, a);
+  fe_sqr_n(&t, &x3, 3);     fe_mul(&x6, &t, &x3);
+  fe_sqr_n(&t, &x6, 3);     fe_mul(&x9, &t, &x3);
+  fe_sqr_n(&t, &x9, 2);     fe_mul(&x11, &t, x2);
+  fe_sqr_n(&t, &x11, 11);   fe_mul(x22, &t, &x11);
+  fe_sqr_n(&t, x22, 22);    fe_mul(&x44, &t, x22);
+  fe_sqr_n(&t, &x44, 44);   fe_mul(&x88, &t, &x44);
+  fe_sqr_n(&t, &x88, 88);   fe_mul(&x176, &t, &x88);
+  fe_sqr_n(&t, &x176, 44);  fe_mul(&x220, &t, &x44);
+  fe_sqr_n(&t, &x220, 3);   fe_mul(x223, &t, &x3);
+}
+
+// r = a^(p - 2)
+static void fe_inv(fe_t *r, const fe_t *a)
+{
+  fe_t x2, x22, x223, t;
+
+  fe_pow_blocks(a, &x2, &x22, &x223);
+  fe_sqr_n(&t, &x223, 23); fe_mul(&t, &t, &x22);
+  fe_sqr_n(&t, &t, 5);     fe_mul(&t, &t, a);
+  fe_sqr_n(&t, &t, 3);     fe_mul(&t, &t, &x2);
+  fe_sqr_n(&t, &t, 2);     fe_mul(r, &t, a);
+}
+
+// r = a^((p + 1) / 4), returns whether r is actually a square root of a
+static int fe_sqrt(fe_t *r, const fe_t *a)
+{
+  fe_t x2, x22, x223, t, check;
+
+  fe_pow_blocks(a, &x2, &x22, &x223);
+  fe_sqr_n(&t, &x223, 23); fe_mul(&t, &t, &x22);
+  fe_sqr_n(&t, &t, 6);     fe_mul(&t, &t, &x2);
+  fe_sqr_n(r, &t, 2);
+
+  fe_sqr(&check, r);
+  return fe_equal(&check, a);
+}
+
+// Inverts len elements using a single field inversion
+static void fe_inv_all(fe_t *r, const fe_t *a, int len)
+{
+  if (len < 1) return;
+
+  r[0] = a[0];
+  for (int i = 1; i < len; i++) {
+    fe_mul(&r[i], &r[i - 1], &a[i]);
+  }
+
+  fe_t u;
+  fe_inv(&u, &r[len - 1]);
+
+  for (int i = len - 1; i > 0; i--) {
+    fe_mul(&r[i], &r[i - 1], &u);
+    fe_mul(&u, &u, &a[i]);
+  }
+  r[0] = u;
+}
+
+/*
+ * Scalar arithmetic
+ */
+
+static inline int sc_cmp_n(const uint64_t *a)
+{
+  for (int i = 3; i >= 0; i--) {
+    if (a[i] > N[i]) return 1;
+    if (a[i] < N[i]) return -1;
+  }
+  return 0;
+}
+
+// Subtracts n if a >= n
+static inline void sc_reduce_once(sc_t *a)
+{
+  if (sc_cmp_n(a->n) >= 0) {
+    uint128_t b = 0;
+    for (int i = 0; i < 4; i++) {
+      uint128_t d = (uint128_t)a->n[i] - N[i] - b;
+      a->n[i] = (uint64_t)d;
+      b = (d >> 64) & 1;
+    }
+  }
+}
+
+// Loads a big endian scalar, returns 1 if it was >= n (and got reduced)
+static int sc_set_b32(sc_t *r, const unsigned char *b)
+{
+  for (int i = 0; i < 4; i++) {
+    const unsigned char *p = b + 24 - 8 * i;
+    r->n[i] = ((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) |
+              ((uint64_t)p[2] << 40) | ((uint64_t)p[3] << 32) |
+              ((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) |
+              ((uint64_t)p[6] <<  8) |  (uint64_t)p[7];
+  }
+  int overflow = sc_cmp_n(r->n) >= 0;
+  sc_reduce_once(r);
+  return overflow;
+}
+
+static inline int sc_is_zero(const sc_t *a)
+{
+  return (a->n[0] | a->n[1] | a->n[2] | a->n[3]) == 0;
+}
+
+static inline int sc_is_high(const sc_t *a)
+{
+  for (int i = 3; i >= 0; i--) {
+    if (a->n[i] > N_H[i]) return 1;
+    if (a->n[i] < N_H[i]) return 0;
+  }
+  return 0;
+}
+
+static void sc_negate(sc_t *r, const sc_t *a)
+{
+  if (sc_is_zero(a)) {
+    *r = *a;
+    return;
+  }
+  uint128_t b = 0;
+  for (int i = 0; i < 4; i++) {
+    uint128_t d = (uint128_t)N[i] - a->n[i] - b;
+    r->n[i] = (uint64_t)d;
+    b = (d >> 64) & 1;
+  }
+}
+
+static void sc_add(sc_t *r, const sc_t *a, const sc_t *b)
+{
+  uint128_t c = 0;
+  for (int i = 0; i < 4; i++) {
+    c += (uint128_t)a->n[i] + b->n[i];
+    r->n[i] = (uint64_t)c;
+    c >>= 64;
+  }
+  if (c) {
+    // Add 2^256 - n, i.e. subtract n modulo 2^256
+    c = 0;
+    for (int i = 0; i < 4; i++) {
+      c += (uint128_t)r->n[i] + (i < 3 ? N_C[i] : 0);
+      r->n[i] = (uint64_t)c;
+      c >>= 64;
+    }
+  }
+  sc_reduce_once(r);
+}
+
+// Full 512 bit product
+static void sc_mul_512(uint64_t *l, const sc_t *a, const sc_t *b)
+{
+  const uint64_t *x = a->n, *y = b->n;
+  uint64_t c0 = 0, c1 = 0, c2 = 0;
+
+  MULADD(x[0], y[0]); EXTRACT(l[0]);
+  MULADD(x[0], y[1]); MULADD(x[1], y[0]); EXTRACT(l[1]);
+  MULADD(x[0], y[2]); MULADD(x[1], y[1]); MULADD(x[2], y[0]); EXTRACT(l[2]);
+  MULADD(x[0], y[3]); MULADD(x[1], y[2]); MULADD(x[2], y[1]); MULADD(x[3], y[0]);
+  EXTRACT(l[3]);
+  MULADD(x[1], y[3]); MULADD(x[2], y[2]); MULADD(x[3], y[1]); EXTRACT(l[4]);
+  MULADD(x[2], y[3]); MULADD(x[3], y[2]); EXTRACT(l[5]);
+  MULADD(x[3], y[3]); EXTRACT(l[6]);
+  l[7] = c0;
+}
+
+static void sc_reduce_512(sc_t *r, const uint64_t *l)
+{
+  const uint64_t n0 = l[4], n1 = l[5], n2 = l[6], n3 = l[7];
+  uint64_t m0, m1, m2, m3, m4, m5, m6;
+  uint64_t p0, p1, p2, p3, p4;
+  uint64_t c0, c1, c2;
+
+  // 512 -> 385 bits: m = l[0..3] + l[4..7] * (2^256 - n)
+  c0 = l[0]; c1 = 0; c2 = 0;
+  MULADD(n0, N_C[0]); EXTRACT(m0);
+  SUMADD(l[1]); MULADD(n1, N_C[0]); MULADD(n0, N_C[1]); EXTRACT(m1);
+  SUMADD(l[2]); MULADD(n2, N_C[0]); MULADD(n1, N_C[1]); SUMADD(n0); EXTRACT(m2);
+  SUMADD(l[3]); MULADD(n3, N_C[0]); MULADD(n2, N_C[1]); SUMADD(n1); EXTRACT(m3);
+  MULADD(n3, N_C[1]); SUMADD(n2); EXTRACT(m4);
+  SUMADD(n3); EXTRACT(m5);
+  m6 = c0;
+
+  // 385 -> 258 bits: p = m[0..3] + m[4..6] * (2^256 - n)
+  c0 = m0; c1 = 0; c2 = 0;
+  MULADD(m4, N_C[0]); EXTRACT(p0);
+  SUMADD(m1); MULADD(m5, N_C[0]); MULADD(m4, N_C[1]); EXTRACT(p1);
+  SUMADD(m2); MULADD(m6, N_C[0]); MULADD(m5, N_C[1]); SUMADD(m4); EXTRACT(p2);
+  SUMADD(m3); MULADD(m6, N_C[1]); SUMADD(m5); EXTRACT(p3);
+  p4 = c0 + m6;
+
+  // 258 -> 256 bits: r = p[0..3] + p4 * (2^256 - n)
+  uint128_t c;
+  c = (uint128_t)p0 + (uint128_t)N_C[0] * p4;
+  r->n[0] = (uint64_t)c; c >>= 64;
+  c += (uint128_t)p1 + (uint128_t)N_C[1] * p4;
+  r->n[1] = (uint64_t)c; c >>= 64;
+  c += (uint128_t)p2 + p4;
+  r->n[2] = (uint64_t)c; c >>= 64;
+  c += p3;
+  r->n[3] = (uint64_t)c; c >>= 64;
+
+  if ((uint64_t)c) {
+    // Overflowed 2^256 once more, which is N_C modulo n
+    c = (uint128_t)r->n[0] + N_C[0]; r->n[0] = (uint64_t)c; c >>= 64;
+    c += (uint128_t)r->n[1] + N_C[1]; r->n[1] = (uint64_t)c; c >>= 64;
+    c += (uint128_t)r->n[2] + N_C[2]; r->n[2] = (uint64_t)c; c >>= 64;
+    c += r->n[3]; r->n[3] = (uint64_t)c;
+  }
+
+  sc_reduce_once(r);
+}
+
+static void sc_mul(sc_t *r, const sc_t *a, const sc_t *b)
+{
+  uint64_t t[8];
+  sc_mul_512(t, a, b);
+  sc_reduce_512(r, t);
+}
+
+// r = a^(n - 2)
+static void sc_inv(sc_t *r, const sc_t *a)
+{
+  // n - 2, little endian limbs
+  static const uint64_t E[4] = {
+    0xBFD25E8CD036413FULL, 0xBAAEDCE6AF48A03BULL,
+    0xFFFFFFFFFFFFFFFEULL, 0xFFFFFFFFFFFFFFFFULL
+  };
+
+  sc_t x = {{1, 0, 0, 0}};
+  for (int i = 255; i >= 0; i--) {
+    sc_mul(&x, &x, &x);
+    if ((E[i >> 6] >> (i & 63)) & 1) {
+      sc_mul(&x, &x, a);
+    }
+  }
+  *r = x;
+}
+
+// r = round(a * b / 2^384)
+static void sc_mul_shift_384(sc_t *r, const sc_t *a, const sc_t *b)
+{
+  uint64_t t[8];
+  sc_mul_512(t, a, b);
+
+  r->n[0] = t[6];
+  r->n[1] = t[7];
+  r->n[2] = r->n[3] = 0;
+
+  if ((t[5] >> 63) & 1) {
+    uint128_t c = (uint128_t)r->n[0] + 1;
+    r->n[0] = (uint64_t)c;
+    r->n[1] += (uint64_t)(c >> 64);
+  }
+}
+
+// Splits k into k1 + k2 * lambda with k1, k2 about 128 bits each (+/-)
+static void sc_split_lambda(sc_t *k1, sc_t *k2, const sc_t *k)
+{
+  sc_t c1, c2, t;
+
+  sc_mul_shift_384(&c1, k, &G1);
+  sc_mul_shift_384(&c2, k, &G2);
+  sc_mul(&c1, &c1, &MINUS_B1);
+  sc_mul(&c2, &c2, &MINUS_B2);
+  sc_add(k2, &c1, &c2);
+
+  sc_mul(&t, k2, &LAMBDA);
+  sc_negate(&t, &t);
+  sc_add(k1, k, &t);
+}
+
+// Width-w NAF of a scalar below 2^129, returns the number of digits
+static int sc_wnaf(int *wnaf, const sc_t *a, int w)
+{
+  uint64_t k[5] = {a->n[0], a->n[1], a->n[2], a->n[3], 0};
+  int len = 0;
+
+  while (k[0] | k[1] | k[2] | k[3] | k[4]) {
+    int digit = 0;
+    if (k[0] & 1) {
+      digit = (int)(k[0] & ((1 << w) - 1));
+      if (digit >= (1 << (w - 1))) {
+        digit -= (1 << w);
+      }
+
+      // k -= digit
+      uint64_t d = digit > 0 ? (uint64_t)digit : (uint64_t)-digit;
+      int i;
+      if (digit > 0) {
+        uint64_t borrow = d;
+        for (i = 0; borrow && i < 5; i++) {
+          uint64_t old = k[i];
+          k[i] -= borrow;
+          borrow = old < borrow ? 1 : 0;
+        }
+      } else {
+        uint64_t carry = d;
+        for (i = 0; carry && i < 5; i++) {
+          k[i] += carry;
+          carry = k[i] < carry ? 1 : 0;
+        }
+      }
+    }
+    wnaf[len++] = digit;
+
+    // k >>= 1
+    for (int i = 0; i < 4; i++) {
+      k[i] = (k[i] >> 1) | (k[i + 1] << 63);
+    }
+    k[4] >>= 1;
+  }
+
+  return len;
+}
+
+/*
+ * Group arithmetic
+ */
+
+static inline void gej_set_infinity(gej_t *r)
+{
+  r->infinity = 1;
+  fe_set_int(&r->x, 0);
+  fe_set_int(&r->y, 0);
+  fe_set_int(&r->z, 0);
+}
+
+static inline void gej_set_ge(gej_t *r, const ge_t *a)
+{
+  r->infinity = a->infinity;
+  r->x = a->x;
+  r->y = a->y;
+  fe_set_int(&r->z, 1);
+}
+
+static void gej_double(gej_t *r, const gej_t *a)
+{
+  if (a->infinity || fe_is_zero(&a->y)) {
+    gej_set_infinity(r);
+    return;
+  }
+
+  // dbl-2009-l (a = 0)
+  fe_t A, B, C, D, E, F, t;
+
+  fe_sqr(&A, &a->x);
+  fe_sqr(&B, &a->y);
+  fe_sqr(&C, &B);
+
+  fe_add(&t, &a->x, &B);
+  fe_sqr(&t, &t);
+  fe_sub(&t, &t, &A);
+  fe_sub(&t, &t, &C);
+  fe_add(&D, &t, &t);
+
+  fe_add(&E, &A, &A);
+  fe_add(&E, &E, &A);
+  fe_sqr(&F, &E);
+
+  // Z3 = 2 * Y1 * Z1 (before overwriting r, which may alias a)
+  fe_t z3;
+  fe_mul(&z3, &a->y, &a->z);
+  fe_add(&z3, &z3, &z3);
+
+  fe_t x3;
+  fe_sub(&x3, &F, &D);
+  fe_sub(&x3, &x3, &D);
+
+  fe_t y3;
+  fe_sub(&y3, &D, &x3);
+  fe_mul(&y3, &E, &y3);
+  fe_add(&t, &C, &C);
+  fe_add(&t, &t, &t);
+  fe_add(&t, &t, &t);
+  fe_sub(&y3, &y3, &t);
+
+  r->x = x3;
+  r->y = y3;
+  r->z = z3;
+  r->infinity = 0;
+}
+
+// r = a + b where b is affine
+static void gej_add_ge(gej_t *r, const gej_t *a, const ge_t *b)
+{
+  if (b->infinity) {
+    *r = *a;
+    return;
+  }
+  if (a->infinity) {
+    gej_set_ge(r, b);
+    return;
+  }
+
+  fe_t z1z1, u2, s2, h, rr, hh, hhh, v, t;
+
+  fe_sqr(&z1z1, &a->z);
+  fe_mul(&u2, &b->x, &z1z1);
+  fe_mul(&s2, &b->y, &a->z);
+  fe_mul(&s2, &s2, &z1z1);
+
+  fe_sub(&h, &u2, &a->x);
+  fe_sub(&rr, &s2, &a->y);
+
+  if (fe_is_zero(&h)) {
+    if (fe_is_zero(&rr)) {
+      gej_double(r, a);
+    } else {
+      gej_set_infinity(r);
+    }
+    return;
+  }
+
+  fe_sqr(&hh, &h);
+  fe_mul(&hhh, &h, &hh);
+  fe_mul(&v, &a->x, &hh);
+
+  fe_t x3, y3, z3;
+  fe_sqr(&x3, &rr);
+  fe_sub(&x3, &x3, &hhh);
+  fe_sub(&x3, &x3, &v);
+  fe_sub(&x3, &x3, &v);
+
+  fe_sub(&y3, &v, &x3);
+  fe_mul(&y3, &y3, &rr);
+  fe_mul(&t, &a->y, &hhh);
+  fe_sub(&y3, &y3, &t);
+
+  fe_mul(&z3, &a->z, &h);
+
+  r->x = x3;
+  r->y = y3;
+  r->z = z3;
+  r->infinity = 0;
+}
+
+// r = a + b, both Jacobian (only used during precomputation)
+static void gej_add(gej_t *r, const gej_t *a, const gej_t *b)
+{
+  if (a->infinity) {
+    *r = *b;
+    return;
+  }
+  if (b->infinity) {
+    *r = *a;
+    return;
+  }
+
+  fe_t z1z1, z2z2, u1, u2, s1, s2, h, rr, hh, hhh, v, t;
+
+  fe_sqr(&z1z1, &a->z);
+  fe_sqr(&z2z2, &b->z);
+  fe_mul(&u1, &a->x, &z2z2);
+  fe_mul(&u2, &b->x, &z1z1);
+  fe_mul(&s1, &a->y, &b->z);
+  fe_mul(&s1, &s1, &z2z2);
+  fe_mul(&s2, &b->y, &a->z);
+  fe_mul(&s2, &s2, &z1z1);
+
+  fe_sub(&h, &u2, &u1);
+  fe_sub(&rr, &s2, &s1);
+
+  if (fe_is_zero(&h)) {
+    if (fe_is_zero(&rr)) {
+      gej_double(r, a);
+    } else {
+      gej_set_infinity(r);
+    }
+    return;
+  }
+
+  fe_sqr(&hh, &h);
+  fe_mul(&hhh, &h, &hh);
+  fe_mul(&v, &u1, &hh);
+
+  fe_t x3, y3, z3;
+  fe_sqr(&x3, &rr);
+  fe_sub(&x3, &x3, &hhh);
+  fe_sub(&x3, &x3, &v);
+  fe_sub(&x3, &x3, &v);
+
+  fe_sub(&y3, &v, &x3);
+  fe_mul(&y3, &y3, &rr);
+  fe_mul(&t, &s1, &hhh);
+  fe_sub(&y3, &y3, &t);
+
+  fe_mul(&z3, &a->z, &b->z);
+  fe_mul(&z3, &z3, &h);
+
+  r->x = x3;
+  r->y = y3;
+  r->z = z3;
+  r->infinity = 0;
+}
+
+// Converts len Jacobian points (none at infinity) to affine
+static void gej_to_ge_all(ge_t *r, const gej_t *a, fe_t *zs, fe_t *zis, int len)
+{
+  for (int i = 0; i < len; i++) {
+    zs[i] = a[i].z;
+  }
+  fe_inv_all(zis, zs, len);
+  for (int i = 0; i < len; i++) {
+    fe_t zi2, zi3;
+    fe_sqr(&zi2, &zis[i]);
+    fe_mul(&zi3, &zi2, &zis[i]);
+    fe_mul(&r[i].x, &a[i].x, &zi2);
+    fe_mul(&r[i].y, &a[i].y, &zi3);
+    r[i].infinity = 0;
+  }
+}
+
+static inline void ge_negate(ge_t *r, const ge_t *a)
+{
+  r->x = a->x;
+  fe_negate(&r->y, &a->y);
+  r->infinity = a->infinity;
+}
+
+static int ge_is_on_curve(const ge_t *a)
+{
+  fe_t y2, x3, seven;
+  fe_sqr(&y2, &a->y);
+  fe_sqr(&x3, &a->x);
+  fe_mul(&x3, &x3, &a->x);
+  fe_set_int(&seven, 7);
+  fe_add(&x3, &x3, &seven);
+  return fe_equal(&y2, &x3);
+}
+
+/*
+ * Signature handling
+ */
+
+// Lenient DER parsing in the style of pre-1.0.1k OpenSSL: excess length
+// bytes, leading zeros and trailing garbage are tolerated, negative
+// integers are not.
+static int parse_der_lax(unsigned char *r32, unsigned char *s32,
+                         const unsigned char *sig, int sig_len)
+{
+  size_t inputlen = sig_len < 0 ? 0 : (size_t)sig_len;
+  size_t pos = 0, lenbyte;
+  size_t rpos, rlen, spos, slen;
+
+  memset(r32, 0, 32);
+  memset(s32, 0, 32);
+
+  // Sequence tag and length
+  if (pos == inputlen || sig[pos] != 0x30) return 0;
+  pos++;
+  if (pos == inputlen) return 0;
+  lenbyte = sig[pos++];
+  if (lenbyte & 0x80) {
+    lenbyte -= 0x80;
+    if (lenbyte > inputlen - pos) return 0;
+    pos += lenbyte;
+  }
+
+  for (int part = 0; part < 2; part++) {
+    size_t len;
+
+    // Integer tag and length
+    if (pos == inputlen || sig[pos] != 0x02) return 0;
+    pos++;
+    if (pos == inputlen) return 0;
+    lenbyte = sig[pos++];
+    if (lenbyte & 0x80) {
+      lenbyte -= 0x80;
+      if (lenbyte > inputlen - pos) return 0;
+      while (lenbyte > 0 && sig[pos] == 0) {
+        pos++;
+        lenbyte--;
+      }
+      if (lenbyte >= sizeof(size_t)) return 0;
+      len = 0;
+      while (lenbyte > 0) {
+        len = (len << 8) + sig[pos];
+        pos++;
+        lenbyte--;
+      }
+    } else {
+      len = lenbyte;
+    }
+    if (len > inputlen - pos) return 0;
+
+    if (part == 0) {
+      rpos = pos;
+      rlen = len;
+    } else {
+      spos = pos;
+      slen = len;
+    }
+    pos += len;
+  }
+
+  // Negative or empty integers are invalid
+  if (rlen == 0 || (sig[rpos] & 0x80)) return 0;
+  if (slen == 0 || (sig[spos] & 0x80)) return 0;
+
+  while (rlen > 0 && sig[rpos] == 0) {
+    rlen--;
+    rpos++;
+  }
+  while (slen > 0 && sig[spos] == 0) {
+    slen--;
+    spos++;
+  }
+  if (rlen > 32 || slen > 32) return 0;
+
+  memcpy(r32 + 32 - rlen, sig + rpos, rlen);
+  memcpy(s32 + 32 - slen, sig + spos, slen);
+
+  return 1;
+}
+
+// Computes u2 * Q + u1 * G
+static void ecmult(gej_t *r, const ge_t *q, const sc_t *u2, const sc_t *u1)
+{
+  sc_t k1, k2;
+  int neg1, neg2;
+
+  gej_set_infinity(r);
+
+  if (!sc_is_zero(u2)) {
+    sc_split_lambda(&k1, &k2, u2);
+    neg1 = sc_is_high(&k1);
+    neg2 = sc_is_high(&k2);
+    if (neg1) sc_negate(&k1, &k1);
+    if (neg2) sc_negate(&k2, &k2);
+
+    // Odd multiples Q, 3Q, 5Q, ... in affine coordinates
+    gej_t pj[WNAF_TABLE_SIZE], q2;
+    ge_t pre1[WNAF_TABLE_SIZE], pre2[WNAF_TABLE_SIZE];
+    fe_t zs[WNAF_TABLE_SIZE], zis[WNAF_TABLE_SIZE];
+
+    gej_set_ge(&pj[0], q);
+    gej_double(&q2, &pj[0]);
+    for (int i = 1; i < WNAF_TABLE_SIZE; i++) {
+      gej_add(&pj[i], &pj[i - 1], &q2);
+    }
+    gej_to_ge_all(pre1, pj, zs, zis, WNAF_TABLE_SIZE);
+
+    for (int i = 0; i < WNAF_TABLE_SIZE; i++) {
+      fe_mul(&pre2[i].x, &pre1[i].x, &BETA);
+      pre2[i].y = pre1[i].y;
+      pre2[i].infinity = 0;
+      if (neg1) fe_negate(&pre1[i].y, &pre1[i].y);
+      if (neg2) fe_negate(&pre2[i].y, &pre2[i].y);
+    }
+
+    int wnaf1[260], wnaf2[260];
+    int len1 = sc_wnaf(wnaf1, &k1, WNAF_BITS);
+    int len2 = sc_wnaf(wnaf2, &k2, WNAF_BITS);
+    int len = len1 > len2 ? len1 : len2;
+
+    ge_t tmp;
+    for (int i = len - 1; i >= 0; i--) {
+      gej_double(r, r);
+
+      int d;
+      if (i < len1 && (d = wnaf1[i]) != 0) {
+        if (d > 0) {
+          gej_add_ge(r, r, &pre1[(d - 1) / 2]);
+        } else {
+          ge_negate(&tmp, &pre1[(-d - 1) / 2]);
+          gej_add_ge(r, r, &tmp);
+        }
+      }
+      if (i < len2 && (d = wnaf2[i]) != 0) {
+        if (d > 0) {
+          gej_add_ge(r, r, &pre2[(d - 1) / 2]);
+        } else {
+          ge_negate(&tmp, &pre2[(-d - 1) / 2]);
+          gej_add_ge(r, r, &tmp);
+        }
+      }
+    }
+  }
+
+  // Generator part: one table lookup per 4 bit window, no doublings
+  for (int i = 0; i < G_WINDOWS; i++) {
+    int nibble = (int)((u1->n[i >> 4] >> ((i & 15) * 4)) & 0xf);
+    if (nibble) {
+      gej_add_ge(r, r, &G_TABLE[i][nibble - 1]);
+    }
+  }
+}
+
+/*
+ * Public interface
+ */
+
+bool Secp256k1::Init()
+{
+  if (initialized) {
+    return true;
+  }
+
+  static gej_t table[G_WINDOWS * G_ENTRIES];
+  static fe_t zs[G_WINDOWS * G_ENTRIES];
+  static fe_t zis[G_WINDOWS * G_ENTRIES];
+
+  ge_t g;
+  g.x = GX;
+  g.y = GY;
+  g.infinity = 0;
+
+  gej_t base;
+  gej_set_ge(&base, &g);
+  for (int i = 0; i < G_WINDOWS; i++) {
+    gej_t *row = &table[i * G_ENTRIES];
+    row[0] = base;
+    for (int j = 1; j < G_ENTRIES; j++) {
+      gej_add(&row[j], &row[j - 1], &base);
+    }
+    // Next window's base is 16 times this one's
+    gej_add(&base, &row[G_ENTRIES - 1], &base);
+  }
+
+  gej_to_ge_all(&G_TABLE[0][0], table, zs, zis, G_WINDOWS * G_ENTRIES);
+
+  initialized = true;
+  return true;
+}
+
+bool Secp256k1::IsAvailable()
+{
+  return true;
+}
+
+int Secp256k1::ParsePubKey(Point *out, const unsigned char *pub, int pub_len)
+{
+  out->infinity = 0;
+
+  if (pub_len == 33 && (pub[0] == 0x02 || pub[0] == 0x03)) {
+    fe_t x3, seven;
+    if (!fe_set_b32(&out->x, pub + 1)) return 0;
+
+    fe_sqr(&x3, &out->x);
+    fe_mul(&x3, &x3, &out->x);
+    fe_set_int(&seven, 7);
+    fe_add(&x3, &x3, &seven);
+    if (!fe_sqrt(&out->y, &x3)) return 0;
+
+    if (fe_is_odd(&out->y) != (pub[0] == 0x03)) {
+      fe_negate(&out->y, &out->y);
+    }
+    return 1;
+  }
+
+  if (pub_len == 65 && (pub[0] == 0x04 || pub[0] == 0x06 || pub[0] == 0x07)) {
+    if (!fe_set_b32(&out->x, pub + 1)) return 0;
+    if (!fe_set_b32(&out->y, pub + 33)) return 0;
+
+    // Hybrid encoding carries the parity of y in the prefix
+    if (pub[0] != 0x04 && fe_is_odd(&out->y) != (pub[0] == 0x07)) return 0;
+
+    return ge_is_on_curve(out);
+  }
+
+  return 0;
+}
+
+int Secp256k1::Verify(const Point *pub,
+                      const unsigned char *digest, int digest_len,
+                      const unsigned char *sig, int sig_len)
+{
+  if (!initialized) {
+    return -1;
+  }
+
+  unsigned char r32[32], s32[32], e32[32];
+  if (!parse_der_lax(r32, s32, sig, sig_len)) {
+    return -1;
+  }
+
+  sc_t r, s, e;
+  if (sc_set_b32(&r, r32) || sc_is_zero(&r)) return 0;
+  if (sc_set_b32(&s, s32) || sc_is_zero(&s)) return 0;
+
+  // Digest as a big endian integer, truncated to the order's bit length
+  memset(e32, 0, 32);
+  if (digest_len > 32) digest_len = 32;
+  if (digest_len > 0) memcpy(e32 + 32 - digest_len, digest, digest_len);
+  sc_set_b32(&e, e32);
+
+  sc_t w, u1, u2;
+  sc_inv(&w, &s);
+  sc_mul(&u1, &e, &w);
+  sc_mul(&u2, &r, &w);
+
+  gej_t R;
+  ecmult(&R, pub, &u2, &u1);
+  if (R.infinity) {
+    return 0;
+  }
+
+  // Compare x(R) mod n with r without leaving Jacobian coordinates
+  fe_t xr, zz, t;
+  fe_sqr(&zz, &R.z);
+  fe_set_b32(&xr, r32);
+  fe_mul(&t, &xr, &zz);
+  if (fe_equal(&t, &R.x)) {
+    return 1;
+  }
+
+  // x(R) may have been in [n, p), in which case r = x(R) - n
+  static const fe_t P_MINUS_N = {{
+    0x402DA1722FC9BAEEULL, 0x4551231950B75FC4ULL, 1, 0
+  }};
+  int small = 0;
+  for (int i = 3; i >= 0; i--) {
+    if (r.n[i] < P_MINUS_N.n[i]) { small = 1; break; }
+    if (r.n[i] > P_MINUS_N.n[i]) break;
+  }
+  if (small) {
+    fe_t rn;
+    memcpy(rn.n, N, sizeof(rn.n));
+    fe_add(&xr, &xr, &rn);
+    fe_mul(&t, &xr, &zz);
+    if (fe_equal(&t, &R.x)) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+int Secp256k1::Verify(const unsigned char *pub, int pub_len,
+                      const unsigned char *digest, int digest_len,
+                      const unsigned char *sig, int sig_len)
+{
+  Point point;
+  if (!ParsePubKey(&point, pub, pub_len)) {
+    return -1;
+  }
+  return Verify(&point, digest, digest_len, sig, sig_len);
+}
+
+#else
+
+bool Secp256k1::Init()
+{
+  return false;
+}
+
+bool Secp256k1::IsAvailable()
+{
+  return false;
+}
+
+int Secp256k1::ParsePubKey(Point *out, const unsigned char *pub, int pub_len)
+{
+  return 0;
+}
+
+int Secp256k1::Verify(const Point *pub,
+                      const unsigned char *digest, int digest_len,
+                      const unsigned char *sig, int sig_len)
+{
+  return -1;
+}
+
+int Secp256k1::Verify(const unsigned char *pub, int pub_len,
+                      const unsigned char *digest, int digest_len,
+                      const unsigned char *sig, int sig_len)
+{
+  return -1;
+}
+
+#endif
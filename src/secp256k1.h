@@ -0,0 +1,55 @@
+#ifndef BITCOINJS_SERVER_INCLUDE_SECP256K1_H_
+#define BITCOINJS_SERVER_INCLUDE_SECP256K1_H_
+
+#include <stdint.h>
+
+// The native engine relies on 64x64->128 bit multiplication. On platforms
+// without it (or when disabled at build time) only OpenSSL is available.
+#if defined(__SIZEOF_INT128__) && !defined(NO_NATIVE_SECP256K1)
+#define HAVE_NATIVE_SECP256K1 1
+#endif
+
+/**
+ * Specialized secp256k1 signature verification.
+ *
+ * Field elements use four 64 bit limbs, u1*G is computed from precomputed
+ * generator tables and u2*Q is split using the curve's endomorphism, so
+ * only about 130 point doublings are needed per signature.
+ */
+class Secp256k1
+{
+public:
+
+  // Field element modulo p, little endian limbs, always fully reduced
+  struct FieldElem {
+    uint64_t n[4];
+  };
+
+  // Affine point
+  struct Point {
+    FieldElem x;
+    FieldElem y;
+    int infinity;
+  };
+
+  // Builds the generator tables. Must be called once (from the main thread)
+  // before any other method. Returns false if the engine is not available.
+  static bool Init();
+
+  static bool IsAvailable();
+
+  // Decodes a serialized public key (compressed, uncompressed or hybrid),
+  // returns 1 on success and 0 if the encoding or point is invalid.
+  static int ParsePubKey(Point *out, const unsigned char *pub, int pub_len);
+
+  // Same return values as ECDSA_verify: 1 = good, 0 = bad sig, -1 = error
+  static int Verify(const Point *pub,
+                    const unsigned char *digest, int digest_len,
+                    const unsigned char *sig, int sig_len);
+
+  static int Verify(const unsigned char *pub, int pub_len,
+                    const unsigned char *digest, int digest_len,
+                    const unsigned char *sig, int sig_len);
+};
+
+#endif
@@ -0,0 +1,508 @@
+#include <string.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "sha256.h"
+
+using namespace std;
+
+#ifdef __GNUC__
+#define SHA256_ALIGNED __attribute__((aligned(64)))
+#else
+#define SHA256_ALIGNED
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || __GNUC__ > 4 || \
+     (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#include <immintrin.h>
+#define HAVE_SHA256_SSE41 1
+#define HAVE_SHA256_AVX2 1
+#define HAVE_SHA256_AVX512 1
+#endif
+
+const uint32_t Sha256::IV[8] = {
+  0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+  0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+const uint32_t Sha256::K[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+  0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+  0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+  0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+  0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+  0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t read_be32(const unsigned char *p)
+{
+  return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) |
+    ((uint32_t) p[2] << 8) | (uint32_t) p[3];
+}
+
+static inline void write_be32(unsigned char *p, uint32_t x)
+{
+  p[0] = x >> 24;
+  p[1] = x >> 16;
+  p[2] = x >> 8;
+  p[3] = x;
+}
+
+// Number of 64 byte blocks of a message after padding
+static inline size_t padded_blocks(size_t len)
+{
+  return (len + 9 + 63) / 64;
+}
+
+// Writes the last one or two (padded) blocks of a message to tail
+static inline void pad_tail(unsigned char *tail, const unsigned char *msg,
+                            size_t len)
+{
+  size_t full = len / 64;
+  size_t rest = len - full * 64;
+  size_t tail_len = (rest + 9 > 64) ? 128 : 64;
+  uint64_t bits = (uint64_t) len * 8;
+
+  memcpy(tail, msg + full * 64, rest);
+  tail[rest] = 0x80;
+  memset(tail + rest + 1, 0, tail_len - rest - 1);
+  for (int i = 0; i < 8; i++) {
+    tail[tail_len - 1 - i] = (unsigned char) (bits >> (8 * i));
+  }
+}
+
+// Block k of a message, full blocks are read in place
+static inline const unsigned char *
+block_ptr(const unsigned char *tail, const unsigned char *msg, size_t len,
+          size_t k)
+{
+  size_t full = len / 64;
+  return k < full ? msg + 64 * k : tail + 64 * (k - full);
+}
+
+// Plain C, one lane
+#define LANES_TRANSFORM transform_scalar
+#define LANES_HASH hash_scalar
+#define LANES_TARGET
+#define LANES_WIDTH 1
+#define vec_t uint32_t
+#define V_ADD(a, b) ((a) + (b))
+#define V_XOR(a, b) ((a) ^ (b))
+#define V_OR(a, b) ((a) | (b))
+#define V_AND(a, b) ((a) & (b))
+#define V_ANDNOT(a, b) (~(a) & (b))
+#define V_SHR(a, n) ((a) >> (n))
+#define V_SHL(a, n) ((a) << (n))
+#define V_SET1(x) ((uint32_t) (x))
+#define V_LOAD(p) (*(p))
+#define V_STORE(p, a) (*(p) = (a))
+#include "sha256_lanes.h"
+#undef LANES_TRANSFORM
+#undef LANES_HASH
+#undef LANES_TARGET
+#undef LANES_WIDTH
+#undef vec_t
+#undef V_ADD
+#undef V_XOR
+#undef V_OR
+#undef V_AND
+#undef V_ANDNOT
+#undef V_SHR
+#undef V_SHL
+#undef V_SET1
+#undef V_LOAD
+#undef V_STORE
+
+#ifdef HAVE_SHA256_SSE41
+
+#define LANES_TRANSFORM transform_sse41
+#define LANES_HASH hash_sse41
+#define LANES_TARGET __attribute__((target("sse4.1")))
+#define LANES_WIDTH 4
+#define vec_t __m128i
+#define V_ADD(a, b) _mm_add_epi32((a), (b))
+#define V_XOR(a, b) _mm_xor_si128((a), (b))
+#define V_OR(a, b) _mm_or_si128((a), (b))
+#define V_AND(a, b) _mm_and_si128((a), (b))
+#define V_ANDNOT(a, b) _mm_andnot_si128((a), (b))
+#define V_SHR(a, n) _mm_srli_epi32((a), (n))
+#define V_SHL(a, n) _mm_slli_epi32((a), (n))
+#define V_SET1(x) _mm_set1_epi32((int) (x))
+#define V_LOAD(p) _mm_load_si128((const __m128i *) (p))
+#define V_STORE(p, a) _mm_store_si128((__m128i *) (p), (a))
+#include "sha256_lanes.h"
+#undef LANES_TRANSFORM
+#undef LANES_HASH
+#undef LANES_TARGET
+#undef LANES_WIDTH
+#undef vec_t
+#undef V_ADD
+#undef V_XOR
+#undef V_OR
+#undef V_AND
+#undef V_ANDNOT
+#undef V_SHR
+#undef V_SHL
+#undef V_SET1
+#undef V_LOAD
+#undef V_STORE
+
+#endif
+
+#ifdef HAVE_SHA256_AVX2
+
+#define LANES_TRANSFORM transform_avx2
+#define LANES_HASH hash_avx2
+#define LANES_TARGET __attribute__((target("avx2")))
+#define LANES_WIDTH 8
+#define vec_t __m256i
+#define V_ADD(a, b) _mm256_add_epi32((a), (b))
+#define V_XOR(a, b) _mm256_xor_si256((a), (b))
+#define V_OR(a, b) _mm256_or_si256((a), (b))
+#define V_AND(a, b) _mm256_and_si256((a), (b))
+#define V_ANDNOT(a, b) _mm256_andnot_si256((a), (b))
+#define V_SHR(a, n) _mm256_srli_epi32((a), (n))
+#define V_SHL(a, n) _mm256_slli_epi32((a), (n))
+#define V_SET1(x) _mm256_set1_epi32((int) (x))
+#define V_LOAD(p) _mm256_load_si256((const __m256i *) (p))
+#define V_STORE(p, a) _mm256_store_si256((__m256i *) (p), (a))
+#include "sha256_lanes.h"
+#undef LANES_TRANSFORM
+#undef LANES_HASH
+#undef LANES_TARGET
+#undef LANES_WIDTH
+#undef vec_t
+#undef V_ADD
+#undef V_XOR
+#undef V_OR
+#undef V_AND
+#undef V_ANDNOT
+#undef V_SHR
+#undef V_SHL
+#undef V_SET1
+#undef V_LOAD
+#undef V_STORE
+
+#endif
+
+#ifdef HAVE_SHA256_AVX512
+
+// GCC's own avx512fintrin.h triggers -Wmaybe-uninitialized
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+#define LANES_TRANSFORM transform_avx512
+#define LANES_HASH hash_avx512
+#define LANES_TARGET __attribute__((target("avx512f")))
+#define LANES_WIDTH 16
+#define vec_t __m512i
+#define V_ADD(a, b) _mm512_add_epi32((a), (b))
+#define V_XOR(a, b) _mm512_xor_si512((a), (b))
+#define V_OR(a, b) _mm512_or_si512((a), (b))
+#define V_AND(a, b) _mm512_and_si512((a), (b))
+#define V_ANDNOT(a, b) _mm512_andnot_si512((a), (b))
+#define V_SHR(a, n) _mm512_srli_epi32((a), (n))
+#define V_SHL(a, n) _mm512_slli_epi32((a), (n))
+#define V_SET1(x) _mm512_set1_epi32((int) (x))
+#define V_LOAD(p) _mm512_load_si512((const void *) (p))
+#define V_STORE(p, a) _mm512_store_si512((void *) (p), (a))
+#define V_ROR(x, n) _mm512_ror_epi32((x), (n))
+#include "sha256_lanes.h"
+#undef LANES_TRANSFORM
+#undef LANES_HASH
+#undef LANES_TARGET
+#undef LANES_WIDTH
+#undef vec_t
+#undef V_ADD
+#undef V_XOR
+#undef V_OR
+#undef V_AND
+#undef V_ANDNOT
+#undef V_SHR
+#undef V_SHL
+#undef V_SET1
+#undef V_LOAD
+#undef V_STORE
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif
+
+typedef void (*lanes_hash_t)(const unsigned char *const *msgs,
+                             const size_t *lens, size_t nblocks,
+                             unsigned char *const *outs);
+
+struct impl_t {
+  const char *name;
+  int width;
+  lanes_hash_t hash;
+};
+
+// Widest first, the scalar implementation is always last and always
+// supported
+static const impl_t IMPLS[] = {
+#ifdef HAVE_SHA256_AVX512
+  { "avx512", 16, hash_avx512 },
+#endif
+#ifdef HAVE_SHA256_AVX2
+  { "avx2", 8, hash_avx2 },
+#endif
+#ifdef HAVE_SHA256_SSE41
+  { "sse4.1", 4, hash_sse41 },
+#endif
+  { "scalar", 1, hash_scalar }
+};
+
+#define IMPL_COUNT (sizeof(IMPLS) / sizeof(IMPLS[0]))
+
+static bool supported[IMPL_COUNT];
+
+// Index of the widest implementation in use
+static size_t active = IMPL_COUNT - 1;
+
+static bool cpu_supports(const char *name)
+{
+#ifdef HAVE_SHA256_SSE41
+  __builtin_cpu_init();
+  if (strcmp(name, "avx512") == 0) {
+    return __builtin_cpu_supports("avx512f");
+  } else if (strcmp(name, "avx2") == 0) {
+    return __builtin_cpu_supports("avx2");
+  } else if (strcmp(name, "sse4.1") == 0) {
+    return __builtin_cpu_supports("sse4.1");
+  }
+#endif
+  return strcmp(name, "scalar") == 0;
+}
+
+void Sha256::Init()
+{
+  active = IMPL_COUNT - 1;
+  for (size_t i = IMPL_COUNT; i-- > 0; ) {
+    supported[i] = cpu_supports(IMPLS[i].name);
+    if (supported[i]) {
+      active = i;
+    }
+  }
+}
+
+const char *Sha256::GetImplementation()
+{
+  return IMPLS[active].name;
+}
+
+bool Sha256::SetImplementation(const char *name)
+{
+  for (size_t i = 0; i < IMPL_COUNT; i++) {
+    if (strcmp(IMPLS[i].name, name) == 0) {
+      if (!supported[i]) {
+        return false;
+      }
+      active = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Hashes messages which all pad to nblocks blocks.
+ *
+ * Uses the widest implementation first and the narrower ones for whatever
+ * doesn't fill a whole vector.
+ */
+static void hash_group(const unsigned char *const *msgs, const size_t *lens,
+                       unsigned char *const *outs, size_t count,
+                       size_t nblocks)
+{
+  size_t i = 0;
+
+  for (size_t impl = active; impl < IMPL_COUNT; impl++) {
+    size_t width = IMPLS[impl].width;
+    if (!supported[impl]) {
+      continue;
+    }
+    for (; count - i >= width; i += width) {
+      IMPLS[impl].hash(msgs + i, lens + i, nblocks, outs + i);
+    }
+  }
+}
+
+struct by_blocks {
+  const size_t *lens;
+  bool operator()(size_t a, size_t b) const {
+    return padded_blocks(lens[a]) < padded_blocks(lens[b]);
+  }
+};
+
+void Sha256::Transform(uint32_t *state, const unsigned char *block)
+{
+  transform_scalar(state, &block);
+}
+
+Sha256::Stream::Stream() :
+  bytes(0)
+{
+  memcpy(state, IV, sizeof(state));
+}
+
+void Sha256::Stream::Write(const unsigned char *data, size_t len)
+{
+  size_t used = bytes % 64;
+  bytes += len;
+
+  if (used) {
+    size_t fill = 64 - used;
+    if (len < fill) {
+      memcpy(buf + used, data, len);
+      return;
+    }
+    memcpy(buf + used, data, fill);
+    Transform(state, buf);
+    data += fill;
+    len -= fill;
+  }
+
+  // Full blocks are hashed in place
+  for (; len >= 64; data += 64, len -= 64) {
+    Transform(state, data);
+  }
+  memcpy(buf, data, len);
+}
+
+void Sha256::Stream::Finalize(unsigned char *out)
+{
+  unsigned char tail[128];
+  size_t used = bytes % 64;
+  size_t tail_len = (used + 9 > 64) ? 128 : 64;
+  uint64_t bits = bytes * 8;
+
+  memcpy(tail, buf, used);
+  tail[used] = 0x80;
+  memset(tail + used + 1, 0, tail_len - used - 1);
+  for (int i = 0; i < 8; i++) {
+    tail[tail_len - 1 - i] = (unsigned char) (bits >> (8 * i));
+  }
+
+  Transform(state, tail);
+  if (tail_len == 128) {
+    Transform(state, tail + 64);
+  }
+
+  for (int i = 0; i < 8; i++) {
+    write_be32(out + 4 * i, state[i]);
+  }
+}
+
+void Sha256::Stream::FinalizeDouble(unsigned char *out)
+{
+  unsigned char hash[32];
+  Finalize(hash);
+
+  Stream second;
+  second.Write(hash, 32);
+  second.Finalize(out);
+}
+
+void Sha256::DoubleMany(const unsigned char *const *msgs, const size_t *lens,
+                        size_t count, unsigned char *out)
+{
+  if (count == 0) {
+    return;
+  }
+
+  // Lanes have to run in lockstep, so group the messages by block count
+  vector<size_t> order(count);
+  for (size_t i = 0; i < count; i++) {
+    order[i] = i;
+  }
+  by_blocks cmp;
+  cmp.lens = lens;
+  stable_sort(order.begin(), order.end(), cmp);
+
+  vector<const unsigned char *> sorted_msgs(count);
+  vector<size_t> sorted_lens(count);
+  vector<unsigned char *> first_outs(count);
+  vector<unsigned char> first(32 * count);
+  for (size_t i = 0; i < count; i++) {
+    sorted_msgs[i] = msgs[order[i]];
+    sorted_lens[i] = lens[order[i]];
+    first_outs[i] = &first[32 * order[i]];
+  }
+
+  for (size_t start = 0; start < count; ) {
+    size_t nblocks = padded_blocks(sorted_lens[start]);
+    size_t end = start + 1;
+    while (end < count && padded_blocks(sorted_lens[end]) == nblocks) {
+      end++;
+    }
+    hash_group(&sorted_msgs[start], &sorted_lens[start], &first_outs[start],
+               end - start, nblocks);
+    start = end;
+  }
+
+  // Second round, every input is a single block
+  vector<const unsigned char *> second_msgs(count);
+  vector<size_t> second_lens(count, 32);
+  vector<unsigned char *> second_outs(count);
+  for (size_t i = 0; i < count; i++) {
+    second_msgs[i] = &first[32 * i];
+    second_outs[i] = out + 32 * i;
+  }
+  hash_group(&second_msgs[0], &second_lens[0], &second_outs[0], count, 1);
+}
+
+void Sha256::MerkleLevel(const unsigned char *in, size_t size,
+                         unsigned char *out)
+{
+  size_t parents = (size + 1) / 2;
+  unsigned char last[64];
+
+  vector<const unsigned char *> msgs(parents);
+  vector<size_t> lens(parents, 64);
+
+  // Siblings are adjacent, so pairs are hashed straight from the level
+  for (size_t i = 0; i < parents; i++) {
+    msgs[i] = in + 64 * i;
+  }
+  if (size & 1) {
+    memcpy(last, in + 32 * (size - 1), 32);
+    memcpy(last + 32, in + 32 * (size - 1), 32);
+    msgs[parents - 1] = last;
+  }
+
+  DoubleMany(&msgs[0], &lens[0], parents, out);
+}
+
+void Sha256::MerkleRoot(const unsigned char *leaves, size_t count,
+                        unsigned char *root)
+{
+  if (count == 0) {
+    memset(root, 0, 32);
+    return;
+  }
+
+  // The leaves are copied once, all levels are then computed in that copy
+  vector<unsigned char> work(leaves, leaves + 32 * count);
+  for (size_t size = count; size > 1; size = (size + 1) / 2) {
+    MerkleLevel(&work[0], size, &work[0]);
+  }
+  memcpy(root, &work[0], 32);
+}
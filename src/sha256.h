@@ -0,0 +1,73 @@
+#ifndef BITCOINJS_SERVER_INCLUDE_SHA256_H_
+#define BITCOINJS_SERVER_INCLUDE_SHA256_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Multi-buffer SHA-256.
+ *
+ * Hashes many independent messages at once, using one SIMD lane per
+ * message (4 with SSE4.1, 8 with AVX2, 16 with AVX-512). The best
+ * implementation supported by the CPU is picked at runtime; messages that
+ * don't fill a whole vector go to the narrower ones, down to plain C.
+ */
+class Sha256
+{
+public:
+
+  // Detects the CPU features, must be called once from the main thread
+  static void Init();
+
+  // Name of the active implementation: "avx512", "avx2", "sse4.1" or "scalar"
+  static const char *GetImplementation();
+
+  // Selects an implementation by name, returns false if it is unsupported
+  static bool SetImplementation(const char *name);
+
+  // out + 32 * i receives sha256(sha256(msgs[i]))
+  static void DoubleMany(const unsigned char *const *msgs, const size_t *lens,
+                         size_t count, unsigned char *out);
+
+  /**
+   * Hashes one level of a merkle tree: reads `size` 32 byte nodes from `in`
+   * and writes (size + 1) / 2 parents to `out`, which may be equal to `in`.
+   * An odd last node is paired with itself, like CBlock::BuildMerkleTree().
+   */
+  static void MerkleLevel(const unsigned char *in, size_t size,
+                          unsigned char *out);
+
+  // Merkle root of `count` leaves, all zeros if there are none
+  static void MerkleRoot(const unsigned char *leaves, size_t count,
+                         unsigned char *root);
+
+  // Plain compression function, updates state with one 64 byte block
+  static void Transform(uint32_t *state, const unsigned char *block);
+
+  static const uint32_t IV[8];
+  static const uint32_t K[64];
+
+  /**
+   * Incremental hashing for data that is never materialized in one piece,
+   * built on the scalar Transform().
+   */
+  class Stream
+  {
+  public:
+    Stream();
+
+    void Write(const unsigned char *data, size_t len);
+
+    // Writes sha256 (Finalize) or sha256(sha256) (FinalizeDouble) to out,
+    // the stream can't be written to afterwards
+    void Finalize(unsigned char *out);
+    void FinalizeDouble(unsigned char *out);
+
+  private:
+    uint32_t state[8];
+    unsigned char buf[64];
+    uint64_t bytes;
+  };
+};
+
+#endif
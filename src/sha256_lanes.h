@@ -0,0 +1,124 @@
+/**
+ * SHA-256 compression function over several independent lanes.
+ *
+ * This file is included once per instruction set by sha256.cc (and has no
+ * include guard on purpose). The includer defines:
+ *
+ *   LANES_TRANSFORM name of the generated compression function
+ *   LANES_HASH      name of the generated hash function
+ *   LANES_TARGET    function attribute enabling the instruction set
+ *   LANES_WIDTH     number of 32 bit lanes per vector
+ *   vec_t           vector type
+ *   V_ADD, V_XOR, V_OR, V_AND, V_ANDNOT(a, b) = ~a & b,
+ *   V_SHR, V_SHL    (by immediate), V_SET1, V_LOAD, V_STORE
+ *   V_ROR           optional, rotate right by immediate
+ *
+ * The state is kept as eight vectors (one per word, lane i in element i),
+ * blocks[i] points to the 64 byte block of lane i.
+ */
+
+#ifndef V_ROR
+#define V_ROR(x, n) V_OR(V_SHR((x), (n)), V_SHL((x), 32 - (n)))
+#endif
+#define V_S0(x) V_XOR(V_XOR(V_ROR((x), 2), V_ROR((x), 13)), V_ROR((x), 22))
+#define V_S1(x) V_XOR(V_XOR(V_ROR((x), 6), V_ROR((x), 11)), V_ROR((x), 25))
+#define V_s0(x) V_XOR(V_XOR(V_ROR((x), 7), V_ROR((x), 18)), V_SHR((x), 3))
+#define V_s1(x) V_XOR(V_XOR(V_ROR((x), 17), V_ROR((x), 19)), V_SHR((x), 10))
+#define V_CH(x, y, z) V_XOR(V_AND((x), (y)), V_ANDNOT((x), (z)))
+#define V_MAJ(x, y, z) V_OR(V_AND((x), (y)), V_AND(V_OR((x), (y)), (z)))
+
+LANES_TARGET static void
+LANES_TRANSFORM(vec_t *state, const unsigned char *const *blocks)
+{
+  uint32_t tmp[LANES_WIDTH] SHA256_ALIGNED;
+  vec_t w[16];
+
+  // Transpose the message words into lanes
+  for (int i = 0; i < 16; i++) {
+    for (int l = 0; l < LANES_WIDTH; l++) {
+      tmp[l] = read_be32(blocks[l] + 4 * i);
+    }
+    w[i] = V_LOAD(tmp);
+  }
+
+  vec_t a = state[0], b = state[1], c = state[2], d = state[3];
+  vec_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+  for (int i = 0; i < 64; i++) {
+    vec_t wi;
+    if (i < 16) {
+      wi = w[i];
+    } else {
+      wi = V_ADD(V_ADD(V_s1(w[(i - 2) & 15]), w[(i - 7) & 15]),
+                 V_ADD(V_s0(w[(i - 15) & 15]), w[i & 15]));
+      w[i & 15] = wi;
+    }
+
+    vec_t t1 = V_ADD(V_ADD(V_ADD(h, V_S1(e)), V_ADD(V_CH(e, f, g),
+                                                    V_SET1(Sha256::K[i]))),
+                     wi);
+    vec_t t2 = V_ADD(V_S0(a), V_MAJ(a, b, c));
+
+    h = g;
+    g = f;
+    f = e;
+    e = V_ADD(d, t1);
+    d = c;
+    c = b;
+    b = a;
+    a = V_ADD(t1, t2);
+  }
+
+  state[0] = V_ADD(state[0], a);
+  state[1] = V_ADD(state[1], b);
+  state[2] = V_ADD(state[2], c);
+  state[3] = V_ADD(state[3], d);
+  state[4] = V_ADD(state[4], e);
+  state[5] = V_ADD(state[5], f);
+  state[6] = V_ADD(state[6], g);
+  state[7] = V_ADD(state[7], h);
+}
+
+/**
+ * Hashes LANES_WIDTH messages which all pad to `nblocks` blocks, the digest
+ * of msgs[i] is written to outs[i].
+ */
+LANES_TARGET static void
+LANES_HASH(const unsigned char *const *msgs, const size_t *lens,
+           size_t nblocks, unsigned char *const *outs)
+{
+  unsigned char tails[LANES_WIDTH][128];
+  const unsigned char *blocks[LANES_WIDTH];
+  uint32_t tmp[LANES_WIDTH] SHA256_ALIGNED;
+  vec_t state[8];
+
+  for (int j = 0; j < 8; j++) {
+    state[j] = V_SET1(Sha256::IV[j]);
+  }
+
+  for (int l = 0; l < LANES_WIDTH; l++) {
+    pad_tail(tails[l], msgs[l], lens[l]);
+  }
+
+  for (size_t k = 0; k < nblocks; k++) {
+    for (int l = 0; l < LANES_WIDTH; l++) {
+      blocks[l] = block_ptr(tails[l], msgs[l], lens[l], k);
+    }
+    LANES_TRANSFORM(state, blocks);
+  }
+
+  for (int j = 0; j < 8; j++) {
+    V_STORE(tmp, state[j]);
+    for (int l = 0; l < LANES_WIDTH; l++) {
+      write_be32(outs[l] + 4 * j, tmp[l]);
+    }
+  }
+}
+
+#undef V_ROR
+#undef V_S0
+#undef V_S1
+#undef V_s0
+#undef V_s1
+#undef V_CH
+#undef V_MAJ
@@ -0,0 +1,271 @@
+#include <string.h>
+#include <stdlib.h>
+
+#include <v8.h>
+
+#include <node.h>
+#include <node_buffer.h>
+
+#include <openssl/rand.h>
+#include <openssl/sha.h>
+
+#include "common.h"
+#include "sigcache.h"
+
+using namespace std;
+using namespace v8;
+using namespace node;
+
+#define SIGCACHE_BUCKET_ENTRIES 4
+
+// 4 MB = 131072 entries
+#define SIGCACHE_DEFAULT_SIZE (4 * 1024 * 1024)
+
+SigCache::entry_t *SigCache::table = NULL;
+uint32_t SigCache::bucketMask = 0;
+unsigned char SigCache::salt[32];
+
+volatile uint32_t SigCache::hits = 0;
+volatile uint32_t SigCache::misses = 0;
+volatile uint32_t SigCache::inserts = 0;
+
+void SigCache::ComputeEntry(uint64_t *out,
+                            const unsigned char *digest, int digest_len,
+                            const unsigned char *pub, int pub_len,
+                            const unsigned char *sig, int sig_len)
+{
+  unsigned char lens[3] = {
+    (unsigned char) digest_len,
+    (unsigned char) pub_len,
+    (unsigned char) sig_len
+  };
+  unsigned char hash[SHA256_DIGEST_LENGTH];
+
+  SHA256_CTX c;
+  SHA256_Init(&c);
+  SHA256_Update(&c, salt, sizeof(salt));
+  SHA256_Update(&c, lens, sizeof(lens));
+  SHA256_Update(&c, digest, digest_len);
+  SHA256_Update(&c, pub, pub_len);
+  SHA256_Update(&c, sig, sig_len);
+  SHA256_Final(hash, &c);
+
+  memcpy(out, hash, sizeof(hash));
+
+  // An all zero entry marks an empty slot
+  if ((out[0] | out[1] | out[2] | out[3]) == 0) {
+    out[3] = 1;
+  }
+}
+
+bool SigCache::Query(const unsigned char *digest, int digest_len,
+                     const unsigned char *pub, int pub_len,
+                     const unsigned char *sig, int sig_len)
+{
+  entry_t *t = table;
+  if (t == NULL ||
+      digest_len > 255 || pub_len > 255 || sig_len > 255) {
+    return false;
+  }
+
+  uint64_t w[4];
+  ComputeEntry(w, digest, digest_len, pub, pub_len, sig, sig_len);
+
+  entry_t *bucket = &t[(w[0] & bucketMask) * SIGCACHE_BUCKET_ENTRIES];
+  for (int i = 0; i < SIGCACHE_BUCKET_ENTRIES; i++) {
+    entry_t *e = &bucket[i];
+    if (e->w[0] == w[0] && e->w[1] == w[1] &&
+        e->w[2] == w[2] && e->w[3] == w[3]) {
+      __sync_fetch_and_add(&hits, 1);
+      return true;
+    }
+  }
+
+  __sync_fetch_and_add(&misses, 1);
+  return false;
+}
+
+void SigCache::Insert(const unsigned char *digest, int digest_len,
+                      const unsigned char *pub, int pub_len,
+                      const unsigned char *sig, int sig_len)
+{
+  entry_t *t = table;
+  if (t == NULL ||
+      digest_len > 255 || pub_len > 255 || sig_len > 255) {
+    return;
+  }
+
+  uint64_t w[4];
+  ComputeEntry(w, digest, digest_len, pub, pub_len, sig, sig_len);
+
+  entry_t *bucket = &t[(w[0] & bucketMask) * SIGCACHE_BUCKET_ENTRIES];
+
+  // Prefer an empty slot, otherwise replace one picked by the entry itself,
+  // which is as good as random since the salt is secret.
+  entry_t *slot = &bucket[(w[1] >> 62) & (SIGCACHE_BUCKET_ENTRIES - 1)];
+  for (int i = 0; i < SIGCACHE_BUCKET_ENTRIES; i++) {
+    entry_t *e = &bucket[i];
+    if (e->w[0] == w[0] && e->w[1] == w[1] &&
+        e->w[2] == w[2] && e->w[3] == w[3]) {
+      return;
+    }
+    if ((e->w[0] | e->w[1] | e->w[2] | e->w[3]) == 0) {
+      slot = e;
+    }
+  }
+
+  slot->w[0] = w[0];
+  slot->w[1] = w[1];
+  slot->w[2] = w[2];
+  slot->w[3] = w[3];
+
+  __sync_fetch_and_add(&inserts, 1);
+}
+
+void SigCache::SetSize(size_t bytes)
+{
+  entry_t *old = table;
+  table = NULL;
+  free(old);
+
+  // Round down to a power of two number of buckets
+  size_t buckets = bytes / (sizeof(entry_t) * SIGCACHE_BUCKET_ENTRIES);
+  if (buckets == 0) {
+    bucketMask = 0;
+    return;
+  }
+  size_t n = 1;
+  while (n * 2 <= buckets && n < 0x80000000UL) {
+    n *= 2;
+  }
+
+  entry_t *t = (entry_t *) calloc(n * SIGCACHE_BUCKET_ENTRIES, sizeof(entry_t));
+  if (t == NULL) {
+    return;
+  }
+  bucketMask = n - 1;
+  table = t;
+}
+
+void SigCache::Init(Handle<Object> target)
+{
+  HandleScope scope;
+
+  if (RAND_bytes(salt, sizeof(salt)) != 1) {
+    // Fall back to a weaker salt rather than running without a cache
+    RAND_pseudo_bytes(salt, sizeof(salt));
+  }
+
+  SetSize(SIGCACHE_DEFAULT_SIZE);
+
+  Local<Object> obj = Object::New();
+  NODE_SET_METHOD(obj, "query", Query);
+  NODE_SET_METHOD(obj, "insert", Insert);
+  NODE_SET_METHOD(obj, "setSize", SetSize);
+  NODE_SET_METHOD(obj, "getStats", GetStats);
+
+  target->Set(String::NewSymbol("SigCache"), obj);
+}
+
+static Handle<Value>
+CheckArgs(const Arguments& args)
+{
+  if (args.Length() != 3) {
+    return VException("Three arguments expected: hash, pubkey, sig");
+  }
+  if (!Buffer::HasInstance(args[0])) {
+    return VException("Argument 'hash' must be of type Buffer");
+  }
+  if (!Buffer::HasInstance(args[1])) {
+    return VException("Argument 'pubkey' must be of type Buffer");
+  }
+  if (!Buffer::HasInstance(args[2])) {
+    return VException("Argument 'sig' must be of type Buffer");
+  }
+  return Handle<Value>();
+}
+
+/**
+ * Returns true if the signature for (hash, pubkey) is known to be valid.
+ */
+Handle<Value>
+SigCache::Query(const Arguments& args)
+{
+  HandleScope scope;
+
+  Handle<Value> err = CheckArgs(args);
+  if (!err.IsEmpty()) {
+    return err;
+  }
+
+  Handle<Object> hash_buf = args[0]->ToObject();
+  Handle<Object> pub_buf = args[1]->ToObject();
+  Handle<Object> sig_buf = args[2]->ToObject();
+
+  bool found = Query(
+    (const unsigned char *) Buffer::Data(hash_buf), Buffer::Length(hash_buf),
+    (const unsigned char *) Buffer::Data(pub_buf), Buffer::Length(pub_buf),
+    (const unsigned char *) Buffer::Data(sig_buf), Buffer::Length(sig_buf));
+
+  return scope.Close(Boolean::New(found));
+}
+
+/**
+ * Remembers a signature that has been verified successfully.
+ */
+Handle<Value>
+SigCache::Insert(const Arguments& args)
+{
+  HandleScope scope;
+
+  Handle<Value> err = CheckArgs(args);
+  if (!err.IsEmpty()) {
+    return err;
+  }
+
+  Handle<Object> hash_buf = args[0]->ToObject();
+  Handle<Object> pub_buf = args[1]->ToObject();
+  Handle<Object> sig_buf = args[2]->ToObject();
+
+  Insert(
+    (const unsigned char *) Buffer::Data(hash_buf), Buffer::Length(hash_buf),
+    (const unsigned char *) Buffer::Data(pub_buf), Buffer::Length(pub_buf),
+    (const unsigned char *) Buffer::Data(sig_buf), Buffer::Length(sig_buf));
+
+  return scope.Close(Undefined());
+}
+
+/**
+ * Sets the size of the cache in bytes, 0 disables it.
+ */
+Handle<Value>
+SigCache::SetSize(const Arguments& args)
+{
+  HandleScope scope;
+
+  if (args.Length() != 1 || !args[0]->IsNumber() ||
+      args[0]->NumberValue() < 0) {
+    return VException("One argument expected: size in bytes");
+  }
+
+  SetSize((size_t) args[0]->NumberValue());
+
+  return scope.Close(Undefined());
+}
+
+Handle<Value>
+SigCache::GetStats(const Arguments& args)
+{
+  HandleScope scope;
+
+  size_t entries = table ?
+    (bucketMask + 1) * SIGCACHE_BUCKET_ENTRIES : 0;
+
+  Local<Object> stats = Object::New();
+  stats->Set(String::NewSymbol("hits"), Number::New(hits));
+  stats->Set(String::NewSymbol("misses"), Number::New(misses));
+  stats->Set(String::NewSymbol("inserts"), Number::New(inserts));
+  stats->Set(String::NewSymbol("entries"), Number::New((double) entries));
+
+  return scope.Close(stats);
+}
@@ -0,0 +1,68 @@
+#ifndef BITCOINJS_SERVER_INCLUDE_SIGCACHE_H_
+#define BITCOINJS_SERVER_INCLUDE_SIGCACHE_H_
+
+#include <stdint.h>
+
+#include <v8.h>
+#include <node.h>
+
+using namespace v8;
+using namespace node;
+
+/**
+ * Cache of signatures that have already been verified successfully.
+ *
+ * Entries are the SHA-256 of a random per-process salt followed by the
+ * sighash, public key and signature, so peers can't construct colliding
+ * entries. The table has a fixed size and is organized in four way buckets
+ * with pseudo random replacement.
+ *
+ * Query and Insert don't take any locks and may be called from the libuv
+ * threadpool. A torn write can only ever produce an entry that matches
+ * nothing.
+ */
+class SigCache
+{
+private:
+
+  struct entry_t {
+    volatile uint64_t w[4];
+  };
+
+  static entry_t *table;
+  static uint32_t bucketMask;
+  static unsigned char salt[32];
+
+  static volatile uint32_t hits;
+  static volatile uint32_t misses;
+  static volatile uint32_t inserts;
+
+  static void ComputeEntry(uint64_t *out,
+                           const unsigned char *digest, int digest_len,
+                           const unsigned char *pub, int pub_len,
+                           const unsigned char *sig, int sig_len);
+
+public:
+
+  static void Init(Handle<Object> target);
+
+  // Returns true if this exact signature has been verified before
+  static bool Query(const unsigned char *digest, int digest_len,
+                    const unsigned char *pub, int pub_len,
+                    const unsigned char *sig, int sig_len);
+
+  static void Insert(const unsigned char *digest, int digest_len,
+                     const unsigned char *pub, int pub_len,
+                     const unsigned char *sig, int sig_len);
+
+  // Resizes (and clears) the table. Must not be called while verifications
+  // are running on the threadpool.
+  static void SetSize(size_t bytes);
+
+  static Handle<Value> Query(const Arguments& args);
+  static Handle<Value> Insert(const Arguments& args);
+  static Handle<Value> SetSize(const Arguments& args);
+  static Handle<Value> GetStats(const Arguments& args);
+};
+
+#endif
@@ -0,0 +1,319 @@
+#include <string.h>
+
+#include <v8.h>
+
+#include <node.h>
+#include <node_buffer.h>
+
+#include "common.h"
+#include "sha256.h"
+#include "sighash.h"
+#include "txparser.h"
+
+using namespace std;
+using namespace v8;
+using namespace node;
+
+#define OP_PUSHDATA1 0x4c
+#define OP_PUSHDATA2 0x4d
+#define OP_PUSHDATA4 0x4e
+#define OP_CODESEPARATOR 0xab
+
+static inline void write_le32(unsigned char *p, uint32_t x)
+{
+  p[0] = x & 0xff;
+  p[1] = (x >> 8) & 0xff;
+  p[2] = (x >> 16) & 0xff;
+  p[3] = (x >> 24) & 0xff;
+}
+
+// Canonical variable length integer, returns its size
+static size_t
+encode_varint (unsigned char *out, uint64_t value)
+{
+  if (value < 0xfd) {
+    out[0] = (unsigned char) value;
+    return 1;
+  }
+
+  size_t size = value <= 0xffff ? 2 : value <= 0xffffffff ? 4 : 8;
+  out[0] = size == 2 ? 0xfd : size == 4 ? 0xfe : 0xff;
+  for (size_t i = 0; i < size; i++) {
+    out[1 + i] = (unsigned char) (value >> (8 * i));
+  }
+  return 1 + size;
+}
+
+static inline void
+write_varint (Sha256::Stream &stream, uint64_t value)
+{
+  unsigned char buf[9];
+  stream.Write(buf, encode_varint(buf, value));
+}
+
+static inline void
+write_varint (vector<unsigned char> &out, uint64_t value)
+{
+  unsigned char buf[9];
+  out.insert(out.end(), buf, buf + encode_varint(buf, value));
+}
+
+/**
+ * Returns the position after the operation at pos, or len if the operation
+ * is a truncated push.
+ */
+static size_t
+next_op (const unsigned char *script, size_t len, size_t pos)
+{
+  unsigned char opcode = script[pos++];
+  size_t size_len = opcode == OP_PUSHDATA1 ? 1 :
+    opcode == OP_PUSHDATA2 ? 2 : opcode == OP_PUSHDATA4 ? 4 : 0;
+  uint64_t push = 0;
+
+  if (opcode < OP_PUSHDATA1) {
+    push = opcode;
+  } else if (size_len) {
+    if (len - pos < size_len) {
+      return len;
+    }
+    for (size_t i = 0; i < size_len; i++) {
+      push |= (uint64_t) script[pos + i] << (8 * i);
+    }
+    pos += size_len;
+  }
+
+  if (push > len - pos) {
+    return len;
+  }
+  return pos + (size_t) push;
+}
+
+// Writes script without its OP_CODESEPARATORs, prefixed with its length
+static void
+write_script (Sha256::Stream &stream, const unsigned char *script,
+              size_t len)
+{
+  size_t removed = 0;
+  for (size_t pos = 0; pos < len; pos = next_op(script, len, pos)) {
+    if (script[pos] == OP_CODESEPARATOR) {
+      removed++;
+    }
+  }
+
+  write_varint(stream, len - removed);
+  if (!removed) {
+    stream.Write(script, len);
+    return;
+  }
+
+  size_t start = 0;
+  for (size_t pos = 0; pos < len; pos = next_op(script, len, pos)) {
+    if (script[pos] == OP_CODESEPARATOR) {
+      stream.Write(script + start, pos - start);
+      start = pos + 1;
+    }
+  }
+  stream.Write(script + start, len - start);
+}
+
+Persistent<FunctionTemplate> SigHash::s_ct;
+
+void SigHash::Init(Handle<Object> target)
+{
+  HandleScope scope;
+  Local<FunctionTemplate> t = FunctionTemplate::New(New);
+
+  s_ct = Persistent<FunctionTemplate>::New(t);
+  s_ct->InstanceTemplate()->SetInternalFieldCount(1);
+  s_ct->SetClassName(String::NewSymbol("SigHash"));
+
+  // Methods
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "hash", Hash);
+
+  target->Set(String::NewSymbol("SigHash"),
+              s_ct->GetFunction());
+}
+
+SigHash::SigHash(const unsigned char *tx, size_t len) :
+  tx(tx),
+  txLen(len),
+  hasOutputs(false)
+{
+  size_t pos = 0;
+  valid = TxParser::Scan(tx, len, &pos, table);
+}
+
+SigHash::~SigHash()
+{
+  if (!txBuf.IsEmpty()) {
+    txBuf.Dispose();
+    txBuf.Clear();
+  }
+}
+
+void SigHash::BuildOutputs()
+{
+  size_t count = table[3];
+  const uint32_t *out = &table[TxParser::RECORD_WORDS +
+                               TxParser::IO_WORDS * table[2]];
+
+  write_varint(outputs, count);
+  for (size_t i = 0; i < count; i++, out += TxParser::IO_WORDS) {
+    outputs.insert(outputs.end(), tx + out[0], tx + out[0] + 8);
+    write_varint(outputs, out[2]);
+    outputs.insert(outputs.end(), tx + out[1], tx + out[1] + out[2]);
+  }
+
+  hasOutputs = true;
+}
+
+const char *
+SigHash::Compute(size_t inIndex, const unsigned char *script,
+                 size_t scriptLen, uint32_t hashType, unsigned char *out)
+{
+  if (!valid) {
+    return "Transaction data is truncated or malformed";
+  }
+
+  size_t ins = table[2];
+  size_t outs = table[3];
+  const uint32_t *in = &table[TxParser::RECORD_WORDS];
+  const uint32_t *txout = in + TxParser::IO_WORDS * ins;
+  uint32_t mode = hashType & 0x1f;
+  unsigned char word[4];
+
+  if (inIndex >= ins) {
+    return "Input index out of bounds";
+  }
+  if (mode == SIGHASH_SINGLE && inIndex >= outs) {
+    return "SIGHASH_SINGLE without a corresponding output";
+  }
+
+  Sha256::Stream stream;
+
+  // Version
+  stream.Write(tx + table[0], 4);
+
+  // Inputs, only the current one gets the script
+  size_t first = 0, last = ins;
+  if (hashType & SIGHASH_ANYONECANPAY) {
+    first = inIndex;
+    last = inIndex + 1;
+  }
+  write_varint(stream, last - first);
+  for (size_t i = first; i < last; i++) {
+    const uint32_t *txin = in + TxParser::IO_WORDS * i;
+    stream.Write(tx + txin[0], 36);
+
+    if (i == inIndex) {
+      write_script(stream, script, scriptLen);
+      stream.Write(tx + txin[1] + txin[2], 4);
+    } else {
+      write_varint(stream, 0);
+      if (mode == SIGHASH_NONE || mode == SIGHASH_SINGLE) {
+        memset(word, 0, 4);
+        stream.Write(word, 4);
+      } else {
+        stream.Write(tx + txin[1] + txin[2], 4);
+      }
+    }
+  }
+
+  // Outputs
+  if (mode == SIGHASH_NONE) {
+    write_varint(stream, 0);
+  } else if (mode == SIGHASH_SINGLE) {
+    // Outputs before the current one are nulled
+    static const unsigned char null_out[9] = {
+      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00
+    };
+    write_varint(stream, inIndex + 1);
+    for (size_t i = 0; i < inIndex; i++) {
+      stream.Write(null_out, sizeof(null_out));
+    }
+    const uint32_t *o = txout + TxParser::IO_WORDS * inIndex;
+    stream.Write(tx + o[0], 8);
+    write_varint(stream, o[2]);
+    stream.Write(tx + o[1], o[2]);
+  } else {
+    if (!hasOutputs) {
+      BuildOutputs();
+    }
+    stream.Write(&outputs[0], outputs.size());
+  }
+
+  // Lock time and hash type
+  stream.Write(tx + table[1] - 4, 4);
+  write_le32(word, hashType);
+  stream.Write(word, 4);
+
+  stream.FinalizeDouble(out);
+  return NULL;
+}
+
+/**
+ * Arguments: serialized transaction Buffer.
+ */
+Handle<Value>
+SigHash::New(const Arguments& args)
+{
+  if (!args.IsConstructCall()) {
+    return FromConstructorTemplate(s_ct, args);
+  }
+
+  HandleScope scope;
+
+  if (args.Length() != 1 || !Buffer::HasInstance(args[0])) {
+    return VException("One argument expected: transaction Buffer");
+  }
+
+  Handle<Object> buf = args[0]->ToObject();
+  SigHash *sighash = new SigHash(
+    (const unsigned char *) Buffer::Data(buf), Buffer::Length(buf));
+  if (!sighash->IsValid()) {
+    delete sighash;
+    return VException("Transaction data is truncated or malformed");
+  }
+  sighash->txBuf = Persistent<Object>::New(buf);
+  sighash->Wrap(args.Holder());
+
+  return scope.Close(args.This());
+}
+
+/**
+ * Arguments: input index, script Buffer, hash type. Returns the 32 byte
+ * signature hash.
+ */
+Handle<Value>
+SigHash::Hash(const Arguments& args)
+{
+  HandleScope scope;
+  SigHash *sighash = ObjectWrap::Unwrap<SigHash>(args.This());
+
+  if (args.Length() != 3) {
+    return VException("Three arguments expected: inIndex, script, hashType");
+  }
+  if (!args[0]->IsUint32()) {
+    return VException("Argument 'inIndex' must be a non-negative integer");
+  }
+  if (!Buffer::HasInstance(args[1])) {
+    return VException("Argument 'script' must be of type Buffer");
+  }
+  if (!args[2]->IsNumber()) {
+    return VException("Argument 'hashType' must be a number");
+  }
+
+  Handle<Object> script_buf = args[1]->ToObject();
+
+  Buffer *result = Buffer::New(32);
+  const char *err = sighash->Compute(
+    args[0]->Uint32Value(),
+    (const unsigned char *) Buffer::Data(script_buf),
+    Buffer::Length(script_buf), args[2]->Uint32Value(),
+    (unsigned char *) Buffer::Data(result));
+  if (err) {
+    return VException(err);
+  }
+
+  return scope.Close(result->handle_);
+}
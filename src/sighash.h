@@ -0,0 +1,77 @@
+#ifndef BITCOINJS_SERVER_INCLUDE_SIGHASH_H_
+#define BITCOINJS_SERVER_INCLUDE_SIGHASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include <v8.h>
+#include <node.h>
+
+using namespace v8;
+using namespace node;
+
+/**
+ * Signature hashes of one transaction.
+ *
+ * The modified serialization for each input is streamed straight into
+ * SHA-256 instead of being built. The transaction is scanned once, and the
+ * outputs section, which is the same for every SIGHASH_ALL input, is
+ * serialized only once as well.
+ *
+ * Can be used from C++ without being wrapped, also on the threadpool as long
+ * as each instance is used by one thread at a time.
+ */
+class SigHash : ObjectWrap
+{
+private:
+
+  const unsigned char *tx;
+  size_t txLen;
+
+  // TxParser record of the transaction
+  std::vector<uint32_t> table;
+  bool valid;
+
+  // Outputs section for SIGHASH_ALL, built on first use
+  std::vector<unsigned char> outputs;
+  bool hasOutputs;
+
+  // Keeps the data alive while wrapped
+  Persistent<Object> txBuf;
+
+  void BuildOutputs();
+
+public:
+
+  static const uint32_t SIGHASH_ALL = 1;
+  static const uint32_t SIGHASH_NONE = 2;
+  static const uint32_t SIGHASH_SINGLE = 3;
+  static const uint32_t SIGHASH_ANYONECANPAY = 0x80;
+
+  SigHash(const unsigned char *tx, size_t len);
+  ~SigHash();
+
+  // False if the transaction could not be parsed
+  bool IsValid() const { return valid; }
+
+  /**
+   * Writes the signature hash for input inIndex to out. OP_CODESEPARATORs
+   * are removed from script, like FindAndDelete() does in the reference
+   * client. Returns an error message or NULL on success.
+   */
+  const char *Compute(size_t inIndex, const unsigned char *script,
+                      size_t scriptLen, uint32_t hashType,
+                      unsigned char *out);
+
+  static Persistent<FunctionTemplate> s_ct;
+
+  static void Init(Handle<Object> target);
+
+  static Handle<Value> New(const Arguments& args);
+
+  static Handle<Value> Hash(const Arguments& args);
+};
+
+#endif
@@ -0,0 +1,329 @@
+#include <string.h>
+
+#include <v8.h>
+
+#include <node.h>
+#include <node_buffer.h>
+
+#include "common.h"
+#include "sha256.h"
+#include "txparser.h"
+
+using namespace std;
+using namespace v8;
+using namespace node;
+
+#define BLOCK_HEADER_SIZE 80
+
+// Smallest possible serialized input (outpoint, empty script, sequence) and
+// output (value, empty script)
+#define MIN_TXIN_SIZE 41
+#define MIN_TXOUT_SIZE 9
+
+static inline uint32_t read_le32(const unsigned char *p)
+{
+  return (uint32_t) p[0] | ((uint32_t) p[1] << 8) |
+    ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static inline void write_le32(unsigned char *p, uint32_t x)
+{
+  p[0] = x & 0xff;
+  p[1] = (x >> 8) & 0xff;
+  p[2] = (x >> 16) & 0xff;
+  p[3] = (x >> 24) & 0xff;
+}
+
+bool
+TxParser::ReadVarInt(const unsigned char *data, size_t len, size_t *pos,
+                     uint64_t *value)
+{
+  size_t p = *pos;
+
+  if (p >= len) {
+    return false;
+  }
+
+  unsigned char first = data[p++];
+  size_t size = first == 0xfd ? 2 : first == 0xfe ? 4 : first == 0xff ? 8 : 0;
+
+  if (size == 0) {
+    *value = first;
+  } else {
+    if (len - p < size) {
+      return false;
+    }
+    uint64_t v = 0;
+    for (size_t i = 0; i < size; i++) {
+      v |= (uint64_t) data[p + i] << (8 * i);
+    }
+    *value = v;
+    p += size;
+  }
+
+  *pos = p;
+  return true;
+}
+
+// Reads a count whose items need at least min_size bytes each
+static bool
+read_count(const unsigned char *data, size_t len, size_t *pos,
+           size_t min_size, size_t *count)
+{
+  uint64_t value;
+  if (!TxParser::ReadVarInt(data, len, pos, &value)) {
+    return false;
+  }
+  if (value > (len - *pos) / min_size) {
+    return false;
+  }
+  *count = (size_t) value;
+  return true;
+}
+
+bool
+TxParser::Scan(const unsigned char *data, size_t len, size_t *pos,
+               vector<uint32_t> &table)
+{
+  size_t p = *pos;
+  size_t ins, outs;
+  uint64_t script_len;
+
+  // Offsets are stored as 32 bit words
+  if (len > 0xffffffff || p > len || len - p < 4) {
+    return false;
+  }
+
+  size_t record = table.size();
+  table.resize(record + RECORD_WORDS);
+  table[record] = (uint32_t) p;
+  p += 4;
+
+  if (!read_count(data, len, &p, MIN_TXIN_SIZE, &ins)) {
+    return false;
+  }
+  table[record + 2] = (uint32_t) ins;
+  table.reserve(table.size() + IO_WORDS * ins);
+
+  for (size_t i = 0; i < ins; i++) {
+    if (len - p < 36) {
+      return false;
+    }
+    table.push_back((uint32_t) p);
+    p += 36;
+
+    if (!ReadVarInt(data, len, &p, &script_len) || len - p < 4 ||
+        script_len > len - p - 4) {
+      return false;
+    }
+    table.push_back((uint32_t) p);
+    table.push_back((uint32_t) script_len);
+    p += script_len + 4;
+  }
+
+  if (!read_count(data, len, &p, MIN_TXOUT_SIZE, &outs)) {
+    return false;
+  }
+  table[record + 3] = (uint32_t) outs;
+  table.reserve(table.size() + IO_WORDS * outs);
+
+  for (size_t i = 0; i < outs; i++) {
+    if (len - p < 8) {
+      return false;
+    }
+    table.push_back((uint32_t) p);
+    p += 8;
+
+    if (!ReadVarInt(data, len, &p, &script_len) ||
+        script_len > len - p) {
+      return false;
+    }
+    table.push_back((uint32_t) p);
+    table.push_back((uint32_t) script_len);
+    p += script_len;
+  }
+
+  // Lock time
+  if (len - p < 4) {
+    return false;
+  }
+  p += 4;
+
+  table[record + 1] = (uint32_t) p;
+  *pos = p;
+  return true;
+}
+
+bool
+TxParser::ScanMany(const unsigned char *data, size_t len, size_t pos,
+                   size_t count, vector<uint32_t> &table)
+{
+  // Every transaction is at least ten bytes, don't trust the count further
+  if (pos > len || count > (len - pos) / 10) {
+    return false;
+  }
+
+  table.clear();
+  table.resize(HEADER_WORDS + count);
+  table[0] = (uint32_t) count;
+
+  for (size_t i = 0; i < count; i++) {
+    table[HEADER_WORDS + i] = (uint32_t) table.size();
+    if (!Scan(data, len, &pos, table)) {
+      return false;
+    }
+  }
+
+  table[1] = (uint32_t) pos;
+  return true;
+}
+
+void
+TxParser::HashMany(const unsigned char *data, const vector<uint32_t> &table,
+                   unsigned char *out)
+{
+  size_t count = table[0];
+  if (count == 0) {
+    return;
+  }
+
+  vector<const unsigned char *> msgs(count);
+  vector<size_t> lens(count);
+
+  // The spans are hashed in place
+  for (size_t i = 0; i < count; i++) {
+    size_t rec = table[HEADER_WORDS + i];
+    msgs[i] = data + table[rec];
+    lens[i] = table[rec + 1] - table[rec];
+  }
+
+  Sha256::DoubleMany(&msgs[0], &lens[0], count, out);
+}
+
+static Local<Object>
+table_buffer (const vector<uint32_t> &table)
+{
+  Buffer *result = Buffer::New(4 * table.size());
+  unsigned char *out = (unsigned char *) Buffer::Data(result);
+  for (size_t i = 0; i < table.size(); i++) {
+    write_le32(out + 4 * i, table[i]);
+  }
+  return Local<Object>::New(result->handle_);
+}
+
+static Local<Object>
+copy_buffer (const unsigned char *data, size_t len)
+{
+  Buffer *result = Buffer::New(len);
+  memcpy(Buffer::Data(result), data, len);
+  return Local<Object>::New(result->handle_);
+}
+
+void
+TxParser::Init(Handle<Object> target)
+{
+  HandleScope scope;
+
+  target->Set(String::NewSymbol("parseTxs"),
+              FunctionTemplate::New(ParseTxs)->GetFunction());
+  target->Set(String::NewSymbol("parseBlock"),
+              FunctionTemplate::New(ParseBlock)->GetFunction());
+}
+
+/**
+ * Scans consecutive serialized transactions.
+ *
+ * Arguments: buffer, [offset] (default 0), [count] (default 1). Returns the
+ * table as a Buffer of little endian 32 bit words, throws if the data is
+ * truncated or malformed.
+ */
+Handle<Value>
+TxParser::ParseTxs(const Arguments& args)
+{
+  HandleScope scope;
+
+  if (args.Length() < 1 || !Buffer::HasInstance(args[0])) {
+    return VException("Arguments expected: buffer, [offset], [count]");
+  }
+  if (args.Length() > 1 && !args[1]->IsUndefined() && !args[1]->IsUint32()) {
+    return VException("Argument 'offset' must be a non-negative integer");
+  }
+  if (args.Length() > 2 && !args[2]->IsUndefined() && !args[2]->IsUint32()) {
+    return VException("Argument 'count' must be a non-negative integer");
+  }
+
+  Handle<Object> buf = args[0]->ToObject();
+  const unsigned char *data = (const unsigned char *) Buffer::Data(buf);
+  size_t len = Buffer::Length(buf);
+
+  size_t offset = 0;
+  if (args.Length() > 1 && !args[1]->IsUndefined()) {
+    offset = args[1]->Uint32Value();
+  }
+  size_t count = 1;
+  if (args.Length() > 2 && !args[2]->IsUndefined()) {
+    count = args[2]->Uint32Value();
+  }
+
+  vector<uint32_t> table;
+  if (!ScanMany(data, len, offset, count, table)) {
+    return VException("Transaction data is truncated or malformed");
+  }
+
+  return scope.Close(table_buffer(table));
+}
+
+/**
+ * Parses a serialized block (the payload of a 'block' message) in one pass.
+ *
+ * Returns the header fields, `txTable` (the table of parseTxs() for all
+ * transactions), `txHashes` (the txids back to back) and `calcMerkleRoot`,
+ * the merkle root computed from those txids. Throws if the data is
+ * truncated or malformed.
+ */
+Handle<Value>
+TxParser::ParseBlock(const Arguments& args)
+{
+  HandleScope scope;
+
+  if (args.Length() != 1 || !Buffer::HasInstance(args[0])) {
+    return VException("One argument expected: block Buffer");
+  }
+
+  Handle<Object> buf = args[0]->ToObject();
+  const unsigned char *data = (const unsigned char *) Buffer::Data(buf);
+  size_t len = Buffer::Length(buf);
+
+  size_t pos = BLOCK_HEADER_SIZE;
+  uint64_t count;
+  vector<uint32_t> table;
+  if (len < BLOCK_HEADER_SIZE || !ReadVarInt(data, len, &pos, &count) ||
+      count > len ||
+      !ScanMany(data, len, pos, (size_t) count, table)) {
+    return VException("Block data is truncated or malformed");
+  }
+
+  Buffer *hashes_buf = Buffer::New(32 * count);
+  unsigned char *hashes = (unsigned char *) Buffer::Data(hashes_buf);
+  HashMany(data, table, hashes);
+
+  Buffer *root_buf = Buffer::New(32);
+  Sha256::MerkleRoot(hashes, count, (unsigned char *) Buffer::Data(root_buf));
+
+  Local<Object> result = Object::New();
+  result->Set(String::NewSymbol("version"),
+              Integer::NewFromUnsigned(read_le32(data)));
+  result->Set(String::NewSymbol("prev_hash"), copy_buffer(data + 4, 32));
+  result->Set(String::NewSymbol("merkle_root"), copy_buffer(data + 36, 32));
+  result->Set(String::NewSymbol("timestamp"),
+              Integer::NewFromUnsigned(read_le32(data + 68)));
+  result->Set(String::NewSymbol("bits"),
+              Integer::NewFromUnsigned(read_le32(data + 72)));
+  result->Set(String::NewSymbol("nonce"),
+              Integer::NewFromUnsigned(read_le32(data + 76)));
+  result->Set(String::NewSymbol("txTable"), table_buffer(table));
+  result->Set(String::NewSymbol("txHashes"), hashes_buf->handle_);
+  result->Set(String::NewSymbol("calcMerkleRoot"), root_buf->handle_);
+
+  return scope.Close(result);
+}
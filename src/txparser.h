@@ -0,0 +1,70 @@
+#ifndef BITCOINJS_SERVER_INCLUDE_TXPARSER_H_
+#define BITCOINJS_SERVER_INCLUDE_TXPARSER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include <v8.h>
+#include <node.h>
+
+using namespace v8;
+using namespace node;
+
+/**
+ * Single pass scanner for serialized transactions.
+ *
+ * Instead of materializing every field, the scanner records where the fields
+ * are in the original buffer. The result is a table of 32 bit words:
+ *
+ *   count, end, record index of tx 0 .. count-1, records
+ *
+ * where `end` is the offset after the last transaction and each record is
+ *
+ *   start, end, in count, out count,
+ *   per input:  outpoint offset, script offset, script length
+ *   per output: value offset, script offset, script length
+ *
+ * The version is at `start`, the lock time at `end - 4` and the sequence of
+ * an input directly after its script.
+ */
+class TxParser
+{
+public:
+
+  // Words before the record index
+  static const int HEADER_WORDS = 2;
+
+  // Words at the start of each record, and per input/output
+  static const int RECORD_WORDS = 4;
+  static const int IO_WORDS = 3;
+
+  // Reads a variable length integer at *pos, returns false if truncated
+  static bool ReadVarInt(const unsigned char *data, size_t len, size_t *pos,
+                         uint64_t *value);
+
+  /**
+   * Scans the transaction at *pos and appends its record to table. On
+   * success *pos is moved past the transaction, returns false if the data is
+   * truncated or malformed.
+   */
+  static bool Scan(const unsigned char *data, size_t len, size_t *pos,
+                   std::vector<uint32_t> &table);
+
+  // Scans count consecutive transactions into a complete table
+  static bool ScanMany(const unsigned char *data, size_t len, size_t pos,
+                       size_t count, std::vector<uint32_t> &table);
+
+  // Writes the txid of every transaction in a complete table to out
+  static void HashMany(const unsigned char *data,
+                       const std::vector<uint32_t> &table, unsigned char *out);
+
+  static void Init(Handle<Object> target);
+
+  static Handle<Value> ParseTxs(const Arguments& args);
+
+  static Handle<Value> ParseBlock(const Arguments& args);
+};
+
+#endif
@@ -0,0 +1,271 @@
+#include <string.h>
+
+#include "uint256.h"
+
+#define WORDS 8
+
+Uint256::Uint256()
+{
+  memset(words, 0, sizeof(words));
+}
+
+Uint256::Uint256(uint64_t value)
+{
+  memset(words, 0, sizeof(words));
+  words[0] = (uint32_t) value;
+  words[1] = (uint32_t) (value >> 32);
+}
+
+Uint256 Uint256::FromBE(const unsigned char *data)
+{
+  Uint256 result;
+  for (int i = 0; i < WORDS; i++) {
+    const unsigned char *p = data + 4 * (WORDS - 1 - i);
+    result.words[i] = ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) |
+      ((uint32_t) p[2] << 8) | (uint32_t) p[3];
+  }
+  return result;
+}
+
+Uint256 Uint256::FromLE(const unsigned char *data)
+{
+  Uint256 result;
+  for (int i = 0; i < WORDS; i++) {
+    const unsigned char *p = data + 4 * i;
+    result.words[i] = (uint32_t) p[0] | ((uint32_t) p[1] << 8) |
+      ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+  }
+  return result;
+}
+
+void Uint256::ToBE(unsigned char *out) const
+{
+  for (int i = 0; i < WORDS; i++) {
+    unsigned char *p = out + 4 * (WORDS - 1 - i);
+    p[0] = words[i] >> 24;
+    p[1] = words[i] >> 16;
+    p[2] = words[i] >> 8;
+    p[3] = words[i];
+  }
+}
+
+void Uint256::ToLE(unsigned char *out) const
+{
+  for (int i = 0; i < WORDS; i++) {
+    unsigned char *p = out + 4 * i;
+    p[0] = words[i];
+    p[1] = words[i] >> 8;
+    p[2] = words[i] >> 16;
+    p[3] = words[i] >> 24;
+  }
+}
+
+bool Uint256::SetCompact(uint32_t bits)
+{
+  unsigned int size = bits >> 24;
+  uint32_t mantissa = bits & 0x00ffffff;
+
+  *this = Uint256(0);
+  if (size <= 3) {
+    words[0] = mantissa >> (8 * (3 - size));
+    return true;
+  }
+
+  words[0] = mantissa;
+  unsigned int shift = 8 * (size - 3);
+  if (mantissa != 0 && Bits() + shift > 256) {
+    return false;
+  }
+  *this <<= shift;
+  return true;
+}
+
+uint32_t Uint256::GetCompact() const
+{
+  unsigned int size = (Bits() + 7) / 8;
+  uint32_t compact;
+  if (size <= 3) {
+    compact = words[0] << (8 * (3 - size));
+  } else {
+    Uint256 shifted = *this;
+    shifted >>= 8 * (size - 3);
+    compact = shifted.words[0];
+  }
+
+  // The mantissa would have its sign bit set
+  if (compact & 0x00800000) {
+    compact >>= 8;
+    size++;
+  }
+
+  return compact | (size << 24);
+}
+
+unsigned int Uint256::Bits() const
+{
+  for (int i = WORDS - 1; i >= 0; i--) {
+    if (words[i]) {
+      for (int bit = 31; bit >= 0; bit--) {
+        if (words[i] & (1U << bit)) {
+          return 32 * i + bit + 1;
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+bool Uint256::IsZero() const
+{
+  for (int i = 0; i < WORDS; i++) {
+    if (words[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int Uint256::Compare(const Uint256 &other) const
+{
+  for (int i = WORDS - 1; i >= 0; i--) {
+    if (words[i] != other.words[i]) {
+      return words[i] < other.words[i] ? -1 : 1;
+    }
+  }
+  return 0;
+}
+
+Uint256 &Uint256::operator+=(const Uint256 &other)
+{
+  uint64_t carry = 0;
+  for (int i = 0; i < WORDS; i++) {
+    uint64_t n = carry + words[i] + other.words[i];
+    words[i] = (uint32_t) n;
+    carry = n >> 32;
+  }
+  return *this;
+}
+
+Uint256 &Uint256::operator-=(const Uint256 &other)
+{
+  uint64_t borrow = 0;
+  for (int i = 0; i < WORDS; i++) {
+    uint64_t n = (uint64_t) words[i] - other.words[i] - borrow;
+    words[i] = (uint32_t) n;
+    borrow = (n >> 32) ? 1 : 0;
+  }
+  return *this;
+}
+
+Uint256 &Uint256::operator<<=(unsigned int shift)
+{
+  Uint256 a = *this;
+  *this = Uint256(0);
+  int k = shift / 32;
+  shift %= 32;
+  for (int i = 0; i < WORDS; i++) {
+    if (i + k + 1 < WORDS && shift != 0) {
+      words[i + k + 1] |= a.words[i] >> (32 - shift);
+    }
+    if (i + k < WORDS) {
+      words[i + k] |= a.words[i] << shift;
+    }
+  }
+  return *this;
+}
+
+Uint256 &Uint256::operator>>=(unsigned int shift)
+{
+  Uint256 a = *this;
+  *this = Uint256(0);
+  int k = shift / 32;
+  shift %= 32;
+  for (int i = 0; i < WORDS; i++) {
+    if (i - k - 1 >= 0 && shift != 0) {
+      words[i - k - 1] |= a.words[i] << (32 - shift);
+    }
+    if (i - k >= 0) {
+      words[i - k] |= a.words[i] >> shift;
+    }
+  }
+  return *this;
+}
+
+Uint256 &Uint256::operator/=(const Uint256 &divisor)
+{
+  // Shift and subtract, one bit of the quotient at a time
+  Uint256 num = *this;
+  Uint256 div = divisor;
+  *this = Uint256(0);
+
+  int num_bits = num.Bits();
+  int div_bits = div.Bits();
+  if (div_bits == 0 || div_bits > num_bits) {
+    return *this;
+  }
+
+  int shift = num_bits - div_bits;
+  div <<= shift;
+  while (shift >= 0) {
+    if (num.Compare(div) >= 0) {
+      num -= div;
+      words[shift / 32] |= 1U << (shift % 32);
+    }
+    div >>= 1;
+    shift--;
+  }
+  return *this;
+}
+
+bool Uint256::MulDiv(uint32_t mul, uint32_t div)
+{
+  // 288 bit product
+  uint32_t product[WORDS + 1];
+  uint64_t carry = 0;
+  for (int i = 0; i < WORDS; i++) {
+    uint64_t n = (uint64_t) words[i] * mul + carry;
+    product[i] = (uint32_t) n;
+    carry = n >> 32;
+  }
+  product[WORDS] = (uint32_t) carry;
+
+  uint64_t rem = 0;
+  for (int i = WORDS; i >= 0; i--) {
+    uint64_t n = (rem << 32) | product[i];
+    product[i] = (uint32_t) (n / div);
+    rem = n % div;
+  }
+
+  memcpy(words, product, sizeof(words));
+  return product[WORDS] == 0;
+}
+
+Uint256 Uint256::WorkFromCompact(uint32_t bits)
+{
+  Uint256 target;
+  if (!target.SetCompact(bits)) {
+    return Uint256(0);
+  }
+
+  // The work would be 2^256
+  if (target.IsZero()) {
+    Uint256 max;
+    memset(max.words, 0xff, sizeof(max.words));
+    return max;
+  }
+
+  // 2^256 / (target + 1) = ~target / (target + 1) + 1
+  Uint256 divisor = target;
+  divisor += Uint256(1);
+  if (divisor.IsZero()) {
+    return Uint256(1);
+  }
+
+  Uint256 work;
+  for (int i = 0; i < WORDS; i++) {
+    work.words[i] = ~target.words[i];
+  }
+  work /= divisor;
+  work += Uint256(1);
+  return work;
+}
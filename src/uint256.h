@@ -0,0 +1,65 @@
+#ifndef BITCOINJS_SERVER_INCLUDE_UINT256_H_
+#define BITCOINJS_SERVER_INCLUDE_UINT256_H_
+
+#include <stdint.h>
+
+/**
+ * Unsigned 256 bit integer for difficulty targets and chain work.
+ *
+ * Stored as eight 32 bit words, least significant first. Arithmetic wraps
+ * around like with built-in unsigned types.
+ */
+class Uint256
+{
+public:
+
+  uint32_t words[8];
+
+  Uint256();
+  explicit Uint256(uint64_t value);
+
+  // Conversion from and to 32 bytes. Big endian is the order of
+  // bignum.toBuffer(), little endian the order of hashes.
+  static Uint256 FromBE(const unsigned char *data);
+  static Uint256 FromLE(const unsigned char *data);
+  void ToBE(unsigned char *out) const;
+  void ToLE(unsigned char *out) const;
+
+  /**
+   * Decodes compact difficulty bits, like Util.decodeDiffBits(): the low 24
+   * bits are the mantissa (there is no sign bit) and the top 8 bits the
+   * size in bytes. Returns false if the value doesn't fit into 256 bits.
+   */
+  bool SetCompact(uint32_t bits);
+
+  // Inverse of SetCompact(), like Util.encodeDiffBits()
+  uint32_t GetCompact() const;
+
+  // Number of significant bits
+  unsigned int Bits() const;
+
+  bool IsZero() const;
+
+  int Compare(const Uint256 &other) const;
+
+  Uint256 &operator+=(const Uint256 &other);
+  Uint256 &operator-=(const Uint256 &other);
+  Uint256 &operator/=(const Uint256 &divisor);
+  Uint256 &operator<<=(unsigned int shift);
+  Uint256 &operator>>=(unsigned int shift);
+
+  /**
+   * Sets this to this * mul / div, without losing the bits that overflow
+   * in between. Returns false if the result doesn't fit into 256 bits.
+   */
+  bool MulDiv(uint32_t mul, uint32_t div);
+
+  /**
+   * Work represented by a target, 2^256 / (target + 1), like
+   * Block.getWork(). A target that doesn't fit into 256 bits is no work,
+   * a target of zero saturates to 2^256 - 1 as 2^256 doesn't fit.
+   */
+  static Uint256 WorkFromCompact(uint32_t bits);
+};
+
+#endif
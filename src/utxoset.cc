@@ -0,0 +1,688 @@
+#include <string.h>
+
+#include <v8.h>
+
+#include <node.h>
+#include <node_buffer.h>
+
+#include "common.h"
+#include "sha256.h"
+#include "txparser.h"
+#include "utxoset.h"
+
+using namespace std;
+using namespace v8;
+using namespace node;
+
+#define OUTPOINT_SIZE 36
+
+// value, height
+#define RECORD_HEADER_SIZE 12
+
+// Default number of entries, records average about 50 bytes
+#define UTXO_SET_DEFAULT_CAPACITY 1000000
+
+static inline void write_le32(unsigned char *p, uint32_t x)
+{
+  p[0] = x & 0xff;
+  p[1] = (x >> 8) & 0xff;
+  p[2] = (x >> 16) & 0xff;
+  p[3] = (x >> 24) & 0xff;
+}
+
+static Local<Object>
+copy_buffer (const unsigned char *data, size_t len)
+{
+  Buffer *result = Buffer::New(len);
+  if (len) {
+    memcpy(Buffer::Data(result), data, len);
+  }
+  return Local<Object>::New(result->handle_);
+}
+
+static void
+write_varint (vector<unsigned char> &out, uint64_t value)
+{
+  if (value < 0xfd) {
+    out.push_back((unsigned char) value);
+    return;
+  }
+
+  size_t size = value <= 0xffff ? 2 : value <= 0xffffffff ? 4 : 8;
+  out.push_back(size == 2 ? 0xfd : size == 4 ? 0xfe : 0xff);
+  for (size_t i = 0; i < size; i++) {
+    out.push_back((unsigned char) (value >> (8 * i)));
+  }
+}
+
+static bool
+is_coinbase (const unsigned char *data, const uint32_t *record)
+{
+  static const unsigned char null_outpoint[OUTPOINT_SIZE] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0xff, 0xff, 0xff, 0xff
+  };
+
+  return record[2] == 1 &&
+    memcmp(data + record[TxParser::RECORD_WORDS], null_outpoint,
+           OUTPOINT_SIZE) == 0;
+}
+
+// A transaction from the Array passed to applyBlock() etc.
+struct scanned_tx_t {
+  const unsigned char *data;
+  vector<uint32_t> record;
+  unsigned char txid[32];
+};
+
+static const char *
+scan_txs (Handle<Array> txs, vector<scanned_tx_t> &out)
+{
+  out.resize(txs->Length());
+
+  for (size_t i = 0; i < out.size(); i++) {
+    Local<Value> tx = txs->Get(i);
+    if (!Buffer::HasInstance(tx)) {
+      return "Transactions must be of type Buffer";
+    }
+    Local<Object> tx_buf = tx->ToObject();
+    const unsigned char *data = (const unsigned char *) Buffer::Data(tx_buf);
+    size_t len = Buffer::Length(tx_buf);
+
+    size_t pos = 0;
+    if (!TxParser::Scan(data, len, &pos, out[i].record) || pos != len) {
+      return "Transaction data is truncated or malformed";
+    }
+    out[i].data = data;
+
+    Sha256::Stream stream;
+    stream.Write(data, len);
+    stream.FinalizeDouble(out[i].txid);
+  }
+
+  return NULL;
+}
+
+static string
+outpoint_key (const unsigned char *txid, uint32_t index)
+{
+  unsigned char key[OUTPOINT_SIZE];
+  memcpy(key, txid, 32);
+  write_le32(key + 32, index);
+  return string((const char *) key, OUTPOINT_SIZE);
+}
+
+Persistent<FunctionTemplate> UtxoSet::s_ct;
+
+void UtxoSet::Init(Handle<Object> target)
+{
+  HandleScope scope;
+  Local<FunctionTemplate> t = FunctionTemplate::New(New);
+
+  s_ct = Persistent<FunctionTemplate>::New(t);
+  s_ct->InstanceTemplate()->SetInternalFieldCount(1);
+  s_ct->SetClassName(String::NewSymbol("UtxoSet"));
+
+  // Methods
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "get", Get);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "load", Load);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "missing", Missing);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "applyBlock", ApplyBlock);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "undoBlock", UndoBlock);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "flush", Flush);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "commit", Commit);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "getEpoch", GetEpoch);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "getStats", GetStats);
+
+  target->Set(String::NewSymbol("UtxoSet"),
+              s_ct->GetFunction());
+}
+
+UtxoSet::UtxoSet(size_t capacity) :
+  head(NULL),
+  tail(NULL),
+  capacity(capacity),
+  dirty(0),
+  flushes(0),
+  epoch(0),
+  hits(0),
+  misses(0)
+{
+}
+
+UtxoSet::~UtxoSet()
+{
+  for (map_t::iterator it = entries.begin(); it != entries.end(); ++it) {
+    delete it->second;
+  }
+}
+
+void UtxoSet::Unlink(entry_t *e)
+{
+  if (e->prev) e->prev->next = e->next; else head = e->next;
+  if (e->next) e->next->prev = e->prev; else tail = e->prev;
+  e->prev = e->next = NULL;
+}
+
+void UtxoSet::PushFront(entry_t *e)
+{
+  e->prev = NULL;
+  e->next = head;
+  if (head) head->prev = e; else tail = e;
+  head = e;
+}
+
+void UtxoSet::MarkDirty(entry_t *e, state_t state)
+{
+  if (e->state == CLEAN) {
+    Unlink(e);
+    dirty++;
+  }
+  e->state = state;
+  e->flushed = 0;
+}
+
+void UtxoSet::Evict()
+{
+  while (entries.size() > capacity && tail != NULL) {
+    entry_t *e = tail;
+    Unlink(e);
+    entries.erase(e->key);
+    delete e;
+  }
+}
+
+void UtxoSet::Put(const string &key, const string &record)
+{
+  map_t::iterator it = entries.find(key);
+  entry_t *e;
+  if (it != entries.end()) {
+    e = it->second;
+    MarkDirty(e, DIRTY);
+  } else {
+    e = new entry_t();
+    e->key = key;
+    e->state = DIRTY;
+    e->flushed = 0;
+    e->prev = e->next = NULL;
+    entries[key] = e;
+    dirty++;
+  }
+  e->record = record;
+}
+
+void UtxoSet::Spend(const string &key, vector<unsigned char> &undo)
+{
+  map_t::iterator it = entries.find(key);
+  if (it == entries.end() || it->second->state == SPENT) {
+    return;
+  }
+
+  entry_t *e = it->second;
+  undo.insert(undo.end(), key.begin(), key.end());
+  write_varint(undo, e->record.size());
+  undo.insert(undo.end(), e->record.begin(), e->record.end());
+
+  MarkDirty(e, SPENT);
+  e->record.clear();
+}
+
+const char *
+UtxoSet::Apply(Handle<Array> txs, uint32_t height, vector<unsigned char> &undo)
+{
+  vector<scanned_tx_t> scanned;
+  const char *err = scan_txs(txs, scanned);
+  if (err) {
+    return err;
+  }
+
+  for (size_t i = 0; i < scanned.size(); i++) {
+    const unsigned char *data = scanned[i].data;
+    const uint32_t *record = &scanned[i].record[0];
+    const uint32_t *in = record + TxParser::RECORD_WORDS;
+    const uint32_t *out = in + TxParser::IO_WORDS * record[2];
+
+    if (!is_coinbase(data, record)) {
+      for (size_t j = 0; j < record[2]; j++, in += TxParser::IO_WORDS) {
+        Spend(string((const char *) data + in[0], OUTPOINT_SIZE), undo);
+      }
+    }
+
+    unsigned char header[RECORD_HEADER_SIZE];
+    write_le32(header + 8, height);
+    for (size_t j = 0; j < record[3]; j++, out += TxParser::IO_WORDS) {
+      memcpy(header, data + out[0], 8);
+      string value((const char *) header, RECORD_HEADER_SIZE);
+      value.append((const char *) data + out[1], out[2]);
+      Put(outpoint_key(scanned[i].txid, j), value);
+    }
+  }
+
+  return NULL;
+}
+
+const char *
+UtxoSet::Undo(Handle<Array> txs, const unsigned char *undo, size_t undo_len)
+{
+  vector<scanned_tx_t> scanned;
+  const char *err = scan_txs(txs, scanned);
+  if (err) {
+    return err;
+  }
+
+  // Spent outputs come back first, so outputs that were created and spent
+  // within the block end up deleted
+  size_t pos = 0;
+  while (pos < undo_len) {
+    uint64_t len;
+    if (undo_len - pos < OUTPOINT_SIZE) {
+      return "Undo data is truncated";
+    }
+    string key((const char *) undo + pos, OUTPOINT_SIZE);
+    pos += OUTPOINT_SIZE;
+    if (!TxParser::ReadVarInt(undo, undo_len, &pos, &len) ||
+        len > undo_len - pos) {
+      return "Undo data is truncated";
+    }
+    Put(key, string((const char *) undo + pos, len));
+    pos += len;
+  }
+
+  for (size_t i = scanned.size(); i-- > 0; ) {
+    size_t outs = scanned[i].record[3];
+    for (size_t j = 0; j < outs; j++) {
+      string key = outpoint_key(scanned[i].txid, j);
+      map_t::iterator it = entries.find(key);
+      entry_t *e;
+      if (it != entries.end()) {
+        e = it->second;
+        MarkDirty(e, SPENT);
+      } else {
+        e = new entry_t();
+        e->key = key;
+        e->state = SPENT;
+        e->flushed = 0;
+        e->prev = e->next = NULL;
+        entries[key] = e;
+        dirty++;
+      }
+      e->record.clear();
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Arguments: maximum number of entries kept in memory (optional).
+ */
+Handle<Value>
+UtxoSet::New(const Arguments& args)
+{
+  if (!args.IsConstructCall()) {
+    return FromConstructorTemplate(s_ct, args);
+  }
+
+  HandleScope scope;
+
+  size_t capacity = UTXO_SET_DEFAULT_CAPACITY;
+  if (args.Length() > 0 && !args[0]->IsUndefined()) {
+    if (!args[0]->IsUint32()) {
+      return VException("Argument 'capacity' must be a non-negative integer");
+    }
+    capacity = args[0]->Uint32Value();
+  }
+
+  UtxoSet *set = new UtxoSet(capacity);
+  set->Wrap(args.Holder());
+
+  return scope.Close(args.This());
+}
+
+/**
+ * Arguments: Array of outpoint Buffers. Returns an Array with the record of
+ * each outpoint, null if it is known to be spent or undefined if it is not
+ * in memory and has to be looked up in the database.
+ */
+Handle<Value>
+UtxoSet::Get(const Arguments& args)
+{
+  HandleScope scope;
+  UtxoSet *set = ObjectWrap::Unwrap<UtxoSet>(args.This());
+
+  if (args.Length() != 1 || !args[0]->IsArray()) {
+    return VException("One argument expected: outpoints Array");
+  }
+
+  Local<Array> outpoints = Local<Array>::Cast(args[0]);
+  uint32_t count = outpoints->Length();
+  Local<Array> result = Array::New(count);
+
+  for (uint32_t i = 0; i < count; i++) {
+    Local<Value> outpoint = outpoints->Get(i);
+    if (!Buffer::HasInstance(outpoint) ||
+        Buffer::Length(outpoint->ToObject()) != OUTPOINT_SIZE) {
+      return VException("Outpoints must be Buffers of length 36 bytes");
+    }
+
+    string key(Buffer::Data(outpoint->ToObject()), OUTPOINT_SIZE);
+    map_t::iterator it = set->entries.find(key);
+    if (it == set->entries.end()) {
+      set->misses++;
+      result->Set(i, Local<Value>::New(Undefined()));
+      continue;
+    }
+
+    entry_t *e = it->second;
+    set->hits++;
+    if (e->state == SPENT) {
+      result->Set(i, Local<Value>::New(Null()));
+      continue;
+    }
+    if (e->state == CLEAN) {
+      set->Unlink(e);
+      set->PushFront(e);
+    }
+    result->Set(i, copy_buffer((const unsigned char *) e->record.data(),
+                               e->record.size()));
+  }
+
+  return scope.Close(result);
+}
+
+/**
+ * Arguments: Array of outpoint Buffers, Array of their records as read
+ * from the database (null for outpoints that aren't there) and optionally
+ * the getEpoch() from before the reads. Adds them as clean entries, unless
+ * they are in memory already.
+ *
+ * If a flush was committed since the given epoch, the records may predate
+ * it and nothing is added. Returns false in that case, true otherwise.
+ */
+Handle<Value>
+UtxoSet::Load(const Arguments& args)
+{
+  HandleScope scope;
+  UtxoSet *set = ObjectWrap::Unwrap<UtxoSet>(args.This());
+
+  if (args.Length() < 2 || !args[0]->IsArray() || !args[1]->IsArray()) {
+    return VException("Arguments expected: outpoints Array, records Array, [epoch]");
+  }
+  if (args.Length() > 2 && !args[2]->IsUndefined() && !args[2]->IsUint32()) {
+    return VException("Argument 'epoch' must be a non-negative integer");
+  }
+
+  Local<Array> outpoints = Local<Array>::Cast(args[0]);
+  Local<Array> records = Local<Array>::Cast(args[1]);
+  if (outpoints->Length() != records->Length()) {
+    return VException("Arguments 'outpoints' and 'records' must have the same length");
+  }
+  if (args.Length() > 2 && !args[2]->IsUndefined() &&
+      args[2]->Uint32Value() != set->epoch) {
+    return scope.Close(False());
+  }
+
+  for (uint32_t i = 0; i < outpoints->Length(); i++) {
+    Local<Value> outpoint = outpoints->Get(i);
+    Local<Value> record = records->Get(i);
+    if (!Buffer::HasInstance(outpoint) ||
+        Buffer::Length(outpoint->ToObject()) != OUTPOINT_SIZE) {
+      return VException("Outpoints must be Buffers of length 36 bytes");
+    }
+    if (!Buffer::HasInstance(record)) {
+      continue;
+    }
+    if (Buffer::Length(record->ToObject()) < RECORD_HEADER_SIZE) {
+      return VException("Records must be at least 12 bytes long");
+    }
+
+    string key(Buffer::Data(outpoint->ToObject()), OUTPOINT_SIZE);
+    if (set->entries.count(key)) {
+      continue;
+    }
+
+    entry_t *e = new entry_t();
+    e->key = key;
+    e->record.assign(Buffer::Data(record->ToObject()),
+                     Buffer::Length(record->ToObject()));
+    e->state = CLEAN;
+    e->flushed = 0;
+    set->entries[key] = e;
+    set->PushFront(e);
+  }
+
+  set->Evict();
+
+  return scope.Close(True());
+}
+
+/**
+ * Arguments: Array of transaction Buffers. Returns the outpoints they spend
+ * which are neither in memory nor created by one of the transactions, i.e.
+ * the ones that have to be loaded before applyBlock().
+ */
+Handle<Value>
+UtxoSet::Missing(const Arguments& args)
+{
+  HandleScope scope;
+  UtxoSet *set = ObjectWrap::Unwrap<UtxoSet>(args.This());
+
+  if (args.Length() != 1 || !args[0]->IsArray()) {
+    return VException("One argument expected: transactions Array");
+  }
+
+  vector<scanned_tx_t> scanned;
+  const char *err = scan_txs(Local<Array>::Cast(args[0]), scanned);
+  if (err) {
+    return VException(err);
+  }
+
+  map<string, bool> created;
+  for (size_t i = 0; i < scanned.size(); i++) {
+    created[string((const char *) scanned[i].txid, 32)] = true;
+  }
+
+  Local<Array> result = Array::New();
+  uint32_t count = 0;
+  for (size_t i = 0; i < scanned.size(); i++) {
+    const unsigned char *data = scanned[i].data;
+    const uint32_t *record = &scanned[i].record[0];
+    const uint32_t *in = record + TxParser::RECORD_WORDS;
+
+    if (is_coinbase(data, record)) {
+      continue;
+    }
+    for (size_t j = 0; j < record[2]; j++, in += TxParser::IO_WORDS) {
+      string key((const char *) data + in[0], OUTPOINT_SIZE);
+      if (!set->entries.count(key) && !created.count(key.substr(0, 32))) {
+        result->Set(count++, copy_buffer(data + in[0], OUTPOINT_SIZE));
+      }
+    }
+  }
+
+  return scope.Close(result);
+}
+
+/**
+ * Arguments: Array of transaction Buffers in block order, block height.
+ * Spends their inputs and adds their outputs. Returns the undo data for
+ * undoBlock(), the records of all spent outputs. Outpoints that are not in
+ * memory are skipped, so missing() ones should be loaded first.
+ */
+Handle<Value>
+UtxoSet::ApplyBlock(const Arguments& args)
+{
+  HandleScope scope;
+  UtxoSet *set = ObjectWrap::Unwrap<UtxoSet>(args.This());
+
+  if (args.Length() != 2) {
+    return VException("Two arguments expected: transactions, height");
+  }
+  if (!args[0]->IsArray()) {
+    return VException("Argument 'transactions' must be an Array");
+  }
+  if (!args[1]->IsUint32()) {
+    return VException("Argument 'height' must be a non-negative integer");
+  }
+
+  vector<unsigned char> undo;
+  const char *err = set->Apply(Local<Array>::Cast(args[0]),
+                               args[1]->Uint32Value(), undo);
+  if (err) {
+    return VException(err);
+  }
+
+  return scope.Close(copy_buffer(undo.size() ? &undo[0] : NULL,
+                                 undo.size()));
+}
+
+/**
+ * Arguments: Array of transaction Buffers in block order, undo data from
+ * applyBlock(). Removes their outputs and restores the ones they spent.
+ */
+Handle<Value>
+UtxoSet::UndoBlock(const Arguments& args)
+{
+  HandleScope scope;
+  UtxoSet *set = ObjectWrap::Unwrap<UtxoSet>(args.This());
+
+  if (args.Length() != 2) {
+    return VException("Two arguments expected: transactions, undo");
+  }
+  if (!args[0]->IsArray()) {
+    return VException("Argument 'transactions' must be an Array");
+  }
+  if (!Buffer::HasInstance(args[1])) {
+    return VException("Argument 'undo' must be of type Buffer");
+  }
+
+  Handle<Object> undo_buf = args[1]->ToObject();
+  const char *err = set->Undo(Local<Array>::Cast(args[0]),
+                              (const unsigned char *) Buffer::Data(undo_buf),
+                              Buffer::Length(undo_buf));
+  if (err) {
+    return VException(err);
+  }
+
+  return scope.Close(Undefined());
+}
+
+/**
+ * Returns the changes that aren't committed yet as {id, changes}, where
+ * changes is an Array of [outpoint, record] pairs and the record is null if
+ * the outpoint has to be deleted. Pass the id to commit() once the changes
+ * are written. If the write fails, the entries stay dirty and the next
+ * flush returns them again.
+ */
+Handle<Value>
+UtxoSet::Flush(const Arguments& args)
+{
+  HandleScope scope;
+  UtxoSet *set = ObjectWrap::Unwrap<UtxoSet>(args.This());
+
+  uint32_t id = ++set->flushes;
+  if (id == 0) {
+    id = ++set->flushes;
+  }
+
+  Local<Array> changes = Array::New(set->dirty);
+  uint32_t count = 0;
+
+  for (map_t::iterator it = set->entries.begin();
+       it != set->entries.end(); ++it) {
+    entry_t *e = it->second;
+    if (e->state == CLEAN) {
+      continue;
+    }
+
+    Local<Array> change = Array::New(2);
+    change->Set(0, copy_buffer((const unsigned char *) e->key.data(),
+                               OUTPOINT_SIZE));
+    if (e->state == SPENT) {
+      change->Set(1, Local<Value>::New(Null()));
+    } else {
+      change->Set(1, copy_buffer((const unsigned char *) e->record.data(),
+                                 e->record.size()));
+    }
+    e->flushed = id;
+    changes->Set(count++, change);
+  }
+
+  Local<Object> result = Object::New();
+  result->Set(String::NewSymbol("id"), Integer::NewFromUnsigned(id));
+  result->Set(String::NewSymbol("changes"), changes);
+
+  return scope.Close(result);
+}
+
+/**
+ * Arguments: id of a flush whose changes were written. Makes the entries
+ * that haven't changed since clean and drops the spent ones.
+ */
+Handle<Value>
+UtxoSet::Commit(const Arguments& args)
+{
+  HandleScope scope;
+  UtxoSet *set = ObjectWrap::Unwrap<UtxoSet>(args.This());
+
+  if (args.Length() != 1 || !args[0]->IsUint32()) {
+    return VException("One argument expected: flush id");
+  }
+  uint32_t id = args[0]->Uint32Value();
+
+  map_t::iterator it = set->entries.begin();
+  while (it != set->entries.end()) {
+    entry_t *e = it->second;
+    if (e->state == CLEAN || e->flushed != id) {
+      ++it;
+      continue;
+    }
+
+    set->dirty--;
+    if (e->state == SPENT) {
+      set->entries.erase(it++);
+      delete e;
+    } else {
+      e->state = CLEAN;
+      e->flushed = 0;
+      set->PushFront(e);
+      ++it;
+    }
+  }
+  set->epoch++;
+
+  set->Evict();
+
+  return scope.Close(Undefined());
+}
+
+/**
+ * Returns the number of commits so far, see load().
+ */
+Handle<Value>
+UtxoSet::GetEpoch(const Arguments& args)
+{
+  HandleScope scope;
+  UtxoSet *set = ObjectWrap::Unwrap<UtxoSet>(args.This());
+
+  return scope.Close(Integer::NewFromUnsigned(set->epoch));
+}
+
+Handle<Value>
+UtxoSet::GetStats(const Arguments& args)
+{
+  HandleScope scope;
+  UtxoSet *set = ObjectWrap::Unwrap<UtxoSet>(args.This());
+
+  Local<Object> result = Object::New();
+  result->Set(String::NewSymbol("size"),
+              Number::New((double) set->entries.size()));
+  result->Set(String::NewSymbol("dirty"), Number::New((double) set->dirty));
+  result->Set(String::NewSymbol("capacity"),
+              Number::New((double) set->capacity));
+  result->Set(String::NewSymbol("hits"), Number::New((double) set->hits));
+  result->Set(String::NewSymbol("misses"), Number::New((double) set->misses));
+
+  return scope.Close(result);
+}
@@ -0,0 +1,119 @@
+#ifndef BITCOINJS_SERVER_INCLUDE_UTXOSET_H_
+#define BITCOINJS_SERVER_INCLUDE_UTXOSET_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <v8.h>
+#include <node.h>
+
+using namespace v8;
+using namespace node;
+
+/**
+ * In-memory tier of the unspent output index.
+ *
+ * Keys are outpoints (txid followed by the output index as a 32 bit little
+ * endian number, like TransactionIn.o) and values are compact records:
+ *
+ *   value (8 bytes), height (32 bit little endian), script
+ *
+ * The set only caches the database. Entries are either clean (same as the
+ * database), dirty (changed since the last commit) or spent (to be deleted
+ * from the database). Blocks are applied and undone in memory, flush()
+ * returns the changes to write and commit() makes them clean once they are
+ * written. Until then spent entries stay in memory, so reads from the
+ * database can't bring them back. Clean entries beyond the capacity are
+ * evicted, least recently used first.
+ */
+class UtxoSet : ObjectWrap
+{
+private:
+
+  enum state_t {
+    CLEAN,
+    DIRTY,
+    SPENT
+  };
+
+  struct entry_t {
+    std::string key;
+    std::string record;
+    state_t state;
+
+    // Flush that is writing the entry, 0 if it changed since
+    uint32_t flushed;
+
+    // LRU list of the clean entries, head is the most recently used
+    entry_t *prev;
+    entry_t *next;
+  };
+
+  typedef std::map<std::string, entry_t *> map_t;
+
+  map_t entries;
+  entry_t *head;
+  entry_t *tail;
+  size_t capacity;
+  size_t dirty;
+
+  // Number of the last flush and of the commits so far
+  uint32_t flushes;
+  uint32_t epoch;
+
+  uint64_t hits;
+  uint64_t misses;
+
+  void Unlink(entry_t *e);
+  void PushFront(entry_t *e);
+  void MarkDirty(entry_t *e, state_t state);
+
+  // Drops clean entries until at most capacity remain
+  void Evict();
+
+  void Put(const std::string &key, const std::string &record);
+
+  // Appends the spent record to undo, if the outpoint is known
+  void Spend(const std::string &key, std::vector<unsigned char> &undo);
+
+  // Applies or undoes the transactions in txs, an Array of Buffers
+  const char *Apply(Handle<Array> txs, uint32_t height,
+                    std::vector<unsigned char> &undo);
+  const char *Undo(Handle<Array> txs, const unsigned char *undo,
+                   size_t undo_len);
+
+public:
+
+  static Persistent<FunctionTemplate> s_ct;
+
+  static void Init(Handle<Object> target);
+
+  UtxoSet(size_t capacity);
+  ~UtxoSet();
+
+  static Handle<Value> New(const Arguments& args);
+
+  static Handle<Value> Get(const Arguments& args);
+
+  static Handle<Value> Load(const Arguments& args);
+
+  static Handle<Value> Missing(const Arguments& args);
+
+  static Handle<Value> ApplyBlock(const Arguments& args);
+
+  static Handle<Value> UndoBlock(const Arguments& args);
+
+  static Handle<Value> Flush(const Arguments& args);
+
+  static Handle<Value> Commit(const Arguments& args);
+
+  static Handle<Value> GetEpoch(const Arguments& args);
+
+  static Handle<Value> GetStats(const Arguments& args);
+};
+
+#endif
@@ -0,0 +1,128 @@
+var vows = require('vows'),
+    assert = require('assert');
+
+var Block = require('../lib/schema/block').Block;
+var binding = require('../lib/binding');
+var Util = require('../lib/util');
+var encodeHex = Util.encodeHex;
+
+// Straightforward port of CBlock::BuildMerkleTree() to compare against
+function referenceMerkleTree(hashes) {
+  var tree = hashes.slice(0);
+  var j = 0;
+  for (var size = hashes.length; size > 1; size = Math.floor((size + 1) / 2)) {
+    for (var i = 0; i < size; i += 2) {
+      var i2 = Math.min(i + 1, size - 1);
+      tree.push(Util.twoSha256(tree[j + i].concat(tree[j + i2])));
+    }
+    j += size;
+  }
+  return tree;
+};
+
+function makeHashes(count) {
+  var hashes = [];
+  for (var i = 0; i < count; i++) {
+    var hash = new Buffer(32);
+    for (var j = 0; j < 32; j++) {
+      hash[j] = (i * 13 + j) & 0xff;
+    }
+    hashes.push(hash);
+  }
+  return hashes;
+};
+
+vows.describe('Block').addBatch({
+  'A merkle tree': {
+    topic: function () {
+      return new Block();
+    },
+
+    'of one hash is that hash': function (topic) {
+      var hashes = makeHashes(1);
+      assert.equal(encodeHex(topic.calcMerkleRoot(hashes)),
+                   encodeHex(hashes[0]));
+    },
+
+    'of no hashes is the null hash': function (topic) {
+      assert.equal(encodeHex(topic.calcMerkleRoot([])),
+                   encodeHex(Util.NULL_HASH));
+    },
+
+    'matches the reference implementation': function (topic) {
+      [2, 3, 4, 5, 7, 8, 9, 17, 33, 100].forEach(function (count) {
+        var hashes = makeHashes(count);
+        var expected = referenceMerkleTree(hashes).map(encodeHex);
+        var tree = topic.getMerkleTree(hashes).map(encodeHex);
+
+        assert.deepEqual(tree, expected);
+        assert.equal(encodeHex(topic.calcMerkleRoot(hashes)),
+                     expected[expected.length - 1]);
+      });
+    },
+
+    'can be updated from the branch of the first hash': function (topic) {
+      [1, 2, 3, 6, 11, 64].forEach(function (count) {
+        var hashes = makeHashes(count);
+        var branch = topic.getMerkleBranch(hashes);
+
+        hashes[0] = Util.twoSha256(hashes[0]);
+        assert.equal(encodeHex(topic.calcMerkleRootFromBranch(hashes[0], branch)),
+                     encodeHex(topic.calcMerkleRoot(hashes)));
+      });
+    }
+  },
+
+  'A block record': {
+    topic: function () {
+      var block = new Block({
+        prev_hash: makeHashes(2)[1],
+        merkle_root: makeHashes(3)[2],
+        timestamp: 1231006505,
+        bits: 0x1d00ffff,
+        nonce: 2083236893,
+        version: 1,
+        height: 170,
+        size: 490,
+        active: true,
+        chainWork: new Buffer('0100010001', 'hex'),
+        txs: makeHashes(5)
+      });
+      return {
+        block: block,
+        record: new Block(binding.decodeBlockRecord(binding.encodeBlockRecord(block)))
+      };
+    },
+
+    'keeps the header': function (topic) {
+      assert.equal(encodeHex(topic.record.getHeader()),
+                   encodeHex(topic.block.getHeader()));
+      assert.equal(encodeHex(topic.record.calcHash()),
+                   encodeHex(topic.block.calcHash()));
+    },
+
+    'keeps the chain position': function (topic) {
+      assert.equal(topic.record.height, 170);
+      assert.equal(topic.record.size, 490);
+      assert.equal(topic.record.active, true);
+      assert.equal(topic.record.getChainWork().toString(),
+                   topic.block.getChainWork().toString());
+    },
+
+    'keeps the transaction hashes': function (topic) {
+      assert.deepEqual(topic.record.txs.map(encodeHex),
+                       topic.block.txs.map(encodeHex));
+    },
+
+    'is not mistaken for a JSON one': function (topic) {
+      assert.isNull(binding.decodeBlockRecord(new Buffer('{"nonce":1}')));
+    },
+
+    'is rejected if truncated': function (topic) {
+      var record = binding.encodeBlockRecord(topic.block);
+      assert.throws(function () {
+        binding.decodeBlockRecord(record.slice(0, record.length - 1));
+      });
+    }
+  }
+}).export(module);
@@ -87,6 +87,56 @@ function testEngine(label, uri) {
         assert.equal(topic.chain.getTopBlock().height, 1);
       }
     }
+  }).addBatch({
+    'Headers of a mined chain': {
+      topic: function () {
+        var callback = this.callback;
+        makeTestChain({
+          blocks: [
+            // O -> A -> B -> C
+            ['O', 'A'],
+            ['A', 'B'],
+            ['B', 'C']
+          ]
+        }).call({
+          callback: function (err, topic) {
+            if (err) {
+              callback(err);
+              return;
+            }
+
+            var blocks = topic.blocks;
+            var headers = Buffer.concat([blocks.B.getHeader(),
+                                         blocks.C.getHeader()]);
+            topic.chain.validateHeaders(headers, function (err, result) {
+              topic.result = result;
+              callback(err, topic);
+            });
+          }
+        });
+      },
+
+      'are valid': function (topic) {
+        assert.equal(topic.result.failed, -1);
+        assert.isNull(topic.result.error);
+      },
+
+      'add up to the chain work of the last block': function (topic) {
+        assert.equal(encodeHex(topic.result.chainWork),
+                     encodeHex(topic.blocks.C.chainWork));
+      },
+
+      'are hashed': function (topic) {
+        assert.equal(encodeHex(topic.result.hashes.slice(32)),
+                     encodeHex(topic.blocks.C.getHash()));
+      },
+
+      'must connect to a known block': function (topic) {
+        topic.chain.validateHeaders(new Buffer(80).clear(), function (err) {
+          assert.instanceOf(err, Error);
+        });
+      }
+    }
   }).addBatch({
     'A chain downloaded in the wrong order': {
       topic: makeTestChain({
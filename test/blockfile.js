@@ -0,0 +1,89 @@
+var vows = require('vows'),
+    assert = require('assert');
+
+var fs = require('fs');
+var path = require('path');
+var mkdirp = require('mkdirp');
+
+var BlockFile = require('../lib/binding').BlockFile;
+var encodeHex = require('../lib/util').encodeHex;
+
+var TEST_DIR = '/tmp/unittest_blockfile';
+
+function emptyTestDir() {
+  mkdirp.sync(TEST_DIR, 0755);
+  fs.readdirSync(TEST_DIR).forEach(function (name) {
+    fs.unlinkSync(path.join(TEST_DIR, name));
+  });
+};
+
+function makeData(length, seed) {
+  var data = new Buffer(length);
+  for (var i = 0; i < length; i++) {
+    data[i] = (i * 7 + seed) & 0xff;
+  }
+  return data;
+};
+
+vows.describe('BlockFile').addBatch({
+  'A block file store': {
+    topic: function () {
+      var callback = this.callback;
+      emptyTestDir();
+
+      var store = new BlockFile(TEST_DIR, 1000);
+      var first = [makeData(300, 1), makeData(0, 2), makeData(500, 3)];
+      var second = [makeData(400, 4)];
+      store.append(first, function (err, firstLocations) {
+        if (err) {
+          callback(err);
+          return;
+        }
+        store.append(second, function (err, secondLocations) {
+          callback(err, {
+            store: store,
+            data: first.concat(second),
+            locations: firstLocations.concat(secondLocations)
+          });
+        });
+      });
+    },
+
+    'returns what was appended': function (topic) {
+      topic.locations.forEach(function (location, i) {
+        assert.equal(encodeHex(topic.store.read(location)),
+                     encodeHex(topic.data[i]));
+      });
+    },
+
+    'writes an append to a single file': function (topic) {
+      assert.equal(topic.locations[0].readUInt32LE(0), 0);
+      assert.equal(topic.locations[0].readUInt32LE(4), 0);
+      assert.equal(topic.locations[0].readUInt32LE(8), 300);
+      assert.equal(topic.locations[2].readUInt32LE(0), 0);
+      assert.equal(topic.locations[2].readUInt32LE(4), 300);
+    },
+
+    'starts a new file when full': function (topic) {
+      assert.equal(topic.locations[3].readUInt32LE(0), 1);
+      assert.equal(topic.locations[3].readUInt32LE(4), 0);
+      assert.equal(topic.store.getStats().files, 2);
+    },
+
+    'can be reopened': function (topic) {
+      var store = new BlockFile(TEST_DIR, 1000);
+      assert.equal(store.getStats().size, 1200);
+      assert.equal(encodeHex(store.read(topic.locations[3])),
+                   encodeHex(topic.data[3]));
+      store.close();
+    },
+
+    'rejects locations beyond the end': function (topic) {
+      var location = new Buffer(topic.locations[3]);
+      location.writeUInt32LE(401, 8);
+      assert.throws(function () {
+        topic.store.read(location);
+      });
+    }
+  }
+}).export(module);
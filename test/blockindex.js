@@ -0,0 +1,108 @@
+var vows = require('vows'),
+    assert = require('assert');
+
+var BlockIndex = require('../lib/binding').BlockIndex;
+var Util = require('../lib/util');
+var encodeHex = Util.encodeHex;
+
+function makeHash(branch, height) {
+  var hash = new Buffer(32).clear();
+  hash.writeUInt32LE(height, 0);
+  hash[4] = branch;
+  return hash;
+};
+
+function makeBlock(branch, height, parentBranch) {
+  return {
+    hash: makeHash(branch, height),
+    prev_hash: height ? makeHash(parentBranch, height - 1) : Util.NULL_HASH,
+    bits: 0x1d00ffff,
+    timestamp: 1000000 + height * 600 - (height % 3) * 1000,
+    chainWork: new Buffer([height >> 8, height & 0xff])
+  };
+};
+
+// Main chain of 1000 blocks, side chain forking off after block 600
+function makeBlocks() {
+  var blocks = [];
+  for (var i = 0; i < 1000; i++) {
+    blocks.push(makeBlock(0, i, 0));
+  }
+  for (var i = 601; i < 650; i++) {
+    blocks.push(makeBlock(1, i, i == 601 ? 0 : 1));
+  }
+  return blocks;
+};
+
+vows.describe('BlockIndex').addBatch({
+  'A block index': {
+    topic: function () {
+      var index = new BlockIndex();
+      var blocks = makeBlocks();
+
+      // Children before their parents
+      for (var i = blocks.length - 1; i >= 0; i -= 2) {
+        index.add(blocks[i]);
+      }
+      for (var i = blocks.length - 2; i >= 0; i -= 2) {
+        index.add(blocks[i]);
+      }
+      return {index: index, blocks: blocks};
+    },
+
+    'has all blocks': function (topic) {
+      var stats = topic.index.getStats();
+      assert.equal(stats.size, topic.blocks.length);
+      assert.equal(stats.pending, 0);
+    },
+
+    'returns the header fields': function (topic) {
+      var entry = topic.index.get(makeHash(1, 620));
+      assert.equal(entry.height, 620);
+      assert.equal(entry.bits, 0x1d00ffff);
+      assert.equal(entry.timestamp, makeBlock(1, 620, 1).timestamp);
+      assert.equal(encodeHex(entry.prev_hash), encodeHex(makeHash(1, 619)));
+      assert.equal(encodeHex(entry.chainWork.slice(30)), '026c');
+    },
+
+    'finds ancestors': function (topic) {
+      [0, 1, 2, 63, 64, 65, 511, 600, 998, 999].forEach(function (height) {
+        assert.equal(encodeHex(topic.index.getAncestor(makeHash(0, 999), height).hash),
+                     encodeHex(makeHash(0, height)));
+      });
+      assert.equal(encodeHex(topic.index.getAncestor(makeHash(1, 649), 601).hash),
+                   encodeHex(makeHash(1, 601)));
+      assert.equal(encodeHex(topic.index.getAncestor(makeHash(1, 649), 600).hash),
+                   encodeHex(makeHash(0, 600)));
+      assert.isNull(topic.index.getAncestor(makeHash(0, 10), 11));
+    },
+
+    'calculates the median time past': function (topic) {
+      var timestamps = [];
+      for (var i = 490; i <= 500; i++) {
+        timestamps.push(makeBlock(0, i, 0).timestamp);
+      }
+      timestamps.sort(function (a, b) { return a - b; });
+      assert.equal(topic.index.getMedianTimePast(makeHash(0, 500)), timestamps[5]);
+      assert.equal(topic.index.getMedianTimePast(makeHash(0, 0)),
+                   makeBlock(0, 0, 0).timestamp);
+    },
+
+    'finds the fork point': function (topic) {
+      assert.equal(topic.index.findFork(makeHash(0, 999), makeHash(1, 649)).height, 600);
+      assert.equal(topic.index.findFork(makeHash(1, 610), makeHash(0, 700)).height, 600);
+      assert.equal(topic.index.findFork(makeHash(0, 300), makeHash(0, 700)).height, 300);
+      assert.isNull(topic.index.findFork(makeHash(0, 300), makeHash(2, 700)));
+    },
+
+    'creates locators': function (topic) {
+      var heights = topic.index.getLocator(makeHash(0, 999)).map(function (hash) {
+        return hash.readUInt32LE(0);
+      });
+      assert.deepEqual(heights.slice(0, 11),
+                       [999, 998, 997, 996, 995, 994, 993, 992, 991, 990, 989]);
+      assert.equal(heights[11], 987);
+      assert.equal(heights[12], 983);
+    }
+  }
+}).export(module);
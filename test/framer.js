@@ -0,0 +1,143 @@
+var vows = require('vows'),
+    assert = require('assert');
+
+var Connection = require('../lib/connection').Connection;
+var Util = require('../lib/util');
+var Framer = Util.ccmodule.Framer;
+
+var MAGIC = Util.decodeHex('f9beb4d9');
+
+function makeMessage(command, payload, checksum) {
+  var header = new Buffer(24);
+  header.fill(0);
+  MAGIC.copy(header, 0);
+  header.write(command, 4, 'ascii');
+  header.writeUInt32LE(payload.length, 16);
+  (checksum || Util.twoSha256(payload)).copy(header, 20, 0, 4);
+  return Buffer.concat([header, payload]);
+}
+
+vows.describe('Framer').addBatch({
+  'A stream of messages': {
+    topic: function () {
+      return Buffer.concat([
+        makeMessage('verack', new Buffer(0)),
+        new Buffer([0x01, 0xf9, 0xbe]),
+        makeMessage('inv', Util.decodeHex('0102030405')),
+        makeMessage('ping', Util.decodeHex('0001020304050607'))
+      ]);
+    },
+
+    'is split into all messages at once': function (topic) {
+      var framer = new Framer(MAGIC);
+      framer.push(topic);
+
+      var frames = framer.read(true);
+      assert.equal(frames.length, 3);
+      assert.deepEqual(frames.map(function (frame) {
+        return frame.command;
+      }), ['verack', 'inv', 'ping']);
+      assert.equal(Util.encodeHex(frames[1].payload), '0102030405');
+      assert.equal(frames[0].skipped, 0);
+      assert.equal(frames[1].skipped, 3);
+      assert.equal(framer.length, 0);
+    },
+
+    'is reassembled when received byte by byte': function (topic) {
+      var framer = new Framer(MAGIC);
+      var commands = [];
+      for (var i = 0; i < topic.length; i++) {
+        framer.push(topic.slice(i, i + 1));
+        framer.read(true).forEach(function (frame) {
+          commands.push(frame.command);
+        });
+      }
+      assert.deepEqual(commands, ['verack', 'inv', 'ping']);
+    }
+  },
+
+  'A message with a bad checksum': {
+    topic: function () {
+      var framer = new Framer(MAGIC);
+      framer.push(makeMessage('tx', new Buffer([1, 2, 3]),
+                              new Buffer([0, 0, 0, 0])));
+      framer.push(makeMessage('verack', new Buffer(0)));
+      return framer.read(true);
+    },
+
+    'has no payload': function (topic) {
+      assert.equal(topic[0].command, 'tx');
+      assert.isNull(topic[0].payload);
+      assert.equal(Util.encodeHex(topic[0].checksum), '00000000');
+      assert.equal(topic[0].calcChecksum.length, 4);
+    },
+
+    'does not block the following messages': function (topic) {
+      assert.equal(topic.length, 2);
+      assert.equal(topic[1].command, 'verack');
+    }
+  },
+
+  'A version message': {
+    topic: function () {
+      var framer = new Framer(MAGIC);
+      framer.push(makeMessage('version', new Buffer([1, 2])));
+      framer.push(makeMessage('verack', new Buffer(0)));
+      return framer;
+    },
+
+    'ends a batch': function (topic) {
+      assert.equal(topic.read(true).length, 1);
+      assert.equal(topic.read(true)[0].command, 'verack');
+    }
+  },
+
+  'A serialized message': {
+    topic: function () {
+      return Util.decodeHex('000102030405060708090a0b0c0d0e0f');
+    },
+
+    'matches the reference serialization': function (topic) {
+      var message = Util.ccmodule.frameMessage(MAGIC, 'inv', topic);
+      assert.equal(Util.encodeHex(message), Util.encodeHex(makeMessage('inv', topic)));
+    },
+
+    'can be split into header and payload': function (topic) {
+      var header = Util.ccmodule.frameHeader(MAGIC, 'inv', topic);
+      assert.equal(header.length, 24);
+      assert.equal(Util.encodeHex(Buffer.concat([header, topic])),
+                   Util.encodeHex(Util.ccmodule.frameMessage(MAGIC, 'inv', topic)));
+    },
+
+    'uses a given checksum': function (topic) {
+      var checksum = new Buffer([1, 2, 3, 4]);
+      var header = Util.ccmodule.frameHeader(MAGIC, 'inv', topic, checksum);
+      assert.equal(Util.encodeHex(header.slice(20)), '01020304');
+    },
+
+    'has no checksum for old versions': function (topic) {
+      var message = Util.ccmodule.frameMessage(MAGIC, 'inv', topic, false);
+      assert.equal(message.length, 20 + topic.length);
+
+      var framer = new Framer(MAGIC);
+      framer.push(message);
+      var frames = framer.read(false);
+      assert.equal(frames.length, 1);
+      assert.equal(Util.encodeHex(frames[0].payload), Util.encodeHex(topic));
+    },
+
+    'rejects long commands': function (topic) {
+      assert.throws(function () {
+        Util.ccmodule.frameMessage(MAGIC, 'thisistoolong', topic);
+      });
+    },
+
+    'has its checksum cached': function (topic) {
+      var payload = new Buffer(topic);
+      var checksum = Connection.getChecksum(payload);
+      assert.equal(Util.encodeHex(checksum),
+                   Util.encodeHex(Util.twoSha256(topic).slice(0, 4)));
+      assert.strictEqual(Connection.getChecksum(payload), checksum);
+    }
+  }
+}).export(module);
@@ -0,0 +1,288 @@
+var vows = require('vows'),
+    assert = require('assert');
+
+var binding = require('../lib/binding');
+var Util = require('../lib/util');
+var Connection = require('../lib/connection').Connection;
+var encodeHex = Util.encodeHex;
+var decodeHex = Util.decodeHex;
+
+// Main net blocks 1 and 2
+var HEADERS = decodeHex(
+  '010000006fe28c0ab6f1b372c1a6a246ae63f74f931e8365e15a089c68d6190000000000' +
+  '982051fd1e4ba744bbbe680e1fee14677ba1a3c3540bf7b1cdb606e857233e0e61bc6649' +
+  'ffff001d01e36299' +
+  '010000004860eb18bf1b1620e37e9490fc8a427514416fd75159ab86688e9a8300000000' +
+  'd5fdcc541e25de1c7a5addedf24858b8bb665c9f36ef744ee42c316022c90f9bb0bc6649' +
+  'ffff001d08d2bd61'
+);
+
+// Synthetic chain with a retarget interval of four blocks, so that headers
+// at a retarget boundary can be mined cheaply. The parents are only given
+// by the context, headers 4 (and 6, 7 on testnet) were mined against
+// targets computed with big integers.
+var PARENT_HASH = decodeHex('e47125968b3b71049fbc4802d1e40a71ea1359decfabacf70b34588037d4ff0c');
+var T0 = 1300000000;
+
+// Height 4 after a period of 1200 seconds, bits 0x1f7fff80
+var RETARGET = decodeHex(
+  '01000000e47125968b3b71049fbc4802d1e40a71ea1359decfabacf70b34588037d4ff0c' +
+  '2c86b97b08a0272886d6978fc185fa3b3c87c81c278e40efba418f74b306bd8b40737c4d' +
+  '80ff7f1f94010000'
+);
+
+// The same header, but keeping the bits of the period, 0x2000ffff
+var RETARGET_UNCHANGED = decodeHex(
+  '01000000e47125968b3b71049fbc4802d1e40a71ea1359decfabacf70b34588037d4ff0c' +
+  '3ba45530c56992154fcd8c8d7eaec5b10330293936792be7b7a7d877735d848440737c4d' +
+  'ffff0020a4000000'
+);
+
+// Height 4 after 300 seconds, clamped to a quarter of the target timespan
+var RETARGET_FAST = decodeHex(
+  '01000000e47125968b3b71049fbc4802d1e40a71ea1359decfabacf70b34588037d4ff0c' +
+  '97617b55b101fe45c4a898ff03f8a0deab51438000470c5065a38deffc9502c3906e7c4d' +
+  'c0ff3f1f42020000'
+);
+
+// Height 4 after 12000 seconds from bits 0x20200000, capped at the limit
+var RETARGET_SLOW = decodeHex(
+  '01000000e47125968b3b71049fbc4802d1e40a71ea1359decfabacf70b34588037d4ff0c' +
+  '86f760bc1bb03c67139db4aead1afad21a6ba708712701207f52b12df0e575b080ab7c4d' +
+  'ffff7f2000000000'
+);
+
+// Testnet heights 6 and 7: the minimum difficulty after a gap of more than
+// 20 minutes, then the last normal bits again
+var TESTNET_HEADERS = decodeHex(
+  '01000000e47125968b3b71049fbc4802d1e40a71ea1359decfabacf70b34588037d4ff0c' +
+  '8b29b25d75c3193c24729488d34b381815b6e212b428530b73c860f3d6b21c37697d7c4d' +
+  'ffff7f2000000000' +
+  '010000008cc31d2f0ed14eef34497a67f10f955acb4c501d8ecbf38c0f46e9e284677f10' +
+  'bb8be30fc86de4736fab4ccf1fd91ac7002e15a35f42a8598d4c724b5690184ac17f7c4d' +
+  'ffff0020a2000000'
+);
+
+// Height 7 keeping the minimum difficulty without a gap
+var TESTNET_MIN_AGAIN = decodeHex(
+  '010000008cc31d2f0ed14eef34497a67f10f955acb4c501d8ecbf38c0f46e9e284677f10' +
+  '7543f0688eeec49adfeef126d4182ee6edb3af95a7d0ea86bc9202ccbc915aacc17f7c4d' +
+  'ffff7f2001000000'
+);
+
+// Context of a block of the synthetic chain
+function syntheticContext(height, bits, timestamps, periodStart) {
+  return {
+    hash: PARENT_HASH,
+    height: height,
+    bits: bits,
+    chainWork: new Buffer(0),
+    timestamps: timestamps,
+    periodStart: periodStart,
+    powLimit: 0x207fffff,
+    targetTimespan: 4 * 600,
+    targetSpacing: 600,
+    testnet: false
+  };
+};
+
+// Context of block 3, the last one of the first period
+function periodContext(bits, spacing) {
+  return syntheticContext(3, bits, [0, 1, 2, 3].map(function (i) {
+    return T0 + spacing * i;
+  }), T0);
+};
+
+// Context of testnet block 5
+function testnetContext(bits, lastNormalBits) {
+  var context = syntheticContext(5, bits, [T0 + 2400, T0 + 3000], T0 + 2400);
+  context.testnet = true;
+  context.lastNormalBits = lastNormalBits;
+  return context;
+};
+
+function genesisContext() {
+  return {
+    hash: decodeHex('6fe28c0ab6f1b372c1a6a246ae63f74f931e8365e15a089c68d6190000000000'),
+    height: 0,
+    bits: 0x1d00ffff,
+    chainWork: decodeHex('0100010001'),
+    timestamps: [1231006505],
+    periodStart: 1231006505,
+    powLimit: 0x1d00ffff,
+    targetTimespan: 14 * 24 * 60 * 60,
+    targetSpacing: 10 * 60,
+    testnet: false
+  };
+};
+
+function validate(headers, context) {
+  return function () {
+    binding.validateHeaders(headers, context, this.callback);
+  };
+};
+
+vows.describe('HeaderChain').addBatch({
+  'Valid headers': {
+    topic: validate(HEADERS, genesisContext()),
+
+    'are accepted': function (result) {
+      assert.equal(result.failed, -1);
+      assert.isNull(result.error);
+    },
+
+    'add up their work': function (result) {
+      assert.equal(encodeHex(result.chainWork),
+                   '0000000000000000000000000000000000000000000000000000000300030003');
+    },
+
+    'are hashed': function (result) {
+      assert.equal(encodeHex(result.hashes.slice(32)),
+                   'bddd99ccfda39da1b108ce1a5d70038d0a967bacb68b6b63065f626a00000000');
+    }
+  },
+
+  'Headers out of order': {
+    topic: validate(Buffer.concat([HEADERS.slice(80), HEADERS.slice(0, 80)]),
+                    genesisContext()),
+
+    'fail at the first one': function (result) {
+      assert.equal(result.failed, 0);
+      assert.equal(result.error, 'Header does not connect to the previous one');
+    }
+  },
+
+  'A header with a wrong nonce': {
+    topic: function () {
+      var headers = new Buffer(HEADERS);
+      headers[159] ^= 1;
+      validate(headers, genesisContext()).call(this);
+    },
+
+    'fails on the proof of work': function (result) {
+      assert.equal(result.failed, 1);
+      assert.equal(result.error, 'Difficulty target not met');
+      assert.equal(encodeHex(result.chainWork),
+                   '0000000000000000000000000000000000000000000000000000000200020002');
+    }
+  },
+
+  'A header from the future': {
+    topic: function () {
+      var context = genesisContext();
+      context.maxTimestamp = 1231469700;
+      validate(HEADERS, context).call(this);
+    },
+
+    'is rejected': function (result) {
+      assert.equal(result.failed, 1);
+      assert.equal(result.error, 'Timestamp too far into the future');
+    }
+  },
+
+  'A header with a timestamp before the median': {
+    topic: function () {
+      var context = genesisContext();
+      context.timestamps = [1231469665, 1231469666, 1231469667];
+      validate(HEADERS, context).call(this);
+    },
+
+    'is rejected': function (result) {
+      assert.equal(result.failed, 0);
+      assert.equal(result.error, "Block's timestamp is too early");
+    }
+  },
+  'A header at a retarget boundary': {
+    topic: validate(RETARGET, periodContext(0x2000ffff, 400)),
+
+    'needs the new bits': function (result) {
+      assert.equal(result.failed, -1);
+      assert.equal(encodeHex(result.chainWork),
+                   '0000000000000000000000000000000000000000000000000000000000000200');
+    }
+  },
+
+  'A header at a retarget boundary with the old bits': {
+    topic: validate(RETARGET_UNCHANGED, periodContext(0x2000ffff, 400)),
+
+    'is rejected': function (result) {
+      assert.equal(result.failed, 0);
+      assert.equal(result.error, 'Incorrect proof of work');
+    }
+  },
+
+  'A retarget after a short period': {
+    topic: validate(RETARGET_FAST, periodContext(0x2000ffff, 100)),
+
+    'is clamped': function (result) {
+      assert.equal(result.failed, -1);
+      assert.equal(encodeHex(result.chainWork),
+                   '0000000000000000000000000000000000000000000000000000000000000400');
+    }
+  },
+
+  'A retarget after a long period': {
+    topic: validate(RETARGET_SLOW, periodContext(0x20200000, 4000)),
+
+    'is capped at the proof of work limit': function (result) {
+      assert.equal(result.failed, -1);
+    }
+  },
+
+  'Testnet headers': {
+    topic: validate(TESTNET_HEADERS, testnetContext(0x2000ffff, 0x2000ffff)),
+
+    'may use the minimum difficulty after a gap': function (result) {
+      assert.equal(result.failed, -1);
+      assert.equal(encodeHex(result.chainWork),
+                   '0000000000000000000000000000000000000000000000000000000000000102');
+    }
+  },
+
+  'Testnet headers on a minimum difficulty block': {
+    topic: validate(TESTNET_HEADERS, testnetContext(0x207fffff, 0x2000ffff)),
+
+    'return to the last normal bits': function (result) {
+      assert.equal(result.failed, -1);
+    }
+  },
+
+  'A testnet header with the minimum difficulty without a gap': {
+    topic: validate(Buffer.concat([TESTNET_HEADERS.slice(0, 80),
+                                   TESTNET_MIN_AGAIN]),
+                    testnetContext(0x2000ffff, 0x2000ffff)),
+
+    'is rejected': function (result) {
+      assert.equal(result.failed, 1);
+      assert.equal(result.error, 'Incorrect proof of work');
+    }
+  },
+
+  'A headers message': {
+    topic: function () {
+      var conn = Object.create(Connection.prototype);
+      var sent = null;
+      conn.sendMessage = function (command, payload) {
+        sent = {command: command, payload: payload};
+      };
+      conn.sendHeaders([HEADERS.slice(0, 80), HEADERS.slice(80)]);
+
+      return {
+        data: conn.parseMessage(sent.command, sent.payload),
+        truncated: conn.parseMessage(sent.command, sent.payload.slice(0, 100))
+      };
+    },
+
+    'is parsed into packed headers': function (topic) {
+      assert.equal(topic.data.command, 'headers');
+      assert.equal(topic.data.count, 2);
+      assert.equal(encodeHex(topic.data.headers), encodeHex(HEADERS));
+    },
+
+    'only yields complete headers': function (topic) {
+      assert.equal(topic.truncated.count, 1);
+      assert.equal(encodeHex(topic.truncated.headers),
+                   encodeHex(HEADERS.slice(0, 80)));
+    }
+  }
+}).export(module);
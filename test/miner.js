@@ -0,0 +1,38 @@
+var vows = require('vows'),
+    assert = require('assert');
+
+var NativeMiner = require('../lib/miner/native').NativeMiner;
+var Util = require('../lib/util');
+
+vows.describe('Miner').addBatch({
+  'The native miner': {
+    topic: function () {
+      var header = new Buffer(80);
+      for (var i = 0; i < 80; i++) {
+        header[i] = (i * 7) & 0xff;
+      }
+
+      // About one in 4096 hashes is below this target
+      var target = new Buffer(32);
+      target.fill(0xff);
+      target[0] = 0;
+      target[1] = 0x0f;
+
+      var self = this;
+      new NativeMiner(2).solve(header, target, function (err, nonce) {
+        self.callback(err, {header: header, target: target, nonce: nonce});
+      });
+    },
+
+    'writes the nonce into the header': function (topic) {
+      var nonce = topic.header.readUInt32LE(76);
+      assert.equal(nonce, topic.nonce);
+    },
+
+    'finds a hash below the target': function (topic) {
+      var hash = Util.twoSha256(topic.header);
+      hash.reverse();
+      assert.isTrue(hash.compare(topic.target) < 0);
+    }
+  }
+}).export(module);
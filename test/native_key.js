@@ -3,6 +3,7 @@ var vows = require('vows'),
 
 var ccmodule = require('../native');
 var BitcoinKey = ccmodule.BitcoinKey;
+var SigCache = ccmodule.SigCache;
 var Util = require('../lib/util');
 var encodeHex = Util.encodeHex;
 var decodeHex = Util.decodeHex;
@@ -124,6 +125,136 @@ vows.describe('BitcoinKey').addBatch({
         assert.isTrue(topic);
       }
     }
+  },
+
+  'A batch of signatures': {
+    topic: function () {
+      var pubkey = decodeHex("04a19c1f07c7a0868d86dbb37510305843cc730eb3bea8a99d92131f44950cecd923788419bfef2f635fad621d753f30d4b4b63b29da44b4f3d92db974537ad5a4");
+      var hash = decodeHex("230aba77ccde46bb17fcb0295a92c0cc42a6ea9f439aaadeb0094625f49e6ed8");
+      var sig = decodeHex("3046022100a3ee5408f0003d8ef00ff2e0537f54ba09771626ff70dca1f01296b05c510e85022100d4dc70a5bb50685b65833a97e536909a6951dd247a2fdbde6688c33ba6d6407501");
+      var badHash = decodeHex("230aba77ccde46bb17fcb0295a92c0cc42a6ea9f439aaadeb0094625f49e6ed9");
+
+      var items = [];
+      for (var i = 0; i < 40; i++) {
+        items.push({
+          pubkey: pubkey,
+          hash: (i % 3) ? hash : badHash,
+          sig: sig
+        });
+      }
+      BitcoinKey.verifyBatch(items, this.callback);
+    },
+
+    'returns a bitmap with one bit per signature': function (topic) {
+      assert.isTrue(Buffer.isBuffer(topic));
+      assert.equal(topic.length, 5);
+    },
+
+    'marks exactly the valid signatures': function (topic) {
+      for (var i = 0; i < 40; i++) {
+        assert.equal(!!(topic[i >> 3] & (1 << (i & 7))), !!(i % 3));
+      }
+    }
+  }
+}).addBatch({
+  'The secp256k1 verify engine': {
+    topic: function () {
+      return BitcoinKey.setVerifyEngine('secp256k1');
+    },
+
+    'is reported as selected if available': function (topic) {
+      assert.equal(BitcoinKey.getVerifyEngine(),
+                   topic ? 'secp256k1' : 'openssl');
+    },
+
+    'agrees with OpenSSL': function (topic) {
+      var hash = decodeHex("230aba77ccde46bb17fcb0295a92c0cc42a6ea9f439aaadeb0094625f49e6ed8");
+      var badHash = decodeHex("230aba77ccde46bb17fcb0295a92c0cc42a6ea9f439aaadeb0094625f49e6ed9");
+      var sig = decodeHex("3046022100a3ee5408f0003d8ef00ff2e0537f54ba09771626ff70dca1f01296b05c510e85022100d4dc70a5bb50685b65833a97e536909a6951dd247a2fdbde6688c33ba6d6407501");
+
+      var key = new BitcoinKey();
+      key.public = decodeHex("04a19c1f07c7a0868d86dbb37510305843cc730eb3bea8a99d92131f44950cecd923788419bfef2f635fad621d753f30d4b4b63b29da44b4f3d92db974537ad5a4");
+      assert.isTrue(key.verifySignatureSync(hash, sig));
+      assert.isFalse(key.verifySignatureSync(badHash, sig));
+
+      key.public = decodeHex("02a19c1f07c7a0868d86dbb37510305843cc730eb3bea8a99d92131f44950cecd9");
+      assert.isTrue(key.verifySignatureSync(hash, sig));
+      assert.isFalse(key.verifySignatureSync(badHash, sig));
+    },
+
+    'can be switched back to OpenSSL': function (topic) {
+      assert.isTrue(BitcoinKey.setVerifyEngine('openssl'));
+      assert.equal(BitcoinKey.getVerifyEngine(), 'openssl');
+    },
+
+    'rejects unknown engines': function (topic) {
+      assert.throws(function () {
+        BitcoinKey.setVerifyEngine('bogus');
+      });
+    }
+  },
+
+  'The public key cache': {
+    topic: function () {
+      return BitcoinKey.getPubKeyCacheStats();
+    },
+
+    'reports its counters': function (topic) {
+      assert.isNumber(topic.hits);
+      assert.isNumber(topic.misses);
+      assert.isNumber(topic.size);
+      assert.isNumber(topic.capacity);
+    },
+
+    'is hit when a key is set again': function (topic) {
+      var pubkey = decodeHex("0478314155256b51105268fd1ef12f63a6deb4ac7955489cd023f6e0137f0e3889c54f533d3212d9d65636825f11b2d1e0a0da20504b010370008c7c8a945333be");
+      var key = new BitcoinKey();
+      key.public = pubkey;
+      var before = BitcoinKey.getPubKeyCacheStats();
+      key = new BitcoinKey();
+      key.public = pubkey;
+      var after = BitcoinKey.getPubKeyCacheStats();
+      assert.equal(after.hits, before.hits + 1);
+      assert.equal(after.misses, before.misses);
+      assert.equal(encodeHex(key.public), encodeHex(pubkey));
+    },
+
+    'keeps compressed keys compressed': function (topic) {
+      var pubkey = decodeHex("02a19c1f07c7a0868d86dbb37510305843cc730eb3bea8a99d92131f44950cecd9");
+      var key = new BitcoinKey();
+      key.public = pubkey;
+      key = new BitcoinKey();
+      key.public = pubkey;
+      assert.equal(encodeHex(key.public), encodeHex(pubkey));
+    }
+  },
+
+  'The signature cache': {
+    topic: function () {
+      return {
+        hash: decodeHex("230aba77ccde46bb17fcb0295a92c0cc42a6ea9f439aaadeb0094625f49e6ed8"),
+        pubkey: decodeHex("04a19c1f07c7a0868d86dbb37510305843cc730eb3bea8a99d92131f44950cecd923788419bfef2f635fad621d753f30d4b4b63b29da44b4f3d92db974537ad5a4"),
+        sig: decodeHex("3046022100a3ee5408f0003d8ef00ff2e0537f54ba09771626ff70dca1f01296b05c510e85022100d4dc70a5bb50685b65833a97e536909a6951dd247a2fdbde6688c33ba6d64075")
+      };
+    },
+
+    'finds inserted signatures': function (topic) {
+      SigCache.insert(topic.hash, topic.pubkey, topic.sig);
+      assert.isTrue(SigCache.query(topic.hash, topic.pubkey, topic.sig));
+    },
+
+    'does not match a different hash': function (topic) {
+      var hash = decodeHex("230aba77ccde46bb17fcb0295a92c0cc42a6ea9f439aaadeb0094625f49e6ed9");
+      assert.isFalse(SigCache.query(hash, topic.pubkey, topic.sig));
+    },
+
+    'reports its counters': function (topic) {
+      var stats = SigCache.getStats();
+      assert.isTrue(stats.hits > 0);
+      assert.isTrue(stats.misses > 0);
+      assert.isTrue(stats.inserts > 0);
+      assert.isTrue(stats.entries > 0);
+    }
   }
 }).export(module);
 
@@ -269,6 +269,33 @@ suite.addBatch({ "Script with": {
   'OP_CHECKMULTISIG_5':
   checkmultisigTest(20, 20),
   
+  'Standard multisig':
+  verifyMultisigTest(2, 3),
+
+  'Standard multisig with signatures out of order':
+  verifyMultisigTest(2, 3, true),
+
+  'Standard pay-to-pubkey-hash':
+  verifyStandardTest(true, true),
+
+  'Standard pay-to-pubkey-hash signed by another key':
+  verifyStandardTest(true, false),
+
+  'Standard pay-to-pubkey':
+  verifyStandardTest(false, true),
+
+  'Standard pay-to-pubkey signed by another key':
+  verifyStandardTest(false, false),
+
+  'Inputs of a block':
+  verifyInputsTest([true, true, true]),
+
+  'Inputs of a block with an invalid one':
+  verifyInputsTest([true, true, false, true]),
+
+  'Inputs of a block with several invalid ones':
+  verifyInputsTest(manyInputs(64, [50, 20, 37])),
+
   'OP_CHECKMULTISIG_6':
   // Tx a17b21f52859ed326d1395d8a56d5c7389f5fc83c17b9140a71d7cb86fdf0f5f
   // from testnet, block 30301
@@ -282,11 +309,15 @@ suite.addBatch({ "Script with": {
 
 suite.addBatch(generateSuite('script_valid.json'));
 suite.addBatch(generateSuite('script_invalid.json', true));
+suite.addBatch(generateSuite('script_valid.json', false, compareTest));
+suite.addBatch(generateSuite('script_invalid.json', true, compareTest));
 
 suite.export(module);
 
-function generateSuite(filename, shouldFail)
+function generateSuite(filename, shouldFail, makeTest)
 {
+  makeTest = makeTest || scriptTest;
+
   var file = fs.readFileSync(__dirname + '/data/' + filename, 'utf8');
   var tests = JSON.parse(file);
   var suite = {};
@@ -299,7 +330,7 @@ function generateSuite(filename, shouldFail)
     if (test.length >= 3) {
       title += ' '+test[2];
     }
-    suite[title] = scriptTest(scriptSig, scriptPubKey, shouldFail);
+    suite[title] = makeTest(scriptSig, scriptPubKey, shouldFail);
   });
   return { 'Static script': suite };
 };
@@ -421,6 +452,35 @@ function scriptTest(scriptSigBuffer, scriptPubKeyBuffer, shouldFail)
   return testCase;
 };
 
+/**
+ * Test whether the native interpreter ends with the same stack as the JS one.
+ */
+function compareTest(scriptSigBuffer, scriptPubKeyBuffer)
+{
+  return {
+    topic: function () {
+      var cb = this.callback;
+      var scriptSig = new Script(scriptSigBuffer);
+      var scriptPubKey = new Script(scriptPubKeyBuffer);
+      var js = new ScriptInterpreter();
+      var native = new ScriptInterpreter();
+
+      js.evalTwo(scriptSig, scriptPubKey, defaultTx, 0, 1, function (jsErr) {
+        native.evalNative(scriptSig, scriptPubKey, defaultTx, 0, 1, function (nativeErr) {
+          cb(null, {
+            js: jsErr ? null : js.getPrimitiveStack(),
+            native: nativeErr ? null : native.getPrimitiveStack()
+          });
+        });
+      });
+    },
+
+    'matches the JS interpreter': function (topic) {
+      assert.deepEqual(topic.native, topic.js);
+    }
+  };
+};
+
 function txTest(txData, scriptPubKeyData, inIndex, expectedResult)
 {
   inIndex = "number" === typeof inIndex ? inIndex : 0;
@@ -512,6 +572,105 @@ function checkmultisigTest(sigCount, keyCount) {
   };
 };
 
+/**
+ * Test k-of-n multisig through ScriptInterpreter.verify(), which evaluates
+ * standard scripts without the interpreter loop.
+ */
+function verifyMultisigTest(sigCount, keyCount, reverse) {
+  var context = {
+    'topic': function () {
+      var cb = this.callback;
+      var input = makeMultisigInput(sigCount, keyCount, reverse);
+      ScriptInterpreter.verify(input.scriptSig, input.scriptPubKey,
+                               input.tx, 0, 0, cb);
+
+      // Async topics must not return a value
+      return;
+    }
+  };
+
+  context[reverse ? 'is false' : 'is true'] = function (topic) {
+    assert.equal(topic, !reverse);
+  };
+
+  return context;
+};
+
+/**
+ * Test ScriptInterpreter.verifyInputs() with the given inputs, each either
+ * valid (true) or signed out of order (false). The first invalid one has to
+ * be reported.
+ */
+function verifyInputsTest(valid) {
+  var context = {
+    'topic': function () {
+      var cb = this.callback;
+      var jobs = valid.map(function (isValid) {
+        var input = makeMultisigInput(2, 3, !isValid);
+        input.index = 0;
+        return input;
+      });
+      ScriptInterpreter.verifyInputs(jobs, cb);
+
+      // Async topics must not return a value
+      return;
+    }
+  };
+
+  var first = valid.indexOf(false);
+  context[first < 0 ? 'are all valid' : 'fail at input '+first] =
+  function (topic) {
+    assert.equal(topic, first);
+  };
+
+  return context;
+};
+
+// Validity of count inputs of which the given indexes are invalid
+function manyInputs(count, invalid) {
+  var valid = [];
+  for (var i = 0; i < count; i++) {
+    valid.push(invalid.indexOf(i) < 0);
+  }
+  return valid;
+};
+
+// Returns {tx, scriptSig, scriptPubKey} for input 0 of a new transaction
+function makeMultisigInput(sigCount, keyCount, reverse) {
+  var keys = [];
+  for (var i = 0; i < keyCount; i++) {
+    keys.push(BitcoinKey.generateSync());
+  }
+
+  var scriptPubkey = Script.fromTestData([].concat(
+    [sigCount+80],
+    keys.map(function (key) {
+      return key.public;
+    }),
+    [keyCount+80, OP_CHECKMULTISIG]
+  ));
+
+  var tx = new Transaction({
+    ins: [{
+      o: Util.NULL_HASH
+    }],
+    outs: [{
+      v: Util.decodeHex('05f5e100'),
+      s: new Buffer(0)
+    }]
+  });
+  var signers = keys.slice(0, sigCount);
+  if (reverse) {
+    signers.reverse();
+  }
+
+  return {
+    tx: tx,
+    scriptSig: signMultisig(scriptPubkey, signers, tx),
+    scriptPubKey: scriptPubkey
+  };
+};
+
 function signMultisig(scriptPubkey, keys, tx) {
   var hash = tx.hashForSignature(scriptPubkey, 0, 1);
 
@@ -528,3 +687,51 @@ function signMultisig(scriptPubkey, keys, tx) {
 
   return Script.fromTestData(scriptData);
 };
+
+/**
+ * Test a pay-to-pubkey-hash or pay-to-pubkey input through
+ * ScriptInterpreter.verify(), signed with the right key or another one.
+ */
+function verifyStandardTest(pubKeyHash, valid) {
+  var context = {
+    'topic': function () {
+      var cb = this.callback;
+
+      var key = BitcoinKey.generateSync();
+      var signer = valid ? key : BitcoinKey.generateSync();
+
+      var scriptPubkey = pubKeyHash ?
+        Script.createPubKeyHashOut(Util.sha256ripe160(key.public)) :
+        Script.createPubKeyOut(key.public);
+
+      var tx = new Transaction({
+        ins: [{
+          o: Util.NULL_HASH
+        }],
+        outs: [{
+          v: Util.decodeHex('05f5e100'),
+          s: new Buffer(0)
+        }]
+      });
+
+      var hash = tx.hashForSignature(scriptPubkey, 0, 1);
+      var sig = signer.signSync(hash);
+      var sigData = new Buffer(sig.length+1);
+      sig.copy(sigData);
+      sigData[sigData.length-1] = 1;
+
+      var scriptSig = Script.fromTestData(pubKeyHash ?
+                                          [sigData, key.public] : [sigData]);
+      ScriptInterpreter.verify(scriptSig, scriptPubkey, tx, 0, 0, cb);
+
+      // Async topics must not return a value
+      return;
+    }
+  };
+
+  context[valid ? 'is true' : 'is false'] = function (topic) {
+    assert.equal(topic, valid);
+  };
+
+  return context;
+};
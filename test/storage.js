@@ -7,6 +7,8 @@ var encodeHex = require('../lib/util').encodeHex;
 var Block = require('../lib/schema/block').Block;
 var Transaction = require('../lib/schema/transaction').Transaction;
 
+var BlockIndex = require('../lib/binding').BlockIndex;
+
 var Step = require('step');
 
 var testBlock1 = new Block({
@@ -56,6 +58,15 @@ var bogusBlock = new Block({
 var testTx1 = new Transaction({
 });
 
+var testTx2 = new Transaction({
+  ins: [{
+    o: Buffer.concat([testBlock1.getHash(), new Buffer([1, 0, 0, 0])]),
+    s: new Buffer(0),
+    q: 0xffffffff
+  }],
+  outs: []
+});
+
 
 // Detect test-ready Storage engines
 var leveldbAvailable = false;
@@ -113,6 +124,10 @@ function testEngine(label, uri) {
             if (err) throw err;
             storage.saveTransaction(testTx1, this);
           },
+          function insertTx2(err) {
+            if (err) throw err;
+            storage.saveTransaction(testTx2, this);
+          },
           function startTests(err) {
             callback(err, storage);
           }
@@ -431,6 +446,48 @@ function testEngine(label, uri) {
             encodeHex(testTx1.getHash())
           );
         }
+      },
+
+      'can fetch a transaction to modify': {
+        topic: function (storage) {
+          storage.getTransactionByHash(testTx2.getHash(), this.callback);
+        },
+
+        'in place': function (topic) {
+          assert.equal(topic.ins[0].getOutpointIndex(), 1);
+          topic.ins[0].setOutpointIndex(2);
+          assert.equal(topic.ins[0].getOutpointIndex(), 2);
+        }
+      },
+
+      'can load the block index': {
+        topic: function (storage) {
+          var callback = this.callback;
+          var index = new BlockIndex();
+
+          // A transaction location in blk00254.dat starts with 0xfe, like a
+          // block record
+          var key = new Buffer(32);
+          key.fill(0xab);
+          var location = new Buffer(12).clear();
+          location.writeUInt32LE(254, 0);
+
+          storage.hMain.put(key, location, function (err) {
+            if (err) {
+              callback(err);
+              return;
+            }
+
+            storage.loadBlockIndex(index, function (err) {
+              callback(err, index);
+            });
+          });
+        },
+
+        'with all blocks': function (index) {
+          assert.equal(index.getStats().size, 6);
+          assert.isNotNull(index.get(testBlock4.getHash()));
+        }
       }
     }
   }).export(module);
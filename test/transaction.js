@@ -4,16 +4,22 @@ var vows = require('vows'),
 var Connection = require('../lib/connection').Connection;
 var Script = require('../lib/script').Script;
 var Transaction = require('../lib/schema/transaction').Transaction;
+var TxTable = require('../lib/txtable').TxTable;
 var Util = require('../lib/util');
 var encodeHex = Util.encodeHex;
 var decodeHex = Util.decodeHex;
 
+// Tx f4184fc596403b9d638783cf57adfe4c75c605f6356fbc91338530e9831e9e16
+// from livenet, block 170
+var TX_170 = "0100000001c997a5e56e104102fa209c6a852dd90660a20b2d9c352423edce25857fcd3704000000004847304402204e45e16932b8af514961a1d3a1a25fdf3f4f7732e9d624c6c61548ab5fb8cd410220181522ec8eca07de4860a4acdd12909d831cc56cbbac4622082221a8768d1d0901ffffffff0200ca9a3b00000000434104ae1a62fe09c5f51b13905f07f06b99a2f7159b2225f374cd378d71302fa28414e7aab37397f554a7df5f142c21c1b7303b8a0626f1baded5c72a704f7e6cd84cac00286bee0000000043410411db93e1dcdb8a016b49840f8c53bc1eb68a382e97b1482ecad7b148a6909a5cb2e0eaddfb84ccf9744464f82e160bfa9b8b64f9d4c03f999b8643f656b412a3ac00000000";
+
+// Public key push of the output it spends, which is <pubkey> OP_CHECKSIG
+var PUBKEY_170 = "410411db93e1dcdb8a016b49840f8c53bc1eb68a382e97b1482ecad7b148a6909a5cb2e0eaddfb84ccf9744464f82e160bfa9b8b64f9d4c03f999b8643f656b412a3";
+
 vows.describe('Transaction').addBatch({
   'An example transaction': {
     topic: function () {
-      // Tx f4184fc596403b9d638783cf57adfe4c75c605f6356fbc91338530e9831e9e16
-      // from livenet, block 170
-      var txData = decodeHex("0100000001c997a5e56e104102fa209c6a852dd90660a20b2d9c352423edce25857fcd3704000000004847304402204e45e16932b8af514961a1d3a1a25fdf3f4f7732e9d624c6c61548ab5fb8cd410220181522ec8eca07de4860a4acdd12909d831cc56cbbac4622082221a8768d1d0901ffffffff0200ca9a3b00000000434104ae1a62fe09c5f51b13905f07f06b99a2f7159b2225f374cd378d71302fa28414e7aab37397f554a7df5f142c21c1b7303b8a0626f1baded5c72a704f7e6cd84cac00286bee0000000043410411db93e1dcdb8a016b49840f8c53bc1eb68a382e97b1482ecad7b148a6909a5cb2e0eaddfb84ccf9744464f82e160bfa9b8b64f9d4c03f999b8643f656b412a3ac00000000");
+      var txData = decodeHex(TX_170);
       var txInfo = Connection.parseTx(txData);
       var tx = new Transaction(txInfo);
       return tx;
@@ -30,6 +36,231 @@ vows.describe('Transaction').addBatch({
       assert.equal(
         encodeHex(hash),
         "7a05c6145f10101e9d6325494245adf1297d80f8f38d4d576d57cdba220bcb19");
+    },
+
+    'hashes for signature with other hash types': function (topic) {
+      var script = new Script(decodeHex(PUBKEY_170 + "ac"));
+      // SIGHASH_NONE, SIGHASH_SINGLE, SIGHASH_ALL | SIGHASH_ANYONECANPAY
+      assert.equal(
+        encodeHex(topic.hashForSignature(script, 0, 2)),
+        "0c75c3ac059ee8e19758c58c757d88bcb18d447517ce4d1c3b5a6b7183b41698");
+      assert.equal(
+        encodeHex(topic.hashForSignature(script, 0, 3)),
+        "2c836064b405a0d6658da729df4b73667d864c2861601a6d1cfc4264556fc203");
+      assert.equal(
+        encodeHex(topic.hashForSignature(script, 0, 0x81)),
+        "45692ee72fe2285c88b2339c47d2f7d01f0b130494fd42be524a23672421d3f9");
+    },
+
+    'ignores code separators when hashing for signature': function (topic) {
+      var script = new Script(decodeHex("ab" + PUBKEY_170 + "abab" + "ac"));
+      assert.equal(
+        encodeHex(topic.hashForSignature(script, 0, 1)),
+        "7a05c6145f10101e9d6325494245adf1297d80f8f38d4d576d57cdba220bcb19");
+    },
+
+    'rejects a bad input index when hashing for signature': function (topic) {
+      var script = new Script(decodeHex(PUBKEY_170 + "ac"));
+      assert.throws(function () {
+        topic.hashForSignature(script, 1, 1);
+      });
+    }
+  },
+
+  'A transaction table': {
+    topic: function () {
+      // The tx from block 170 twice, after a two byte prefix
+      var txData = decodeHex(TX_170);
+      var buffer = Buffer.concat([new Buffer([0xaa, 0xbb]), txData, txData]);
+      return new TxTable(buffer, 2, 2);
+    },
+
+    'finds all transactions': function (topic) {
+      assert.equal(topic.length, 2);
+      assert.equal(topic.end, 2 + 2 * 275);
+      assert.equal(topic.getBuffer(0).length, 275);
+      assert.equal(encodeHex(topic.getBuffer(1)), encodeHex(topic.getBuffer(0)));
+    },
+
+    'reads the fields': function (topic) {
+      assert.equal(topic.getVersion(1), 1);
+      assert.equal(topic.getLockTime(1), 0);
+      assert.equal(topic.getInCount(1), 1);
+      assert.equal(topic.getOutCount(1), 2);
+
+      var txin = topic.getIn(1, 0);
+      assert.equal(txin.o.length, 36);
+      assert.equal(txin.s.length, 72);
+      assert.equal(txin.q, 0xffffffff);
+
+      var txout = topic.getOut(1, 1);
+      assert.equal(encodeHex(txout.v), "00286bee00000000");
+      assert.equal(txout.s.length, 67);
+    },
+
+    'matches Connection.parseTx': function (topic) {
+      var data = topic.getData(1);
+      var tx = new Transaction(data);
+      assert.equal(encodeHex(tx.getHash()),
+                   "169e1e83e930853391bc6f35f605c6754cfead57cf8387639d3b4096c54f18f4");
+      assert.equal(encodeHex(tx.serialize()), encodeHex(data.buffer));
+    },
+
+    'rejects truncated data': function (topic) {
+      assert.throws(function () {
+        new TxTable(topic.buffer.slice(0, topic.buffer.length - 1), 2, 2);
+      });
+      assert.throws(function () {
+        new TxTable(topic.buffer, 2, 3);
+      });
+    }
+  },
+
+  'A parsed block': {
+    topic: function () {
+      var txData = new TxTable(decodeHex(TX_170)).getBuffer(0);
+      var header = new Buffer(80);
+      header.fill(0x11);
+      header.writeUInt32LE(2, 0);
+      header.writeUInt32LE(1231731025, 68);
+      header.writeUInt32LE(0x1d00ffff, 72);
+      header.writeUInt32LE(0xdeadbeef, 76);
+      var payload = Buffer.concat([header, new Buffer([3]),
+                                   txData, txData, txData]);
+      return TxTable.parseBlock(payload);
+    },
+
+    'has the header fields': function (topic) {
+      assert.equal(topic.version, 2);
+      assert.equal(encodeHex(topic.prev_hash),
+                   "1111111111111111111111111111111111111111111111111111111111111111");
+      assert.equal(topic.timestamp, 1231731025);
+      assert.equal(topic.bits, 0x1d00ffff);
+      assert.equal(topic.nonce, 0xdeadbeef);
+    },
+
+    'has the txids': function (topic) {
+      assert.equal(topic.txs.length, 3);
+      assert.equal(encodeHex(topic.txs.getHash(2)),
+                   "169e1e83e930853391bc6f35f605c6754cfead57cf8387639d3b4096c54f18f4");
+      assert.equal(encodeHex(topic.txs.getData(1).hash),
+                   encodeHex(topic.txs.getHash(1)));
+    },
+
+    'has the computed merkle root': function (topic) {
+      assert.equal(encodeHex(topic.calcMerkleRoot),
+                   "5515be9e623fe9ea7796180487794052ba75b4b9501bd6e7d22ed4a07772ef99");
+    },
+
+    'rejects truncated data': function (topic) {
+      assert.throws(function () {
+        TxTable.parseBlock(new Buffer(79));
+      });
+      assert.throws(function () {
+        TxTable.parseBlock(topic.txs.buffer.slice(0, topic.txs.end - 1));
+      });
+    }
+  },
+
+  'An unspent output set': {
+    topic: function () {
+      var tx = new Transaction(Connection.parseTx(decodeHex(TX_170)));
+
+      // The output spent by the example transaction, from block 9
+      var record = new Buffer(12);
+      record.fill(0);
+      record.writeUInt32LE(5000000000 % 0x100000000, 0);
+      record[4] = 1;
+      record.writeUInt32LE(9, 8);
+      record = Buffer.concat([record, decodeHex(PUBKEY_170 + "ac")]);
+
+      return {
+        set: new Util.ccmodule.UtxoSet(),
+        tx: tx,
+        spent: tx.ins[0].o,
+        created: Buffer.concat([tx.getHash(), new Buffer([0, 0, 0, 0])]),
+        record: record
+      };
+    },
+
+    'applies and undoes a block': function (topic) {
+      var set = topic.set;
+      var txs = [topic.tx.getBuffer()];
+
+      var missing = set.missing(txs);
+      assert.equal(missing.length, 1);
+      assert.equal(encodeHex(missing[0]), encodeHex(topic.spent));
+      assert.isUndefined(set.get([topic.spent])[0]);
+
+      set.load(missing, [topic.record]);
+      assert.equal(set.missing(txs).length, 0);
+
+      var undo = set.applyBlock(txs, 170);
+      var result = set.get([topic.spent, topic.created]);
+      assert.isNull(result[0]);
+      assert.equal(result[1].readUInt32LE(8), 170);
+      assert.equal(encodeHex(result[1].slice(0, 8)),
+                   encodeHex(topic.tx.outs[0].v));
+      assert.equal(encodeHex(result[1].slice(12)),
+                   encodeHex(topic.tx.outs[0].s));
+
+      var flush = set.flush();
+      assert.equal(flush.changes.length, 3);
+      assert.equal(set.getStats().dirty, 3);
+      set.commit(flush.id);
+      assert.equal(set.getStats().dirty, 0);
+
+      set.undoBlock(txs, undo);
+      result = set.get([topic.spent, topic.created]);
+      assert.equal(encodeHex(result[0]), encodeHex(topic.record));
+      assert.isNull(result[1]);
+    },
+
+    'ignores database reads that overlap a connect': function (topic) {
+      var set = new Util.ccmodule.UtxoSet();
+      var txs = [topic.tx.getBuffer()];
+
+      // A lookup reads the output from the database...
+      var epoch = set.getEpoch();
+
+      // ...while a block spending it is connected and written
+      set.load(set.missing(txs), [topic.record], set.getEpoch());
+      set.applyBlock(txs, 170);
+      var flush = set.flush();
+
+      // Spent entries stay until the write has completed
+      assert.isTrue(set.load([topic.spent], [topic.record], epoch));
+      assert.isNull(set.get([topic.spent])[0]);
+
+      set.commit(flush.id);
+      assert.isUndefined(set.get([topic.spent])[0]);
+
+      // The outdated row is not loaded
+      assert.isFalse(set.load([topic.spent], [topic.record], epoch));
+      assert.isUndefined(set.get([topic.spent])[0]);
+    },
+
+    'keeps changes dirty until they are committed': function (topic) {
+      var set = new Util.ccmodule.UtxoSet();
+      var txs = [topic.tx.getBuffer()];
+
+      set.load(set.missing(txs), [topic.record]);
+      var undo = set.applyBlock(txs, 170);
+
+      // A failed write is never committed, the next flush repeats it
+      var failed = set.flush();
+      assert.equal(set.getStats().dirty, 3);
+      var flush = set.flush();
+      assert.equal(flush.changes.length, failed.changes.length);
+
+      // Entries changed after the flush stay dirty when it is committed
+      set.undoBlock(txs, undo);
+      set.commit(flush.id);
+      assert.equal(set.getStats().dirty, 3);
+
+      set.commit(set.flush().id);
+      assert.equal(set.getStats().dirty, 0);
+      assert.equal(encodeHex(set.get([topic.spent])[0]), encodeHex(topic.record));
     }
   }
 }).export(module);
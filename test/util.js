@@ -5,10 +5,19 @@ var Binary = require('binary');
 var bignum = require('bignum');
 
 var Util = require('../lib/util');
+var binding = require('../lib/binding');
 var logger = require('../lib/logger');
 
 logger.disable();
 
+// Hex of a bignum as a 32 byte big endian number
+function toHex32(n) {
+  var buf = n.toBuffer();
+  var padded = new Buffer(32).clear();
+  buf.copy(padded, 32 - buf.length);
+  return padded.toString('hex');
+};
+
 vows.describe('Bitcoin Utils').addBatch({
   'A Bitcoin address': {
     topic: "12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX",
@@ -21,6 +30,57 @@ vows.describe('Bitcoin Utils').addBatch({
     'is re-encoded correctly': function (topic) {
       var addrHash = Util.addressToPubKeyHash(topic);
       assert.equal(Util.pubKeyHashToAddress(addrHash), topic);
+    },
+    'is decoded with whitespace inside': function (topic) {
+      var addrHash = Util.addressToPubKeyHash(topic.slice(0, 10) + " \n" +
+                                              topic.slice(10));
+      assert.equal(Util.encodeHex(addrHash),
+                   "119b098e2e980a229e139a9ed01a469e518e6f26");
+    },
+    'is decoded in batches with whitespace inside': function (topic) {
+      var keys = (" " + topic.slice(0, 10) + "\t" + topic.slice(10) + "," +
+                  topic).split(',').map(Util.normalizeAddress);
+      var decoded = Util.decodeAddressMany(keys);
+      assert.equal(Util.encodeHex(decoded[0].hash),
+                   "119b098e2e980a229e139a9ed01a469e518e6f26");
+      assert.equal(Util.encodeHex(decoded[1].hash),
+                   "119b098e2e980a229e139a9ed01a469e518e6f26");
+    },
+    'is decoded with its version': function (topic) {
+      var decoded = Util.decodeAddress(" " + topic + "\n");
+      assert.equal(decoded.version, 0);
+      assert.equal(Util.encodeHex(decoded.hash),
+                   "119b098e2e980a229e139a9ed01a469e518e6f26");
+    },
+    'can be encoded with other versions': function (topic) {
+      var hash = Util.addressToPubKeyHash(topic);
+      assert.equal(Util.encodeAddress(111, hash),
+                   "mh83WVoSsTGJAB3aiHJLpmYQCkwtnQ6o76");
+      assert.equal(Util.pubKeyHashToAddress(hash, 5),
+                   "33J78zCucL9RUEGQ7ozZRUh1VHduP2dNr2");
+      assert.equal(Util.decodeAddress("mh83WVoSsTGJAB3aiHJLpmYQCkwtnQ6o76").version,
+                   111);
+    },
+    'is rejected with a bad checksum': function (topic) {
+      assert.isNull(Util.decodeAddress(topic.slice(0, -1) + "Y"));
+      assert.isNull(Util.addressToPubKeyHash(topic.slice(0, -1) + "Y"));
+    },
+    'is rejected with a bad length or characters': function (topic) {
+      assert.isNull(Util.decodeAddress(topic.slice(1)));
+      assert.isNull(Util.decodeAddress(topic + "1"));
+      assert.isNull(Util.decodeAddress("0" + topic.slice(1)));
+      assert.isNull(Util.decodeAddress(""));
+    },
+    'can be encoded and decoded many at once': function (topic) {
+      var hash = Util.addressToPubKeyHash(topic);
+      assert.deepEqual(Util.encodeAddressMany(0, [hash, hash]), [topic, topic]);
+
+      var decoded = Util.decodeAddressMany([topic, "invalid", 42]);
+      assert.equal(decoded.length, 3);
+      assert.equal(decoded[0].version, 0);
+      assert.equal(decoded[0].hash.compare(hash), 0);
+      assert.isNull(decoded[1]);
+      assert.isNull(decoded[2]);
     }
   },
 
@@ -43,6 +103,58 @@ vows.describe('Bitcoin Utils').addBatch({
       var reencoded = Util.encodeDiffBits(decoded);
       assert.equal(reencoded,
                    topic);
+    },
+    'are rejected if the target overflows': function (topic) {
+      assert.throws(function () {
+        Util.decodeDiffBits(0x2200ffff);
+      });
+    }
+  },
+
+  'Chain work': {
+    topic: [0x1d00ffff, 0x1b0404cb, 0x1a0c2a12, 0x207fffff],
+    'matches the bignum calculation': function (topic) {
+      var largestHash = bignum(2).pow(256);
+      topic.forEach(function (bits) {
+        var target = Util.decodeDiffBits(bits, true);
+        assert.equal(binding.getWork(bits).toString('hex'),
+                     toHex32(largestHash.div(target.add(1))));
+      });
+    },
+    'saturates for a zero target': function (topic) {
+      var max = new Buffer(32);
+      max.fill(0xff);
+      assert.equal(binding.getWork(0x00ad2903).toString('hex'),
+                   max.toString('hex'));
+      assert.equal(binding.getWorkMany([0x01003456]).toString('hex'),
+                   max.toString('hex'));
+    },
+    'is computed in batches': function (topic) {
+      var works = binding.getWorkMany(topic);
+      var targets = binding.decodeBitsMany(topic);
+      assert.equal(works.length, 32 * topic.length);
+      topic.forEach(function (bits, i) {
+        assert.equal(works.slice(32 * i, 32 * (i + 1)).toString('hex'),
+                     binding.getWork(bits).toString('hex'));
+        assert.equal(targets.slice(32 * i, 32 * (i + 1)).toString('hex'),
+                     Util.decodeDiffBits(bits).toString('hex'));
+      });
+    },
+    'adds up along a chain': function (topic) {
+      var parent = new Buffer('0100010001', 'hex');
+      var chainWorks = binding.accumulateWork(parent, topic);
+      var expected = bignum.fromBuffer(parent);
+      topic.forEach(function (bits, i) {
+        expected = expected.add(bignum.fromBuffer(binding.getWork(bits)));
+        var chainWork = chainWorks.slice(32 * i, 32 * (i + 1));
+        assert.equal(chainWork.toString('hex'),
+                     toHex32(expected));
+        assert.equal(binding.compareWork(chainWork, parent), 1);
+        assert.equal(binding.compareWork(parent, chainWork), -1);
+        assert.equal(binding.compareWork(chainWork, expected.toBuffer()), 0);
+      });
+      assert.equal(binding.addWork(parent, binding.getWork(topic[0])).toString('hex'),
+                   chainWorks.slice(0, 32).toString('hex'));
     }
   },
 
@@ -58,5 +170,112 @@ vows.describe('Bitcoin Utils').addBatch({
                    "2a7ce7ed41c789515649417421a5f260" +
                    "576461a477d440cda7355ddbab651f8c");
     }
+  },
+
+  'Base58': {
+    topic: [
+      ["", ""],
+      ["61", "2g"],
+      ["626262", "a3gV"],
+      ["73696d706c792061206c6f6e6720737472696e67",
+       "2cFupjhnEsSn59qHXstmK2ffpLv2"],
+      ["00eb15231dfceb60925886b67d065299925915aeb172c06647",
+       "1NS17iag9jJgTHD1VXjvLCEnZuQ3rJDE9L"],
+      ["bf4f89001e670274dd", "3SEo3LWLoPntC"],
+      ["00000000000000000000", "1111111111"]
+    ],
+    'encodes correctly': function (topic) {
+      topic.forEach(function (vector) {
+        assert.equal(Util.encodeBase58(Util.decodeHex(vector[0])), vector[1]);
+      });
+    },
+    'decodes correctly': function (topic) {
+      topic.forEach(function (vector) {
+        assert.equal(Util.encodeHex(Util.decodeBase58(vector[1])), vector[0]);
+      });
+    },
+    'ignores surrounding whitespace': function (topic) {
+      assert.equal(Util.encodeHex(Util.decodeBase58(" \t2g\n")), "61");
+    },
+    'rejects invalid characters': function (topic) {
+      assert.throws(function () {
+        Util.decodeBase58("2g0");
+      });
+    },
+    'can encode and decode many at once': function (topic) {
+      var bufs = topic.map(function (vector) {
+        return Util.decodeHex(vector[0]);
+      });
+      var strs = Util.encodeBase58Many(bufs);
+      assert.deepEqual(strs, topic.map(function (vector) {
+        return vector[1];
+      }));
+
+      var decoded = Util.decodeBase58Many(strs.concat(["I0l"]));
+      assert.equal(decoded.length, topic.length + 1);
+      topic.forEach(function (vector, i) {
+        assert.equal(Util.encodeHex(decoded[i]), vector[0]);
+      });
+      assert.isNull(decoded[topic.length]);
+    }
+  },
+
+  'Hashing an empty Buffer': {
+    topic: new Buffer(0),
+    'with twoSha256 gives the correct result': function (topic) {
+      assert.equal(Util.encodeHex(Util.twoSha256(topic)),
+                   "5df6e0e2761359d30a8275058e299fcc" +
+                   "0381534545f55cf43e41983f5d4c9456");
+    },
+    'with sha256ripe160 gives the correct result': function (topic) {
+      assert.equal(Util.encodeHex(Util.sha256ripe160(topic)),
+                   "b472a266d0bd89c13706a4132ccfb16f7c3b9fcb");
+    },
+    'can write into an existing Buffer': function (topic) {
+      var out = new Buffer(24);
+      out.fill(0);
+      assert.strictEqual(Util.sha256ripe160(topic, out, 4), out);
+      assert.equal(Util.encodeHex(out),
+                   "00000000b472a266d0bd89c13706a413" +
+                   "2ccfb16f7c3b9fcb");
+    },
+    'refuses an output Buffer that is too small': function (topic) {
+      assert.throws(function () {
+        Util.twoSha256(topic, new Buffer(32), 1);
+      });
+    }
+  },
+
+  'Hashing many Buffers at once': {
+    topic: function () {
+      var bufs = [];
+      for (var i = 0; i < 300; i++) {
+        var buf = new Buffer(i);
+        for (var j = 0; j < i; j++) {
+          buf[j] = (i * 31 + j * 7) & 0xff;
+        }
+        bufs.push(buf);
+      }
+      return bufs;
+    },
+    'matches twoSha256 with every implementation': function (topic) {
+      var names = ['scalar', 'sse4.1', 'avx2', 'avx512'];
+      var original = Util.ccmodule.sha256_implementation();
+      names.forEach(function (name) {
+        try {
+          Util.ccmodule.sha256_implementation(name);
+        } catch (e) {
+          // Not supported by this CPU
+          return;
+        }
+        var result = Util.twoSha256Many(topic);
+        assert.equal(result.length, 32 * topic.length);
+        topic.forEach(function (buf, i) {
+          assert.equal(Util.encodeHex(result.slice(32 * i, 32 * i + 32)),
+                       Util.encodeHex(Util.twoSha256(buf)));
+        });
+      });
+      Util.ccmodule.sha256_implementation(original);
+    }
   }
 }).export(module);